@@ -2456,6 +2456,153 @@ static void test_delete_value(void)
        "expect ERROR_FILE_NOT_FOUND, got %i\n", res);
 }
 
+static void test_many_entries(void)
+{
+    char name[16], prev[16];
+    DWORD i, count, len, value, subkeys, values;
+    HKEY key, subkey;
+    LONG res;
+
+    res = RegCreateKeyA( hkey_main, "many", &key );
+    ok(res == ERROR_SUCCESS, "RegCreateKeyA failed: %d\n", res);
+
+    /* create the entries out of order, with mixed case */
+    for (i = 0; i < 500; i++)
+    {
+        sprintf( name, (i & 1) ? "key%04x" : "KEY%04x", (i * 7919) % 500 );
+        res = RegCreateKeyA( key, name, &subkey );
+        ok(res == ERROR_SUCCESS, "RegCreateKeyA %s failed: %d\n", name, res);
+        RegCloseKey( subkey );
+        sprintf( name, (i & 1) ? "value%04x" : "VALUE%04x", (i * 7919) % 500 );
+        res = RegSetValueExA( key, name, 0, REG_DWORD, (const BYTE *)&i, sizeof(i) );
+        ok(res == ERROR_SUCCESS, "RegSetValueExA %s failed: %d\n", name, res);
+    }
+
+    /* lookups are case-insensitive */
+    for (i = 0; i < 500; i++)
+    {
+        sprintf( name, "kEy%04x", i );
+        res = RegOpenKeyA( key, name, &subkey );
+        ok(res == ERROR_SUCCESS, "RegOpenKeyA %s failed: %d\n", name, res);
+        RegCloseKey( subkey );
+        sprintf( name, "vAlUe%04x", i );
+        len = sizeof(value);
+        res = RegQueryValueExA( key, name, NULL, NULL, (BYTE *)&value, &len );
+        ok(res == ERROR_SUCCESS, "RegQueryValueExA %s failed: %d\n", name, res);
+        ok(value * 7919 % 500 == i, "wrong value %u for %s\n", value, name);
+    }
+
+    for (i = 0; i < 500; i += 3)
+    {
+        sprintf( name, "key%04x", i );
+        res = RegDeleteKeyA( key, name );
+        ok(res == ERROR_SUCCESS, "RegDeleteKeyA %s failed: %d\n", name, res);
+        sprintf( name, "value%04x", i );
+        res = RegDeleteValueA( key, name );
+        ok(res == ERROR_SUCCESS, "RegDeleteValueA %s failed: %d\n", name, res);
+    }
+    res = RegOpenKeyA( key, "key0003", &subkey );
+    ok(res == ERROR_FILE_NOT_FOUND, "RegOpenKeyA succeeded: %d\n", res);
+    res = RegQueryValueExA( key, "value0003", NULL, NULL, NULL, NULL );
+    ok(res == ERROR_FILE_NOT_FOUND, "RegQueryValueExA succeeded: %d\n", res);
+
+    res = RegQueryInfoKeyA( key, NULL, NULL, NULL, &subkeys, NULL, NULL, &values, NULL, NULL, NULL, NULL );
+    ok(res == ERROR_SUCCESS, "RegQueryInfoKeyA failed: %d\n", res);
+    ok(subkeys == 333, "got %u subkeys\n", subkeys);
+    ok(values == 333, "got %u values\n", values);
+
+    /* subkeys are enumerated in alphabetical order */
+    for (count = 0; ; count++)
+    {
+        len = sizeof(name);
+        if (RegEnumKeyExA( key, count, name, &len, NULL, NULL, NULL, NULL )) break;
+        if (count) ok(lstrcmpiA( prev, name ) < 0, "%s enumerated after %s\n", name, prev);
+        strcpy( prev, name );
+    }
+    ok(count == 333, "enumerated %u subkeys\n", count);
+
+    for (count = 0; ; count++)
+    {
+        len = sizeof(name);
+        if (RegEnumValueA( key, count, name, &len, NULL, NULL, NULL, NULL )) break;
+    }
+    ok(count == 333, "enumerated %u values\n", count);
+
+    delete_key( key );
+    RegCloseKey( key );
+}
+
+#define REG_PERF_COUNT 50000
+
+static double perf_elapsed( const LARGE_INTEGER *start, const LARGE_INTEGER *freq )
+{
+    LARGE_INTEGER end;
+
+    QueryPerformanceCounter( &end );
+    return (double)(end.QuadPart - start->QuadPart) / freq->QuadPart;
+}
+
+static void test_registry_perf(void)
+{
+    LARGE_INTEGER freq, start;
+    char name[16];
+    DWORD i, len, value;
+    HKEY key, subkey;
+    LONG res;
+
+    if (!winetest_interactive)
+    {
+        skip( "registry benchmark (set WINETEST_INTERACTIVE=1)\n" );
+        return;
+    }
+
+    res = RegCreateKeyA( hkey_main, "perf", &key );
+    ok(res == ERROR_SUCCESS, "RegCreateKeyA failed: %d\n", res);
+    QueryPerformanceFrequency( &freq );
+
+    /* large keys filled in random order used to shift their arrays on each insert */
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < REG_PERF_COUNT; i++)
+    {
+        sprintf( name, "key%05u", (i * 7919) % REG_PERF_COUNT );
+        RegCreateKeyA( key, name, &subkey );
+        RegCloseKey( subkey );
+    }
+    trace( "create %u subkeys: %.3fs\n", REG_PERF_COUNT, perf_elapsed( &start, &freq ) );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < REG_PERF_COUNT; i++)
+    {
+        sprintf( name, "value%05u", (i * 7919) % REG_PERF_COUNT );
+        RegSetValueExA( key, name, 0, REG_DWORD, (const BYTE *)&i, sizeof(i) );
+    }
+    trace( "set %u values: %.3fs\n", REG_PERF_COUNT, perf_elapsed( &start, &freq ) );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < REG_PERF_COUNT; i++)
+    {
+        sprintf( name, "KEY%05u", i );
+        if (!RegOpenKeyA( key, name, &subkey )) RegCloseKey( subkey );
+        sprintf( name, "VALUE%05u", i );
+        len = sizeof(value);
+        RegQueryValueExA( key, name, NULL, NULL, (BYTE *)&value, &len );
+    }
+    trace( "look up %u subkeys and values: %.3fs\n", REG_PERF_COUNT, perf_elapsed( &start, &freq ) );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; ; i++)
+    {
+        len = sizeof(name);
+        if (RegEnumKeyExA( key, i, name, &len, NULL, NULL, NULL, NULL )) break;
+    }
+    trace( "enumerate %u subkeys: %.3fs\n", i, perf_elapsed( &start, &freq ) );
+
+    QueryPerformanceCounter( &start );
+    delete_key( key );
+    trace( "delete the key: %.3fs\n", perf_elapsed( &start, &freq ) );
+    RegCloseKey( key );
+}
+
 START_TEST(registry)
 {
     /* Load pointers for functions that are not available in all Windows versions */
@@ -2493,6 +2640,8 @@ START_TEST(registry)
     test_rw_order();
     test_deleted_key();
     test_delete_value();
+    test_many_entries();
+    test_registry_perf();
 
     /* cleanup */
     delete_key( hkey_main );
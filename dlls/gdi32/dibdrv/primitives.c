@@ -19,6 +19,12 @@
  */
 
 #include <assert.h>
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_SSE2
+#include <cpuid.h>
+#include <emmintrin.h>
+#endif
 
 #include "gdi_private.h"
 #include "dibdrv.h"
@@ -1801,10 +1807,91 @@ static inline BOOL bit_fields_match(const dib_info *d1, const dib_info *d2)
            d1->blue_mask  == d2->blue_mask;
 }
 
+/* Row kernels process the start of a row and return the number of pixels done, the C loop
+ * does the rest. They are selected once per call with SIMD_FUNC(), which returns NULL when
+ * the CPU doesn't support them. */
+
+typedef int (*convert_row_to_8888_func)( DWORD *dst, const WORD *src, int width );
+typedef int (*blend_row_8888_func)( DWORD *dst, const DWORD *src, int width, BLENDFUNCTION blend, DWORD src_alpha );
+typedef int (*blend_row_24_func)( BYTE *dst, const DWORD *src, int width, BLENDFUNCTION blend );
+typedef int (*blend_row_16_func)( WORD *dst, const DWORD *src, int width, BLENDFUNCTION blend );
+typedef int (*draw_glyph_row_8888_func)( DWORD *dst, const BYTE *glyph, int width, DWORD text_pixel,
+                                         const struct intensity_range *ranges );
+
+#ifdef USE_SSE2
+
+/* the SSE2 functions are compiled for SSE2 even if the rest of the file isn't */
+#define SSE2_TARGET __attribute__((target("sse2")))
+
+static BOOL have_sse2(void)
+{
+    static int sse2 = -1;
+    unsigned int eax, ebx, ecx, edx;
+
+    if (sse2 == -1) sse2 = __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) && (edx & bit_SSE2);
+    return sse2;
+}
+
+#define SIMD_FUNC(func) (have_sse2() ? func##_sse2 : NULL)
+
+/* convert a 555 row eight pixels at a time */
+static SSE2_TARGET int convert_row_555_to_8888_sse2( DWORD *dst, const WORD *src, int width )
+{
+    const __m128i mask = _mm_set1_epi16( 0xf8 ), low_mask = _mm_set1_epi16( 0x07 );
+    __m128i val, b, g, r;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        val = _mm_loadu_si128( (const __m128i *)(src + x) );
+        b = _mm_or_si128( _mm_and_si128( _mm_slli_epi16( val, 3 ), mask ),
+                          _mm_and_si128( _mm_srli_epi16( val, 2 ), low_mask ));
+        g = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( val, 2 ), mask ),
+                          _mm_and_si128( _mm_srli_epi16( val, 7 ), low_mask ));
+        r = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( val, 7 ), mask ),
+                          _mm_and_si128( _mm_srli_epi16( val, 12 ), low_mask ));
+        b = _mm_or_si128( b, _mm_slli_epi16( g, 8 ));
+        _mm_storeu_si128( (__m128i *)(dst + x), _mm_unpacklo_epi16( b, r ));
+        _mm_storeu_si128( (__m128i *)(dst + x + 4), _mm_unpackhi_epi16( b, r ));
+    }
+    return x;
+}
+
+/* convert a 565 row eight pixels at a time */
+static SSE2_TARGET int convert_row_565_to_8888_sse2( DWORD *dst, const WORD *src, int width )
+{
+    const __m128i mask = _mm_set1_epi16( 0xf8 ), low_mask = _mm_set1_epi16( 0x07 );
+    const __m128i g_mask = _mm_set1_epi16( 0xfc ), g_low_mask = _mm_set1_epi16( 0x03 );
+    __m128i val, b, g, r;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        val = _mm_loadu_si128( (const __m128i *)(src + x) );
+        b = _mm_or_si128( _mm_and_si128( _mm_slli_epi16( val, 3 ), mask ),
+                          _mm_and_si128( _mm_srli_epi16( val, 2 ), low_mask ));
+        g = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( val, 3 ), g_mask ),
+                          _mm_and_si128( _mm_srli_epi16( val, 9 ), g_low_mask ));
+        r = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( val, 8 ), mask ),
+                          _mm_srli_epi16( val, 13 ));
+        b = _mm_or_si128( b, _mm_slli_epi16( g, 8 ));
+        _mm_storeu_si128( (__m128i *)(dst + x), _mm_unpacklo_epi16( b, r ));
+        _mm_storeu_si128( (__m128i *)(dst + x + 4), _mm_unpackhi_epi16( b, r ));
+    }
+    return x;
+}
+
+#else  /* USE_SSE2 */
+
+#define SIMD_FUNC(func) NULL
+
+#endif  /* USE_SSE2 */
+
 static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_rect, BOOL dither)
 {
     DWORD *dst_start = get_pixel_ptr_32(dst, 0, 0), *dst_pixel, src_val;
     int x, y, pad_size = (dst->width - (src_rect->right - src_rect->left)) * 4;
+    convert_row_to_8888_func convert_row;
 
     switch(src->bit_count)
     {
@@ -1894,11 +1981,13 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         WORD *src_start = get_pixel_ptr_16(src, src_rect->left, src_rect->top), *src_pixel;
         if(src->funcs == &funcs_555)
         {
+            convert_row = SIMD_FUNC(convert_row_555_to_8888);
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = convert_row ? convert_row(dst_start, src_start, src_rect->right - src_rect->left) : 0;
+                dst_pixel = dst_start + x;
+                src_pixel = src_start + x;
+                for(x += src_rect->left; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ = ((src_val << 9) & 0xf80000) | ((src_val << 4) & 0x070000) |
@@ -1933,11 +2022,15 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         }
         else if(src->red_len == 5 && src->green_len == 6 && src->blue_len == 5)
         {
+            convert_row = NULL;
+            if (src->red_shift == 11 && src->green_shift == 5 && src->blue_shift == 0)
+                convert_row = SIMD_FUNC(convert_row_565_to_8888);
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = convert_row ? convert_row(dst_start, src_start, src_rect->right - src_rect->left) : 0;
+                dst_pixel = dst_start + x;
+                src_pixel = src_start + x;
+                for(x += src_rect->left; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ = (((src_val >> src->red_shift)   << 19) & 0xf80000) |
@@ -4182,31 +4275,191 @@ static inline DWORD blend_rgb( BYTE dst_r, BYTE dst_g, BYTE dst_b, DWORD src, BL
             blend_color( dst_r, src >> 16, blend.SourceConstantAlpha ) << 16);
 }
 
+#ifdef USE_SSE2
+
+/* same as (x + 127) / 255 on each 16-bit component, for x <= 255 * 255 */
+static inline SSE2_TARGET __m128i div255_sse2( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_set1_epi16( 128 ));
+    return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 )), 8 );
+}
+
+/* same as blend_argb on two pixels unpacked to 16-bit components */
+static inline SSE2_TARGET __m128i blend_argb_sse2( __m128i dst, __m128i src )
+{
+    const __m128i mask = _mm_set1_epi16( 0xff );
+    __m128i alpha = _mm_shufflehi_epi16( _mm_shufflelo_epi16( src, 0xff ), 0xff );
+    __m128i sum = _mm_add_epi16( src, div255_sse2( _mm_mullo_epi16( dst, _mm_sub_epi16( mask, alpha ))));
+
+    /* the overflow of a component spills into the next one, like in the C version */
+    return _mm_or_si128( _mm_and_si128( sum, mask ), _mm_slli_epi64( _mm_srli_epi16( sum, 8 ), 16 ));
+}
+
+/* same as blend_argb_constant_alpha on two pixels unpacked to 16-bit components */
+static inline SSE2_TARGET __m128i blend_constant_alpha_sse2( __m128i dst, __m128i src, __m128i alpha )
+{
+    __m128i inv_alpha = _mm_sub_epi16( _mm_set1_epi16( 0xff ), alpha );
+    return div255_sse2( _mm_add_epi16( _mm_mullo_epi16( src, alpha ), _mm_mullo_epi16( dst, inv_alpha )));
+}
+
+/* blend four pixels like blend_rect_8888 does, the b, g and r components are also the same as blend_rgb */
+static inline SSE2_TARGET __m128i blend_pixels_sse2( __m128i d, __m128i s, BLENDFUNCTION blend, __m128i alpha )
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i s_lo, s_hi, d_lo = _mm_unpacklo_epi8( d, zero ), d_hi = _mm_unpackhi_epi8( d, zero );
+
+    if (blend.AlphaFormat & AC_SRC_ALPHA)
+    {
+        s_lo = _mm_unpacklo_epi8( s, zero );
+        s_hi = _mm_unpackhi_epi8( s, zero );
+        if (blend.SourceConstantAlpha != 255)
+        {
+            s_lo = div255_sse2( _mm_mullo_epi16( s_lo, alpha ));
+            s_hi = div255_sse2( _mm_mullo_epi16( s_hi, alpha ));
+        }
+        d_lo = blend_argb_sse2( d_lo, s_lo );
+        d_hi = blend_argb_sse2( d_hi, s_hi );
+    }
+    else
+    {
+        d_lo = blend_constant_alpha_sse2( d_lo, _mm_unpacklo_epi8( s, zero ), alpha );
+        d_hi = blend_constant_alpha_sse2( d_hi, _mm_unpackhi_epi8( s, zero ), alpha );
+    }
+    return _mm_packus_epi16( d_lo, d_hi );
+}
+
+/* check for four fully transparent black pixels, that don't change the destination */
+static inline SSE2_TARGET BOOL is_transparent_sse2( __m128i s, BLENDFUNCTION blend )
+{
+    return (blend.AlphaFormat & AC_SRC_ALPHA) &&
+           _mm_movemask_epi8( _mm_cmpeq_epi32( s, _mm_setzero_si128() )) == 0xffff;
+}
+
+static SSE2_TARGET int blend_row_8888_sse2( DWORD *dst, const DWORD *src, int width,
+                                            BLENDFUNCTION blend, DWORD src_alpha )
+{
+    const __m128i alpha = _mm_set1_epi16( blend.SourceConstantAlpha );
+    const __m128i src_or = _mm_set1_epi32( src_alpha );
+    __m128i s;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        s = _mm_or_si128( _mm_loadu_si128( (const __m128i *)(src + x) ), src_or );
+        if (is_transparent_sse2( s, blend )) continue;
+        _mm_storeu_si128( (__m128i *)(dst + x),
+                          blend_pixels_sse2( _mm_loadu_si128( (const __m128i *)(dst + x) ), s, blend, alpha ));
+    }
+    return x;
+}
+
+static SSE2_TARGET int blend_row_24_sse2( BYTE *dst, const DWORD *src, int width, BLENDFUNCTION blend )
+{
+    const __m128i alpha = _mm_set1_epi16( blend.SourceConstantAlpha );
+    __m128i s, d;
+    DWORD val[4];
+    BYTE *ptr;
+    int x, i;
+
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        s = _mm_loadu_si128( (const __m128i *)(src + x) );
+        if (is_transparent_sse2( s, blend )) continue;
+        ptr = dst + x * 3;
+        d = _mm_setr_epi32( ptr[0] | ptr[1] << 8 | ptr[2] << 16, ptr[3] | ptr[4] << 8 | ptr[5] << 16,
+                            ptr[6] | ptr[7] << 8 | ptr[8] << 16, ptr[9] | ptr[10] << 8 | ptr[11] << 16 );
+        _mm_storeu_si128( (__m128i *)val, blend_pixels_sse2( d, s, blend, alpha ));
+        for (i = 0; i < 4; i++, ptr += 3)
+        {
+            ptr[0] = val[i];
+            ptr[1] = val[i] >> 8;
+            ptr[2] = val[i] >> 16;
+        }
+    }
+    return x;
+}
+
+/* the 16-bpp rows are always written back, since the C loop clears the unused bit of 555 pixels */
+static SSE2_TARGET int blend_row_555_sse2( WORD *dst, const DWORD *src, int width, BLENDFUNCTION blend )
+{
+    const __m128i alpha = _mm_set1_epi16( blend.SourceConstantAlpha );
+    __m128i s, d, v;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        s = _mm_loadu_si128( (const __m128i *)(src + x) );
+        v = _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i *)(dst + x) ), _mm_setzero_si128() );
+        d = _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 9 ), _mm_set1_epi32( 0xf80000 )),
+                                        _mm_and_si128( _mm_slli_epi32( v, 4 ), _mm_set1_epi32( 0x070000 ))),
+                          _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 6 ), _mm_set1_epi32( 0x00f800 )),
+                                        _mm_and_si128( _mm_slli_epi32( v, 1 ), _mm_set1_epi32( 0x000700 ))));
+        d = _mm_or_si128( d, _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 3 ), _mm_set1_epi32( 0x0000f8 )),
+                                           _mm_and_si128( _mm_srli_epi32( v, 2 ), _mm_set1_epi32( 0x000007 ))));
+        v = blend_pixels_sse2( d, s, blend, alpha );
+        v = _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi32( v, 9 ), _mm_set1_epi32( 0x7c00 )),
+                                        _mm_and_si128( _mm_srli_epi32( v, 6 ), _mm_set1_epi32( 0x03e0 ))),
+                          _mm_and_si128( _mm_srli_epi32( v, 3 ), _mm_set1_epi32( 0x001f )));
+        _mm_storel_epi64( (__m128i *)(dst + x), _mm_packs_epi32( v, v ));
+    }
+    return x;
+}
+
+static SSE2_TARGET int blend_row_565_sse2( WORD *dst, const DWORD *src, int width, BLENDFUNCTION blend )
+{
+    const __m128i alpha = _mm_set1_epi16( blend.SourceConstantAlpha );
+    __m128i s, d, v;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        s = _mm_loadu_si128( (const __m128i *)(src + x) );
+        v = _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i *)(dst + x) ), _mm_setzero_si128() );
+        d = _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 8 ), _mm_set1_epi32( 0xf80000 )),
+                                        _mm_and_si128( _mm_slli_epi32( v, 3 ), _mm_set1_epi32( 0x070000 ))),
+                          _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 5 ), _mm_set1_epi32( 0x00fc00 )),
+                                        _mm_and_si128( _mm_srli_epi32( v, 1 ), _mm_set1_epi32( 0x000300 ))));
+        d = _mm_or_si128( d, _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 3 ), _mm_set1_epi32( 0x0000f8 )),
+                                           _mm_and_si128( _mm_srli_epi32( v, 2 ), _mm_set1_epi32( 0x000007 ))));
+        v = blend_pixels_sse2( d, s, blend, alpha );
+        v = _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi32( v, 8 ), _mm_set1_epi32( 0xf800 )),
+                                        _mm_and_si128( _mm_srli_epi32( v, 5 ), _mm_set1_epi32( 0x07e0 ))),
+                          _mm_and_si128( _mm_srli_epi32( v, 3 ), _mm_set1_epi32( 0x001f )));
+        /* sign-extend the pixels so that the saturating pack keeps them intact */
+        v = _mm_srai_epi32( _mm_slli_epi32( v, 16 ), 16 );
+        _mm_storel_epi64( (__m128i *)(dst + x), _mm_packs_epi32( v, v ));
+    }
+    return x;
+}
+
+#endif  /* USE_SSE2 */
+
 static void blend_rect_8888(const dib_info *dst, const RECT *rc,
                             const dib_info *src, const POINT *origin, BLENDFUNCTION blend)
 {
     DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
     DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
-    int x, y;
+    int x, y, width = rc->right - rc->left;
+    blend_row_8888_func blend_row = SIMD_FUNC(blend_row_8888);
 
     if (blend.AlphaFormat & AC_SRC_ALPHA)
     {
 	if (blend.SourceConstantAlpha == 255)
 	    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-		for (x = 0; x < rc->right - rc->left; x++)
+		for (x = blend_row ? blend_row( dst_ptr, src_ptr, width, blend, 0 ) : 0; x < width; x++)
 		    dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
         else
 	    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-		for (x = 0; x < rc->right - rc->left; x++)
+		for (x = blend_row ? blend_row( dst_ptr, src_ptr, width, blend, 0 ) : 0; x < width; x++)
 		    dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
     }
     else if (src->compression == BI_RGB)
 	for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-	    for (x = 0; x < rc->right - rc->left; x++)
+	    for (x = blend_row ? blend_row( dst_ptr, src_ptr, width, blend, 0 ) : 0; x < width; x++)
 		dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
     else
 	for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-	    for (x = 0; x < rc->right - rc->left; x++)
+	    for (x = blend_row ? blend_row( dst_ptr, src_ptr, width, blend, 0xff000000 ) : 0; x < width; x++)
 		dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
 }
 
@@ -4256,11 +4509,12 @@ static void blend_rect_24(const dib_info *dst, const RECT *rc,
 {
     DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
     BYTE *dst_ptr = get_pixel_ptr_24( dst, rc->left, rc->top );
-    int x, y;
+    int x, y, width = rc->right - rc->left;
+    blend_row_24_func blend_row = SIMD_FUNC(blend_row_24);
 
     for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride, src_ptr += src->stride / 4)
     {
-        for (x = 0; x < rc->right - rc->left; x++)
+        for (x = blend_row ? blend_row( dst_ptr, src_ptr, width, blend ) : 0; x < width; x++)
         {
             DWORD val = blend_rgb( dst_ptr[x * 3 + 2], dst_ptr[x * 3 + 1], dst_ptr[x * 3],
                                    src_ptr[x], blend );
@@ -4276,11 +4530,12 @@ static void blend_rect_555(const dib_info *dst, const RECT *rc,
 {
     DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
     WORD *dst_ptr = get_pixel_ptr_16( dst, rc->left, rc->top );
-    int x, y;
+    int x, y, width = rc->right - rc->left;
+    blend_row_16_func blend_row = SIMD_FUNC(blend_row_555);
 
     for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 2, src_ptr += src->stride / 4)
     {
-        for (x = 0; x < rc->right - rc->left; x++)
+        for (x = blend_row ? blend_row( dst_ptr, src_ptr, width, blend ) : 0; x < width; x++)
         {
             DWORD val = blend_rgb( ((dst_ptr[x] >> 7) & 0xf8) | ((dst_ptr[x] >> 12) & 0x07),
                                    ((dst_ptr[x] >> 2) & 0xf8) | ((dst_ptr[x] >>  7) & 0x07),
@@ -4296,11 +4551,15 @@ static void blend_rect_16(const dib_info *dst, const RECT *rc,
 {
     DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
     WORD *dst_ptr = get_pixel_ptr_16( dst, rc->left, rc->top );
-    int x, y;
+    int x, y, width = rc->right - rc->left;
+    blend_row_16_func blend_row = NULL;
+
+    if (dst->red_mask == 0xf800 && dst->green_mask == 0x07e0 && dst->blue_mask == 0x001f)
+        blend_row = SIMD_FUNC(blend_row_565);
 
     for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 2, src_ptr += src->stride / 4)
     {
-        for (x = 0; x < rc->right - rc->left; x++)
+        for (x = blend_row ? blend_row( dst_ptr, src_ptr, width, blend ) : 0; x < width; x++)
         {
             DWORD val = blend_rgb( get_field( dst_ptr[x], dst->red_shift, dst->red_len ),
                                    get_field( dst_ptr[x], dst->green_shift, dst->green_len ),
@@ -4941,16 +5200,62 @@ static inline DWORD aa_rgb( BYTE r_dst, BYTE g_dst, BYTE b_dst, DWORD text, cons
             aa_color( r_dst, text >> 16, range->r_min, range->r_max ) << 16);
 }
 
+#ifdef USE_SSE2
+
+/* draw a glyph row sixteen pixels at a time, the spans of fully transparent and fully
+ * opaque pixels are done with masks, the antialiased edges with aa_rgb */
+static SSE2_TARGET int draw_glyph_row_8888_sse2( DWORD *dst, const BYTE *glyph, int width, DWORD text_pixel,
+                                                 const struct intensity_range *ranges )
+{
+    const __m128i one = _mm_set1_epi8( 1 ), sixteen = _mm_set1_epi8( 16 );
+    const __m128i text = _mm_set1_epi32( text_pixel );
+    __m128i g, skip, fill, mask;
+    int x, i, skip_bits, fill_bits;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        g = _mm_loadu_si128( (const __m128i *)(glyph + x) );
+        skip = _mm_cmpeq_epi8( _mm_min_epu8( g, one ), g );
+        fill = _mm_cmpeq_epi8( _mm_max_epu8( g, sixteen ), g );
+        skip_bits = _mm_movemask_epi8( skip );
+        fill_bits = _mm_movemask_epi8( fill );
+        if (skip_bits == 0xffff) continue;
+        if ((skip_bits | fill_bits) != 0xffff)
+        {
+            for (i = x; i < x + 16; i++)
+            {
+                if (glyph[i] <= 1) continue;
+                if (glyph[i] >= 16) { dst[i] = text_pixel; continue; }
+                dst[i] = aa_rgb( dst[i] >> 16, dst[i] >> 8, dst[i], text_pixel, ranges + glyph[i] );
+            }
+            continue;
+        }
+        for (i = 0; i < 4; i++)
+        {
+            mask = _mm_unpacklo_epi8( fill, fill );
+            mask = _mm_unpacklo_epi16( mask, mask );
+            _mm_storeu_si128( (__m128i *)(dst + x + 4 * i),
+                              _mm_or_si128( _mm_and_si128( mask, text ),
+                                            _mm_andnot_si128( mask, _mm_loadu_si128( (const __m128i *)(dst + x + 4 * i) ))));
+            fill = _mm_srli_si128( fill, 4 );
+        }
+    }
+    return x;
+}
+
+#endif  /* USE_SSE2 */
+
 static void draw_glyph_8888( const dib_info *dib, const RECT *rect, const dib_info *glyph,
                              const POINT *origin, DWORD text_pixel, const struct intensity_range *ranges )
 {
     DWORD *dst_ptr = get_pixel_ptr_32( dib, rect->left, rect->top );
     const BYTE *glyph_ptr = get_pixel_ptr_8( glyph, origin->x, origin->y );
-    int x, y;
+    int x, y, width = rect->right - rect->left;
+    draw_glyph_row_8888_func draw_row = SIMD_FUNC(draw_glyph_row_8888);
 
     for (y = rect->top; y < rect->bottom; y++)
     {
-        for (x = 0; x < rect->right - rect->left; x++)
+        for (x = draw_row ? draw_row( dst_ptr, glyph_ptr, width, text_pixel, ranges ) : 0; x < width; x++)
         {
             if (glyph_ptr[x] <= 1) continue;
             if (glyph_ptr[x] >= 16) { dst_ptr[x] = text_pixel; continue; }
@@ -3199,6 +3199,161 @@ static void test_simple_graphics(void)
     DeleteDC(mem_dc);
 }
 
+static HBITMAP create_perf_dib( HDC hdc, int bpp, const DWORD *masks, int size, void **bits )
+{
+    char bmibuf[sizeof(BITMAPINFO) + 3 * sizeof(DWORD)];
+    BITMAPINFO *bmi = (BITMAPINFO *)bmibuf;
+    HBITMAP dib;
+
+    memset( bmibuf, 0, sizeof(bmibuf) );
+    bmi->bmiHeader.biSize = sizeof(bmi->bmiHeader);
+    bmi->bmiHeader.biWidth = size;
+    bmi->bmiHeader.biHeight = -size;
+    bmi->bmiHeader.biBitCount = bpp;
+    bmi->bmiHeader.biPlanes = 1;
+    bmi->bmiHeader.biCompression = masks ? BI_BITFIELDS : BI_RGB;
+    if (masks) memcpy( bmi->bmiColors, masks, 3 * sizeof(DWORD) );
+    dib = CreateDIBSection( hdc, bmi, DIB_RGB_COLORS, bits, NULL, 0 );
+    ok( dib != NULL, "failed to create %u-bpp dib\n", bpp );
+    return dib;
+}
+
+static double perf_elapsed( const LARGE_INTEGER *start, const LARGE_INTEGER *freq )
+{
+    LARGE_INTEGER end;
+
+    QueryPerformanceCounter( &end );
+    return (double)(end.QuadPart - start->QuadPart) / freq->QuadPart;
+}
+
+#define DIB_PERF_PIXELS (16 * 1024 * 1024)
+
+static void test_dib_perf(void)
+{
+    static const DWORD masks_565[3] = { 0xf800, 0x07e0, 0x001f };
+    static const DWORD masks_555[3] = { 0x7c00, 0x03e0, 0x001f };
+    static const int sizes[] = { 16, 64, 256, 1024 };
+    static const struct
+    {
+        const char  *name;
+        int          bpp;
+        const DWORD *masks;
+    } formats[] =
+    {
+        { "8888", 32, NULL },
+        { "24",   24, NULL },
+        { "555",  16, NULL },
+        { "565",  16, masks_565 },
+    };
+    static const char text[] = "The quick brown fox jumps over the lazy dog";
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+    HDC src_dc, dst_dc;
+    HBITMAP src_dib, dst_dib, orig_src, orig_dst;
+    LARGE_INTEGER freq, start;
+    DWORD *src_bits, *dst_bits;
+    void *bits;
+    HFONT font, orig_font;
+    LOGFONTA lf;
+    int i, j, k, count, size;
+    double time;
+
+    if (!winetest_interactive)
+    {
+        skip("dib benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+    if (!pGdiAlphaBlend)
+    {
+        win_skip("GdiAlphaBlend is not available\n");
+        return;
+    }
+
+    QueryPerformanceFrequency( &freq );
+    src_dc = CreateCompatibleDC( NULL );
+    dst_dc = CreateCompatibleDC( NULL );
+
+    /* premultiplied source pixels, a quarter of them fully transparent */
+    src_dib = create_perf_dib( src_dc, 32, NULL, 1024, (void **)&src_bits );
+    for (i = 0; i < 1024 * 1024; i++)
+    {
+        DWORD alpha = (i % 4) ? (i * 7) & 0xff : 0;
+        src_bits[i] = alpha << 24 | ((i * 13) & 0xff) * alpha / 255 << 16 |
+                      ((i * 5) & 0xff) * alpha / 255 << 8 | ((i * 3) & 0xff) * alpha / 255;
+    }
+    orig_src = SelectObject( src_dc, src_dib );
+
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        dst_dib = create_perf_dib( dst_dc, formats[i].bpp, formats[i].masks, 1024, &bits );
+        memset( bits, 0x80, 1024 * 1024 * formats[i].bpp / 8 );
+        orig_dst = SelectObject( dst_dc, dst_dib );
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+        {
+            size = sizes[j];
+            count = DIB_PERF_PIXELS / (size * size);
+            for (blend.SourceConstantAlpha = 255; blend.SourceConstantAlpha >= 128; blend.SourceConstantAlpha -= 127)
+            {
+                QueryPerformanceCounter( &start );
+                for (k = 0; k < count; k++)
+                    pGdiAlphaBlend( dst_dc, 0, 0, size, size, src_dc, 0, 0, size, size, blend );
+                time = perf_elapsed( &start, &freq );
+                trace( "AlphaBlend to %s, %ux%u, constant alpha %u: %.1f Mpixels/s\n", formats[i].name,
+                       size, size, blend.SourceConstantAlpha, DIB_PERF_PIXELS / time / 1e6 );
+            }
+        }
+        SelectObject( dst_dc, orig_dst );
+        DeleteObject( dst_dib );
+    }
+    SelectObject( src_dc, orig_src );
+    DeleteObject( src_dib );
+
+    /* 16-bpp to 8888 conversion */
+    dst_dib = create_perf_dib( dst_dc, 32, NULL, 1024, (void **)&dst_bits );
+    orig_dst = SelectObject( dst_dc, dst_dib );
+    for (i = 2; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        src_dib = create_perf_dib( src_dc, formats[i].bpp, formats[i].masks ? formats[i].masks : masks_555,
+                                   1024, &bits );
+        for (k = 0; k < 1024 * 1024; k++) ((WORD *)bits)[k] = k * 7;
+        orig_src = SelectObject( src_dc, src_dib );
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+        {
+            size = sizes[j];
+            count = DIB_PERF_PIXELS / (size * size);
+            QueryPerformanceCounter( &start );
+            for (k = 0; k < count; k++) BitBlt( dst_dc, 0, 0, size, size, src_dc, 0, 0, SRCCOPY );
+            time = perf_elapsed( &start, &freq );
+            trace( "BitBlt from %s to 8888, %ux%u: %.1f Mpixels/s\n", formats[i].name, size, size,
+                   DIB_PERF_PIXELS / time / 1e6 );
+        }
+        SelectObject( src_dc, orig_src );
+        DeleteObject( src_dib );
+    }
+
+    /* antialiased text */
+    memset( &lf, 0, sizeof(lf) );
+    strcpy( lf.lfFaceName, "Tahoma" );
+    lf.lfQuality = ANTIALIASED_QUALITY;
+    SetBkMode( dst_dc, TRANSPARENT );
+    for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]) - 1; j++)
+    {
+        lf.lfHeight = sizes[j];
+        font = CreateFontIndirectA( &lf );
+        orig_font = SelectObject( dst_dc, font );
+        QueryPerformanceCounter( &start );
+        for (k = 0; k < 1000; k++) ExtTextOutA( dst_dc, 0, 0, 0, NULL, text, sizeof(text) - 1, NULL );
+        time = perf_elapsed( &start, &freq );
+        trace( "ExtTextOut to 8888, height %u: %.1f us per string\n", sizes[j], time * 1e6 / 1000 );
+        SelectObject( dst_dc, orig_font );
+        DeleteObject( font );
+    }
+
+    SelectObject( dst_dc, orig_dst );
+    DeleteObject( dst_dib );
+    DeleteDC( dst_dc );
+    DeleteDC( src_dc );
+}
+
 START_TEST(dib)
 {
     HMODULE mod = GetModuleHandleA("gdi32.dll");
@@ -3211,4 +3366,6 @@ START_TEST(dib)
     test_simple_graphics();
 
     CryptReleaseContext(crypt_prov, 0);
+
+    test_dib_perf();
 }
@@ -38,6 +38,7 @@
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
 struct heap_layout
@@ -580,6 +581,85 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+static void test_low_fragmentation_heap(void)
+{
+    static const SIZE_T sizes[] = { 0, 1, 8, 17, 100, 256, 300, 1000, 4000, 10000, 16000 };
+    BYTE *blocks[sizeof(sizes) / sizeof(sizes[0])], *p;
+    HANDLE heap;
+    ULONG info;
+    SIZE_T i, j, size;
+    BOOL ret;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandle("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapSetInformation || !pHeapQueryInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    heap = HeapCreate( HEAP_NO_SERIALIZE, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "HeapSetInformation succeeded on a HEAP_NO_SERIALIZE heap\n" );
+    HeapDestroy( heap );
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+
+    SetLastError( 0xdeadbeef );
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) - 1 );
+    ok( !ret, "HeapSetInformation succeeded\n" );
+    ok( GetLastError() == ERROR_INSUFFICIENT_BUFFER, "wrong error %u\n", GetLastError() );
+
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        blocks[i] = HeapAlloc( heap, HEAP_ZERO_MEMORY, sizes[i] );
+        ok( blocks[i] != NULL, "HeapAlloc failed for size %lu\n", sizes[i] );
+        ok( !((ULONG_PTR)blocks[i] % (2 * sizeof(void *))), "unaligned block %p\n", blocks[i] );
+        size = HeapSize( heap, 0, blocks[i] );
+        ok( size == sizes[i], "wrong size %lu for %lu\n", size, sizes[i] );
+        for (j = 0; j < sizes[i]; j++) if (blocks[i][j]) break;
+        ok( j == sizes[i], "block of size %lu not zeroed at %lu\n", sizes[i], j );
+        ret = HeapValidate( heap, 0, blocks[i] );
+        ok( ret, "HeapValidate failed for size %lu\n", sizes[i] );
+        memset( blocks[i], 0x55, sizes[i] );
+    }
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        p = HeapReAlloc( heap, HEAP_ZERO_MEMORY, blocks[i], sizes[i] + 20 );
+        ok( p != NULL, "HeapReAlloc failed for size %lu\n", sizes[i] );
+        size = HeapSize( heap, 0, p );
+        ok( size == sizes[i] + 20, "wrong size %lu for %lu\n", size, sizes[i] + 20 );
+        for (j = 0; j < sizes[i]; j++) if (p[j] != 0x55) break;
+        ok( j == sizes[i], "block of size %lu not preserved at %lu\n", sizes[i], j );
+        for (; j < sizes[i] + 20; j++) if (p[j]) break;
+        ok( j == sizes[i] + 20, "block of size %lu not zeroed at %lu\n", sizes[i], j );
+        blocks[i] = p;
+    }
+
+    ret = HeapValidate( heap, 0, NULL );
+    ok( ret, "HeapValidate failed\n" );
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        ret = HeapFree( heap, 0, blocks[i] );
+        ok( ret, "HeapFree failed for size %lu\n", sizes[i] );
+    }
+
+    ret = HeapValidate( heap, 0, NULL );
+    ok( ret, "HeapValidate failed\n" );
+    HeapDestroy( heap );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -872,6 +952,64 @@ static void test_child_heap( const char *arg )
     test_heap_checks( expect_heap );
 }
 
+#define HEAP_PERF_THREADS 4
+#define HEAP_PERF_COUNT   1000000
+
+static DWORD WINAPI heap_perf_thread( void *arg )
+{
+    HANDLE heap = arg;
+    void *blocks[64];
+    int i;
+
+    memset( blocks, 0, sizeof(blocks) );
+    for (i = 0; i < HEAP_PERF_COUNT; i++)
+    {
+        HeapFree( heap, 0, blocks[i % 64] );
+        blocks[i % 64] = HeapAlloc( heap, 0, 16 + (i * 37) % 500 );
+    }
+    for (i = 0; i < 64; i++) HeapFree( heap, 0, blocks[i] );
+    return 0;
+}
+
+static void test_heap_perf(void)
+{
+    HANDLE heap, threads[HEAP_PERF_THREADS];
+    LARGE_INTEGER freq, start, end;
+    ULONG info;
+    int i, lfh;
+
+    if (!winetest_interactive)
+    {
+        skip("heap benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+    if (!pHeapSetInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    QueryPerformanceFrequency( &freq );
+    for (lfh = 0; lfh < 2; lfh++)
+    {
+        heap = HeapCreate( 0, 0, 0 );
+        info = 2;
+        if (lfh) pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+
+        QueryPerformanceCounter( &start );
+        for (i = 0; i < HEAP_PERF_THREADS; i++)
+            threads[i] = CreateThread( NULL, 0, heap_perf_thread, heap, 0, NULL );
+        WaitForMultipleObjects( HEAP_PERF_THREADS, threads, TRUE, INFINITE );
+        QueryPerformanceCounter( &end );
+        for (i = 0; i < HEAP_PERF_THREADS; i++) CloseHandle( threads[i] );
+
+        trace( "%s: %.1f ns per alloc/free pair with %u threads\n", lfh ? "lfh" : "no lfh",
+               (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / HEAP_PERF_COUNT,
+               HEAP_PERF_THREADS );
+        HeapDestroy( heap );
+    }
+}
+
 START_TEST(heap)
 {
     int argc;
@@ -897,6 +1035,8 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), (2 << 20));
     test_sized_HeapReAlloc((1 << 20), 1);
     test_HeapQueryInformation();
+    test_low_fragmentation_heap();
+    test_heap_perf();
 
     if (pRtlGetNtGlobalFlags)
     {
@@ -684,6 +684,43 @@ static void testGetModuleHandleEx(void)
     FreeLibrary( mod_kernel32 );
 }
 
+static void testGetProcAddress_Perf(void)
+{
+    static const char * const dlls[] = { "ntdll.dll", "kernel32.dll", "user32.dll" };
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const IMAGE_NT_HEADERS *nt;
+    LARGE_INTEGER freq, start, end;
+    const DWORD *names;
+    HMODULE module;
+    DWORD i, j, k;
+
+    if (!winetest_interactive)
+    {
+        skip("GetProcAddress benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+
+    QueryPerformanceFrequency(&freq);
+    for (i = 0; i < sizeof(dlls) / sizeof(dlls[0]); i++)
+    {
+        if (!(module = LoadLibraryA(dlls[i]))) continue;
+        nt = (const IMAGE_NT_HEADERS *)((const char *)module + ((const IMAGE_DOS_HEADER *)module)->e_lfanew);
+        exports = (const IMAGE_EXPORT_DIRECTORY *)((const char *)module +
+                      nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
+        names = (const DWORD *)((const char *)module + exports->AddressOfNames);
+
+        /* look up every named export of the module by name */
+        QueryPerformanceCounter(&start);
+        for (k = 0; k < 10; k++)
+            for (j = 0; j < exports->NumberOfNames; j++)
+                GetProcAddress(module, (const char *)module + names[j]);
+        QueryPerformanceCounter(&end);
+        trace("%s: %u names, %.0f ns per lookup\n", dlls[i], exports->NumberOfNames,
+              (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / (10 * exports->NumberOfNames));
+        FreeLibrary(module);
+    }
+}
+
 START_TEST(module)
 {
     WCHAR filenameW[MAX_PATH];
@@ -712,4 +749,5 @@ START_TEST(module)
     testGetProcAddress_Wrong();
     testLoadLibraryEx();
     testGetModuleHandleEx();
+    testGetProcAddress_Perf();
 }
@@ -46,6 +46,15 @@ static VOID   (WINAPI *pInitializeConditionVariable)(PCONDITION_VARIABLE);
 static BOOL   (WINAPI *pSleepConditionVariableCS)(PCONDITION_VARIABLE,PCRITICAL_SECTION,DWORD);
 static VOID   (WINAPI *pWakeAllConditionVariable)(PCONDITION_VARIABLE);
 static VOID   (WINAPI *pWakeConditionVariable)(PCONDITION_VARIABLE);
+static BOOL   (WINAPI *pSleepConditionVariableSRW)(PCONDITION_VARIABLE,PSRWLOCK,DWORD,ULONG);
+
+static VOID   (WINAPI *pInitializeSRWLock)(PSRWLOCK);
+static VOID   (WINAPI *pAcquireSRWLockExclusive)(PSRWLOCK);
+static VOID   (WINAPI *pAcquireSRWLockShared)(PSRWLOCK);
+static VOID   (WINAPI *pReleaseSRWLockExclusive)(PSRWLOCK);
+static VOID   (WINAPI *pReleaseSRWLockShared)(PSRWLOCK);
+static BOOLEAN (WINAPI *pTryAcquireSRWLockExclusive)(PSRWLOCK);
+static BOOLEAN (WINAPI *pTryAcquireSRWLockShared)(PSRWLOCK);
 
 static void test_signalandwait(void)
 {
@@ -1316,8 +1325,7 @@ static void test_condvars_consumer_producer(void)
 
     if (!pInitializeConditionVariable) {
         /* function is not yet in XP, only in newer Windows */
-        /* and not yet implemented in Wine for some days/weeks */
-        todo_wine win_skip("no condition variable support.\n");
+        win_skip("no condition variable support.\n");
         return;
     }
 
@@ -1479,8 +1487,7 @@ static void test_condvars_base(void) {
 
     if (!pInitializeConditionVariable) {
         /* function is not yet in XP, only in newer Windows */
-        /* and not yet implemented in Wine for some days/weeks */
-        todo_wine win_skip("no condition variable support.\n");
+        win_skip("no condition variable support.\n");
         return;
     }
 
@@ -1505,6 +1512,349 @@ static void test_condvars_base(void) {
     WaitForSingleObject(hc, 100);
 }
 
+static SRWLOCK srwlock_base;
+static LONG srwlock_owners, srwlock_exclusive, srwlock_errors;
+
+static DWORD WINAPI srwlock_thread(LPVOID arg)
+{
+    int i;
+
+    for (i = 0; i < 2000; i++)
+    {
+        if (i % 4 == 0)
+        {
+            pAcquireSRWLockExclusive(&srwlock_base);
+            if (InterlockedIncrement(&srwlock_exclusive) != 1 || srwlock_owners)
+                InterlockedIncrement(&srwlock_errors);
+            if (!(i % 64)) Sleep(0);
+            InterlockedDecrement(&srwlock_exclusive);
+            pReleaseSRWLockExclusive(&srwlock_base);
+        }
+        else
+        {
+            pAcquireSRWLockShared(&srwlock_base);
+            InterlockedIncrement(&srwlock_owners);
+            if (srwlock_exclusive) InterlockedIncrement(&srwlock_errors);
+            if (!(i % 64)) Sleep(0);
+            InterlockedDecrement(&srwlock_owners);
+            pReleaseSRWLockShared(&srwlock_base);
+        }
+    }
+    return 0;
+}
+
+static void test_srwlock_base(void)
+{
+    HANDLE threads[4];
+    DWORD dummy;
+    BOOLEAN ret;
+    int i;
+
+    if (!pInitializeSRWLock)
+    {
+        /* function is not yet in XP, only in newer Windows */
+        win_skip("no srw lock support.\n");
+        return;
+    }
+
+    pInitializeSRWLock(&srwlock_base);
+
+    pAcquireSRWLockShared(&srwlock_base);
+    pAcquireSRWLockShared(&srwlock_base);
+    if (pTryAcquireSRWLockExclusive)
+    {
+        ret = pTryAcquireSRWLockExclusive(&srwlock_base);
+        ok(!ret, "TryAcquireSRWLockExclusive succeeded on a shared lock\n");
+        ret = pTryAcquireSRWLockShared(&srwlock_base);
+        ok(ret, "TryAcquireSRWLockShared failed on a shared lock\n");
+        if (ret) pReleaseSRWLockShared(&srwlock_base);
+    }
+    pReleaseSRWLockShared(&srwlock_base);
+    pReleaseSRWLockShared(&srwlock_base);
+
+    pAcquireSRWLockExclusive(&srwlock_base);
+    if (pTryAcquireSRWLockShared)
+    {
+        ret = pTryAcquireSRWLockShared(&srwlock_base);
+        ok(!ret, "TryAcquireSRWLockShared succeeded on an exclusive lock\n");
+        ret = pTryAcquireSRWLockExclusive(&srwlock_base);
+        ok(!ret, "TryAcquireSRWLockExclusive succeeded on an exclusive lock\n");
+    }
+    pReleaseSRWLockExclusive(&srwlock_base);
+
+    if (pTryAcquireSRWLockExclusive)
+    {
+        ret = pTryAcquireSRWLockExclusive(&srwlock_base);
+        ok(ret, "TryAcquireSRWLockExclusive failed on a free lock\n");
+        if (ret) pReleaseSRWLockExclusive(&srwlock_base);
+    }
+
+    for (i = 0; i < sizeof(threads)/sizeof(threads[0]); i++)
+        threads[i] = CreateThread(NULL, 0, srwlock_thread, NULL, 0, &dummy);
+    ok(!WaitForMultipleObjects(sizeof(threads)/sizeof(threads[0]), threads, TRUE, 30000),
+       "srw lock threads did not finish\n");
+    for (i = 0; i < sizeof(threads)/sizeof(threads[0]); i++) CloseHandle(threads[i]);
+
+    ok(!srwlock_errors, "got %d srw lock exclusion errors\n", srwlock_errors);
+}
+
+static SRWLOCK srwlock_cv;
+static CONDITION_VARIABLE condvar_srw;
+static LONG condvar_srw_value;
+
+static DWORD WINAPI condvar_srw_waker(LPVOID arg)
+{
+    Sleep(50);
+    pAcquireSRWLockExclusive(&srwlock_cv);
+    condvar_srw_value = 1;
+    pReleaseSRWLockExclusive(&srwlock_cv);
+    pWakeAllConditionVariable(&condvar_srw);
+    return 0;
+}
+
+static void test_condvars_srw(void)
+{
+    HANDLE thread;
+    DWORD dummy;
+    BOOL ret;
+
+    if (!pSleepConditionVariableSRW || !pInitializeSRWLock)
+    {
+        win_skip("no SleepConditionVariableSRW support.\n");
+        return;
+    }
+
+    pInitializeSRWLock(&srwlock_cv);
+    pInitializeConditionVariable(&condvar_srw);
+
+    pAcquireSRWLockExclusive(&srwlock_cv);
+    SetLastError(0xdeadbeef);
+    ret = pSleepConditionVariableSRW(&condvar_srw, &srwlock_cv, 10, 0);
+    ok(!ret, "SleepConditionVariableSRW should return FALSE on untriggered condvar\n");
+    ok(GetLastError() == ERROR_TIMEOUT, "SleepConditionVariableSRW should return ERROR_TIMEOUT, not %d\n", GetLastError());
+
+    thread = CreateThread(NULL, 0, condvar_srw_waker, NULL, 0, &dummy);
+    while (!condvar_srw_value)
+    {
+        ret = pSleepConditionVariableSRW(&condvar_srw, &srwlock_cv, 5000, 0);
+        ok(ret, "SleepConditionVariableSRW failed %d\n", GetLastError());
+        if (!ret) break;
+    }
+    pReleaseSRWLockExclusive(&srwlock_cv);
+
+    pAcquireSRWLockShared(&srwlock_cv);
+    ret = pSleepConditionVariableSRW(&condvar_srw, &srwlock_cv, 10, CONDITION_VARIABLE_LOCKMODE_SHARED);
+    ok(!ret, "SleepConditionVariableSRW should return FALSE on untriggered condvar\n");
+    pReleaseSRWLockShared(&srwlock_cv);
+
+    WaitForSingleObject(thread, 1000);
+    CloseHandle(thread);
+}
+
+
+static CRITICAL_SECTION condvar_perf_crit;
+static CONDITION_VARIABLE condvar_perf_cv;
+static LONG condvar_perf_turn;
+
+#define CONDVAR_PERF_ROUNDS 100000
+
+static DWORD WINAPI condvar_perf_thread(LPVOID arg)
+{
+    LONG me = (LONG)(ULONG_PTR)arg;
+    int i;
+
+    EnterCriticalSection(&condvar_perf_crit);
+    for (i = 0; i < CONDVAR_PERF_ROUNDS; i++)
+    {
+        while (condvar_perf_turn != me)
+            pSleepConditionVariableCS(&condvar_perf_cv, &condvar_perf_crit, INFINITE);
+        condvar_perf_turn = !me;
+        pWakeConditionVariable(&condvar_perf_cv);
+    }
+    LeaveCriticalSection(&condvar_perf_crit);
+    return 0;
+}
+
+static void test_condvar_perf(void)
+{
+    LARGE_INTEGER freq, start, end;
+    HANDLE thread;
+    DWORD i;
+
+    if (!winetest_interactive)
+    {
+        skip("condition variable benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+    if (!pInitializeConditionVariable)
+    {
+        win_skip("no condition variable support.\n");
+        return;
+    }
+
+    QueryPerformanceFrequency(&freq);
+    pInitializeConditionVariable(&condvar_perf_cv);
+    InitializeCriticalSection(&condvar_perf_crit);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < 1000000; i++) pWakeConditionVariable(&condvar_perf_cv);
+    for (i = 0; i < 1000000; i++) pWakeAllConditionVariable(&condvar_perf_cv);
+    QueryPerformanceCounter(&end);
+    trace("wake without waiters: %.1f ns\n",
+          (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / 2000000);
+
+    condvar_perf_turn = 0;
+    thread = CreateThread(NULL, 0, condvar_perf_thread, (void *)1, 0, NULL);
+    QueryPerformanceCounter(&start);
+    condvar_perf_thread((void *)0);
+    WaitForSingleObject(thread, INFINITE);
+    QueryPerformanceCounter(&end);
+    CloseHandle(thread);
+    trace("ping-pong between two threads: %.2f us per round trip\n",
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / CONDVAR_PERF_ROUNDS);
+
+    DeleteCriticalSection(&condvar_perf_crit);
+}
+
+#define SYNC_PERF_ROUNDS 100000
+
+static HANDLE sync_perf_events[2];
+
+static DWORD WINAPI sync_perf_thread(void *arg)
+{
+    DWORD i, me = (DWORD_PTR)arg;
+
+    for (i = 0; i < SYNC_PERF_ROUNDS; i++)
+    {
+        WaitForSingleObject(sync_perf_events[me], INFINITE);
+        SetEvent(sync_perf_events[!me]);
+    }
+    return 0;
+}
+
+static double sync_perf_elapsed(const LARGE_INTEGER *start, const LARGE_INTEGER *freq, DWORD count)
+{
+    LARGE_INTEGER end;
+
+    QueryPerformanceCounter(&end);
+    return (end.QuadPart - start->QuadPart) * 1e6 / freq->QuadPart / count;
+}
+
+static void test_sync_perf(void)
+{
+    LARGE_INTEGER freq, start;
+    HANDLE event, semaphore, mutex, thread;
+    DWORD i;
+
+    if (!winetest_interactive)
+    {
+        skip("synchronization objects benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+
+    /* run with and without WINEFASTSYNC=1 to compare */
+    QueryPerformanceFrequency(&freq);
+    event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    semaphore = CreateSemaphoreA(NULL, 0, 1, NULL);
+    mutex = CreateMutexA(NULL, FALSE, NULL);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < SYNC_PERF_ROUNDS; i++)
+    {
+        SetEvent(event);
+        WaitForSingleObject(event, 0);
+        ResetEvent(event);
+    }
+    trace("set, wait and reset an event: %.2f us\n", sync_perf_elapsed(&start, &freq, SYNC_PERF_ROUNDS));
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < SYNC_PERF_ROUNDS; i++)
+    {
+        ReleaseSemaphore(semaphore, 1, NULL);
+        WaitForSingleObject(semaphore, 0);
+    }
+    trace("release and acquire a semaphore: %.2f us\n", sync_perf_elapsed(&start, &freq, SYNC_PERF_ROUNDS));
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < SYNC_PERF_ROUNDS; i++)
+    {
+        WaitForSingleObject(mutex, 0);
+        ReleaseMutex(mutex);
+    }
+    trace("acquire and release a mutex: %.2f us\n", sync_perf_elapsed(&start, &freq, SYNC_PERF_ROUNDS));
+
+    sync_perf_events[0] = CreateEventA(NULL, FALSE, FALSE, NULL);
+    sync_perf_events[1] = CreateEventA(NULL, FALSE, FALSE, NULL);
+    thread = CreateThread(NULL, 0, sync_perf_thread, (void *)1, 0, NULL);
+    QueryPerformanceCounter(&start);
+    SetEvent(sync_perf_events[1]);
+    for (i = 0; i < SYNC_PERF_ROUNDS; i++)
+    {
+        WaitForSingleObject(sync_perf_events[0], INFINITE);
+        if (i < SYNC_PERF_ROUNDS - 1) SetEvent(sync_perf_events[1]);
+    }
+    trace("ping-pong between two threads with events: %.2f us per round trip\n",
+          sync_perf_elapsed(&start, &freq, SYNC_PERF_ROUNDS));
+    WaitForSingleObject(thread, INFINITE);
+
+    CloseHandle(thread);
+    CloseHandle(sync_perf_events[0]);
+    CloseHandle(sync_perf_events[1]);
+    CloseHandle(event);
+    CloseHandle(semaphore);
+    CloseHandle(mutex);
+}
+
+#define TIMER_PERF_COUNT 50000
+
+static void test_timer_perf(void)
+{
+    LARGE_INTEGER freq, start, end, due;
+    HANDLE *timers;
+    DWORD i, seed = 12345;
+
+    if (!winetest_interactive)
+    {
+        skip("waitable timer benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+    if (!pCreateWaitableTimerA)
+    {
+        win_skip("CreateWaitableTimerA() is not available\n");
+        return;
+    }
+
+    timers = HeapAlloc(GetProcessHeap(), 0, TIMER_PERF_COUNT * sizeof(*timers));
+    for (i = 0; i < TIMER_PERF_COUNT; i++) timers[i] = pCreateWaitableTimerA(NULL, FALSE, NULL);
+    QueryPerformanceFrequency(&freq);
+
+    /* many long timers pending at once, with random due times between 100 and 10000 seconds */
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < TIMER_PERF_COUNT; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        due.QuadPart = -(LONGLONG)(100 + seed % 9900) * 10000000;
+        SetWaitableTimer(timers[i], &due, 0, NULL, NULL, FALSE);
+    }
+    QueryPerformanceCounter(&end);
+    trace("arm %u timers: %.3fs\n", TIMER_PERF_COUNT,
+          (double)(end.QuadPart - start.QuadPart) / freq.QuadPart);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < TIMER_PERF_COUNT; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        due.QuadPart = -(LONGLONG)(100 + seed % 9900) * 10000000;
+        SetWaitableTimer(timers[seed % TIMER_PERF_COUNT], &due, 0, NULL, NULL, FALSE);
+    }
+    QueryPerformanceCounter(&end);
+    trace("re-arm %u timers: %.3fs\n", TIMER_PERF_COUNT,
+          (double)(end.QuadPart - start.QuadPart) / freq.QuadPart);
+
+    for (i = 0; i < TIMER_PERF_COUNT; i++) CloseHandle(timers[i]);
+    HeapFree(GetProcessHeap(), 0, timers);
+}
+
 
 START_TEST(sync)
 {
@@ -1526,6 +1876,14 @@ START_TEST(sync)
     pSleepConditionVariableCS = (void *)GetProcAddress(hdll, "SleepConditionVariableCS");
     pWakeAllConditionVariable = (void *)GetProcAddress(hdll, "WakeAllConditionVariable");
     pWakeConditionVariable = (void *)GetProcAddress(hdll, "WakeConditionVariable");
+    pSleepConditionVariableSRW = (void *)GetProcAddress(hdll, "SleepConditionVariableSRW");
+    pInitializeSRWLock = (void *)GetProcAddress(hdll, "InitializeSRWLock");
+    pAcquireSRWLockExclusive = (void *)GetProcAddress(hdll, "AcquireSRWLockExclusive");
+    pAcquireSRWLockShared = (void *)GetProcAddress(hdll, "AcquireSRWLockShared");
+    pReleaseSRWLockExclusive = (void *)GetProcAddress(hdll, "ReleaseSRWLockExclusive");
+    pReleaseSRWLockShared = (void *)GetProcAddress(hdll, "ReleaseSRWLockShared");
+    pTryAcquireSRWLockExclusive = (void *)GetProcAddress(hdll, "TryAcquireSRWLockExclusive");
+    pTryAcquireSRWLockShared = (void *)GetProcAddress(hdll, "TryAcquireSRWLockShared");
 
     test_signalandwait();
     test_mutex();
@@ -1540,4 +1898,9 @@ START_TEST(sync)
     test_initonce();
     test_condvars_base();
     test_condvars_consumer_producer();
+    test_srwlock_base();
+    test_condvars_srw();
+    test_condvar_perf();
+    test_timer_perf();
+    test_sync_perf();
 }
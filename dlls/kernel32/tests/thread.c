@@ -65,6 +65,23 @@ static BOOL (WINAPI *pIsWow64Process)(HANDLE,PBOOL);
 static BOOL (WINAPI *pSetThreadErrorMode)(DWORD,PDWORD);
 static DWORD (WINAPI *pGetThreadErrorMode)(void);
 static DWORD (WINAPI *pRtlGetThreadErrorMode)(void);
+static PTP_WORK (WINAPI *pCreateThreadpoolWork)(PTP_WORK_CALLBACK,PVOID,PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSubmitThreadpoolWork)(PTP_WORK);
+static VOID (WINAPI *pWaitForThreadpoolWorkCallbacks)(PTP_WORK,BOOL);
+static VOID (WINAPI *pCloseThreadpoolWork)(PTP_WORK);
+static PTP_TIMER (WINAPI *pCreateThreadpoolTimer)(PTP_TIMER_CALLBACK,PVOID,PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolTimer)(PTP_TIMER,FILETIME*,DWORD,DWORD);
+static BOOL (WINAPI *pIsThreadpoolTimerSet)(PTP_TIMER);
+static VOID (WINAPI *pWaitForThreadpoolTimerCallbacks)(PTP_TIMER,BOOL);
+static VOID (WINAPI *pCloseThreadpoolTimer)(PTP_TIMER);
+static PTP_WAIT (WINAPI *pCreateThreadpoolWait)(PTP_WAIT_CALLBACK,PVOID,PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolWait)(PTP_WAIT,HANDLE,FILETIME*);
+static VOID (WINAPI *pWaitForThreadpoolWaitCallbacks)(PTP_WAIT,BOOL);
+static VOID (WINAPI *pCloseThreadpoolWait)(PTP_WAIT);
+static PTP_CLEANUP_GROUP (WINAPI *pCreateThreadpoolCleanupGroup)(void);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroupMembers)(PTP_CLEANUP_GROUP,BOOL,PVOID);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroup)(PTP_CLEANUP_GROUP);
+static BOOL (WINAPI *pTrySubmitThreadpoolCallback)(PTP_SIMPLE_CALLBACK,PVOID,PTP_CALLBACK_ENVIRON);
 
 static HANDLE create_target_process(const char *arg)
 {
@@ -990,11 +1007,25 @@ static DWORD CALLBACK work_function(void *p)
     return 0;
 }
 
+static LONG blocking_count, blocking_total;
+static HANDLE blocking_event;
+
+static DWORD CALLBACK blocking_work_function(void *p)
+{
+    /* only returns once all the work items run at the same time */
+    if (InterlockedIncrement(&blocking_count) == blocking_total)
+        SetEvent(blocking_event);
+    WaitForSingleObject(blocking_event, 10000);
+    InterlockedDecrement(&blocking_count);
+    return 0;
+}
+
 static void test_QueueUserWorkItem(void)
 {
     INT_PTR i;
     DWORD wait_result;
     DWORD before, after;
+    SYSTEM_INFO si;
 
     /* QueueUserWorkItem not present on win9x */
     if (!pQueueUserWorkItem) return;
@@ -1016,6 +1047,147 @@ static void test_QueueUserWorkItem(void)
     ok(wait_result == WAIT_OBJECT_0, "wait failed with error 0x%x\n", wait_result);
 
     ok(times_executed == 100, "didn't execute all of the work items\n");
+
+    /* blocking work items must not starve the ones queued after them */
+    GetSystemInfo(&si);
+    blocking_total = si.dwNumberOfProcessors + 4;
+    blocking_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    for (i = 0; i < blocking_total; i++)
+    {
+        BOOL ret = pQueueUserWorkItem(blocking_work_function, NULL, WT_EXECUTEDEFAULT);
+        ok(ret, "QueueUserWorkItem failed with error %d\n", GetLastError());
+    }
+    wait_result = WaitForSingleObject(blocking_event, 10000);
+    ok(wait_result == WAIT_OBJECT_0, "only %d of %d work items ran\n", blocking_count, blocking_total);
+    while (blocking_count) Sleep(10);
+    CloseHandle(blocking_event);
+}
+
+static LONG tp_work_count, tp_simple_count, tp_cancel_count;
+
+static void CALLBACK tp_simple_cb(PTP_CALLBACK_INSTANCE instance, PVOID userdata)
+{
+    /* fan out from inside the pool */
+    if (userdata) pTrySubmitThreadpoolCallback(tp_simple_cb, NULL, NULL);
+    InterlockedIncrement(&tp_simple_count);
+}
+
+static void CALLBACK tp_work_cb(PTP_CALLBACK_INSTANCE instance, PVOID userdata, PTP_WORK work)
+{
+    if (userdata) Sleep((DWORD_PTR)userdata);
+    InterlockedIncrement(&tp_work_count);
+}
+
+static void CALLBACK tp_timer_cb(PTP_CALLBACK_INSTANCE instance, PVOID userdata, PTP_TIMER timer)
+{
+    SetEvent(userdata);
+}
+
+static TP_WAIT_RESULT tp_wait_result;
+
+static void CALLBACK tp_wait_cb(PTP_CALLBACK_INSTANCE instance, PVOID userdata, PTP_WAIT wait, TP_WAIT_RESULT result)
+{
+    tp_wait_result = result;
+    SetEvent(userdata);
+}
+
+static void CALLBACK tp_group_cancel_cb(PVOID object_context, PVOID cleanup_context)
+{
+    ok(cleanup_context == (void *)0xdeadbeef, "got wrong context %p\n", cleanup_context);
+    InterlockedIncrement(&tp_cancel_count);
+}
+
+static void test_threadpool(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    PTP_CLEANUP_GROUP group;
+    LARGE_INTEGER when;
+    FILETIME due_time;
+    PTP_TIMER timer;
+    PTP_WORK work;
+    PTP_WAIT wait;
+    HANDLE event, semaphore;
+    DWORD result;
+    BOOL ret;
+    int i;
+
+    if (!pCreateThreadpoolWork)
+    {
+        win_skip("Threadpool functions not supported, skipping tests\n");
+        return;
+    }
+
+    work = pCreateThreadpoolWork(tp_work_cb, NULL, NULL);
+    ok(work != NULL, "CreateThreadpoolWork failed with error %u\n", GetLastError());
+    for (i = 0; i < 100; i++) pSubmitThreadpoolWork(work);
+    pWaitForThreadpoolWorkCallbacks(work, FALSE);
+    ok(tp_work_count == 100, "expected 100 callbacks, got %d\n", tp_work_count);
+    pCloseThreadpoolWork(work);
+
+    for (i = 0; i < 10; i++)
+    {
+        ret = pTrySubmitThreadpoolCallback(tp_simple_cb, (void *)1, NULL);
+        ok(ret, "TrySubmitThreadpoolCallback failed with error %u\n", GetLastError());
+    }
+    for (i = 0; i < 100 && tp_simple_count < 20; i++) Sleep(10);
+    ok(tp_simple_count == 20, "expected 20 callbacks, got %d\n", tp_simple_count);
+
+    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    timer = pCreateThreadpoolTimer(tp_timer_cb, event, NULL);
+    ok(timer != NULL, "CreateThreadpoolTimer failed with error %u\n", GetLastError());
+    ok(!pIsThreadpoolTimerSet(timer), "timer should not be set\n");
+    when.QuadPart = (ULONGLONG)200 * -10000;
+    due_time.dwLowDateTime = when.u.LowPart;
+    due_time.dwHighDateTime = when.u.HighPart;
+    pSetThreadpoolTimer(timer, &due_time, 0, 0);
+    ok(pIsThreadpoolTimerSet(timer), "timer should be set\n");
+    result = WaitForSingleObject(event, 50);
+    ok(result == WAIT_TIMEOUT, "timer fired too early\n");
+    result = WaitForSingleObject(event, 1000);
+    ok(result == WAIT_OBJECT_0, "timer didn't fire\n");
+    pSetThreadpoolTimer(timer, NULL, 0, 0);
+    ok(!pIsThreadpoolTimerSet(timer), "timer should not be set\n");
+    pWaitForThreadpoolTimerCallbacks(timer, FALSE);
+    pCloseThreadpoolTimer(timer);
+
+    semaphore = CreateSemaphore(NULL, 0, 1, NULL);
+    wait = pCreateThreadpoolWait(tp_wait_cb, event, NULL);
+    ok(wait != NULL, "CreateThreadpoolWait failed with error %u\n", GetLastError());
+    pSetThreadpoolWait(wait, semaphore, NULL);
+    result = WaitForSingleObject(event, 50);
+    ok(result == WAIT_TIMEOUT, "wait callback shouldn't have run\n");
+    ReleaseSemaphore(semaphore, 1, NULL);
+    result = WaitForSingleObject(event, 1000);
+    ok(result == WAIT_OBJECT_0, "wait callback didn't run\n");
+    ok(tp_wait_result == WAIT_OBJECT_0, "expected WAIT_OBJECT_0, got %u\n", tp_wait_result);
+    when.QuadPart = (ULONGLONG)50 * -10000;
+    due_time.dwLowDateTime = when.u.LowPart;
+    due_time.dwHighDateTime = when.u.HighPart;
+    pSetThreadpoolWait(wait, semaphore, &due_time);
+    result = WaitForSingleObject(event, 1000);
+    ok(result == WAIT_OBJECT_0, "wait callback didn't run\n");
+    ok(tp_wait_result == WAIT_TIMEOUT, "expected WAIT_TIMEOUT, got %u\n", tp_wait_result);
+    pWaitForThreadpoolWaitCallbacks(wait, FALSE);
+    pCloseThreadpoolWait(wait);
+    CloseHandle(semaphore);
+
+    /* closing the group members cancels the queued callbacks */
+    group = pCreateThreadpoolCleanupGroup();
+    ok(group != NULL, "CreateThreadpoolCleanupGroup failed with error %u\n", GetLastError());
+    InitializeThreadpoolEnvironment(&environment);
+    SetThreadpoolCallbackCleanupGroup(&environment, group, tp_group_cancel_cb);
+    tp_work_count = 0;
+    work = pCreateThreadpoolWork(tp_work_cb, (void *)100, &environment);
+    ok(work != NULL, "CreateThreadpoolWork failed with error %u\n", GetLastError());
+    for (i = 0; i < 100; i++) pSubmitThreadpoolWork(work);
+    Sleep(50);
+    pCloseThreadpoolCleanupGroupMembers(group, TRUE, (void *)0xdeadbeef);
+    ok(tp_work_count < 100, "expected some callbacks to be cancelled, got %d\n", tp_work_count);
+    ok(tp_cancel_count == 1, "expected 1 cancel callback, got %d\n", tp_cancel_count);
+    pCloseThreadpoolCleanupGroup(group);
+    DestroyThreadpoolEnvironment(&environment);
+
+    CloseHandle(event);
 }
 
 static void CALLBACK signaled_function(PVOID p, BOOLEAN TimerOrWaitFired)
@@ -1432,6 +1604,112 @@ static void test_thread_fpu_cw(void)
 }
 #endif
 
+#define TP_PERF_ITEMS 1000000
+#define TP_PERF_DEPTH 19
+
+static LONG tp_perf_count;
+static HANDLE tp_perf_done;
+
+static void CALLBACK tp_perf_work_cb(PTP_CALLBACK_INSTANCE instance, PVOID userdata, PTP_WORK work)
+{
+    InterlockedIncrement(&tp_perf_count);
+}
+
+static void CALLBACK tp_perf_tree_cb(PTP_CALLBACK_INSTANCE instance, PVOID userdata)
+{
+    DWORD_PTR depth = (DWORD_PTR)userdata;
+
+    /* work submitted from inside the pool goes to the worker's own deque */
+    if (depth)
+    {
+        pTrySubmitThreadpoolCallback(tp_perf_tree_cb, (void *)(depth - 1), NULL);
+        pTrySubmitThreadpoolCallback(tp_perf_tree_cb, (void *)(depth - 1), NULL);
+    }
+    if (InterlockedIncrement(&tp_perf_count) == (2 << TP_PERF_DEPTH) - 1) SetEvent(tp_perf_done);
+}
+
+static void test_threadpool_perf(void)
+{
+    LARGE_INTEGER freq, start, end;
+    PTP_WORK work;
+    DWORD i;
+
+    if (!winetest_interactive)
+    {
+        skip("threadpool benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+    if (!pCreateThreadpoolWork)
+    {
+        win_skip("Threadpool functions not supported, skipping tests\n");
+        return;
+    }
+
+    QueryPerformanceFrequency(&freq);
+
+    tp_perf_count = 0;
+    work = pCreateThreadpoolWork(tp_perf_work_cb, NULL, NULL);
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < TP_PERF_ITEMS; i++) pSubmitThreadpoolWork(work);
+    pWaitForThreadpoolWorkCallbacks(work, FALSE);
+    QueryPerformanceCounter(&end);
+    pCloseThreadpoolWork(work);
+    ok(tp_perf_count == TP_PERF_ITEMS, "got %d callbacks\n", tp_perf_count);
+    trace("%u items posted from outside the pool: %.0f ns per item\n", TP_PERF_ITEMS,
+          (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / TP_PERF_ITEMS);
+
+    tp_perf_count = 0;
+    tp_perf_done = CreateEventA(NULL, FALSE, FALSE, NULL);
+    QueryPerformanceCounter(&start);
+    pTrySubmitThreadpoolCallback(tp_perf_tree_cb, (void *)TP_PERF_DEPTH, NULL);
+    WaitForSingleObject(tp_perf_done, INFINITE);
+    QueryPerformanceCounter(&end);
+    CloseHandle(tp_perf_done);
+    trace("%u items submitted from callbacks: %.0f ns per item\n", (2 << TP_PERF_DEPTH) - 1,
+          (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / ((2 << TP_PERF_DEPTH) - 1));
+}
+
+#define ROUND_TRIP_PERF_CALLS 100000
+
+static DWORD WINAPI round_trip_perf_thread(void *arg)
+{
+    HANDLE thread = arg;
+    DWORD code, i;
+
+    /* each call is a get_thread_info server round trip */
+    for (i = 0; i < ROUND_TRIP_PERF_CALLS; i++) GetExitCodeThread(thread, &code);
+    return 0;
+}
+
+static void test_round_trip_perf(void)
+{
+    static const unsigned int counts[] = {1, 4};
+    LARGE_INTEGER freq, start, end;
+    HANDLE threads[4];
+    unsigned int i, j;
+
+    if (!winetest_interactive)
+    {
+        skip("server round trip benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+
+    QueryPerformanceFrequency(&freq);
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        QueryPerformanceCounter(&start);
+        for (j = 0; j < counts[i]; j++)
+            threads[j] = CreateThread(NULL, 0, round_trip_perf_thread, GetCurrentThread(), 0, NULL);
+        WaitForMultipleObjects(counts[i], threads, TRUE, INFINITE);
+        QueryPerformanceCounter(&end);
+        for (j = 0; j < counts[i]; j++) CloseHandle(threads[j]);
+
+        /* compare runs with and without WINESHMREQUESTS=1 */
+        trace("%u threads: %.0f round trips/s\n", counts[i],
+              counts[i] * ROUND_TRIP_PERF_CALLS * (double)freq.QuadPart / (end.QuadPart - start.QuadPart));
+    }
+}
+
 START_TEST(thread)
 {
    HINSTANCE lib;
@@ -1454,6 +1732,23 @@ START_TEST(thread)
    pIsWow64Process=(void *)GetProcAddress(lib,"IsWow64Process");
    pSetThreadErrorMode=(void *)GetProcAddress(lib,"SetThreadErrorMode");
    pGetThreadErrorMode=(void *)GetProcAddress(lib,"GetThreadErrorMode");
+   pCreateThreadpoolWork=(void *)GetProcAddress(lib,"CreateThreadpoolWork");
+   pSubmitThreadpoolWork=(void *)GetProcAddress(lib,"SubmitThreadpoolWork");
+   pWaitForThreadpoolWorkCallbacks=(void *)GetProcAddress(lib,"WaitForThreadpoolWorkCallbacks");
+   pCloseThreadpoolWork=(void *)GetProcAddress(lib,"CloseThreadpoolWork");
+   pCreateThreadpoolTimer=(void *)GetProcAddress(lib,"CreateThreadpoolTimer");
+   pSetThreadpoolTimer=(void *)GetProcAddress(lib,"SetThreadpoolTimer");
+   pIsThreadpoolTimerSet=(void *)GetProcAddress(lib,"IsThreadpoolTimerSet");
+   pWaitForThreadpoolTimerCallbacks=(void *)GetProcAddress(lib,"WaitForThreadpoolTimerCallbacks");
+   pCloseThreadpoolTimer=(void *)GetProcAddress(lib,"CloseThreadpoolTimer");
+   pCreateThreadpoolWait=(void *)GetProcAddress(lib,"CreateThreadpoolWait");
+   pSetThreadpoolWait=(void *)GetProcAddress(lib,"SetThreadpoolWait");
+   pWaitForThreadpoolWaitCallbacks=(void *)GetProcAddress(lib,"WaitForThreadpoolWaitCallbacks");
+   pCloseThreadpoolWait=(void *)GetProcAddress(lib,"CloseThreadpoolWait");
+   pCreateThreadpoolCleanupGroup=(void *)GetProcAddress(lib,"CreateThreadpoolCleanupGroup");
+   pCloseThreadpoolCleanupGroupMembers=(void *)GetProcAddress(lib,"CloseThreadpoolCleanupGroupMembers");
+   pCloseThreadpoolCleanupGroup=(void *)GetProcAddress(lib,"CloseThreadpoolCleanupGroup");
+   pTrySubmitThreadpoolCallback=(void *)GetProcAddress(lib,"TrySubmitThreadpoolCallback");
 
    ntdll=GetModuleHandleA("ntdll.dll");
    if (ntdll)
@@ -1502,9 +1797,12 @@ START_TEST(thread)
 #endif
    test_QueueUserWorkItem();
    test_RegisterWaitForSingleObject();
+   test_threadpool();
    test_TLS();
    test_ThreadErrorMode();
 #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
    test_thread_fpu_cw();
 #endif
+   test_threadpool_perf();
+   test_round_trip_perf();
 }
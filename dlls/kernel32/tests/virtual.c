@@ -2489,6 +2489,60 @@ static void test_shared_memory(int is_child)
     CloseHandle(mapping);
 }
 
+#define VIRTUAL_PERF_COUNT 20000
+
+static void test_virtual_perf(void)
+{
+    LARGE_INTEGER freq, start, end;
+    MEMORY_BASIC_INFORMATION info;
+    DWORD i, count, seed = 12345;
+    void **ptrs;
+
+    if (!winetest_interactive)
+    {
+        skip("virtual memory benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+
+    ptrs = HeapAlloc(GetProcessHeap(), 0, VIRTUAL_PERF_COUNT * sizeof(*ptrs));
+    QueryPerformanceFrequency(&freq);
+
+    /* each allocation takes its own 64K unit, so the process ends up with many views */
+    QueryPerformanceCounter(&start);
+    for (count = 0; count < VIRTUAL_PERF_COUNT; count++)
+        if (!(ptrs[count] = VirtualAlloc(NULL, 0x1000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE))) break;
+    QueryPerformanceCounter(&end);
+    ok(count > 0, "VirtualAlloc failed %u\n", GetLastError());
+    if (!count)
+    {
+        HeapFree(GetProcessHeap(), 0, ptrs);
+        return;
+    }
+    trace("allocate %u views: %.2f us per allocation\n", count,
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / count);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < VIRTUAL_PERF_COUNT; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        VirtualQuery((char *)ptrs[seed % count] + 0x800, &info, sizeof(info));
+    }
+    QueryPerformanceCounter(&end);
+    trace("query %u views: %.2f us per query\n", count,
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / VIRTUAL_PERF_COUNT);
+
+    /* free every other view and allocate again, to search for holes between the views */
+    for (i = 0; i < count; i += 2) VirtualFree(ptrs[i], 0, MEM_RELEASE);
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i += 2) ptrs[i] = VirtualAlloc(NULL, 0x1000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    QueryPerformanceCounter(&end);
+    trace("allocate %u views in holes: %.2f us per allocation\n", (count + 1) / 2,
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / ((count + 1) / 2));
+
+    for (i = 0; i < count; i++) if (ptrs[i]) VirtualFree(ptrs[i], 0, MEM_RELEASE);
+    HeapFree(GetProcessHeap(), 0, ptrs);
+}
+
 START_TEST(virtual)
 {
     int argc;
@@ -2547,4 +2601,5 @@ START_TEST(virtual)
     test_IsBadWritePtr();
     test_IsBadCodePtr();
     test_write_watch();
+    test_virtual_perf();
 }
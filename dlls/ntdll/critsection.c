@@ -61,37 +61,6 @@ static inline void small_pause(void)
 
 #ifdef __linux__
 
-static int wait_op = 128; /*FUTEX_WAIT|FUTEX_PRIVATE_FLAG*/
-static int wake_op = 129; /*FUTEX_WAKE|FUTEX_PRIVATE_FLAG*/
-
-static inline int futex_wait( int *addr, int val, struct timespec *timeout )
-{
-    return syscall( __NR_futex, addr, wait_op, val, timeout, 0, 0 );
-}
-
-static inline int futex_wake( int *addr, int val )
-{
-    return syscall( __NR_futex, addr, wake_op, val, NULL, 0, 0 );
-}
-
-static inline int use_futexes(void)
-{
-    static int supported = -1;
-
-    if (supported == -1)
-    {
-        futex_wait( &supported, 10, NULL );
-        if (errno == ENOSYS)
-        {
-            wait_op = 0; /*FUTEX_WAIT*/
-            wake_op = 1; /*FUTEX_WAKE*/
-            futex_wait( &supported, 10, NULL );
-        }
-        supported = (errno != ENOSYS);
-    }
-    return supported;
-}
-
 static inline NTSTATUS fast_wait( RTL_CRITICAL_SECTION *crit, int timeout )
 {
     int val;
@@ -120,11 +89,6 @@ static inline NTSTATUS fast_wake( RTL_CRITICAL_SECTION *crit )
     return STATUS_SUCCESS;
 }
 
-static inline void close_semaphore( RTL_CRITICAL_SECTION *crit )
-{
-    if (!use_futexes()) NtClose( crit->LockSemaphore );
-}
-
 #elif defined(__APPLE__)
 
 #include <mach/mach.h>
@@ -193,11 +157,6 @@ static inline NTSTATUS fast_wake( RTL_CRITICAL_SECTION *crit )
     return STATUS_NOT_IMPLEMENTED;
 }
 
-static inline void close_semaphore( RTL_CRITICAL_SECTION *crit )
-{
-    NtClose( crit->LockSemaphore );
-}
-
 #endif
 
 /***********************************************************************
@@ -225,15 +184,19 @@ static inline NTSTATUS wait_semaphore( RTL_CRITICAL_SECTION *crit, int timeout )
 {
     NTSTATUS ret;
 
+    LARGE_INTEGER time;
+
+    time.QuadPart = timeout * (LONGLONG)-10000000;
+
     /* debug info is cleared by MakeCriticalSectionGlobal */
-    if (!crit->DebugInfo || ((ret = fast_wait( crit, timeout )) == STATUS_NOT_IMPLEMENTED))
+    if (!crit->DebugInfo)
     {
+        /* the section may be shared with other processes, use a real semaphore */
         HANDLE sem = get_semaphore( crit );
-        LARGE_INTEGER time;
-
-        time.QuadPart = timeout * (LONGLONG)-10000000;
         ret = NTDLL_wait_for_multiple_objects( 1, &sem, 0, &time, 0 );
     }
+    else if ((ret = fast_wait( crit, timeout )) == STATUS_NOT_IMPLEMENTED)
+        ret = NtWaitForKeyedEvent( 0, &crit->LockSemaphore, FALSE, &time );
     return ret;
 }
 
@@ -401,7 +364,10 @@ NTSTATUS WINAPI RtlDeleteCriticalSection( RTL_CRITICAL_SECTION *crit )
             RtlFreeHeap( GetProcessHeap(), 0, crit->DebugInfo );
             crit->DebugInfo = NULL;
         }
+#ifdef __APPLE__
+        /* a Mach semaphore isn't a handle, and the other waits don't allocate anything */
         close_semaphore( crit );
+#endif
     }
     else NtClose( crit->LockSemaphore );
     crit->LockSemaphore = 0;
@@ -498,11 +464,16 @@ NTSTATUS WINAPI RtlpUnWaitCriticalSection( RTL_CRITICAL_SECTION *crit )
     NTSTATUS ret;
 
     /* debug info is cleared by MakeCriticalSectionGlobal */
-    if (!crit->DebugInfo || ((ret = fast_wake( crit )) == STATUS_NOT_IMPLEMENTED))
+    if (!crit->DebugInfo)
     {
         HANDLE sem = get_semaphore( crit );
         ret = NtReleaseSemaphore( sem, 1, NULL );
     }
+    else if ((ret = fast_wake( crit )) == STATUS_NOT_IMPLEMENTED)
+    {
+        /* this blocks until the waiter that incremented LockCount shows up */
+        ret = NtReleaseKeyedEvent( 0, &crit->LockSemaphore, FALSE, NULL );
+    }
     if (ret) RtlRaiseStatus( ret );
     return ret;
 }
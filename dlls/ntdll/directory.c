@@ -157,6 +157,23 @@ union file_directory_info
     FILE_ID_FULL_DIRECTORY_INFORMATION id_full;
 };
 
+/* file name mask, preprocessed for the common patterns */
+enum dir_mask_type
+{
+    MASK_ANY,      /* matches everything */
+    MASK_PREFIX,   /* literal followed by '*' */
+    MASK_SUFFIX,   /* '*' followed by a literal */
+    MASK_GENERIC   /* anything else, handled by match_filename */
+};
+
+struct dir_mask
+{
+    const UNICODE_STRING *str;      /* original mask, NULL if none */
+    enum dir_mask_type    type;     /* type of pattern */
+    const WCHAR          *literal;  /* literal part of prefix and suffix masks */
+    unsigned int          len;      /* length of the literal in chars */
+};
+
 static int show_dot_files = -1;
 
 /* at some point we may want to allow Winelib apps to set this */
@@ -1250,6 +1267,122 @@ static BOOLEAN match_filename( const UNICODE_STRING *name_str, const UNICODE_STR
 }
 
 
+static inline int compare_mask_chars( const WCHAR *name, const WCHAR *mask, unsigned int len )
+{
+    if (is_case_sensitive) return memcmp( name, mask, len * sizeof(WCHAR) );
+    return memicmpW( name, mask, len );
+}
+
+/***********************************************************************
+ *           init_dir_mask
+ *
+ * Recognize the masks that can be matched without the generic algorithm.
+ * The fast paths must give the same results as match_filename.
+ */
+static void init_dir_mask( struct dir_mask *mask, const UNICODE_STRING *str )
+{
+    const WCHAR *buffer, *p, *end;
+    unsigned int i, len;
+
+    mask->str = str;
+    mask->type = MASK_GENERIC;
+    if (!str)
+    {
+        mask->type = MASK_ANY;
+        return;
+    }
+    buffer = str->Buffer;
+    len = str->Length / sizeof(WCHAR);
+    end = buffer + len;
+
+    for (p = buffer; p < end; p++) if (*p != '*') break;
+    if (len && p == end)
+    {
+        mask->type = MASK_ANY;
+        return;
+    }
+    if (len == 3 && buffer[0] == '*' && buffer[1] == '.' && buffer[2] == '*')
+    {
+        mask->type = MASK_ANY;
+        return;
+    }
+    if (memchrW( buffer, '?', len )) return;
+
+    if (len > 1 && buffer[0] == '*')
+    {
+        /* the literal can't end with a '.', which match_filename ignores, and its first
+         * char has to be unique since match_filename doesn't look for overlapping matches */
+        mask->literal = buffer + 1;
+        mask->len = len - 1;
+        if (memchrW( mask->literal, '*', mask->len )) return;
+        if (mask->literal[mask->len - 1] == '.') return;
+        for (i = 1; i < mask->len; i++)
+            if (!compare_mask_chars( mask->literal + i, mask->literal, 1 )) return;
+        mask->type = MASK_SUFFIX;
+    }
+    else if (len > 1 && end[-1] == '*')
+    {
+        while (end > buffer && end[-1] == '*') end--;
+        if (memchrW( buffer, '*', end - buffer )) return;
+        mask->literal = buffer;
+        mask->len = end - buffer;
+        mask->type = MASK_PREFIX;
+    }
+}
+
+/***********************************************************************
+ *           match_dir_mask
+ *
+ * Check a file name against a mask initialized with init_dir_mask.
+ */
+static BOOLEAN match_dir_mask( const struct dir_mask *mask, const UNICODE_STRING *name_str )
+{
+    const WCHAR *name = name_str->Buffer;
+    unsigned int i, len = name_str->Length / sizeof(WCHAR);
+
+    switch (mask->type)
+    {
+    case MASK_ANY:
+        return TRUE;
+    case MASK_PREFIX:
+        if (len >= mask->len) return !compare_mask_chars( name, mask->literal, mask->len );
+        if (compare_mask_chars( name, mask->literal, len )) return FALSE;
+        /* trailing '.' chars in the mask are ignored */
+        for (i = len; i < mask->len; i++) if (mask->literal[i] != '.') return FALSE;
+        return TRUE;
+    case MASK_SUFFIX:
+        if (len < mask->len) return FALSE;
+        return !compare_mask_chars( name + len - mask->len, mask->literal, mask->len );
+    default:
+        return match_filename( name_str, mask->str );
+    }
+}
+
+
+/***********************************************************************
+ *           get_entry_short_name
+ *
+ * Get the short name of a directory entry, generating it if the file system
+ * didn't provide one. Returns 0 if the long name is a valid short name.
+ */
+static int get_entry_short_name( const UNICODE_STRING *long_str, const char *short_name,
+                                 WCHAR *short_nameW )
+{
+    BOOLEAN spaces;
+    int len;
+
+    if (short_name)
+    {
+        len = ntdll_umbstowcs( 0, short_name, strlen(short_name), short_nameW, 12 );
+        if (len == -1) len = 12;
+        return len;
+    }
+    if (!RtlIsNameLegalDOS8Dot3( long_str, NULL, &spaces ) || spaces)
+        return hash_short_file_name( long_str, short_nameW );
+    return 0;
+}
+
+
 /***********************************************************************
  *           append_entry
  *
@@ -1257,10 +1390,10 @@ static BOOLEAN match_filename( const UNICODE_STRING *name_str, const UNICODE_STR
  */
 static union file_directory_info *append_entry( void *info_ptr, IO_STATUS_BLOCK *io, ULONG max_length,
                                                 const char *long_name, const char *short_name,
-                                                const UNICODE_STRING *mask, FILE_INFORMATION_CLASS class )
+                                                const struct dir_mask *mask, FILE_INFORMATION_CLASS class )
 {
     union file_directory_info *info;
-    int i, long_len, short_len, total_len;
+    int i, long_len, short_len = -1, total_len;
     struct stat st;
     WCHAR long_nameW[MAX_DIR_ENTRY_LEN];
     WCHAR short_nameW[12];
@@ -1276,31 +1409,16 @@ static union file_directory_info *append_entry( void *info_ptr, IO_STATUS_BLOCK
     str.Length = long_len * sizeof(WCHAR);
     str.MaximumLength = sizeof(long_nameW);
 
-    if (short_name)
-    {
-        short_len = ntdll_umbstowcs( 0, short_name, strlen(short_name),
-                                     short_nameW, sizeof(short_nameW) / sizeof(WCHAR) );
-        if (short_len == -1) short_len = sizeof(short_nameW) / sizeof(WCHAR);
-    }
-    else  /* generate a short name if necessary */
-    {
-        BOOLEAN spaces;
-
-        short_len = 0;
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
-            short_len = hash_short_file_name( &str, short_nameW );
-    }
-
-    TRACE( "long %s short %s mask %s\n",
-           debugstr_us(&str), debugstr_wn(short_nameW, short_len), debugstr_us(mask) );
+    TRACE( "long %s mask %s\n", debugstr_us(&str), debugstr_us(mask->str) );
 
-    if (mask && !match_filename( &str, mask ))
+    if (!match_dir_mask( mask, &str ))
     {
+        short_len = get_entry_short_name( &str, short_name, short_nameW );
         if (!short_len) return NULL;  /* no short name to match */
         str.Buffer = short_nameW;
         str.Length = short_len * sizeof(WCHAR);
         str.MaximumLength = sizeof(short_nameW);
-        if (!match_filename( &str, mask )) return NULL;
+        if (!match_dir_mask( mask, &str )) return NULL;
     }
 
     if (lstat( long_name, &st ) == -1) return NULL;
@@ -1351,6 +1469,7 @@ static union file_directory_info *append_entry( void *info_ptr, IO_STATUS_BLOCK
         break;
 
     case FileBothDirectoryInformation:
+        if (short_len == -1) short_len = get_entry_short_name( &str, short_name, short_nameW );
         info->both.EaSize = 0; /* FIXME */
         info->both.ShortNameLength = short_len * sizeof(WCHAR);
         for (i = 0; i < short_len; i++) info->both.ShortName[i] = toupperW(short_nameW[i]);
@@ -1359,6 +1478,7 @@ static union file_directory_info *append_entry( void *info_ptr, IO_STATUS_BLOCK
         break;
 
     case FileIdBothDirectoryInformation:
+        if (short_len == -1) short_len = get_entry_short_name( &str, short_name, short_nameW );
         info->id_both.EaSize = 0; /* FIXME */
         info->id_both.ShortNameLength = short_len * sizeof(WCHAR);
         for (i = 0; i < short_len; i++) info->id_both.ShortName[i] = toupperW(short_nameW[i]);
@@ -1424,7 +1544,7 @@ static KERNEL_DIRENT *start_vfat_ioctl( int fd )
  * Read a directory using the VFAT ioctl; helper for NtQueryDirectoryFile.
  */
 static int read_directory_vfat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                BOOLEAN single_entry, const UNICODE_STRING *mask,
+                                BOOLEAN single_entry, const struct dir_mask *mask,
                                 BOOLEAN restart_scan, FILE_INFORMATION_CLASS class )
 
 {
@@ -1536,7 +1656,7 @@ static char *read_first_dent_name( int which, int fd, off_t second_offs, KERNEL_
  * Read a directory using the Linux getdents64 system call; helper for NtQueryDirectoryFile.
  */
 static int read_directory_getdents( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                    BOOLEAN single_entry, const UNICODE_STRING *mask,
+                                    BOOLEAN single_entry, const struct dir_mask *mask,
                                     BOOLEAN restart_scan, FILE_INFORMATION_CLASS class )
 {
     static off_t second_entry_pos;
@@ -1730,7 +1850,7 @@ static inline int dir_reclen(struct dirent *de)
  * Read a directory using the BSD getdirentries system call; helper for NtQueryDirectoryFile.
  */
 static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                         BOOLEAN single_entry, const UNICODE_STRING *mask,
+                                         BOOLEAN single_entry, const struct dir_mask *mask,
                                          BOOLEAN restart_scan, FILE_INFORMATION_CLASS class )
 {
     long restart_pos;
@@ -1830,7 +1950,7 @@ static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buff
                 last_info = NULL;
                 goto restart;
             }
-            if (!has_wildcard( mask )) break;
+            if (!has_wildcard( mask->str )) break;
             /* if we have to return but the buffer contains more data, restart with a smaller size */
             if (res > 0 && (single_entry || io->Information + max_dir_info_size(class) > length))
             {
@@ -1880,7 +2000,7 @@ done:
  * Read a directory using the POSIX readdir interface; helper for NtQueryDirectoryFile.
  */
 static void read_directory_readdir( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                    BOOLEAN single_entry, const UNICODE_STRING *mask,
+                                    BOOLEAN single_entry, const struct dir_mask *mask,
                                     BOOLEAN restart_scan, FILE_INFORMATION_CLASS class )
 {
     DIR *dir;
@@ -1954,23 +2074,24 @@ static void read_directory_readdir( int fd, IO_STATUS_BLOCK *io, void *buffer, U
  * identified by mask exists using stat.
  */
 static int read_directory_stat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                BOOLEAN single_entry, const UNICODE_STRING *mask,
+                                BOOLEAN single_entry, const struct dir_mask *mask,
                                 BOOLEAN restart_scan, FILE_INFORMATION_CLASS class )
 {
     int unix_len, ret, used_default;
     char *unix_name;
     struct stat st;
 
-    TRACE("trying optimisation for file %s\n", debugstr_us( mask ));
+    TRACE("trying optimisation for file %s\n", debugstr_us( mask->str ));
 
-    unix_len = ntdll_wcstoumbs( 0, mask->Buffer, mask->Length / sizeof(WCHAR), NULL, 0, NULL, NULL );
+    unix_len = ntdll_wcstoumbs( 0, mask->str->Buffer, mask->str->Length / sizeof(WCHAR),
+                                NULL, 0, NULL, NULL );
     if (!(unix_name = RtlAllocateHeap( GetProcessHeap(), 0, unix_len + 1)))
     {
         io->u.Status = STATUS_NO_MEMORY;
         return 0;
     }
-    ret = ntdll_wcstoumbs( 0, mask->Buffer, mask->Length / sizeof(WCHAR), unix_name, unix_len,
-                           NULL, &used_default );
+    ret = ntdll_wcstoumbs( 0, mask->str->Buffer, mask->str->Length / sizeof(WCHAR),
+                           unix_name, unix_len, NULL, &used_default );
     if (ret > 0 && !used_default)
     {
         unix_name[ret] = 0;
@@ -2021,6 +2142,7 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
                                       PUNICODE_STRING mask,
                                       BOOLEAN restart_scan )
 {
+    struct dir_mask dir_mask;
     int cwd, fd, needs_close;
 
     TRACE("(%p %p %p %p %p %p 0x%08x 0x%08x 0x%08x %s 0x%08x\n",
@@ -2052,6 +2174,7 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
         return io->u.Status;
 
     io->Information = 0;
+    init_dir_mask( &dir_mask, mask );
 
     RtlEnterCriticalSection( &dir_section );
 
@@ -2066,19 +2189,19 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
         curdir.ino = st.st_ino;
 #ifdef VFAT_IOCTL_READDIR_BOTH
         if ((read_directory_vfat( fd, io, buffer, length, single_entry,
-                                  mask, restart_scan, info_class )) != -1) goto done;
+                                  &dir_mask, restart_scan, info_class )) != -1) goto done;
 #endif
         if (!has_wildcard( mask ) &&
             read_directory_stat( fd, io, buffer, length, single_entry,
-                                 mask, restart_scan, info_class ) != -1) goto done;
+                                 &dir_mask, restart_scan, info_class ) != -1) goto done;
 #ifdef USE_GETDENTS
         if ((read_directory_getdents( fd, io, buffer, length, single_entry,
-                                      mask, restart_scan, info_class )) != -1) goto done;
+                                      &dir_mask, restart_scan, info_class )) != -1) goto done;
 #elif defined HAVE_GETDIRENTRIES
         if ((read_directory_getdirentries( fd, io, buffer, length, single_entry,
-                                           mask, restart_scan, info_class )) != -1) goto done;
+                                           &dir_mask, restart_scan, info_class )) != -1) goto done;
 #endif
-        read_directory_readdir( fd, io, buffer, length, single_entry, mask, restart_scan, info_class );
+        read_directory_readdir( fd, io, buffer, length, single_entry, &dir_mask, restart_scan, info_class );
 
     done:
         if (cwd == -1 || fchdir( cwd ) == -1) chdir( "/" );
@@ -2094,6 +2217,248 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
+/* cached directory listing, used to speed up the case-insensitive lookups */
+struct dir_cache_node
+{
+    struct dir_cache_node *next;       /* next node in the hash chain */
+    const WCHAR           *name;       /* Unicode name, long or hashed short one */
+    unsigned int           len;        /* length of the name in chars */
+    BOOL                   is_short;   /* is it a hashed short name? */
+    const char            *unix_name;  /* Unix name of the entry */
+};
+
+struct dir_cache_name
+{
+    struct dir_cache_name *next;              /* next name in the directory */
+    struct dir_cache_node  long_node;         /* hash node for the long name */
+    struct dir_cache_node  short_node;        /* hash node for the hashed short name */
+    WCHAR                  short_name[12];    /* hashed short name, if the long name isn't 8.3 */
+    WCHAR                  long_name[1];      /* long name, followed by the Unix name */
+};
+
+struct dir_cache
+{
+    struct list             entry;      /* entry in the LRU list of cached directories */
+    dev_t                   dev;        /* directory identity */
+    ino_t                   ino;
+    time_t                  mtime;      /* modification time of the directory when it was read */
+    off_t                   size;       /* size of the directory when it was read */
+    BOOL                    temporary;  /* listing too recent to be kept in the cache */
+    struct dir_cache_name  *names;      /* list of names in the directory */
+    unsigned int            hash_size;  /* size of the hash table, a power of 2 */
+    struct dir_cache_node **hash;       /* hash table of the long and short names */
+};
+
+#define MAX_DIR_CACHE 32  /* max number of cached directory listings */
+
+static struct list dir_cache_list = LIST_INIT( dir_cache_list );
+static unsigned int dir_cache_count;
+
+static RTL_CRITICAL_SECTION dir_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG dir_cache_critsect_debug =
+{
+    0, 0, &dir_cache_section,
+    { &dir_cache_critsect_debug.ProcessLocksList, &dir_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dir_cache_section") }
+};
+static RTL_CRITICAL_SECTION dir_cache_section = { &dir_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
+/* case-insensitive hash of a Unicode name */
+static inline unsigned int hash_dir_cache_name( const WCHAR *name, unsigned int len )
+{
+    unsigned int i, hash = 0;
+
+    for (i = 0; i < len; i++) hash = hash * 65599 + toupperW( name[i] );
+    return hash;
+}
+
+static void add_dir_cache_node( struct dir_cache *cache, struct dir_cache_node *node )
+{
+    unsigned int idx = hash_dir_cache_name( node->name, node->len ) & (cache->hash_size - 1);
+
+    node->next = cache->hash[idx];
+    cache->hash[idx] = node;
+}
+
+static void free_dir_cache( struct dir_cache *cache )
+{
+    struct dir_cache_name *name, *next;
+
+    for (name = cache->names; name; name = next)
+    {
+        next = name->next;
+        RtlFreeHeap( GetProcessHeap(), 0, name );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, cache->hash );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+/* read a directory listing; it is kept in the cache unless it was modified too recently
+ * for a later modification to be guaranteed to change its mtime */
+static struct dir_cache *read_dir_cache( const char *unix_name, const struct stat *st, NTSTATUS *status )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache *cache;
+    struct dir_cache_name *name;
+    struct dirent *de;
+    UNICODE_STRING str;
+    BOOLEAN spaces;
+    unsigned int count = 0;
+    LARGE_INTEGER now;
+    ULONG now_secs;
+    int len, unix_len;
+    DIR *dir;
+
+    if (!(dir = opendir( unix_name )))
+    {
+        *status = (errno == ENOENT) ? STATUS_OBJECT_PATH_NOT_FOUND : FILE_GetNtStatus();
+        return NULL;
+    }
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache) )))
+    {
+        closedir( dir );
+        *status = STATUS_NO_MEMORY;
+        return NULL;
+    }
+    cache->dev   = st->st_dev;
+    cache->ino   = st->st_ino;
+    cache->mtime = st->st_mtime;
+    cache->size  = st->st_size;
+
+    while ((de = readdir( dir )))
+    {
+        len = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        unix_len = strlen( de->d_name ) + 1;
+        if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, FIELD_OFFSET( struct dir_cache_name,
+                                                                      long_name[len] ) + unix_len )))
+        {
+            closedir( dir );
+            free_dir_cache( cache );
+            *status = STATUS_NO_MEMORY;
+            return NULL;
+        }
+        memcpy( name->long_name, buffer, len * sizeof(WCHAR) );
+        memcpy( name->long_name + len, de->d_name, unix_len );
+        name->long_node.name      = name->long_name;
+        name->long_node.len       = len;
+        name->long_node.is_short  = FALSE;
+        name->long_node.unix_name = (const char *)(name->long_name + len);
+        name->short_node.len      = 0;
+
+        str.Buffer = buffer;
+        str.Length = str.MaximumLength = len * sizeof(WCHAR);
+        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
+        {
+            name->short_node.name      = name->short_name;
+            name->short_node.len       = hash_short_file_name( &str, name->short_name );
+            name->short_node.is_short  = TRUE;
+            name->short_node.unix_name = name->long_node.unix_name;
+        }
+        name->next = cache->names;
+        cache->names = name;
+        count++;
+    }
+    closedir( dir );
+
+    cache->hash_size = 16;
+    while (cache->hash_size < 2 * count) cache->hash_size *= 2;
+    if (!(cache->hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                         cache->hash_size * sizeof(*cache->hash) )))
+    {
+        free_dir_cache( cache );
+        *status = STATUS_NO_MEMORY;
+        return NULL;
+    }
+    for (name = cache->names; name; name = name->next)
+    {
+        add_dir_cache_node( cache, &name->long_node );
+        if (name->short_node.len) add_dir_cache_node( cache, &name->short_node );
+    }
+
+    /* the mtime granularity can be as coarse as a second */
+    NtQuerySystemTime( &now );
+    RtlTimeToSecondsSince1970( &now, &now_secs );
+    if (cache->mtime >= (time_t)now_secs - 1) cache->temporary = TRUE;
+    else
+    {
+        list_add_head( &dir_cache_list, &cache->entry );
+        if (++dir_cache_count > MAX_DIR_CACHE)
+        {
+            struct dir_cache *old = LIST_ENTRY( list_tail( &dir_cache_list ), struct dir_cache, entry );
+            list_remove( &old->entry );
+            free_dir_cache( old );
+            dir_cache_count--;
+        }
+    }
+    return cache;
+}
+
+/* get the cached listing of a directory, reading it if needed */
+static struct dir_cache *get_dir_cache( const char *unix_name, NTSTATUS *status )
+{
+    struct dir_cache *cache;
+    struct stat st;
+
+    if (stat( unix_name, &st ) == -1)
+    {
+        *status = (errno == ENOENT) ? STATUS_OBJECT_PATH_NOT_FOUND : FILE_GetNtStatus();
+        return NULL;
+    }
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_cache_list, struct dir_cache, entry )
+    {
+        if (cache->dev != st.st_dev || cache->ino != st.st_ino) continue;
+        list_remove( &cache->entry );
+        if (cache->mtime == st.st_mtime && cache->size == st.st_size)
+        {
+            list_add_head( &dir_cache_list, &cache->entry );
+            return cache;
+        }
+        /* the directory has been modified, read it again */
+        free_dir_cache( cache );
+        dir_cache_count--;
+        break;
+    }
+    return read_dir_cache( unix_name, &st, status );
+}
+
+/***********************************************************************
+ *           find_file_in_dir_cache
+ *
+ * Case-insensitive search of a file in the cached directory listing.
+ * unix_name contains the directory name, the file found is appended at pos.
+ */
+static NTSTATUS find_file_in_dir_cache( char *unix_name, int pos, const WCHAR *name, int length,
+                                        BOOL check_short )
+{
+    struct dir_cache *cache;
+    struct dir_cache_node *node, *found = NULL;
+    NTSTATUS status = STATUS_OBJECT_PATH_NOT_FOUND;
+
+    RtlEnterCriticalSection( &dir_cache_section );
+    if ((cache = get_dir_cache( unix_name, &status )))
+    {
+        node = cache->hash[hash_dir_cache_name( name, length ) & (cache->hash_size - 1)];
+        for ( ; node; node = node->next)
+        {
+            if (node->len != length || memicmpW( node->name, name, length )) continue;
+            if (node->is_short && !check_short) continue;
+            found = node;
+            if (!node->is_short) break;  /* long names take precedence */
+        }
+        if (found)
+        {
+            unix_name[pos - 1] = '/';
+            strcpy( unix_name + pos, found->unix_name );
+            status = STATUS_SUCCESS;
+        }
+        if (cache->temporary) free_dir_cache( cache );
+    }
+    RtlLeaveCriticalSection( &dir_cache_section );
+    return status;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2107,9 +2472,8 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     WCHAR buffer[MAX_DIR_ENTRY_LEN];
     UNICODE_STRING str;
     BOOLEAN spaces;
-    DIR *dir;
-    struct dirent *de;
     struct stat st;
+    NTSTATUS status;
     int ret, used_default, is_name_8_dot_3;
 
     /* try a shortcut for this directory */
@@ -2201,40 +2565,9 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
-    if (!(dir = opendir( unix_name )))
-    {
-        if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
-        else return FILE_GetNtStatus();
-    }
-    unix_name[pos - 1] = '/';
-    str.Buffer = buffer;
-    str.MaximumLength = sizeof(buffer);
-    while ((de = readdir( dir )))
-    {
-        ret = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
-        if (ret == length && !memicmpW( buffer, name, length ))
-        {
-            strcpy( unix_name + pos, de->d_name );
-            closedir( dir );
-            goto success;
-        }
-
-        if (!is_name_8_dot_3) continue;
-
-        str.Length = ret * sizeof(WCHAR);
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
-        {
-            WCHAR short_nameW[12];
-            ret = hash_short_file_name( &str, short_nameW );
-            if (ret == length && !memicmpW( short_nameW, name, length ))
-            {
-                strcpy( unix_name + pos, de->d_name );
-                closedir( dir );
-                goto success;
-            }
-        }
-    }
-    closedir( dir );
+    if (!(status = find_file_in_dir_cache( unix_name, pos, name, length, is_name_8_dot_3 )))
+        goto success;
+    if (status != STATUS_OBJECT_PATH_NOT_FOUND) return status;
 
 not_found:
     unix_name[pos - 1] = 0;
@@ -2885,6 +3218,253 @@ NTSTATUS nt_to_unix_file_name_attr( const OBJECT_ATTRIBUTES *attr, ANSI_STRING *
 }
 
 
+/* cache of the NT to Unix file name translations; the entries are checked against the identity
+ * and mtime of the directory that contains the file, or where the lookup failed, and the whole
+ * cache is flushed when a DOS device is defined or removed */
+struct path_cache_entry
+{
+    struct list  entry;        /* entry in the LRU list */
+    struct list  hash_entry;   /* entry in the hash table */
+    unsigned int hash;         /* hash of the NT name */
+    UINT         disposition;  /* disposition of the lookup */
+    BOOLEAN      check_case;   /* was the lookup case-sensitive? */
+    BOOLEAN      redirect;     /* was the Wow64 redirection enabled? */
+    NTSTATUS     status;       /* result of the lookup */
+    dev_t        dev;          /* identity of the directory */
+    ino_t        ino;
+    time_t       mtime;
+    off_t        size;
+    char        *dir_name;     /* directory containing the file, or where the lookup failed */
+    int          unix_len;     /* allocated size of the returned Unix name */
+    char        *unix_name;    /* Unix name returned by the lookup */
+    unsigned int name_len;     /* length of the NT name in chars */
+    WCHAR        name[1];      /* NT name */
+};
+
+#define PATH_CACHE_HASH_SIZE 256
+#define MAX_PATH_CACHE       1024  /* max number of cached translations */
+
+static struct list path_cache_lru = LIST_INIT( path_cache_lru );
+static struct list path_cache_hash[PATH_CACHE_HASH_SIZE];
+static unsigned int path_cache_count;
+static char *dosdevices_dir;           /* directory of the DOS device symlinks */
+static dev_t dosdevices_dev;           /* identity of the DOS devices directory when the cache was filled */
+static ino_t dosdevices_ino;
+static time_t dosdevices_mtime;
+static unsigned int path_cache_generation;  /* incremented when the cache is flushed */
+
+static RTL_CRITICAL_SECTION path_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG path_cache_critsect_debug =
+{
+    0, 0, &path_cache_section,
+    { &path_cache_critsect_debug.ProcessLocksList, &path_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": path_cache_section") }
+};
+static RTL_CRITICAL_SECTION path_cache_section = { &path_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
+static struct list *get_path_cache_bucket( unsigned int hash )
+{
+    if (!path_cache_hash[0].next)
+    {
+        unsigned int i;
+        for (i = 0; i < PATH_CACHE_HASH_SIZE; i++) list_init( &path_cache_hash[i] );
+    }
+    return &path_cache_hash[hash % PATH_CACHE_HASH_SIZE];
+}
+
+static inline unsigned int hash_nt_name( const UNICODE_STRING *name )
+{
+    unsigned int i, hash = 0;
+
+    for (i = 0; i < name->Length / sizeof(WCHAR); i++) hash = hash * 65599 + name->Buffer[i];
+    return hash;
+}
+
+static void free_path_cache_entry( struct path_cache_entry *cache )
+{
+    list_remove( &cache->entry );
+    list_remove( &cache->hash_entry );
+    path_cache_count--;
+    RtlFreeHeap( GetProcessHeap(), 0, cache->unix_name );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->dir_name );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+/* a recent mtime doesn't guarantee that a later change would modify it */
+static BOOL is_recent_mtime( time_t mtime )
+{
+    LARGE_INTEGER now;
+    ULONG now_secs;
+
+    NtQuerySystemTime( &now );
+    RtlTimeToSecondsSince1970( &now, &now_secs );
+    return mtime >= (time_t)now_secs - 1;
+}
+
+/* flush the cache if a DOS device was defined or removed since it was filled;
+ * returns FALSE if the cache can't be used. Must be called with the lock held. */
+static BOOL check_dos_devices(void)
+{
+    struct list *ptr;
+    struct stat st;
+
+    if (!dosdevices_dir)
+    {
+        const char *config_dir = wine_get_config_dir();
+
+        if (!(dosdevices_dir = RtlAllocateHeap( GetProcessHeap(), 0,
+                                                strlen(config_dir) + sizeof("/dosdevices") )))
+            return FALSE;
+        strcpy( dosdevices_dir, config_dir );
+        strcat( dosdevices_dir, "/dosdevices" );
+    }
+    if (stat( dosdevices_dir, &st )) return FALSE;
+
+    if (st.st_dev != dosdevices_dev || st.st_ino != dosdevices_ino || st.st_mtime != dosdevices_mtime)
+    {
+        while ((ptr = list_head( &path_cache_lru )))
+            free_path_cache_entry( LIST_ENTRY( ptr, struct path_cache_entry, entry ));
+        dosdevices_dev   = st.st_dev;
+        dosdevices_ino   = st.st_ino;
+        dosdevices_mtime = st.st_mtime;
+        path_cache_generation++;
+    }
+    return !is_recent_mtime( st.st_mtime );
+}
+
+/* check that a cached translation is still valid */
+static BOOL is_path_cache_valid( const struct path_cache_entry *cache )
+{
+    struct stat st;
+
+    return (!stat( cache->dir_name, &st ) && st.st_dev == cache->dev && st.st_ino == cache->ino &&
+            st.st_mtime == cache->mtime && st.st_size == cache->size);
+}
+
+/* look up a cached translation; returns STATUS_MORE_PROCESSING_REQUIRED if not found, and the
+ * generation of the cache that the result of the lookup has to be added to */
+static NTSTATUS get_path_cache( const UNICODE_STRING *nameW, UINT disposition, BOOLEAN check_case,
+                                BOOLEAN redirect, ANSI_STRING *unix_name_ret,
+                                unsigned int *generation )
+{
+    unsigned int hash = hash_nt_name( nameW );
+    struct path_cache_entry *cache;
+    NTSTATUS status = STATUS_MORE_PROCESSING_REQUIRED;
+    BOOL usable;
+
+    RtlEnterCriticalSection( &path_cache_section );
+    usable = check_dos_devices();
+    *generation = path_cache_generation;
+    if (!usable)
+    {
+        RtlLeaveCriticalSection( &path_cache_section );
+        return status;
+    }
+    LIST_FOR_EACH_ENTRY( cache, get_path_cache_bucket( hash ), struct path_cache_entry, hash_entry )
+    {
+        if (cache->hash != hash || cache->disposition != disposition ||
+            cache->check_case != check_case || cache->redirect != redirect ||
+            cache->name_len != nameW->Length / sizeof(WCHAR) ||
+            memcmp( cache->name, nameW->Buffer, nameW->Length ))
+            continue;
+
+        if (!is_path_cache_valid( cache ))
+        {
+            free_path_cache_entry( cache );
+            break;
+        }
+        list_remove( &cache->entry );
+        list_add_head( &path_cache_lru, &cache->entry );
+
+        status = cache->status;
+        if (status == STATUS_SUCCESS || status == STATUS_NO_SUCH_FILE)
+        {
+            if (!(unix_name_ret->Buffer = RtlAllocateHeap( GetProcessHeap(), 0, cache->unix_len )))
+                status = STATUS_NO_MEMORY;
+            else
+            {
+                strcpy( unix_name_ret->Buffer, cache->unix_name );
+                unix_name_ret->Length = strlen( cache->unix_name );
+                unix_name_ret->MaximumLength = cache->unix_len;
+            }
+        }
+        break;
+    }
+    RtlLeaveCriticalSection( &path_cache_section );
+    return status;
+}
+
+/* add the result of a lookup to the cache */
+static void add_path_cache( const UNICODE_STRING *nameW, UINT disposition, BOOLEAN check_case,
+                            BOOLEAN redirect, unsigned int generation, NTSTATUS status,
+                            const char *unix_name, int unix_len )
+{
+    struct path_cache_entry *cache;
+    char *dir_name, *p;
+    struct stat st;
+
+    if (status != STATUS_SUCCESS && status != STATUS_NO_SUCH_FILE &&
+        status != STATUS_OBJECT_NAME_NOT_FOUND && status != STATUS_OBJECT_PATH_NOT_FOUND)
+        return;
+
+    /* the Unix name is the file that was found, the directory that was searched,
+     * or the name that would be created in it */
+    if (!(dir_name = RtlAllocateHeap( GetProcessHeap(), 0, strlen(unix_name) + 1 ))) return;
+    strcpy( dir_name, unix_name );
+    st.st_mode = 0;
+    if ((status == STATUS_SUCCESS || stat( dir_name, &st ) || !S_ISDIR( st.st_mode )) &&
+        (p = strrchr( dir_name, '/' )))
+    {
+        if (p == dir_name) p++;  /* keep the root directory */
+        *p = 0;
+        if (stat( dir_name, &st )) st.st_mode = 0;
+    }
+    if (!S_ISDIR( st.st_mode ) || is_recent_mtime( st.st_mtime )) goto failed;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), 0, FIELD_OFFSET( struct path_cache_entry,
+                                                                      name[nameW->Length / sizeof(WCHAR)] ))))
+        goto failed;
+    if (!(cache->unix_name = RtlAllocateHeap( GetProcessHeap(), 0, strlen(unix_name) + 1 )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, cache );
+        goto failed;
+    }
+    strcpy( cache->unix_name, unix_name );
+    cache->unix_len    = max( unix_len, strlen(unix_name) + 1 );
+    cache->hash        = hash_nt_name( nameW );
+    cache->disposition = disposition;
+    cache->check_case  = check_case;
+    cache->redirect    = redirect;
+    cache->status      = status;
+    cache->dir_name    = dir_name;
+    cache->dev         = st.st_dev;
+    cache->ino         = st.st_ino;
+    cache->mtime       = st.st_mtime;
+    cache->size        = st.st_size;
+    cache->name_len    = nameW->Length / sizeof(WCHAR);
+    memcpy( cache->name, nameW->Buffer, nameW->Length );
+
+    RtlEnterCriticalSection( &path_cache_section );
+    /* a DOS device may have changed while the name was looked up */
+    if (!check_dos_devices() || generation != path_cache_generation)
+    {
+        RtlLeaveCriticalSection( &path_cache_section );
+        RtlFreeHeap( GetProcessHeap(), 0, cache->unix_name );
+        RtlFreeHeap( GetProcessHeap(), 0, cache );
+        goto failed;
+    }
+    list_add_head( &path_cache_lru, &cache->entry );
+    list_add_head( get_path_cache_bucket( cache->hash ), &cache->hash_entry );
+    if (++path_cache_count > MAX_PATH_CACHE)
+        free_path_cache_entry( LIST_ENTRY( list_tail( &path_cache_lru ), struct path_cache_entry, entry ));
+    RtlLeaveCriticalSection( &path_cache_section );
+    return;
+
+failed:
+    RtlFreeHeap( GetProcessHeap(), 0, dir_name );
+}
+
+
 /******************************************************************************
  *           wine_nt_to_unix_file_name  (NTDLL.@) Not a Windows API
  *
@@ -2908,6 +3488,8 @@ NTSTATUS CDECL wine_nt_to_unix_file_name( const UNICODE_STRING *nameW, ANSI_STRI
     int pos, ret, name_len, unix_len, prefix_len, used_default;
     WCHAR prefix[MAX_DIR_ENTRY_LEN];
     BOOLEAN is_unix = FALSE;
+    BOOLEAN redirect;
+    unsigned int generation = 0;
 
     name     = nameW->Buffer;
     name_len = nameW->Length / sizeof(WCHAR);
@@ -2953,6 +3535,17 @@ NTSTATUS CDECL wine_nt_to_unix_file_name( const UNICODE_STRING *nameW, ANSI_STRI
             if (*p < 32 || strchrW( invalid_charsW, *p )) return STATUS_OBJECT_NAME_INVALID;
     }
 
+    /* creating a file is about to change the result anyway */
+    redirect = nb_redirects && ntdll_get_thread_data()->wow64_redir;
+    if (disposition != FILE_CREATE &&
+        (status = get_path_cache( nameW, disposition, check_case, redirect, unix_name_ret,
+                                  &generation )) !=
+        STATUS_MORE_PROCESSING_REQUIRED)
+    {
+        TRACE( "%s -> %x (cached)\n", debugstr_us(nameW), status );
+        return status;
+    }
+
     unix_len = ntdll_wcstoumbs( 0, prefix, prefix_len, NULL, 0, NULL, NULL );
     unix_len += ntdll_wcstoumbs( 0, name, name_len, NULL, 0, NULL, NULL );
     unix_len += MAX_DIR_ENTRY_LEN + 3;
@@ -2989,6 +3582,9 @@ NTSTATUS CDECL wine_nt_to_unix_file_name( const UNICODE_STRING *nameW, ANSI_STRI
     }
 
     status = lookup_unix_name( name, name_len, &unix_name, unix_len, pos, disposition, check_case );
+    if (disposition != FILE_CREATE)
+        add_path_cache( nameW, disposition, check_case, redirect, generation, status,
+                        unix_name, unix_len );
     if (status == STATUS_SUCCESS || status == STATUS_NO_SUCH_FILE)
     {
         TRACE( "%s -> %s\n", debugstr_us(nameW), debugstr_a(unix_name) );
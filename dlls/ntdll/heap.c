@@ -46,6 +46,7 @@
 #include "wine/server.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(heap);
+WINE_DECLARE_DEBUG_CHANNEL(heapstats);
 
 /* Note: the heap data structures are loosely based on what Pietrek describes in his
  * book 'Windows 95 System Programming Secrets', with some adaptations for
@@ -86,6 +87,8 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_LFH_MAGIC        0x48464c
+#define ARENA_LFH_FREE_MAGIC   0x46464c
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -143,6 +146,79 @@ typedef struct tagSUBHEAP
 
 #define SUBHEAP_MAGIC    ((DWORD)('S' | ('U'<<8) | ('B'<<16) | ('H'<<24)))
 
+/* Low-fragmentation heap front-end
+ *
+ * Small blocks are carved out of chunks of equally sized slots, the chunks
+ * being regular blocks allocated from the heap itself. The free slots are
+ * kept on lock-free lists, one per size class for each group of threads, so
+ * that most allocations and frees don't need to take the heap lock.
+ * Each slot starts with an in-use arena with a special magic, the size
+ * field holding the size of the user data and the unused_bytes field the
+ * size class. The chunks are only released when the heap is destroyed.
+ */
+
+#define LFH_NB_CLASSES       40      /* number of size classes */
+#define LFH_MAX_BLOCK_SIZE   0x4000  /* largest slot handled by the front-end */
+#define LFH_CHUNK_SIZE       0x8000  /* minimum size of the chunks */
+#define LFH_NB_AFFINITIES    16      /* number of thread groups */
+#define LFH_MIN_BLOCK_SIZE   (sizeof(ARENA_INUSE) + sizeof(SLIST_ENTRY))
+
+typedef struct
+{
+    SLIST_HEADER     free_list[LFH_NB_CLASSES];  /* free slots of each size class */
+    void            *alignment[8];               /* avoid false sharing between groups */
+} LFH_AFFINITY;
+
+typedef struct
+{
+    LFH_AFFINITY     affinity[LFH_NB_AFFINITIES];
+} LFH_HEAP;
+
+/* Allocation statistics, enabled with WINEDEBUG=+heapstats
+ *
+ * Every allocation updates the counters, and roughly one allocation out of
+ * HEAP_STATS_SAMPLE_SIZE bytes records its backtrace, so that the blocks that
+ * are never freed can be tracked down. The records are allocated from separate
+ * virtual memory to avoid any interference with the heap being profiled.
+ */
+
+#define HEAP_STATS_SAMPLE_SIZE  0x10000  /* average number of bytes between samples */
+#define HEAP_STATS_HASH_SIZE    1021     /* size of the samples and traces hash tables */
+#define HEAP_STATS_AREA_SIZE    0x10000  /* size of the memory areas for the records */
+
+struct heap_trace
+{
+    struct heap_trace  *next;        /* next trace in hash bucket */
+    ULONG               hash;        /* hash of the frames */
+    WINE_HEAP_TRACE     info;        /* data returned by RtlQueryHeapInformation */
+};
+
+struct heap_backtrace
+{
+    ULONG               count;       /* number of frames */
+    ULONG               hash;        /* hash of the frames */
+    void               *frames[WINE_HEAP_TRACE_FRAMES];
+};
+
+struct heap_sample
+{
+    struct heap_sample *next;        /* next sample in hash bucket */
+    const void         *ptr;         /* sampled block */
+    SIZE_T              size;        /* size of the block */
+    struct heap_trace  *trace;       /* backtrace of the allocation */
+};
+
+typedef struct
+{
+    WINE_HEAP_STATISTICS info;       /* counters returned by RtlQueryHeapInformation */
+    SIZE_T               sample_pos; /* bytes allocated since the last sample */
+    struct heap_sample  *samples[HEAP_STATS_HASH_SIZE];  /* sampled blocks still allocated */
+    struct heap_trace   *traces[HEAP_STATS_HASH_SIZE];   /* backtraces of the samples */
+    struct heap_sample  *free_samples; /* free sample records */
+    void                *area;       /* current area for the records, linked to the previous ones */
+    char                *area_pos;   /* free space in the current area */
+} HEAP_STATS;
+
 typedef struct tagHEAP
 {
     DWORD_PTR        unknown1[2];
@@ -159,6 +235,8 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    LFH_HEAP        *lfh;           /* Low-fragmentation front-end, if enabled */
+    HEAP_STATS      *stats;         /* Allocation statistics, if enabled */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -173,6 +251,10 @@ typedef struct tagHEAP
 #define HEAP_VALIDATE_ALL     0x20000000
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
+/* heap flags that bypass the low-fragmentation front-end */
+#define HEAP_LFH_DISABLE_FLAGS (HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED | \
+                                HEAP_PAGE_ALLOCS | HEAP_VALIDATE | HEAP_SHARED)
+
 static HEAP *processHeap;  /* main process heap */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
@@ -658,10 +740,12 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
     if ((char *)pFree + size < (char *)subheap->base + subheap->size)
         return;  /* Not the last block, so nothing more to do */
 
-    /* Free the whole sub-heap if it's empty and not the original one */
+    /* Free the whole sub-heap if it's empty and not the original one; the
+     * low-fragmentation front-end walks the subheaps without the heap lock,
+     * so they have to stay once it's enabled */
 
     if (((char *)pFree == (char *)subheap->base + subheap->headerSize) &&
-        (subheap != &subheap->heap->subheap))
+        (subheap != &subheap->heap->subheap) && !subheap->heap->lfh)
     {
         void *addr = subheap->base;
 
@@ -905,7 +989,12 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         subheap->commitSize = commitSize;
         subheap->magic      = SUBHEAP_MAGIC;
         subheap->headerSize = ROUND_SIZE( sizeof(SUBHEAP) );
-        list_add_head( &heap->subheap_list, &subheap->entry );
+        /* like list_add_head, but make sure the entry is complete before it can be
+         * seen by the low-fragmentation front-end, which doesn't take the heap lock */
+        subheap->entry.next = heap->subheap_list.next;
+        subheap->entry.prev = &heap->subheap_list;
+        heap->subheap_list.next->prev = &subheap->entry;
+        interlocked_xchg_ptr( (void **)&heap->subheap_list.next, &subheap->entry );
     }
     else
     {
@@ -1307,6 +1396,260 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
 }
 
 
+/***********************************************************************
+ *           get_lfh_class
+ *
+ * Get the size class of a block of the given total size, including the arena.
+ * Classes go by 16 bytes up to 256, and by quarters of powers of two above.
+ */
+static inline unsigned int get_lfh_class( SIZE_T total )
+{
+    unsigned int bits;
+
+    if (total <= 256) return (total - 1) / 16;
+    for (bits = 8; (total - 1) >> (bits + 1); bits++) /* nothing */;
+    return 16 + (bits - 8) * 4 + (((total - 1) >> (bits - 2)) & 3);
+}
+
+
+/***********************************************************************
+ *           get_lfh_class_size
+ *
+ * Get the total slot size of a size class.
+ */
+static inline SIZE_T get_lfh_class_size( unsigned int class )
+{
+    if (class < 16) return (class + 1) * 16;
+    class -= 16;
+    return (SIZE_T)(5 + class % 4) << (6 + class / 4);
+}
+
+
+/***********************************************************************
+ *           get_lfh_affinity
+ *
+ * Get the group of free lists used by the current thread.
+ */
+static inline LFH_AFFINITY *get_lfh_affinity( LFH_HEAP *lfh )
+{
+    ULONG tid = HandleToULong( NtCurrentTeb()->ClientId.UniqueThread );
+    return &lfh->affinity[(tid / 4) % LFH_NB_AFFINITIES];
+}
+
+
+/***********************************************************************
+ *           get_lfh_block
+ *
+ * Return the arena of a block if it was allocated by the low-fragmentation front-end.
+ */
+static inline ARENA_INUSE *get_lfh_block( const HEAP *heap, const void *ptr )
+{
+    ARENA_INUSE *arena = (ARENA_INUSE *)ptr - 1;
+    const SUBHEAP *subheap;
+
+    if (!heap->lfh || (ULONG_PTR)ptr % ALIGNMENT) return NULL;
+    /* make sure the arena can be read; chunks are too small to be large blocks */
+    if (!(subheap = HEAP_FindSubHeap( heap, arena ))) return NULL;
+    if ((const char *)ptr > (const char *)subheap->base + subheap->commitSize) return NULL;
+    if (arena->magic != ARENA_LFH_MAGIC || arena->unused_bytes >= LFH_NB_CLASSES) return NULL;
+    return arena;
+}
+
+
+/***********************************************************************
+ *           grow_lfh_class
+ *
+ * Allocate a new chunk for a size class, and return its first slot.
+ */
+static SLIST_ENTRY *grow_lfh_class( HEAP *heap, LFH_AFFINITY *affinity, unsigned int class )
+{
+    SIZE_T slot_size = get_lfh_class_size( class );
+    SIZE_T i, count = max( LFH_CHUNK_SIZE / slot_size, 4 );
+    SLIST_ENTRY *entry, *first = NULL;
+    ARENA_INUSE *arena;
+    char *chunk;
+
+    /* chunks are always larger than the blocks handled by the front-end */
+    if (!(chunk = RtlAllocateHeap( heap, 0, ARENA_OFFSET + count * slot_size ))) return NULL;
+    TRACE( "heap %p: new chunk %p for %lu blocks of class %u\n", heap, chunk, count, class );
+
+    for (i = count; i-- > 0;)
+    {
+        arena = (ARENA_INUSE *)(chunk + ARENA_OFFSET + i * slot_size);
+        arena->size = 0;
+        arena->magic = ARENA_LFH_FREE_MAGIC;
+        arena->unused_bytes = class;
+        entry = (SLIST_ENTRY *)(arena + 1);
+        entry->Next = first;
+        first = entry;
+    }
+    entry = (SLIST_ENTRY *)(chunk + ALIGNMENT + slot_size);
+    RtlInterlockedPushListSList( &affinity->free_list[class], entry,
+                                 (SLIST_ENTRY *)(chunk + ALIGNMENT + (count - 1) * slot_size), count - 1 );
+    return first;
+}
+
+
+/***********************************************************************
+ *           allocate_lfh_block
+ *
+ * Allocate a block from the low-fragmentation front-end, without taking the heap lock.
+ * Return NULL if the size isn't handled by the front-end.
+ */
+static void *allocate_lfh_block( HEAP *heap, DWORD flags, SIZE_T size )
+{
+    SIZE_T total = max( size + sizeof(ARENA_INUSE), LFH_MIN_BLOCK_SIZE );
+    LFH_AFFINITY *affinity;
+    SLIST_ENTRY *entry;
+    ARENA_INUSE *arena;
+    unsigned int i, class;
+
+    if (size > LFH_MAX_BLOCK_SIZE || total > LFH_MAX_BLOCK_SIZE) return NULL;
+
+    class = get_lfh_class( total );
+    affinity = get_lfh_affinity( heap->lfh );
+    if (!(entry = RtlInterlockedPopEntrySList( &affinity->free_list[class] )))
+    {
+        /* use the blocks freed by other threads before allocating a new chunk */
+        for (i = 0; i < LFH_NB_AFFINITIES && !entry; i++)
+            entry = RtlInterlockedPopEntrySList( &heap->lfh->affinity[i].free_list[class] );
+        if (!entry && !(entry = grow_lfh_class( heap, affinity, class ))) return NULL;
+    }
+
+    arena = (ARENA_INUSE *)entry - 1;
+    arena->size = size;
+    arena->magic = ARENA_LFH_MAGIC;
+    if (flags & HEAP_ZERO_MEMORY) memset( entry, 0, size );
+    return entry;
+}
+
+
+/***********************************************************************
+ *           free_lfh_block
+ */
+static void free_lfh_block( HEAP *heap, ARENA_INUSE *arena )
+{
+    LFH_AFFINITY *affinity = get_lfh_affinity( heap->lfh );
+
+    arena->magic = ARENA_LFH_FREE_MAGIC;
+    RtlInterlockedPushEntrySList( &affinity->free_list[arena->unused_bytes], (SLIST_ENTRY *)(arena + 1) );
+}
+
+
+/***********************************************************************
+ *           realloc_lfh_block
+ */
+static void *realloc_lfh_block( HEAP *heap, DWORD flags, ARENA_INUSE *arena, SIZE_T size )
+{
+    SIZE_T old_size = arena->size;
+    void *ret;
+
+    /* keep the block in place if it's still in the right class */
+    if (size <= get_lfh_class_size( arena->unused_bytes ) - sizeof(ARENA_INUSE) &&
+        ((flags & HEAP_REALLOC_IN_PLACE_ONLY) ||
+         get_lfh_class( max( size + sizeof(ARENA_INUSE), LFH_MIN_BLOCK_SIZE )) == arena->unused_bytes))
+    {
+        if (size > old_size && (flags & HEAP_ZERO_MEMORY))
+            memset( (char *)(arena + 1) + old_size, 0, size - old_size );
+        arena->size = size;
+        return arena + 1;
+    }
+
+    if (!(flags & HEAP_REALLOC_IN_PLACE_ONLY) &&
+        (ret = RtlAllocateHeap( heap, flags & (HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY), size )))
+    {
+        memcpy( ret, arena + 1, min( old_size, size ));
+        free_lfh_block( heap, arena );
+        return ret;
+    }
+
+    if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+    RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           validate_lfh_block
+ *
+ * Check that a block allocated by the low-fragmentation front-end is inside one of its chunks.
+ */
+static BOOL validate_lfh_block( const SUBHEAP *subheap, const ARENA_INUSE *arena, BOOL quiet )
+{
+    const char *ptr = (const char *)subheap->base + subheap->headerSize;
+    const char *end = (const char *)subheap->base + subheap->size;
+    const ARENA_INUSE *chunk = NULL;
+    SIZE_T slot_size, offset;
+
+    if (arena->unused_bytes < LFH_NB_CLASSES)
+    {
+        /* find the heap block containing the arena */
+        while (ptr < end)
+        {
+            DWORD size = *(const DWORD *)ptr;
+            const char *next;
+
+            if (size & ARENA_FLAG_FREE) next = ptr + sizeof(ARENA_FREE) + (size & ARENA_SIZE_MASK);
+            else next = ptr + sizeof(ARENA_INUSE) + (size & ARENA_SIZE_MASK);
+            if ((const char *)arena < next)
+            {
+                if (!(size & ARENA_FLAG_FREE)) chunk = (const ARENA_INUSE *)ptr;
+                break;
+            }
+            ptr = next;
+        }
+    }
+
+    if (chunk && chunk->magic == ARENA_INUSE_MAGIC && (const char *)arena >= (const char *)(chunk + 1) + ARENA_OFFSET)
+    {
+        slot_size = get_lfh_class_size( arena->unused_bytes );
+        offset = (const char *)arena - (const char *)(chunk + 1) - ARENA_OFFSET;
+        if (!(offset % slot_size) && offset + ARENA_OFFSET + slot_size <= (chunk->size & ARENA_SIZE_MASK) &&
+            arena->size <= slot_size - sizeof(ARENA_INUSE))
+            return TRUE;
+    }
+
+    if (quiet == NOISY)
+        ERR( "Heap %p: invalid low-fragmentation block %p\n", subheap->heap, arena + 1 );
+    else if (WARN_ON(heap))
+        WARN( "Heap %p: invalid low-fragmentation block %p\n", subheap->heap, arena + 1 );
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           enable_lfh
+ */
+static NTSTATUS enable_lfh( HEAP *heap )
+{
+    LFH_HEAP *lfh;
+    unsigned int i, j;
+
+    if (heap->lfh) return STATUS_SUCCESS;
+    if (RUNNING_ON_VALGRIND) return STATUS_UNSUCCESSFUL;
+    if ((heap->flags & (HEAP_LFH_DISABLE_FLAGS | HEAP_NO_SERIALIZE)) || !(heap->flags & HEAP_GROWABLE) ||
+        heap->stats)
+        return STATUS_UNSUCCESSFUL;
+
+    if (!(lfh = RtlAllocateHeap( heap, 0, sizeof(*lfh) ))) return STATUS_NO_MEMORY;
+    for (i = 0; i < LFH_NB_AFFINITIES; i++)
+        for (j = 0; j < LFH_NB_CLASSES; j++)
+            RtlInitializeSListHead( &lfh->affinity[i].free_list[j] );
+
+    /* set it under the lock, so that no subheap is being freed at the same time */
+    RtlEnterCriticalSection( &heap->critSection );
+    if (!heap->lfh)
+    {
+        heap->lfh = lfh;
+        lfh = NULL;
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+    if (lfh) RtlFreeHeap( heap, 0, lfh );  /* somebody beat us to it */
+    TRACE( "heap %p: enabled low-fragmentation front-end\n", heap );
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           HEAP_IsRealArena  [Internal]
  * Validates a block is a valid arena.
@@ -1348,7 +1691,10 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
             }
             else
                 ret = validate_large_arena( heapPtr, large_arena, quiet );
-        } else
+        }
+        else if (heapPtr->lfh && arena->magic == ARENA_LFH_MAGIC)
+            ret = validate_lfh_block( subheap, arena, quiet );
+        else
             ret = HEAP_ValidateInUseArena( subheap, arena, quiet );
 
         if (!(flags & HEAP_NO_SERIALIZE))
@@ -1437,6 +1783,361 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/***********************************************************************
+ *           get_block_data_size
+ *
+ * Get the size of the user data of a block from the main heap or a large block.
+ */
+static SIZE_T get_block_data_size( const SUBHEAP *subheap, const void *ptr )
+{
+    const ARENA_INUSE *arena = (const ARENA_INUSE *)ptr - 1;
+
+    if (!subheap) return ((const ARENA_LARGE *)ptr - 1)->data_size;
+    return (arena->size & ARENA_SIZE_MASK) - arena->unused_bytes;
+}
+
+
+/***********************************************************************
+ *           alloc_stats_record
+ *
+ * Allocate memory for a statistics record. The heap lock must be held.
+ */
+static void *alloc_stats_record( HEAP_STATS *stats, SIZE_T size )
+{
+    void *ret;
+
+    if (!stats->area || stats->area_pos + size > (char *)stats->area + HEAP_STATS_AREA_SIZE)
+    {
+        void *area = NULL;
+        SIZE_T area_size = HEAP_STATS_AREA_SIZE;
+
+        if (NtAllocateVirtualMemory( NtCurrentProcess(), &area, 0, &area_size, MEM_COMMIT, PAGE_READWRITE ))
+            return NULL;
+        *(void **)area = stats->area;
+        stats->area = area;
+        stats->area_pos = (char *)area + sizeof(void *);
+    }
+    ret = stats->area_pos;
+    stats->area_pos += size;
+    return ret;
+}
+
+
+/***********************************************************************
+ *           heap_stats_backtrace
+ *
+ * Capture the backtrace of an allocation that is about to be sampled. This is
+ * done before taking the heap lock, so the sampling position is only a hint
+ * here; it is checked again by heap_stats_alloc.
+ */
+static struct heap_backtrace *heap_stats_backtrace( HEAP *heap, SIZE_T size, struct heap_backtrace *bt )
+{
+    if (heap->stats->sample_pos + size + sizeof(ARENA_INUSE) < HEAP_STATS_SAMPLE_SIZE) return NULL;
+    bt->count = RtlCaptureStackBackTrace( 1, WINE_HEAP_TRACE_FRAMES, bt->frames, &bt->hash );
+    return bt;
+}
+
+
+/***********************************************************************
+ *           get_stats_trace
+ *
+ * Get the trace record for the backtrace of an allocation.
+ */
+static struct heap_trace *get_stats_trace( HEAP_STATS *stats, const struct heap_backtrace *bt )
+{
+    struct heap_trace *trace;
+
+    for (trace = stats->traces[bt->hash % HEAP_STATS_HASH_SIZE]; trace; trace = trace->next)
+        if (trace->hash == bt->hash && trace->info.FrameCount == bt->count &&
+            !memcmp( trace->info.Frames, bt->frames, bt->count * sizeof(bt->frames[0]) )) return trace;
+
+    if (!(trace = alloc_stats_record( stats, sizeof(*trace) ))) return NULL;
+    trace->hash = bt->hash;
+    trace->info.FrameCount = bt->count;
+    memcpy( trace->info.Frames, bt->frames, bt->count * sizeof(bt->frames[0]) );
+    trace->next = stats->traces[bt->hash % HEAP_STATS_HASH_SIZE];
+    stats->traces[bt->hash % HEAP_STATS_HASH_SIZE] = trace;
+    stats->info.TraceCount++;
+    return trace;
+}
+
+
+/***********************************************************************
+ *           remove_stats_sample
+ *
+ * Remove the sample record of a block, if it has one.
+ */
+static struct heap_sample *remove_stats_sample( HEAP_STATS *stats, const void *ptr )
+{
+    struct heap_sample **sample;
+
+    for (sample = &stats->samples[(ULONG_PTR)ptr / ALIGNMENT % HEAP_STATS_HASH_SIZE]; *sample;
+         sample = &(*sample)->next)
+    {
+        if ((*sample)->ptr == ptr)
+        {
+            struct heap_sample *ret = *sample;
+            *sample = ret->next;
+            return ret;
+        }
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           add_stats_sample
+ */
+static void add_stats_sample( HEAP_STATS *stats, struct heap_sample *sample, const void *ptr, SIZE_T size )
+{
+    struct heap_sample **bucket = &stats->samples[(ULONG_PTR)ptr / ALIGNMENT % HEAP_STATS_HASH_SIZE];
+
+    sample->ptr = ptr;
+    sample->size = size;
+    sample->next = *bucket;
+    *bucket = sample;
+    sample->trace->info.Size += size;
+}
+
+
+/***********************************************************************
+ *           heap_stats_alloc
+ *
+ * Update the statistics for an allocation. The heap lock must be held.
+ */
+static void heap_stats_alloc( HEAP *heap, const void *ptr, SIZE_T size, const struct heap_backtrace *bt )
+{
+    HEAP_STATS *stats = heap->stats;
+    struct heap_sample *sample;
+    struct heap_trace *trace;
+    unsigned int bucket;
+
+    if (!ptr)
+    {
+        stats->info.Failures++;
+        return;
+    }
+    stats->info.Allocations++;
+    stats->info.Blocks++;
+    stats->info.Size += size;
+    if (stats->info.Size > stats->info.PeakSize) stats->info.PeakSize = stats->info.Size;
+    for (bucket = 0; bucket < WINE_HEAP_HISTOGRAM_SIZE - 1 && size >> bucket; bucket++) /* nothing */;
+    stats->info.Histogram[bucket]++;
+
+    /* count the arena too, so that empty blocks get sampled as well */
+    stats->sample_pos += size + sizeof(ARENA_INUSE);
+    if (stats->sample_pos < HEAP_STATS_SAMPLE_SIZE) return;
+    /* another thread got the sample we were expecting, sample one of the next allocations */
+    if (!bt) return;
+    stats->sample_pos = 0;
+
+    if (!(trace = get_stats_trace( stats, bt ))) return;
+    if ((sample = stats->free_samples)) stats->free_samples = sample->next;
+    else if (!(sample = alloc_stats_record( stats, sizeof(*sample) ))) return;
+    sample->trace = trace;
+    trace->info.Count++;
+    trace->info.TotalCount++;
+    add_stats_sample( stats, sample, ptr, size );
+}
+
+
+/***********************************************************************
+ *           heap_stats_free
+ *
+ * Update the statistics for a freed block. The heap lock must be held.
+ */
+static void heap_stats_free( HEAP *heap, const void *ptr, SIZE_T size )
+{
+    HEAP_STATS *stats = heap->stats;
+    struct heap_sample *sample;
+
+    stats->info.Frees++;
+    stats->info.Blocks--;
+    stats->info.Size -= size;
+
+    if ((sample = remove_stats_sample( stats, ptr )))
+    {
+        sample->trace->info.Count--;
+        sample->trace->info.Size -= sample->size;
+        sample->next = stats->free_samples;
+        stats->free_samples = sample;
+    }
+}
+
+
+/***********************************************************************
+ *           heap_stats_realloc
+ *
+ * Update the statistics for a resized block. The heap lock must be held.
+ */
+static void heap_stats_realloc( HEAP *heap, const void *old_ptr, SIZE_T old_size,
+                                const void *ptr, SIZE_T size )
+{
+    HEAP_STATS *stats = heap->stats;
+    struct heap_sample *sample;
+
+    stats->info.ReAllocations++;
+    stats->info.Size += size - old_size;
+    if (stats->info.Size > stats->info.PeakSize) stats->info.PeakSize = stats->info.Size;
+
+    if ((sample = remove_stats_sample( stats, old_ptr )))
+    {
+        sample->trace->info.Size -= sample->size;
+        add_stats_sample( stats, sample, ptr, size );
+    }
+}
+
+
+/***********************************************************************
+ *           dump_heap_stats
+ */
+static void dump_heap_stats( HEAP *heap )
+{
+    static const unsigned int max_traces = 16;
+    const HEAP_STATS *stats = heap->stats;
+    struct heap_trace *trace, *top[16];
+    unsigned int i, j, count = 0;
+    LDR_MODULE *module;
+
+    TRACE_(heapstats)( "heap %p: %u allocations, %u frees, %u reallocations, %u failures\n", heap,
+                       stats->info.Allocations, stats->info.Frees, stats->info.ReAllocations,
+                       stats->info.Failures );
+    TRACE_(heapstats)( "heap %p: %lu bytes in %u blocks, peak %lu bytes\n", heap,
+                       stats->info.Size, stats->info.Blocks, stats->info.PeakSize );
+    for (i = 0; i < WINE_HEAP_HISTOGRAM_SIZE; i++)
+    {
+        if (!stats->info.Histogram[i]) continue;
+        if (i < 2)
+            TRACE_(heapstats)( "heap %p: %u allocations of %u bytes\n", heap, stats->info.Histogram[i], i );
+        else if (i == WINE_HEAP_HISTOGRAM_SIZE - 1)
+            TRACE_(heapstats)( "heap %p: %u allocations of %lu bytes or more\n", heap,
+                               stats->info.Histogram[i], (SIZE_T)1 << (i - 1) );
+        else
+            TRACE_(heapstats)( "heap %p: %u allocations of %lu-%lu bytes\n", heap, stats->info.Histogram[i],
+                               (SIZE_T)1 << (i - 1), ((SIZE_T)1 << i) - 1 );
+    }
+
+    /* report the backtraces with the largest size still allocated */
+    for (i = 0; i < HEAP_STATS_HASH_SIZE; i++)
+    {
+        for (trace = stats->traces[i]; trace; trace = trace->next)
+        {
+            if (!trace->info.Count) continue;
+            if (count < max_traces) count++;
+            else if (top[count - 1]->info.Size >= trace->info.Size) continue;
+            for (j = count - 1; j > 0 && top[j - 1]->info.Size < trace->info.Size; j--) top[j] = top[j - 1];
+            top[j] = trace;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        TRACE_(heapstats)( "heap %p: %lu bytes in %u sampled blocks (%u total) allocated from:\n", heap,
+                           top[i]->info.Size, top[i]->info.Count, top[i]->info.TotalCount );
+        for (j = 0; j < top[i]->info.FrameCount; j++)
+        {
+            void *frame = top[i]->info.Frames[j];
+
+            if (!LdrFindEntryForAddress( frame, &module ))
+                TRACE_(heapstats)( "heap %p:   %p %s+0x%lx\n", heap, frame,
+                                   debugstr_w( module->BaseDllName.Buffer ),
+                                   (ULONG_PTR)frame - (ULONG_PTR)module->BaseAddress );
+            else
+                TRACE_(heapstats)( "heap %p:   %p\n", heap, frame );
+        }
+    }
+}
+
+
+/***********************************************************************
+ *           alloc_heap_stats
+ *
+ * Enable the statistics on a new heap. This has to be done before the first
+ * allocation, for the counters to match the blocks that are freed later.
+ */
+static void alloc_heap_stats( HEAP *heap )
+{
+    void *ptr = NULL;
+    SIZE_T size = sizeof(*heap->stats);
+
+    if (!NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+        heap->stats = ptr;
+}
+
+
+/***********************************************************************
+ *           free_heap_stats
+ */
+static void free_heap_stats( HEAP *heap )
+{
+    void *area, *next;
+    SIZE_T size;
+
+    for (area = heap->stats->area; area; area = next)
+    {
+        next = *(void **)area;
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &area, &size, MEM_RELEASE );
+    }
+    size = 0;
+    area = heap->stats;
+    NtFreeVirtualMemory( NtCurrentProcess(), &area, &size, MEM_RELEASE );
+    heap->stats = NULL;
+}
+
+
+/***********************************************************************
+ *           query_heap_stats
+ */
+static NTSTATUS query_heap_stats( HEAP *heap, WINE_HEAP_STATISTICS *info, SIZE_T size_in, SIZE_T *size_out )
+{
+    const struct heap_trace *trace;
+    NTSTATUS status = STATUS_SUCCESS;
+    unsigned int i, count = 0;
+    SIZE_T size;
+
+    if (!(heap->flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heap->critSection );
+
+    size = FIELD_OFFSET( WINE_HEAP_STATISTICS, Traces[heap->stats->info.TraceCount] );
+    if (size_out) *size_out = size;
+    if (size_in < size) status = STATUS_BUFFER_TOO_SMALL;
+    else
+    {
+        memcpy( info, &heap->stats->info, FIELD_OFFSET( WINE_HEAP_STATISTICS, Traces ));
+        for (i = 0; i < HEAP_STATS_HASH_SIZE; i++)
+            for (trace = heap->stats->traces[i]; trace; trace = trace->next)
+                info->Traces[count++] = trace->info;
+    }
+
+    if (!(heap->flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heap->critSection );
+    return status;
+}
+
+
+/***********************************************************************
+ *           heap_dump_stats
+ *
+ * Dump the statistics of all the heaps, with WINEDEBUG=+heapstats.
+ */
+void heap_dump_stats(void)
+{
+    HEAP *heap;
+
+    if (!TRACE_ON(heapstats) || !processHeap) return;
+
+    RtlEnterCriticalSection( &processHeap->critSection );
+    if (processHeap->stats) dump_heap_stats( processHeap );
+    LIST_FOR_EACH_ENTRY( heap, &processHeap->entry, HEAP, entry )
+    {
+        if (!heap->stats) continue;
+        if (!(heap->flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heap->critSection );
+        dump_heap_stats( heap );
+        if (!(heap->flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heap->critSection );
+    }
+    RtlLeaveCriticalSection( &processHeap->critSection );
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1553,6 +2254,7 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, PVOID addr, SIZE_T totalSize, SIZE_T c
     if (!(subheap = HEAP_CreateSubHeap( NULL, addr, flags, commitSize, totalSize ))) return 0;
 
     heap_set_debug_flags( subheap->heap );
+    if (TRACE_ON(heapstats)) alloc_heap_stats( subheap->heap );
 
     /* link it into the per-process heap list */
     if (processHeap)
@@ -1602,6 +2304,12 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
     list_remove( &heapPtr->entry );
     RtlLeaveCriticalSection( &processHeap->critSection );
 
+    if (heapPtr->stats)
+    {
+        dump_heap_stats( heapPtr );
+        free_heap_stats( heapPtr );
+    }
+
     heapPtr->critSection.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &heapPtr->critSection );
 
@@ -1659,6 +2367,7 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     SUBHEAP *subheap;
     HEAP *heapPtr = HEAP_GetPtr( heap );
     SIZE_T rounded_size;
+    struct heap_backtrace backtrace, *bt = NULL;
 
     /* Validate the parameters */
 
@@ -1673,11 +2382,24 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh && !(flags & HEAP_LFH_DISABLE_FLAGS))
+    {
+        void *ret = allocate_lfh_block( heapPtr, flags, size );
+        if (ret)
+        {
+            TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+            return ret;
+        }
+    }
+
+    if (heapPtr->stats) bt = heap_stats_backtrace( heapPtr, size, &backtrace );
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
     {
         void *ret = allocate_large_block( heap, flags, size );
+        if (heapPtr->stats) heap_stats_alloc( heapPtr, ret, size, bt );
         if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
         if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
         TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
@@ -1690,6 +2412,7 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     {
         TRACE("(%p,%08x,%08lx): returning NULL\n",
                   heap, flags, size  );
+        if (heapPtr->stats) heap_stats_alloc( heapPtr, NULL, size, bt );
         if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
         if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
         return NULL;
@@ -1715,6 +2438,7 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
 
     notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
     initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
+    if (heapPtr->stats) heap_stats_alloc( heapPtr, pInUse + 1, size, bt );
 
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
 
@@ -1754,6 +2478,13 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
         return FALSE;
     }
 
+    if ((pInUse = get_lfh_block( heapPtr, ptr )))
+    {
+        free_lfh_block( heapPtr, pInUse );
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
@@ -1764,6 +2495,7 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
     /* Some sanity checks */
     pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pInUse )) goto error;
+    if (heapPtr->stats) heap_stats_free( heapPtr, ptr, get_block_data_size( subheap, ptr ));
 
     if (!subheap)
         free_large_block( heapPtr, flags, ptr );
@@ -1817,6 +2549,14 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
+
+    if ((pArena = get_lfh_block( heapPtr, ptr )))
+    {
+        ret = realloc_lfh_block( heapPtr, flags, pArena, size );
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE(flags);
@@ -1825,6 +2565,7 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
 
     pArena = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pArena )) goto error;
+    oldActualSize = get_block_data_size( subheap, ptr );
     if (!subheap)
     {
         if (!(ret = realloc_large_block( heapPtr, flags, ptr, size ))) goto oom;
@@ -1834,7 +2575,6 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     /* Check if we need to grow the block */
 
     oldBlockSize = (pArena->size & ARENA_SIZE_MASK);
-    oldActualSize = (pArena->size & ARENA_SIZE_MASK) - pArena->unused_bytes;
     if (rounded_size > oldBlockSize)
     {
         char *pNext = (char *)(pArena + 1) + oldBlockSize;
@@ -1911,11 +2651,13 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
 
     ret = pArena + 1;
 done:
+    if (heapPtr->stats) heap_stats_realloc( heapPtr, ptr, oldActualSize, ret, size );
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
     return ret;
 
 oom:
+    if (heapPtr->stats) heapPtr->stats->info.Failures++;
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
     RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
@@ -2024,6 +2766,12 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
         RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_HANDLE );
         return ~0UL;
     }
+    if ((pArena = get_lfh_block( heapPtr, ptr )))
+    {
+        TRACE("(%p,%08x,%p): returning %08x\n", heap, flags, ptr, pArena->size );
+        return pArena->size;
+    }
+
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
@@ -2236,6 +2984,15 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
+    if (info_class == HeapWineStatisticsInformation)
+    {
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        if (!heapPtr->stats) return STATUS_INVALID_INFO_CLASS;
+        return query_heap_stats( heapPtr, info, size_in, size_out );
+    }
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2244,7 +3001,8 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        heapPtr = HEAP_GetPtr( heap );
+        *(ULONG *)info = heapPtr && heapPtr->lfh ? 2 : 0; /* low-fragmentation or standard heap */
         return STATUS_SUCCESS;
 
     default:
@@ -2252,3 +3010,33 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         return STATUS_INVALID_INFO_CLASS;
     }
 }
+
+/***********************************************************************
+ *           RtlSetHeapInformation    (NTDLL.@)
+ */
+NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
+                                       PVOID info, SIZE_T size )
+{
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* standard heap */
+            return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:  /* low-fragmentation heap */
+            return enable_lfh( heapPtr );
+        default:
+            return STATUS_INVALID_PARAMETER;
+        }
+
+    default:
+        FIXME("%p %u %p %lu: unknown heap information class, ignoring\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
+}
@@ -23,10 +23,22 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdio.h>
+#ifdef HAVE_DLFCN_H
+# include <dlfcn.h>
+#endif
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 #define NONAMELESSUNION
 #define NONAMELESSSTRUCT
@@ -39,6 +51,7 @@
 
 #include "wine/exception.h"
 #include "wine/library.h"
+#include "wine/list.h"
 #include "wine/unicode.h"
 #include "wine/debug.h"
 #include "wine/server.h"
@@ -72,14 +85,28 @@ static const char * const reason_names[] =
 
 static const WCHAR dllW[] = {'.','d','l','l',0};
 
+/* identity of the file a module was loaded from, all zero if unknown */
+struct file_id
+{
+    ULONGLONG dev;
+    ULONGLONG ino;
+    ULONGLONG mtime;
+    ULONGLONG size;
+};
+
 /* internal representation of 32bit modules. per process. */
 typedef struct _wine_modref
 {
     LDR_MODULE            ldr;
     int                   nDeps;
     struct _wine_modref **deps;
+    DWORD                *export_hash;       /* hash table of the export names, name index + 1 */
+    DWORD                 export_hash_mask;  /* size of the hash table - 1 */
+    struct file_id        file_id;           /* identity of the module file, for the import cache */
 } WINE_MODREF;
 
+#define MIN_EXPORT_HASH_NAMES 16  /* don't bother hashing smaller export tables */
+
 /* info about the current builtin dll load */
 /* used to keep track of things across the register_dll constructor call */
 struct builtin_load_info
@@ -113,7 +140,15 @@ static WINE_MODREF *cached_modref;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
 
-static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_MODREF** pwm );
+/* where load_dll found a dll and how it loaded it */
+struct dll_resolution
+{
+    enum loadorder loadorder;            /* LO_INVALID if the dll was already loaded */
+    WCHAR          filename[MAX_PATH];
+};
+
+static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_MODREF** pwm,
+                          struct dll_resolution *res, BOOL cached );
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
                                     DWORD exp_size, DWORD ordinal, LPCWSTR load_path );
@@ -426,7 +461,7 @@ static FARPROC find_forwarded_export( HMODULE module, const char *forward, LPCWS
     if (!(wm = find_basename_module( mod_name )))
     {
         TRACE( "delay loading %s for '%s'\n", debugstr_w(mod_name), forward );
-        if (load_dll( load_path, mod_name, 0, &wm ) == STATUS_SUCCESS &&
+        if (load_dll( load_path, mod_name, 0, &wm, NULL, FALSE ) == STATUS_SUCCESS &&
             !(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS))
         {
             if (process_attach( wm, NULL ) != STATUS_SUCCESS)
@@ -505,6 +540,49 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/*************************************************************************
+ *		hash_export_name
+ */
+static inline unsigned int hash_export_name( const char *name )
+{
+    unsigned int hash = 0;
+
+    while (*name) hash = hash * 65599 + (unsigned char)*name++;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		get_export_hash
+ *
+ * Get the hash table of the export names of a module, building it on first use.
+ * The loader_section must be locked while calling this function.
+ */
+static const DWORD *get_export_hash( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( wm->ldr.BaseAddress, exports->AddressOfNames );
+    DWORD i, pos, size = MIN_EXPORT_HASH_NAMES;
+
+    if (wm->export_hash) return wm->export_hash;
+
+    /* keep the table at most half full */
+    while (size < 2 * exports->NumberOfNames) size *= 2;
+    if (!(wm->export_hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                             size * sizeof(*wm->export_hash) )))
+        return NULL;
+    wm->export_hash_mask = size - 1;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        pos = hash_export_name( get_rva( wm->ldr.BaseAddress, names[i] )) & wm->export_hash_mask;
+        while (wm->export_hash[pos]) pos = (pos + 1) & wm->export_hash_mask;
+        wm->export_hash[pos] = i + 1;
+    }
+    TRACE( "%s: hashed %u export names\n", debugstr_w(wm->ldr.BaseDllName.Buffer), exports->NumberOfNames );
+    return wm->export_hash;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -516,6 +594,8 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    const DWORD *hash_table;
+    WINE_MODREF *wm;
     int min = 0, max = exports->NumberOfNames - 1;
 
     /* first check the hint */
@@ -526,7 +606,22 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
+    /* then look it up in the hash table */
+    if (exports->NumberOfNames >= MIN_EXPORT_HASH_NAMES && (wm = get_modref( module )) &&
+        (hash_table = get_export_hash( wm, exports )))
+    {
+        DWORD pos = hash_export_name( name ) & wm->export_hash_mask;
+
+        for ( ; hash_table[pos]; pos = (pos + 1) & wm->export_hash_mask)
+        {
+            DWORD index = hash_table[pos] - 1;
+            if (!strcmp( get_rva( module, names[index] ), name ))
+                return find_ordinal_export( module, exports, exp_size, ordinals[index], load_path );
+        }
+        return NULL;
+    }
+
+    /* or do a binary search */
     while (min <= max)
     {
         int res, pos = (min + max) / 2;
@@ -541,6 +636,492 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 }
 
 
+/* The import cache is a file of the prefix that stores the entry points the imports of a module
+ * were resolved to, as RVAs in the imported dll. The records are keyed by the identity and mtime
+ * of the importing module and of the dll that the load order selected, so they are only used
+ * with the exact same files; forwarded entry points are still looked up every time.
+ * The records also store the file the dll was found in and its load order, along with a stamp
+ * of the load order configuration and of the directories of the search path, so that loading
+ * an unchanged dll graph doesn't need to search the path and query the DllOverrides keys. */
+
+#define IMPORT_CACHE_MAGIC     0x48434d49  /* "IMCH" */
+#define IMPORT_CACHE_VERSION   2
+#define IMPORT_CACHE_HASH_SIZE 256
+#define MAX_IMPORT_CACHE_SIZE  (4 * 1024 * 1024)
+
+struct import_cache_header
+{
+    DWORD magic;    /* IMPORT_CACHE_MAGIC */
+    DWORD version;  /* IMPORT_CACHE_VERSION */
+    DWORD count;    /* number of records following the header */
+    DWORD size;     /* total size of the records */
+};
+
+struct import_cache_record
+{
+    struct file_id module;     /* file of the importing module */
+    struct file_id dll;        /* file of the imported dll */
+    ULONGLONG      stamp;      /* search stamp the dll file name was resolved with */
+    DWORD          descr;      /* RVA of the import descriptor in the module */
+    DWORD          loadorder;  /* load order of the dll, LO_INVALID if the file name isn't known */
+    DWORD          name_len;   /* length of the dll file name following the RVAs, in WCHARs */
+    DWORD          count;      /* number of imported entry points */
+    DWORD          rvas[1];    /* RVAs of the entry points in the dll, 0 if they have to be looked up */
+};
+
+struct import_cache_entry
+{
+    struct list                 entry;  /* entry in the hash table */
+    struct import_cache_record *rec;
+};
+
+static struct list import_cache[IMPORT_CACHE_HASH_SIZE];
+static char *import_cache_data;            /* records read from the cache file */
+static struct import_cache_entry *import_cache_entries;  /* entries of the records read from the file */
+static BOOL import_cache_loaded;
+static BOOL import_cache_dirty;            /* records were added by this process */
+
+static inline DWORD import_cache_record_size( DWORD count, DWORD name_len )
+{
+    return (FIELD_OFFSET( struct import_cache_record, rvas[count] ) + name_len * sizeof(WCHAR) + 7) & ~7;
+}
+
+static inline const WCHAR *import_cache_name( const struct import_cache_record *rec )
+{
+    return (const WCHAR *)&rec->rvas[rec->count];
+}
+
+static inline unsigned int hash_import_cache( const struct file_id *module, DWORD descr )
+{
+    return (unsigned int)(module->ino ^ module->mtime ^ descr) % IMPORT_CACHE_HASH_SIZE;
+}
+
+static inline BOOL is_file_id_valid( const struct file_id *id )
+{
+    return id->ino || id->mtime;
+}
+
+static void stat_to_file_id( const struct stat *st, struct file_id *id )
+{
+    id->dev   = st->st_dev;
+    id->ino   = st->st_ino;
+    id->mtime = st->st_mtime;
+    id->size  = st->st_size;
+}
+
+/* get the identity of the file of a native module */
+static void get_file_id( HANDLE file, struct file_id *id )
+{
+    int fd, needs_close;
+    struct stat st;
+
+    if (server_get_unix_fd( file, 0, &fd, &needs_close, NULL, NULL )) return;
+    if (!fstat( fd, &st )) stat_to_file_id( &st, id );
+    if (needs_close) close( fd );
+}
+
+/* get the identity of the file of a module; addr is any address in the .so file of a builtin */
+static const struct file_id *get_module_file_id( WINE_MODREF *wm, const void *addr )
+{
+#ifdef HAVE_DLADDR
+    if (!is_file_id_valid( &wm->file_id ) && (wm->ldr.Flags & LDR_WINE_INTERNAL))
+    {
+        struct stat st;
+        Dl_info info;
+
+        if (dladdr( addr, &info ) && info.dli_fname && !stat( info.dli_fname, &st ))
+            stat_to_file_id( &st, &wm->file_id );
+    }
+#endif
+    return &wm->file_id;
+}
+
+/*************************************************************************
+ *		get_search_stamp
+ *
+ * Return a value that changes when the result of searching a dll in the given path,
+ * or the load order of the dll, may have changed: it covers the load order configuration
+ * and the modification time of the search path directories.
+ * The loader_section must be locked while calling this function.
+ */
+static ULONGLONG get_search_stamp( LPCWSTR load_path )
+{
+    static WCHAR *last_path, *last_dir;
+    static ULONGLONG last_stamp;
+    const UNICODE_STRING *cur_dir = &NtCurrentTeb()->Peb->ProcessParameters->CurrentDirectory.DosPath;
+    WINE_MODREF *main_exe = get_modref( NtCurrentTeb()->Peb->ImageBaseAddress );
+    UNICODE_STRING nt_name;
+    ANSI_STRING unix_name;
+    const WCHAR *p, *end;
+    WCHAR *dir;
+    struct stat st;
+    ULONGLONG stamp;
+
+    /* the path contains relative directories, it's only the same search in the same directory */
+    if (last_path && !strcmpW( last_path, load_path ) &&
+        !strncmpW( last_dir, cur_dir->Buffer, cur_dir->Length / sizeof(WCHAR) ) &&
+        !last_dir[cur_dir->Length / sizeof(WCHAR)])
+        return last_stamp;
+
+    stamp = get_load_order_stamp( main_exe ? main_exe->ldr.BaseDllName.Buffer : NULL );
+    if (!(dir = RtlAllocateHeap( GetProcessHeap(), 0, (strlenW(load_path) + 1) * sizeof(WCHAR) )))
+        return 0;
+    for (p = load_path; *p; p = end)
+    {
+        if (!(end = strchrW( p, ';' ))) end = p + strlenW(p);
+        memcpy( dir, p, (end - p) * sizeof(WCHAR) );
+        dir[end - p] = 0;
+        if (*end) end++;
+        if (!*dir || !RtlDosPathNameToNtPathName_U( dir, &nt_name, NULL, NULL )) continue;
+        if (!wine_nt_to_unix_file_name( &nt_name, &unix_name, FILE_OPEN, FALSE ))
+        {
+            if (!stat( unix_name.Buffer, &st ))
+                stamp = (stamp ^ st.st_ino ^ ((ULONGLONG)st.st_mtime << 32)) * 0x100000001b3;
+            RtlFreeHeap( GetProcessHeap(), 0, unix_name.Buffer );
+        }
+        RtlFreeUnicodeString( &nt_name );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, dir );
+
+    RtlFreeHeap( GetProcessHeap(), 0, last_path );
+    RtlFreeHeap( GetProcessHeap(), 0, last_dir );
+    last_path = RtlAllocateHeap( GetProcessHeap(), 0, (strlenW(load_path) + 1) * sizeof(WCHAR) );
+    last_dir = RtlAllocateHeap( GetProcessHeap(), 0, cur_dir->Length + sizeof(WCHAR) );
+    if (last_path && last_dir)
+    {
+        strcpyW( last_path, load_path );
+        memcpy( last_dir, cur_dir->Buffer, cur_dir->Length );
+        last_dir[cur_dir->Length / sizeof(WCHAR)] = 0;
+    }
+    else
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, last_path );
+        RtlFreeHeap( GetProcessHeap(), 0, last_dir );
+        last_path = last_dir = NULL;
+    }
+    last_stamp = stamp;
+    return stamp;
+}
+
+static char *get_import_cache_path( const char *suffix )
+{
+    static const char name[] = "/importcache";
+    const char *config_dir = wine_get_config_dir();
+    char *path;
+
+    if ((path = RtlAllocateHeap( GetProcessHeap(), 0, strlen(config_dir) + sizeof(name) + strlen(suffix) )))
+    {
+        strcpy( path, config_dir );
+        strcat( path, name );
+        strcat( path, suffix );
+    }
+    return path;
+}
+
+/*************************************************************************
+ *		read_import_cache
+ *
+ * Read and validate the records of an import cache file.
+ * Return the records, and their count and size.
+ */
+static char *read_import_cache( int fd, DWORD *count, DWORD *size )
+{
+    struct import_cache_header header;
+    struct import_cache_record *rec;
+    char *data, *ptr, *end;
+    DWORD i;
+
+    if (read( fd, &header, sizeof(header) ) != sizeof(header) ||
+        header.magic != IMPORT_CACHE_MAGIC || header.version != IMPORT_CACHE_VERSION ||
+        header.size > MAX_IMPORT_CACHE_SIZE || header.count > header.size / import_cache_record_size( 0, 0 ))
+        return NULL;
+    if (!(data = RtlAllocateHeap( GetProcessHeap(), 0, header.size ))) return NULL;
+    if (read( fd, data, header.size ) != header.size)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, data );
+        return NULL;
+    }
+
+    ptr = data;
+    end = data + header.size;
+    for (i = 0; i < header.count; i++)
+    {
+        rec = (struct import_cache_record *)ptr;
+        if (end - ptr < import_cache_record_size( 0, 0 ) ||
+            rec->count > (end - ptr) / sizeof(DWORD) || rec->name_len >= MAX_PATH ||
+            end - ptr < import_cache_record_size( rec->count, rec->name_len ))
+        {
+            WARN( "invalid import cache record %u\n", i );
+            break;
+        }
+        ptr += import_cache_record_size( rec->count, rec->name_len );
+    }
+    *count = i;
+    *size = ptr - data;
+    return data;
+}
+
+/*************************************************************************
+ *		load_import_cache
+ *
+ * Read the import cache file of the prefix.
+ * The loader_section must be locked while calling this function.
+ */
+static void load_import_cache(void)
+{
+    struct import_cache_record *rec;
+    char *path, *ptr;
+    unsigned int i, hash;
+    DWORD count, size;
+    int fd;
+
+    if (import_cache_loaded) return;
+    import_cache_loaded = TRUE;
+    for (i = 0; i < IMPORT_CACHE_HASH_SIZE; i++) list_init( &import_cache[i] );
+
+    if (!(path = get_import_cache_path( "" ))) return;
+    fd = open( path, O_RDONLY );
+    RtlFreeHeap( GetProcessHeap(), 0, path );
+    if (fd == -1) return;
+
+    import_cache_data = read_import_cache( fd, &count, &size );
+    close( fd );
+    if (!import_cache_data) return;
+    if (!(import_cache_entries = RtlAllocateHeap( GetProcessHeap(), 0, count * sizeof(*import_cache_entries) )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, import_cache_data );
+        import_cache_data = NULL;
+        return;
+    }
+
+    ptr = import_cache_data;
+    for (i = 0; i < count; i++)
+    {
+        rec = (struct import_cache_record *)ptr;
+        hash = hash_import_cache( &rec->module, rec->descr );
+        import_cache_entries[i].rec = rec;
+        list_add_tail( &import_cache[hash], &import_cache_entries[i].entry );
+        ptr += import_cache_record_size( rec->count, rec->name_len );
+    }
+    TRACE( "loaded %u import cache records\n", count );
+}
+
+/*************************************************************************
+ *		find_import_cache_entry
+ *
+ * Find the record of an import descriptor, whatever dll it was resolved from.
+ * The loader_section must be locked while calling this function.
+ */
+static struct import_cache_entry *find_import_cache_entry( const struct file_id *module, DWORD descr )
+{
+    struct import_cache_entry *entry;
+
+    load_import_cache();
+    LIST_FOR_EACH_ENTRY( entry, &import_cache[hash_import_cache( module, descr )],
+                         struct import_cache_entry, entry )
+    {
+        if (entry->rec->descr == descr && !memcmp( &entry->rec->module, module, sizeof(*module) ))
+            return entry;
+    }
+    return NULL;
+}
+
+/*************************************************************************
+ *		find_import_cache
+ *
+ * Find the cached entry points of an import descriptor.
+ * The loader_section must be locked while calling this function.
+ */
+static const struct import_cache_record *find_import_cache( const struct file_id *module, DWORD descr,
+                                                            const struct file_id *dll, DWORD count,
+                                                            DWORD dll_size )
+{
+    struct import_cache_entry *entry = find_import_cache_entry( module, descr );
+    const struct import_cache_record *rec;
+    DWORD i;
+
+    if (!entry) return NULL;
+    rec = entry->rec;
+    if (rec->count != count || memcmp( &rec->dll, dll, sizeof(*dll) )) return NULL;
+    for (i = 0; i < count; i++) if (rec->rvas[i] >= dll_size) return NULL;
+    return rec;
+}
+
+/*************************************************************************
+ *		find_import_cache_dll
+ *
+ * Find the cached file name and load order of the dll of an import descriptor.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL find_import_cache_dll( const struct file_id *module, DWORD descr, ULONGLONG stamp,
+                                   struct dll_resolution *res )
+{
+    struct import_cache_entry *entry = find_import_cache_entry( module, descr );
+    const struct import_cache_record *rec;
+
+    if (!entry) return FALSE;
+    rec = entry->rec;
+    if (rec->loadorder == LO_INVALID || rec->stamp != stamp) return FALSE;
+    memcpy( res->filename, import_cache_name( rec ), rec->name_len * sizeof(WCHAR) );
+    res->filename[rec->name_len] = 0;
+    res->loadorder = rec->loadorder;
+    return TRUE;
+}
+
+/*************************************************************************
+ *		add_import_cache
+ *
+ * Allocate a record for the entry points of an import descriptor, replacing the one
+ * that was resolved from another dll. The caller fills the RVAs.
+ * The dll file name is kept from the old record if it isn't known.
+ * The loader_section must be locked while calling this function.
+ */
+static struct import_cache_record *add_import_cache( const struct file_id *module, DWORD descr,
+                                                     const struct file_id *dll, DWORD count,
+                                                     const struct dll_resolution *res, ULONGLONG stamp )
+{
+    unsigned int hash = hash_import_cache( module, descr );
+    struct import_cache_entry *entry, *old = find_import_cache_entry( module, descr );
+    struct import_cache_record *rec;
+    const WCHAR *name = NULL;
+    DWORD loadorder = LO_INVALID, name_len = 0;
+
+    if (res->loadorder != LO_INVALID)
+    {
+        name = res->filename;
+        name_len = strlenW( name );
+        loadorder = res->loadorder;
+    }
+    else if (old && old->rec->loadorder != LO_INVALID && old->rec->stamp == stamp)
+    {
+        name = import_cache_name( old->rec );
+        name_len = old->rec->name_len;
+        loadorder = old->rec->loadorder;
+    }
+
+    if (!(entry = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   sizeof(*entry) + import_cache_record_size( count, name_len ) )))
+        return NULL;
+    entry->rec = rec = (struct import_cache_record *)(entry + 1);
+    rec->module    = *module;
+    rec->dll       = *dll;
+    rec->stamp     = stamp;
+    rec->descr     = descr;
+    rec->loadorder = loadorder;
+    rec->name_len  = name_len;
+    rec->count     = count;
+    if (name) memcpy( &rec->rvas[count], name, name_len * sizeof(WCHAR) );
+    if (old) list_remove( &old->entry );
+    list_add_head( &import_cache[hash], &entry->entry );
+    import_cache_dirty = TRUE;
+    return rec;
+}
+
+/*************************************************************************
+ *		save_import_cache
+ *
+ * Write the import cache file if records were added by this process, merging the records
+ * that other processes added to the file since it was loaded.
+ * The loader_section must be locked while calling this function.
+ */
+static void save_import_cache(void)
+{
+    struct import_cache_header header;
+    struct import_cache_entry *entry;
+    struct import_cache_record *rec;
+    struct flock fl;
+    char *path = NULL, *tmp = NULL, *lock = NULL, *buffer = NULL, *ptr, *disk = NULL;
+    unsigned int i, size, count = 0;
+    DWORD disk_count = 0, disk_size = 0;
+    int fd, lock_fd = -1;
+
+    if (!import_cache_dirty) return;
+    import_cache_dirty = FALSE;
+
+    if (!(path = get_import_cache_path( "" ))) goto done;
+    if (!(tmp = get_import_cache_path( ".XXXXXX" ))) goto done;
+    if (!(lock = get_import_cache_path( ".lock" ))) goto done;
+
+    /* serialize the writers, so that concurrent processes don't drop each other's records */
+    if ((lock_fd = open( lock, O_RDWR | O_CREAT, 0666 )) != -1)
+    {
+        fl.l_type   = F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        fl.l_start  = 0;
+        fl.l_len    = 0;
+        while (fcntl( lock_fd, F_SETLKW, &fl ) == -1 && errno == EINTR);
+    }
+    if ((fd = open( path, O_RDONLY )) != -1)
+    {
+        disk = read_import_cache( fd, &disk_count, &disk_size );
+        close( fd );
+    }
+
+    header.magic   = IMPORT_CACHE_MAGIC;
+    header.version = IMPORT_CACHE_VERSION;
+    header.count   = 0;
+    header.size    = 0;
+    for (i = 0; i < IMPORT_CACHE_HASH_SIZE; i++)
+    {
+        LIST_FOR_EACH_ENTRY( entry, &import_cache[i], struct import_cache_entry, entry )
+        {
+            size = import_cache_record_size( entry->rec->count, entry->rec->name_len );
+            if (header.size + size > MAX_IMPORT_CACHE_SIZE) goto full;
+            header.size += size;
+            header.count++;
+        }
+    }
+full:
+    if (!(buffer = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(header) + header.size + disk_size )))
+        goto done;
+    ptr = buffer + sizeof(header);
+    for (i = 0; i < IMPORT_CACHE_HASH_SIZE && count < header.count; i++)
+    {
+        LIST_FOR_EACH_ENTRY( entry, &import_cache[i], struct import_cache_entry, entry )
+        {
+            if (count++ == header.count) break;
+            size = import_cache_record_size( entry->rec->count, entry->rec->name_len );
+            memcpy( ptr, entry->rec, size );
+            ptr += size;
+        }
+    }
+
+    /* then the records of the file that this process doesn't know about */
+    for (i = 0, rec = (struct import_cache_record *)disk; i < disk_count; i++)
+    {
+        size = import_cache_record_size( rec->count, rec->name_len );
+        if (header.size + size > MAX_IMPORT_CACHE_SIZE) break;
+        if (!find_import_cache_entry( &rec->module, rec->descr ))
+        {
+            memcpy( ptr, rec, size );
+            ptr += size;
+            header.size += size;
+            header.count++;
+        }
+        rec = (struct import_cache_record *)((char *)rec + size);
+    }
+    memcpy( buffer, &header, sizeof(header) );
+
+    /* write a new file and rename it, other processes may be reading the old one */
+    if ((fd = mkstemp( tmp )) == -1) goto done;
+    size = sizeof(header) + header.size;
+    if (write( fd, buffer, size ) != size || rename( tmp, path ))
+    {
+        WARN( "failed to write the import cache %s\n", debugstr_a(path) );
+        unlink( tmp );
+    }
+    close( fd );
+
+done:
+    if (lock_fd != -1) close( lock_fd );  /* releases the lock */
+    RtlFreeHeap( GetProcessHeap(), 0, lock );
+    RtlFreeHeap( GetProcessHeap(), 0, tmp );
+    RtlFreeHeap( GetProcessHeap(), 0, path );
+    RtlFreeHeap( GetProcessHeap(), 0, buffer );
+    RtlFreeHeap( GetProcessHeap(), 0, disk );
+}
+
+
 /*************************************************************************
  *		import_dll
  *
@@ -558,10 +1139,17 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
     IMAGE_THUNK_DATA *thunk_list;
     WCHAR buffer[32];
     const char *name = get_rva( module, descr->Name );
-    DWORD len = strlen(name);
+    DWORD i, count = 0, len = strlen(name);
     PVOID protect_base;
-    SIZE_T protect_size = 0;
+    SIZE_T protect_size;
     DWORD protect_old;
+    const struct import_cache_record *cached = NULL;
+    struct import_cache_record *record = NULL;
+    const struct file_id *module_id = NULL;
+    DWORD descr_rva = (const char *)descr - (const char *)module;
+    struct dll_resolution res;
+    ULONGLONG stamp = 0;
+    BOOL use_cache, cached_dll = FALSE;
 
     thunk_list = get_rva( module, (DWORD)descr->FirstThunk );
     if (descr->u.OriginalFirstThunk)
@@ -571,11 +1159,27 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
 
     while (len && name[len-1] == ' ') len--;  /* remove trailing spaces */
 
+    /* relay and snoop need to replace the entry points */
+    use_cache = !TRACE_ON(relay) && !TRACE_ON(snoop);
+    res.loadorder = LO_INVALID;
+    if (use_cache)
+    {
+        module_id = get_module_file_id( current_modref, descr );
+        if (!is_file_id_valid( module_id )) use_cache = FALSE;
+        /* an activation context can redirect the dll to another file */
+        else if (!NtCurrentTeb()->ActivationContextStack.ActiveFrame && !memchr( name, '\\', len ) &&
+                 !memchr( name, '/', len ))
+        {
+            stamp = get_search_stamp( load_path );
+            cached_dll = find_import_cache_dll( module_id, descr_rva, stamp, &res );
+        }
+    }
+
     if (len * sizeof(WCHAR) < sizeof(buffer))
     {
         ascii_to_unicode( buffer, name, len );
         buffer[len] = 0;
-        status = load_dll( load_path, buffer, 0, &wmImp );
+        status = load_dll( load_path, buffer, 0, &wmImp, stamp ? &res : NULL, cached_dll );
     }
     else  /* need to allocate a larger buffer */
     {
@@ -583,7 +1187,7 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
         if (!ptr) return NULL;
         ascii_to_unicode( ptr, name, len );
         ptr[len] = 0;
-        status = load_dll( load_path, ptr, 0, &wmImp );
+        status = load_dll( load_path, ptr, 0, &wmImp, stamp ? &res : NULL, cached_dll );
         RtlFreeHeap( GetProcessHeap(), 0, ptr );
     }
 
@@ -600,9 +1204,9 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
 
     /* unprotect the import address table since it can be located in
      * readonly section */
-    while (import_list[protect_size].u1.Ordinal) protect_size++;
+    while (import_list[count].u1.Ordinal) count++;
     protect_base = thunk_list;
-    protect_size *= sizeof(*thunk_list);
+    protect_size = count * sizeof(*thunk_list);
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base,
                             &protect_size, PAGE_READWRITE, &protect_old );
 
@@ -635,9 +1239,24 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
         goto done;
     }
 
-    while (import_list->u1.Ordinal)
+    if (use_cache)
     {
-        if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
+        const struct file_id *dll_id = get_module_file_id( wmImp, exports );
+
+        if (is_file_id_valid( dll_id ) &&
+            !(cached = find_import_cache( module_id, descr_rva, dll_id, count,
+                                          wmImp->ldr.SizeOfImage )))
+            record = add_import_cache( module_id, descr_rva, dll_id, count, &res, stamp );
+        if (cached) TRACE_(imports)( "using cached imports of %s\n", name );
+    }
+
+    for (i = 0; import_list->u1.Ordinal; i++)
+    {
+        if (cached && cached->rvas[i])
+        {
+            thunk_list->u1.Function = (ULONG_PTR)imp_mod + cached->rvas[i];
+        }
+        else if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
         {
             int ordinal = IMAGE_ORDINAL(import_list->u1.Ordinal);
 
@@ -669,6 +1288,9 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
             TRACE_(imports)("--- %s %s.%d = %p\n",
                             pe_name->Name, name, pe_name->Hint, (void *)thunk_list->u1.Function);
         }
+        /* forwarded entry points and stubs are outside of the dll */
+        if (record && thunk_list->u1.Function - (ULONG_PTR)imp_mod < wmImp->ldr.SizeOfImage)
+            record->rvas[i] = thunk_list->u1.Function - (ULONG_PTR)imp_mod;
         import_list++;
         thunk_list++;
     }
@@ -812,6 +1434,9 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
 
     wm->nDeps    = 0;
     wm->deps     = NULL;
+    wm->export_hash = NULL;
+    wm->export_hash_mask = 0;
+    memset( &wm->file_id, 0, sizeof(wm->file_id) );
 
     wm->ldr.BaseAddress   = hModule;
     wm->ldr.EntryPoint    = NULL;
@@ -1542,6 +2167,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
         status = STATUS_NO_MEMORY;
         goto done;
     }
+    get_file_id( file, &wm->file_id );
 
     /* fixup imports */
 
@@ -1938,51 +2564,41 @@ overflow:
 
 
 /***********************************************************************
- *	load_dll  (internal)
+ *	open_dll_file
  *
- * Load a PE style module according to the load order.
- * The loader_section must be locked while calling this function.
+ * Open the file of a dll whose full path name is known.
  */
-static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_MODREF** pwm )
+static HANDLE open_dll_file( const WCHAR *filename )
 {
-    enum loadorder loadorder;
-    WCHAR buffer[32];
-    WCHAR *filename;
-    ULONG size;
-    WINE_MODREF *main_exe;
-    HANDLE handle = 0;
-    NTSTATUS nts;
-
-    TRACE( "looking for %s in %s\n", debugstr_w(libname), debugstr_w(load_path) );
-
-    *pwm = NULL;
-    filename = buffer;
-    size = sizeof(buffer);
-    for (;;)
-    {
-        nts = find_dll_file( load_path, libname, filename, &size, pwm, &handle );
-        if (nts == STATUS_SUCCESS) break;
-        if (filename != buffer) RtlFreeHeap( GetProcessHeap(), 0, filename );
-        if (nts != STATUS_BUFFER_TOO_SMALL) return nts;
-        /* grow the buffer and retry */
-        if (!(filename = RtlAllocateHeap( GetProcessHeap(), 0, size ))) return STATUS_NO_MEMORY;
-    }
-
-    if (*pwm)  /* found already loaded module */
-    {
-        if ((*pwm)->ldr.LoadCount != -1) (*pwm)->ldr.LoadCount++;
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    UNICODE_STRING nt_name;
+    HANDLE handle;
 
-        if (!(flags & DONT_RESOLVE_DLL_REFERENCES)) fixup_imports( *pwm, load_path );
+    if (!RtlDosPathNameToNtPathName_U( filename, &nt_name, NULL, NULL )) return 0;
+    attr.Length = sizeof(attr);
+    attr.RootDirectory = 0;
+    attr.Attributes = OBJ_CASE_INSENSITIVE;
+    attr.ObjectName = &nt_name;
+    attr.SecurityDescriptor = NULL;
+    attr.SecurityQualityOfService = NULL;
+    if (NtOpenFile( &handle, GENERIC_READ, &attr, &io, FILE_SHARE_READ|FILE_SHARE_DELETE, 0 )) handle = 0;
+    RtlFreeUnicodeString( &nt_name );
+    return handle;
+}
 
-        TRACE("Found %s for %s at %p, count=%d\n",
-              debugstr_w((*pwm)->ldr.FullDllName.Buffer), debugstr_w(libname),
-              (*pwm)->ldr.BaseAddress, (*pwm)->ldr.LoadCount);
-        if (filename != buffer) RtlFreeHeap( GetProcessHeap(), 0, filename );
-        return STATUS_SUCCESS;
-    }
 
-    main_exe = get_modref( NtCurrentTeb()->Peb->ImageBaseAddress );
-    loadorder = get_load_order( main_exe ? main_exe->ldr.BaseDllName.Buffer : NULL, filename );
+/***********************************************************************
+ *	load_dll_file
+ *
+ * Load a dll from the file found by load_dll, according to its load order.
+ * The handle of the file is closed.
+ * The loader_section must be locked while calling this function.
+ */
+static NTSTATUS load_dll_file( LPCWSTR load_path, LPCWSTR filename, HANDLE handle,
+                               enum loadorder loadorder, DWORD flags, WINE_MODREF **pwm )
+{
+    NTSTATUS nts = STATUS_DLL_NOT_FOUND;
 
     if (handle && is_fake_dll( handle ))
     {
@@ -2039,17 +2655,84 @@ static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_
         TRACE("Loaded module %s (%s) at %p\n", debugstr_w(filename),
               ((*pwm)->ldr.Flags & LDR_WINE_INTERNAL) ? "builtin" : "native",
               (*pwm)->ldr.BaseAddress);
-        if (handle) NtClose( handle );
+    }
+    if (handle) NtClose( handle );
+    return nts;
+}
+
+/***********************************************************************
+ *	load_dll  (internal)
+ *
+ * Load a PE style module according to the load order.
+ * If res is set, it receives the file name and load order that were used; if cached
+ * is also set, they have been found in the import cache and are used without searching.
+ * The loader_section must be locked while calling this function.
+ */
+static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_MODREF** pwm,
+                          struct dll_resolution *res, BOOL cached )
+{
+    enum loadorder loadorder;
+    WCHAR buffer[32];
+    WCHAR *filename;
+    ULONG size;
+    WINE_MODREF *main_exe;
+    HANDLE handle = 0;
+    NTSTATUS nts;
+
+    TRACE( "looking for %s in %s\n", debugstr_w(libname), debugstr_w(load_path) );
+
+    *pwm = NULL;
+    filename = buffer;
+    size = sizeof(buffer);
+    if (cached && !(*pwm = find_basename_module( libname )) && !(*pwm = find_fullname_module( res->filename )))
+    {
+        TRACE( "using cached %s for %s\n", debugstr_w(res->filename), debugstr_w(libname) );
+        if (contains_path( res->filename )) handle = open_dll_file( res->filename );
+        nts = load_dll_file( load_path, res->filename, handle, res->loadorder, flags, pwm );
+        if (nts == STATUS_SUCCESS) return nts;
+        /* search it again, the cached load order may have been resolved for a different file */
+        *pwm = NULL;
+        handle = 0;
+    }
+    if (!*pwm) for (;;)
+    {
+        nts = find_dll_file( load_path, libname, filename, &size, pwm, &handle );
+        if (nts == STATUS_SUCCESS) break;
         if (filename != buffer) RtlFreeHeap( GetProcessHeap(), 0, filename );
-        return nts;
+        if (nts != STATUS_BUFFER_TOO_SMALL) return nts;
+        /* grow the buffer and retry */
+        if (!(filename = RtlAllocateHeap( GetProcessHeap(), 0, size ))) return STATUS_NO_MEMORY;
     }
+    if (res) res->loadorder = LO_INVALID;
 
-    WARN("Failed to load module %s; status=%x\n", debugstr_w(libname), nts);
-    if (handle) NtClose( handle );
+    if (*pwm)  /* found already loaded module */
+    {
+        if ((*pwm)->ldr.LoadCount != -1) (*pwm)->ldr.LoadCount++;
+
+        if (!(flags & DONT_RESOLVE_DLL_REFERENCES)) fixup_imports( *pwm, load_path );
+
+        TRACE("Found %s for %s at %p, count=%d\n",
+              debugstr_w((*pwm)->ldr.FullDllName.Buffer), debugstr_w(libname),
+              (*pwm)->ldr.BaseAddress, (*pwm)->ldr.LoadCount);
+        if (filename != buffer) RtlFreeHeap( GetProcessHeap(), 0, filename );
+        return STATUS_SUCCESS;
+    }
+
+    main_exe = get_modref( NtCurrentTeb()->Peb->ImageBaseAddress );
+    loadorder = get_load_order( main_exe ? main_exe->ldr.BaseDllName.Buffer : NULL, filename );
+
+    nts = load_dll_file( load_path, filename, handle, loadorder, flags, pwm );
+    if (nts == STATUS_SUCCESS && res && strlenW( filename ) < MAX_PATH)
+    {
+        strcpyW( res->filename, filename );
+        res->loadorder = loadorder;
+    }
+    else if (nts != STATUS_SUCCESS) WARN( "Failed to load module %s; status=%x\n", debugstr_w(libname), nts );
     if (filename != buffer) RtlFreeHeap( GetProcessHeap(), 0, filename );
     return nts;
 }
 
+
 /******************************************************************
  *		LdrLoadDll (NTDLL.@)
  */
@@ -2062,7 +2745,7 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH LdrLoadDll(LPCWSTR path_name, DWORD flags,
     RtlEnterCriticalSection( &loader_section );
 
     if (!path_name) path_name = NtCurrentTeb()->Peb->ProcessParameters->DllPath.Buffer;
-    nts = load_dll( path_name, libname->Buffer, flags, &wm );
+    nts = load_dll( path_name, libname->Buffer, flags, &wm, NULL, FALSE );
 
     if (nts == STATUS_SUCCESS && !(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS))
     {
@@ -2395,6 +3078,10 @@ void WINAPI LdrShutdownProcess(void)
 {
     TRACE("()\n");
     process_detach( TRUE, (LPVOID)1 );
+    RtlEnterCriticalSection( &loader_section );
+    save_import_cache();
+    RtlLeaveCriticalSection( &loader_section );
+    heap_dump_stats();
 }
 
 /******************************************************************
@@ -2463,6 +3150,7 @@ static void free_modref( WINE_MODREF *wm )
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
@@ -2704,11 +3392,15 @@ void WINAPI LdrInitializeThunk( void *kernel_start, ULONG_PTR unknown2,
     LPCWSTR load_path;
     PEB *peb = NtCurrentTeb()->Peb;
 
-    if (main_exe_file) NtClose( main_exe_file );  /* at this point the main module is created */
-
     /* allocate the modref for the main exe (if not already done) */
     wm = get_modref( peb->ImageBaseAddress );
     assert( wm );
+
+    if (main_exe_file)  /* at this point the main module is created */
+    {
+        get_file_id( main_exe_file, &wm->file_id );
+        NtClose( main_exe_file );
+    }
     if (wm->ldr.Flags & LDR_IMAGE_IS_DLL)
     {
         ERR("%s is a dll, not an executable\n", debugstr_w(wm->ldr.FullDllName.Buffer) );
@@ -489,3 +489,42 @@ enum loadorder get_load_order( const WCHAR *app_name, const WCHAR *path )
     RtlFreeHeap( GetProcessHeap(), 0, module );
     return ret;
 }
+
+
+/***************************************************************************
+ *	get_key_write_time
+ */
+static ULONGLONG get_key_write_time( HANDLE hkey )
+{
+    char buffer[sizeof(KEY_BASIC_INFORMATION) + MAX_PATH * sizeof(WCHAR)];
+    KEY_BASIC_INFORMATION *info = (KEY_BASIC_INFORMATION *)buffer;
+    DWORD count;
+
+    if (!hkey || NtQueryKey( hkey, KeyBasicInformation, buffer, sizeof(buffer), &count )) return 0;
+    return info->LastWriteTime.QuadPart;
+}
+
+
+/***************************************************************************
+ *	get_load_order_stamp   (internal)
+ *
+ * Return a value that changes when the load order configuration changes, i.e. the
+ * WINEDLLOVERRIDES variable or the DllOverrides keys, so that the loader can
+ * reuse load orders it resolved before.
+ */
+ULONGLONG get_load_order_stamp( const WCHAR *app_name )
+{
+    const char *order = getenv( "WINEDLLOVERRIDES" );
+    ULONGLONG stamp = 0xcbf29ce484222325;
+
+    if (order) while (*order) stamp = (stamp ^ (unsigned char)*order++) * 0x100000001b3;
+    stamp = (stamp ^ get_key_write_time( get_standard_key() )) * 0x100000001b3;
+    if (app_name)
+    {
+        const WCHAR *p;
+
+        for (p = app_name; *p; p++) stamp = (stamp ^ tolowerW( *p )) * 0x100000001b3;
+        stamp = (stamp ^ get_key_write_time( get_app_key( app_name ) )) * 0x100000001b3;
+    }
+    return stamp;
+}
@@ -79,6 +79,7 @@ extern void virtual_init(void) DECLSPEC_HIDDEN;
 extern void virtual_init_threading(void) DECLSPEC_HIDDEN;
 extern void fill_cpu_info(void) DECLSPEC_HIDDEN;
 extern void heap_set_debug_flags( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void heap_dump_stats(void) DECLSPEC_HIDDEN;
 
 /* server support */
 extern timeout_t server_start_time DECLSPEC_HIDDEN;
@@ -87,6 +88,7 @@ extern int is_wow64 DECLSPEC_HIDDEN;
 extern void server_init_process(void) DECLSPEC_HIDDEN;
 extern NTSTATUS server_init_process_done(void) DECLSPEC_HIDDEN;
 extern size_t server_init_thread( void *entry_point ) DECLSPEC_HIDDEN;
+extern void server_close_request_shm(void) DECLSPEC_HIDDEN;
 extern void DECLSPEC_NORETURN server_protocol_error( const char *err, ... ) DECLSPEC_HIDDEN;
 extern void DECLSPEC_NORETURN server_protocol_perror( const char *err ) DECLSPEC_HIDDEN;
 extern void DECLSPEC_NORETURN abort_thread( int status ) DECLSPEC_HIDDEN;
@@ -100,6 +102,11 @@ extern int server_get_unix_fd( HANDLE handle, unsigned int access, int *unix_fd,
                                int *needs_close, enum server_fd_type *type, unsigned int *options ) DECLSPEC_HIDDEN;
 extern int server_pipe( int fd[2] ) DECLSPEC_HIDDEN;
 
+/* fast synchronization objects */
+extern struct fast_sync_object *fast_sync_shm DECLSPEC_HIDDEN;
+extern void fast_sync_remove_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void keyed_event_remove_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
+
 /* security descriptors */
 NTSTATUS NTDLL_create_struct_sd(PSECURITY_DESCRIPTOR nt_sd, struct security_descriptor **server_sd,
                                 data_size_t *server_sd_len) DECLSPEC_HIDDEN;
@@ -201,6 +208,7 @@ enum loadorder
 };
 
 extern enum loadorder get_load_order( const WCHAR *app_name, const WCHAR *path ) DECLSPEC_HIDDEN;
+extern ULONGLONG get_load_order_stamp( const WCHAR *app_name ) DECLSPEC_HIDDEN;
 
 struct debug_info
 {
@@ -236,6 +244,8 @@ struct ntdll_thread_data
     WINE_VM86_TEB_INFO vm86;          /* 1fc vm86 private data */
     void              *exit_frame;    /* 204 exit frame pointer */
 #endif
+    struct request_shm *request_shm;  /* 208/318 shared memory buffer for server requests */
+    void              *threadpool_worker; /* 20c/320 current threadpool worker */
 };
 
 static inline struct ntdll_thread_data *ntdll_get_thread_data(void)
@@ -245,6 +255,90 @@ static inline struct ntdll_thread_data *ntdll_get_thread_data(void)
 
 extern mode_t FILE_umask DECLSPEC_HIDDEN;
 
+/* futexes */
+
+extern int futex_private DECLSPEC_HIDDEN;
+extern int use_futexes(void) DECLSPEC_HIDDEN;
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* private futexes, only for memory that isn't shared with other processes */
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, 0 /* FUTEX_WAIT */ | futex_private, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake( int *addr, int count )
+{
+    return syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */ | futex_private, count, NULL, 0, 0 );
+}
+
+/* the timeout of the bitset waits is an absolute CLOCK_MONOTONIC time */
+static inline int futex_wait_bitset( int *addr, int val, struct timespec *timeout, int mask )
+{
+    return syscall( __NR_futex, addr, 9 /* FUTEX_WAIT_BITSET */ | futex_private, val, timeout, 0, mask );
+}
+
+static inline int futex_wake_bitset( int *addr, int count, int mask )
+{
+    return syscall( __NR_futex, addr, 10 /* FUTEX_WAKE_BITSET */ | futex_private, count, NULL, 0, mask );
+}
+
+/* futexes in memory shared with other processes, with an absolute CLOCK_MONOTONIC timeout */
+static inline int futex_wait_shared( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, 9 /* FUTEX_WAIT_BITSET */, val, timeout, 0, ~0 );
+}
+
+static inline int futex_wake_shared( int *addr, int count )
+{
+    return syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, count, NULL, 0, 0 );
+}
+
+#else
+
+#include <errno.h>
+
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static inline int futex_wake( int *addr, int count )
+{
+    return 0;
+}
+
+static inline int futex_wait_bitset( int *addr, int val, struct timespec *timeout, int mask )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static inline int futex_wake_bitset( int *addr, int count, int mask )
+{
+    return 0;
+}
+
+static inline int futex_wait_shared( int *addr, int val, struct timespec *timeout )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static inline int futex_wake_shared( int *addr, int count )
+{
+    return 0;
+}
+
+#endif
+
 /* Register functions */
 
 #ifdef __i386__
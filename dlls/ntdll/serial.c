@@ -1014,7 +1014,7 @@ static NTSTATUS wait_on(HANDLE hDevice, int fd, HANDLE hEvent, PIO_STATUS_BLOCK
     }
 
     /* create the worker for the task */
-    status = RtlQueueWorkItem(wait_for_event, commio, 0 /* FIXME */);
+    status = RtlQueueWorkItem(wait_for_event, commio, WT_EXECUTELONGFUNCTION);
     if (status != STATUS_SUCCESS) goto out_now;
     return STATUS_PENDING;
 
@@ -70,11 +70,16 @@
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#include <time.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
 #include "wine/library.h"
 #include "wine/server.h"
+#include "wine/exception.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 
@@ -114,6 +119,11 @@ timeout_t server_start_time = 0;  /* time of server startup */
 sigset_t server_block_set;  /* signals to block during server calls */
 static int fd_socket = -1;  /* socket to exchange file descriptors with the server */
 static pid_t server_pid;
+static int use_request_shm;  /* use shared memory buffers for requests */
+#ifdef __linux__
+static struct request_shm_header *request_shm_header;  /* pending bitmap shared with the server */
+static int request_shm_doorbell = -1;  /* pipe to wake the server when it's sleeping */
+#endif
 
 static RTL_CRITICAL_SECTION fd_cache_section;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -262,6 +272,117 @@ static inline unsigned int wait_reply( struct __server_request_info *req )
 }
 
 
+#ifdef __linux__
+
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
+/***********************************************************************
+ *           request_fits_shm
+ *
+ * Check whether a request can use the shared memory buffer, the server rejects larger ones.
+ */
+static inline BOOL request_fits_shm( const struct __server_request_info *req )
+{
+    return (req->u.req.request_header.request_size <= REQUEST_SHM_DATA_SIZE &&
+            req->u.req.request_header.reply_size <= REQUEST_SHM_DATA_SIZE);
+}
+
+
+/***********************************************************************
+ *           send_request_shm
+ *
+ * Send a request to the server through the shared buffer.
+ */
+static unsigned int send_request_shm( const struct __server_request_info *req, struct request_shm *shm )
+{
+    unsigned int *pending = &request_shm_header->pending[shm->slot / 32];
+    unsigned int i, pos = 0, bit = 1u << (shm->slot % 32), old;
+
+    if (req->data_count)
+    {
+        __TRY
+        {
+            for (i = 0; i < req->data_count; i++)
+            {
+                memcpy( shm->data + pos, req->data[i].ptr, req->data[i].size );
+                pos += req->data[i].size;
+            }
+        }
+        __EXCEPT_PAGE_FAULT
+        {
+            return STATUS_ACCESS_VIOLATION;
+        }
+        __ENDTRY
+    }
+
+    memcpy( &shm->msg, &req->u.req, sizeof(req->u.req) );
+    shm->req_seq++;
+
+    /* the interlocked op orders the stores above with the check of the sleeping flag */
+    do old = *(volatile unsigned int *)pending;
+    while ((unsigned int)interlocked_cmpxchg( (int *)pending, old | bit, old ) != old);
+
+    if (*(volatile int *)&request_shm_header->sleeping)
+    {
+        char dummy = 0;
+
+        /* a full pipe already wakes the server */
+        while (write( request_shm_doorbell, &dummy, 1 ) == -1 && errno == EINTR);
+    }
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           wait_reply_shm
+ *
+ * Wait for the server to store the reply in the shared buffer.
+ */
+static unsigned int wait_reply_shm( struct __server_request_info *req, struct request_shm *shm, int seq )
+{
+    volatile int *reply_seq = &shm->seq;
+    int spin;
+
+    /* the reply to most requests comes back quickly, so spin a bit before sleeping */
+    if (NtCurrentTeb()->Peb->NumberOfProcessors > 1)
+        for (spin = 0; spin < 256 && *reply_seq == seq; spin++) small_pause();
+
+    while (*reply_seq == seq)
+    {
+        struct timespec timeout;
+        struct pollfd pfd;
+
+        /* the request buffer is shared with the server, so we can't use private futexes here */
+        clock_gettime( CLOCK_MONOTONIC, &timeout );
+        timeout.tv_sec++;
+        interlocked_xchg( &shm->waiting, 1 );
+        if (futex_wait_shared( &shm->seq, seq, &timeout ) != -1 || errno != ETIMEDOUT) continue;
+
+        /* the server doesn't write to a dead thread, check whether it closed the pipe */
+        pfd.fd = ntdll_get_thread_data()->reply_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll( &pfd, 1, 0 ) == 1 && (pfd.revents & (POLLHUP | POLLERR)) && *reply_seq == seq)
+            abort_thread(0);
+    }
+    shm->waiting = 0;
+
+    memcpy( &req->u.reply, &shm->msg, sizeof(req->u.reply) );
+    if (req->u.reply.reply_header.reply_size)
+        memcpy( req->reply_data, shm->data, req->u.reply.reply_header.reply_size );
+    return req->u.reply.reply_header.error;
+}
+
+#endif  /* __linux__ */
+
+
 /***********************************************************************
  *           wine_server_call (NTDLL.@)
  *
@@ -291,6 +412,20 @@ unsigned int wine_server_call( void *req_ptr )
     unsigned int ret;
 
     pthread_sigmask( SIG_BLOCK, &server_block_set, &old_set );
+#ifdef __linux__
+    {
+        struct request_shm *shm = ntdll_get_thread_data()->request_shm;
+
+        if (shm && request_fits_shm( req ))
+        {
+            int seq = shm->seq;
+            ret = send_request_shm( req, shm );
+            if (!ret) ret = wait_reply_shm( req, shm, seq );
+            pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+            return ret;
+        }
+    }
+#endif
     ret = send_request( req );
     if (!ret) ret = wait_reply( req );
     pthread_sigmask( SIG_SETMASK, &old_set, NULL );
@@ -298,6 +433,91 @@ unsigned int wine_server_call( void *req_ptr )
 }
 
 
+/***********************************************************************
+ *           wine_server_call_batch (NTDLL.@)
+ *
+ * Perform several server calls in a single round-trip.
+ *
+ * PARAMS
+ *     reqs  [I/O] Array of requests, initialized with SERVER_BATCH_REQ
+ *     count [I]   Number of requests
+ *
+ * RETURNS
+ *     An NTSTATUS code for the batch itself. The requests are executed in order
+ *     whatever their result; the status of each one is stored in its reply and
+ *     can be retrieved with wine_server_reply_error.
+ */
+unsigned int CDECL wine_server_call_batch( void **reqs, unsigned int count )
+{
+    struct __server_request_info batch;
+    char req_buffer[1024] DECLSPEC_ALIGN(8), reply_buffer[1024] DECLSPEC_ALIGN(8);
+    unsigned int i, j, ret, req_size = 0, reply_size = 0, pos;
+
+    for (i = 0; i < count; i++)
+    {
+        struct __server_request_info *req = reqs[i];
+        req_size += sizeof(req->u.req) + BATCH_ALIGN( req->u.req.request_header.request_size );
+        reply_size += sizeof(req->u.reply) + BATCH_ALIGN( req->u.req.request_header.reply_size );
+    }
+
+    if (req_size > sizeof(req_buffer) || reply_size > sizeof(reply_buffer))
+    {
+        /* too large to be worth it, send them one at a time */
+        for (i = 0; i < count; i++) wine_server_call( reqs[i] );
+        return STATUS_SUCCESS;
+    }
+
+    __TRY
+    {
+        for (i = pos = 0; i < count; i++)
+        {
+            struct __server_request_info *req = reqs[i];
+            memcpy( req_buffer + pos, &req->u.req, sizeof(req->u.req) );
+            pos += sizeof(req->u.req);
+            for (j = 0; j < req->data_count; j++)
+            {
+                memcpy( req_buffer + pos, req->data[j].ptr, req->data[j].size );
+                pos += req->data[j].size;
+            }
+            memset( req_buffer + pos, 0, BATCH_ALIGN( pos ) - pos );
+            pos = BATCH_ALIGN( pos );
+        }
+    }
+    __EXCEPT_PAGE_FAULT
+    {
+        return STATUS_ACCESS_VIOLATION;
+    }
+    __ENDTRY
+
+    memset( &batch.u.req, 0, sizeof(batch.u.req) );
+    batch.u.req.request_header.req = REQ_batch;
+    batch.data_count = 0;
+    wine_server_add_data( &batch, req_buffer, req_size );
+    wine_server_set_reply( &batch, reply_buffer, reply_size );
+    ret = wine_server_call( &batch );
+
+    for (i = pos = 0; i < count; i++)
+    {
+        struct __server_request_info *req = reqs[i];
+
+        if (i < batch.u.reply.batch_reply.count)
+        {
+            memcpy( &req->u.reply, reply_buffer + pos, sizeof(req->u.reply) );
+            pos += sizeof(req->u.reply);
+            if (req->u.reply.reply_header.reply_size)
+                memcpy( req->reply_data, reply_buffer + pos, req->u.reply.reply_header.reply_size );
+            pos += BATCH_ALIGN( req->u.reply.reply_header.reply_size );
+        }
+        else  /* not executed */
+        {
+            memset( &req->u.reply, 0, sizeof(req->u.reply) );
+            req->u.reply.reply_header.error = ret ? ret : STATUS_INTERNAL_ERROR;
+        }
+    }
+    return ret;
+}
+
+
 /***********************************************************************
  *           server_enter_uninterrupted_section
  */
@@ -999,6 +1219,13 @@ void server_init_process(void)
     }
     else fd_socket = server_connect();
 
+#ifdef __linux__
+    {
+        const char *env_shm = getenv( "WINESHMREQUESTS" );
+        use_request_shm = env_shm && atoi( env_shm );
+    }
+#endif
+
     /* setup the signal mask */
     sigemptyset( &server_block_set );
     sigaddset( &server_block_set, SIGALRM );
@@ -1038,6 +1265,47 @@ void server_init_process(void)
 }
 
 
+/***********************************************************************
+ *           init_fast_sync_shm
+ *
+ * Map the shared state of the events, semaphores and mutexes if the
+ * fast synchronization mode is enabled. Failure is not fatal, the
+ * objects are then only accessed through the server.
+ */
+static void init_fast_sync_shm(void)
+{
+    const char *env = getenv( "WINEFASTSYNC" );
+    sigset_t sigset;
+    obj_handle_t handle;
+    data_size_t size = 0;
+    void *ptr;
+    int fd = -1;
+
+    if (!env || !atoi( env )) return;
+
+    /* the fd arrives on the shared process socket */
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    SERVER_START_REQ( get_fast_sync_shm )
+    {
+        if (!wine_server_call( req ))
+        {
+            size = reply->size;
+            fd = receive_fd( &handle );
+        }
+    }
+    SERVER_END_REQ;
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (fd == -1) return;
+    if (size == FAST_SYNC_SHM_SIZE &&
+        (ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) != MAP_FAILED)
+        fast_sync_shm = ptr;
+    else
+        WARN( "failed to map the fast synchronization memory\n" );
+    close( fd );
+}
+
+
 /***********************************************************************
  *           server_init_process_done
  */
@@ -1068,10 +1336,82 @@ NTSTATUS server_init_process_done(void)
     }
     SERVER_END_REQ;
 
+    if (!status) init_fast_sync_shm();
     return status;
 }
 
 
+/***********************************************************************
+ *           init_request_shm
+ *
+ * Setup the shared memory buffer for the requests of the current thread.
+ * Failure is not fatal, requests keep going through the pipes.
+ */
+static void init_request_shm(void)
+{
+#ifdef __linux__
+    sigset_t sigset;
+    obj_handle_t handle;
+    data_size_t size = 0;
+    void *ptr = MAP_FAILED;
+    int fd = -1, header_fd = -1, doorbell_fd = -1, get_fds;
+
+    /* the fds arrive on the shared process socket */
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    get_fds = !request_shm_header;
+    SERVER_START_REQ( create_request_shm )
+    {
+        req->get_fds = get_fds;
+        if (!wine_server_call( req ))
+        {
+            size = reply->size;
+            fd = receive_fd( &handle );
+            if (get_fds)
+            {
+                header_fd = receive_fd( &handle );
+                doorbell_fd = receive_fd( &handle );
+            }
+        }
+    }
+    SERVER_END_REQ;
+    if (header_fd != -1)
+    {
+        ptr = mmap( NULL, REQUEST_SHM_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, header_fd, 0 );
+        close( header_fd );
+        if (ptr != MAP_FAILED)
+        {
+            request_shm_header = ptr;
+            request_shm_doorbell = doorbell_fd;
+        }
+        else close( doorbell_fd );
+    }
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (fd == -1) return;
+    ptr = MAP_FAILED;
+    if (request_shm_header && size == REQUEST_SHM_SIZE)
+        ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if (ptr != MAP_FAILED) ntdll_get_thread_data()->request_shm = ptr;
+#endif
+}
+
+
+/***********************************************************************
+ *           server_close_request_shm
+ *
+ * Release the request buffer of the current thread on exit.
+ */
+void server_close_request_shm(void)
+{
+    struct request_shm *shm = ntdll_get_thread_data()->request_shm;
+
+    if (!shm) return;
+    ntdll_get_thread_data()->request_shm = NULL;
+    munmap( shm, REQUEST_SHM_SIZE );
+}
+
+
 /***********************************************************************
  *           server_init_thread
  *
@@ -1123,6 +1463,8 @@ size_t server_init_thread( void *entry_point )
     is_wow64 = !is_win64 && (server_cpus & (1 << CPU_x86_64)) != 0;
     ntdll_get_thread_data()->wow64_redir = is_wow64;
 
+    if (!ret && use_request_shm) init_request_shm();
+
     switch (ret)
     {
     case STATUS_SUCCESS:
@@ -3209,13 +3209,67 @@ __ASM_GLOBAL_FUNC( RtlRaiseException,
                    "call " __ASM_NAME("set_cpu_context") /* does not return */ );
 
 
+/***********************************************************************
+ *           unwind_backtrace_frame
+ *
+ * Unwind a single frame for a stack backtrace. Return FALSE at the end of the stack.
+ */
+static BOOL unwind_backtrace_frame( CONTEXT *context )
+{
+    LDR_MODULE *module = NULL;
+    RUNTIME_FUNCTION *dir, *func = NULL;
+    const struct dwarf_fde *fde = NULL;
+    struct dwarf_eh_bases bases;
+    PEXCEPTION_ROUTINE handler;
+    ULONG64 frame;
+    void *data;
+    DWORD size;
+
+    if (!LdrFindEntryForAddress( (void *)context->Rip, &module ) &&
+        (dir = RtlImageDirectoryEntryToData( module->BaseAddress, TRUE,
+                                             IMAGE_DIRECTORY_ENTRY_EXCEPTION, &size )))
+        func = find_function_info( context->Rip, module->BaseAddress, dir, size );
+
+    if (func)
+        RtlVirtualUnwind( UNW_FLAG_NHANDLER, (ULONG64)module->BaseAddress, context->Rip,
+                          func, context, &data, &frame, NULL );
+    else if ((!module || (module->Flags & LDR_WINE_INTERNAL)) &&
+             (fde = _Unwind_Find_FDE( (void *)(context->Rip - 1), &bases )))
+    {
+        if (dwarf_virtual_unwind( context->Rip, &frame, context, fde, &bases, &handler, &data ))
+            return FALSE;
+    }
+    else  /* no unwind information, treat as a leaf function */
+    {
+        context->Rip = *(ULONG64 *)context->Rsp;
+        context->Rsp += sizeof(ULONG64);
+    }
+
+    return context->Rip && !(context->Rsp & 7) &&
+           context->Rsp >= (ULONG64)NtCurrentTeb()->Tib.StackLimit &&
+           context->Rsp < (ULONG64)NtCurrentTeb()->Tib.StackBase;
+}
+
+
 /*************************************************************************
  *		RtlCaptureStackBackTrace (NTDLL.@)
  */
 USHORT WINAPI RtlCaptureStackBackTrace( ULONG skip, ULONG count, PVOID *buffer, ULONG *hash )
 {
-    FIXME( "(%d, %d, %p, %p) stub!\n", skip, count, buffer, hash );
-    return 0;
+    CONTEXT context;
+    ULONG i;
+
+    RtlCaptureContext( &context );
+    if (hash) *hash = 0;
+
+    for (i = 0; i < skip + count; i++)
+    {
+        if (!unwind_backtrace_frame( &context )) break;
+        if (i < skip) continue;
+        buffer[i - skip] = (void *)context.Rip;
+        if (hash) *hash += context.Rip;
+    }
+    return i > skip ? i - skip : 0;
 }
 
 
@@ -22,6 +22,7 @@
  */
 
 #include "config.h"
+#include "wine/port.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -41,6 +42,10 @@
 #ifdef HAVE_SCHED_H
 # include <sched.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#include <limits.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -55,6 +60,7 @@
 #include "windef.h"
 #include "winternl.h"
 #include "wine/server.h"
+#include "wine/list.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 
@@ -130,6 +136,250 @@ void NTDLL_free_struct_sd(struct security_descriptor *server_sd)
     RtlFreeHeap(GetProcessHeap(), 0, server_sd);
 }
 
+/*
+ *	Fast synchronization objects
+ *
+ * When the fast synchronization mode is enabled, the server keeps the state
+ * of the events, semaphores and mutexes in memory shared with all the
+ * clients. Uncontended signals and waits are then done with atomic
+ * operations and futexes, the server is only told when some of its own
+ * waiters have to be woken up.
+ */
+
+struct fast_sync_object *fast_sync_shm = NULL;
+
+struct fast_sync_cache_entry
+{
+    int          index;   /* index of the object + 1, 0 if unknown, -1 if the server has to handle it */
+    unsigned int access;  /* access rights of the handle */
+};
+
+#define FAST_SYNC_CACHE_BLOCK_SIZE  (65536 / sizeof(struct fast_sync_cache_entry))
+#define FAST_SYNC_CACHE_ENTRIES     128
+
+static struct fast_sync_cache_entry *fast_sync_cache[FAST_SYNC_CACHE_ENTRIES];
+
+static struct timespec *get_abs_timespec( struct timespec *ts, const LARGE_INTEGER *timeout, BOOL monotonic );
+
+/* wake up to count client threads sleeping on the object value */
+static inline void fast_sync_wake( struct fast_sync_object *sync, int count )
+{
+    if (sync->sleepers) futex_wake_shared( &sync->value, count );
+}
+
+static inline unsigned int fast_sync_handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / FAST_SYNC_CACHE_BLOCK_SIZE;
+    return idx % FAST_SYNC_CACHE_BLOCK_SIZE;
+}
+
+static void add_fast_sync_to_cache( HANDLE handle, int index, unsigned int access )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+    struct fast_sync_cache_entry *block = fast_sync_cache[entry];
+
+    if (!block)  /* do we need to allocate a new block of entries? */
+    {
+        if (!(block = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                       FAST_SYNC_CACHE_BLOCK_SIZE * sizeof(*block) )))
+            return;
+        if (interlocked_cmpxchg_ptr( (void **)&fast_sync_cache[entry], block, NULL ))
+        {
+            RtlFreeHeap( GetProcessHeap(), 0, block );
+            block = fast_sync_cache[entry];
+        }
+    }
+    block[idx].access = access;
+    interlocked_xchg( &block[idx].index, index );
+}
+
+/***********************************************************************
+ *           fast_sync_remove_from_cache
+ */
+void fast_sync_remove_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+
+    if (entry < FAST_SYNC_CACHE_ENTRIES && fast_sync_cache[entry])
+        interlocked_xchg( &fast_sync_cache[entry][idx].index, 0 );
+}
+
+/* get the shared state of an event, semaphore or mutex; NULL if the server has to handle the call */
+static struct fast_sync_object *get_fast_sync_object( HANDLE handle, unsigned int *access )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+    NTSTATUS ret;
+    int index;
+
+    /* pseudo-handles and very large handle values are never cached */
+    if (!fast_sync_shm || entry >= FAST_SYNC_CACHE_ENTRIES) return NULL;
+
+    if (fast_sync_cache[entry] && (index = fast_sync_cache[entry][idx].index))
+    {
+        *access = fast_sync_cache[entry][idx].access;
+        return index > 0 ? &fast_sync_shm[index - 1] : NULL;
+    }
+
+    SERVER_START_REQ( get_fast_sync_obj )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        if (!(ret = wine_server_call( req )))
+        {
+            index   = reply->index + 1;
+            *access = reply->access;
+        }
+    }
+    SERVER_END_REQ;
+
+    if (ret == STATUS_OBJECT_TYPE_MISMATCH || ret == STATUS_NOT_SUPPORTED) index = -1;
+    else if (ret) return NULL;  /* let the server report the error */
+    add_fast_sync_to_cache( handle, index, *access );
+    return index > 0 ? &fast_sync_shm[index - 1] : NULL;
+}
+
+/* let the server check its wait queues after the object was signaled */
+static void fast_sync_wake_server( HANDLE handle, struct fast_sync_object *sync )
+{
+    /* the state was changed with an interlocked operation, so waiters is up to date */
+    if (!sync->waiters) return;
+
+    SERVER_START_REQ( wake_fast_sync_obj )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+}
+
+/* set the signaled state and bump the set count, so that the waiters notice even a pulse */
+static void fast_sync_set_event( struct fast_sync_object *sync )
+{
+    int value;
+
+    do value = sync->value;
+    while (interlocked_cmpxchg( &sync->value, (int)((unsigned int)value + 2) | FAST_SYNC_EVENT_SIGNALED,
+                                value ) != value);
+    fast_sync_wake( sync, sync->max ? INT_MAX : 1 );
+}
+
+static void fast_sync_reset_event( struct fast_sync_object *sync )
+{
+    int value;
+
+    do value = sync->value;
+    while (interlocked_cmpxchg( &sync->value, value & ~FAST_SYNC_EVENT_SIGNALED, value ) != value);
+}
+
+/* release the threads waiting for the event without leaving it signaled; the manual-reset
+ * waiters notice the set count change, an auto-reset pulse is claimed by a single waiter */
+static void fast_sync_pulse_event( struct fast_sync_object *sync )
+{
+    unsigned int value, pulse;
+
+    do
+    {
+        value = sync->value;
+        if (!(pulse = (value & ~FAST_SYNC_EVENT_SIGNALED) + 2)) pulse = 2;
+    }
+    while (interlocked_cmpxchg( &sync->value, pulse, value ) != value);
+    if (!sync->max) interlocked_xchg( (int *)&sync->count, pulse );
+    fast_sync_wake( sync, INT_MAX );
+}
+
+/* try to acquire an object without blocking; returns STATUS_PENDING if it isn't available */
+static NTSTATUS fast_sync_try_acquire( struct fast_sync_object *sync, int initial, DWORD tid )
+{
+    unsigned int pulse;
+    int value;
+
+    switch (sync->type)
+    {
+    case FAST_SYNC_EVENT:
+        if (sync->max)
+        {
+            /* a manual-reset event also satisfies the wait if it was set and reset in the meantime */
+            value = sync->value;
+            if ((value & FAST_SYNC_EVENT_SIGNALED) || value != initial) return STATUS_SUCCESS;
+            return STATUS_PENDING;
+        }
+        while ((value = sync->value) & FAST_SYNC_EVENT_SIGNALED)
+            if (interlocked_cmpxchg( &sync->value, value & ~FAST_SYNC_EVENT_SIGNALED, value ) == value)
+                return STATUS_SUCCESS;
+
+        /* claim a pulse that happened after the wait started */
+        pulse = sync->count;
+        if (pulse && (int)(pulse - (initial & ~FAST_SYNC_EVENT_SIGNALED)) > 0 &&
+            interlocked_cmpxchg( (int *)&sync->count, 0, pulse ) == pulse)
+            return STATUS_SUCCESS;
+        return STATUS_PENDING;
+
+    case FAST_SYNC_SEMAPHORE:
+        do
+        {
+            value = sync->value;
+            if (value <= 0) return STATUS_PENDING;
+        }
+        while (interlocked_cmpxchg( &sync->value, value - 1, value ) != value);
+        return STATUS_SUCCESS;
+
+    case FAST_SYNC_MUTEX:
+        if (sync->value != (int)tid && interlocked_cmpxchg( &sync->value, tid, 0 ))
+            return STATUS_PENDING;
+        sync->count++;
+        if (interlocked_xchg( &sync->abandoned, 0 )) return STATUS_ABANDONED_WAIT_0;
+        return STATUS_SUCCESS;
+    }
+    return STATUS_PENDING;
+}
+
+/* wait for the objects without going through the server if possible;
+ * returns STATUS_PENDING if the server has to handle the wait */
+static NTSTATUS fast_sync_wait( DWORD count, const HANDLE *handles, const LARGE_INTEGER *timeout )
+{
+    struct fast_sync_object *syncs[MAXIMUM_WAIT_OBJECTS], *sync;
+    DWORD tid = HandleToULong( NtCurrentTeb()->ClientId.UniqueThread );
+    struct timespec ts, *abs_timeout = NULL;
+    unsigned int access;
+    int initial, value, err;
+    NTSTATUS ret;
+    DWORD i;
+
+    if (!fast_sync_shm) return STATUS_PENDING;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(syncs[i] = get_fast_sync_object( handles[i], &access ))) return STATUS_PENDING;
+        if (!(access & SYNCHRONIZE)) return STATUS_PENDING;
+    }
+
+    if (count > 1)
+    {
+        /* only poll the objects, the server handles the blocking wait */
+        for (i = 0; i < count; i++)
+            if ((ret = fast_sync_try_acquire( syncs[i], syncs[i]->value, tid )) != STATUS_PENDING)
+                return ret + i;
+        return (timeout && !timeout->QuadPart) ? STATUS_TIMEOUT : STATUS_PENDING;
+    }
+
+    sync = syncs[0];
+    initial = sync->value;
+    for (;;)
+    {
+        value = sync->value;
+        if ((ret = fast_sync_try_acquire( sync, initial, tid )) != STATUS_PENDING) return ret;
+        if (timeout && !timeout->QuadPart) return STATUS_TIMEOUT;
+        if (timeout && !abs_timeout) abs_timeout = get_abs_timespec( &ts, timeout, TRUE );
+
+        /* the sleepers count update orders the futex value check with the signal */
+        interlocked_xchg_add( &sync->sleepers, 1 );
+        err = futex_wait_shared( &sync->value, value, abs_timeout ) == -1 ? errno : 0;
+        interlocked_xchg_add( &sync->sleepers, -1 );
+        if (err == ETIMEDOUT) return STATUS_TIMEOUT;
+        if (err == ENOSYS) return STATUS_PENDING;
+    }
+}
+
 /*
  *	Semaphores
  */
@@ -225,7 +475,30 @@ NTSTATUS WINAPI NtQuerySemaphore(
  */
 NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous )
 {
+    struct fast_sync_object *sync;
+    unsigned int access, current;
     NTSTATUS ret;
+
+    if ((sync = get_fast_sync_object( handle, &access )) && sync->type == FAST_SYNC_SEMAPHORE)
+    {
+        if (!(access & SEMAPHORE_MODIFY_STATE)) return STATUS_ACCESS_DENIED;
+        do
+        {
+            current = sync->value;
+            if (current + count < current || current + count > sync->max)
+                return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+        }
+        while (interlocked_cmpxchg( &sync->value, current + count, current ) != current);
+        if (previous) *previous = current;
+        /* there cannot be any thread to wake up if the count was != 0 */
+        if (!current)
+        {
+            fast_sync_wake( sync, count );
+            fast_sync_wake_server( handle, sync );
+        }
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( release_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -319,10 +592,20 @@ NTSTATUS WINAPI NtOpenEvent(
  */
 NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    struct fast_sync_object *sync;
+    unsigned int access;
     NTSTATUS ret;
 
     /* FIXME: set NumberOfThreadsReleased */
 
+    if ((sync = get_fast_sync_object( handle, &access )) && sync->type == FAST_SYNC_EVENT)
+    {
+        if (!(access & EVENT_MODIFY_STATE)) return STATUS_ACCESS_DENIED;
+        fast_sync_set_event( sync );
+        fast_sync_wake_server( handle, sync );
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -338,11 +621,20 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
  */
 NTSTATUS WINAPI NtResetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    struct fast_sync_object *sync;
+    unsigned int access;
     NTSTATUS ret;
 
     /* resetting an event can't release any thread... */
     if (NumberOfThreadsReleased) *NumberOfThreadsReleased = 0;
 
+    if ((sync = get_fast_sync_object( handle, &access )) && sync->type == FAST_SYNC_EVENT)
+    {
+        if (!(access & EVENT_MODIFY_STATE)) return STATUS_ACCESS_DENIED;
+        fast_sync_reset_event( sync );
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -372,11 +664,22 @@ NTSTATUS WINAPI NtClearEvent ( HANDLE handle )
  */
 NTSTATUS WINAPI NtPulseEvent( HANDLE handle, PULONG PulseCount )
 {
+    struct fast_sync_object *sync;
+    unsigned int access;
     NTSTATUS ret;
 
     if (PulseCount)
       FIXME("(%p,%d)\n", handle, *PulseCount);
 
+    /* the server waiters would miss the pulse, so let the server handle it if there are any */
+    if ((sync = get_fast_sync_object( handle, &access )) && sync->type == FAST_SYNC_EVENT &&
+        !sync->waiters)
+    {
+        if (!(access & EVENT_MODIFY_STATE)) return STATUS_ACCESS_DENIED;
+        fast_sync_pulse_event( sync );
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -480,8 +783,25 @@ NTSTATUS WINAPI NtOpenMutant(OUT HANDLE* MutantHandle,
  */
 NTSTATUS WINAPI NtReleaseMutant( IN HANDLE handle, OUT PLONG prev_count OPTIONAL)
 {
+    struct fast_sync_object *sync;
+    unsigned int access;
     NTSTATUS    status;
 
+    if ((sync = get_fast_sync_object( handle, &access )) && sync->type == FAST_SYNC_MUTEX)
+    {
+        DWORD tid = HandleToULong( NtCurrentTeb()->ClientId.UniqueThread );
+
+        if (sync->value != (int)tid || !sync->count) return STATUS_MUTANT_NOT_OWNED;
+        if (prev_count) *prev_count = sync->count;
+        if (!--sync->count)
+        {
+            interlocked_xchg( &sync->value, 0 );
+            fast_sync_wake( sync, 1 );
+            fast_sync_wake_server( handle, sync );
+        }
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( release_mutex )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -1082,13 +1402,9 @@ NTSTATUS NTDLL_queue_process_apc( HANDLE process, const apc_call_t *call, apc_re
 }
 
 
-/***********************************************************************
- *              NTDLL_wait_for_multiple_objects
- *
- * Implementation of NtWaitForMultipleObjects
- */
-NTSTATUS NTDLL_wait_for_multiple_objects( UINT count, const HANDLE *handles, UINT flags,
-                                          const LARGE_INTEGER *timeout, HANDLE signal_object )
+/* wait on a list of handles in the server; the key is only used by keyed event operations */
+static NTSTATUS server_wait( UINT count, const HANDLE *handles, UINT flags, const void *key,
+                             const LARGE_INTEGER *timeout, HANDLE signal_object )
 {
     NTSTATUS ret;
     UINT i;
@@ -1112,6 +1428,7 @@ NTSTATUS NTDLL_wait_for_multiple_objects( UINT count, const HANDLE *handles, UIN
             req->signal   = wine_server_obj_handle( signal_object );
             req->prev_apc = apc_handle;
             req->timeout  = abs_timeout;
+            req->key      = wine_server_client_ptr( key );
             wine_server_add_data( req, &result, sizeof(result) );
             wine_server_add_data( req, obj_handles, count * sizeof(*obj_handles) );
             ret = wine_server_call( req );
@@ -1143,6 +1460,18 @@ NTSTATUS NTDLL_wait_for_multiple_objects( UINT count, const HANDLE *handles, UIN
 }
 
 
+/***********************************************************************
+ *              NTDLL_wait_for_multiple_objects
+ *
+ * Implementation of NtWaitForMultipleObjects
+ */
+NTSTATUS NTDLL_wait_for_multiple_objects( UINT count, const HANDLE *handles, UINT flags,
+                                          const LARGE_INTEGER *timeout, HANDLE signal_object )
+{
+    return server_wait( count, handles, flags, NULL, timeout, signal_object );
+}
+
+
 /* wait operations */
 
 /******************************************************************
@@ -1153,9 +1482,14 @@ NTSTATUS WINAPI NtWaitForMultipleObjects( DWORD count, const HANDLE *handles,
                                           const LARGE_INTEGER *timeout )
 {
     UINT flags = SELECT_INTERRUPTIBLE;
+    NTSTATUS ret;
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    if (!alertable && (count == 1 || !wait_all) &&
+        (ret = fast_sync_wait( count, handles, timeout )) != STATUS_PENDING)
+        return ret;
+
     if (wait_all) flags |= SELECT_ALL;
     if (alertable) flags |= SELECT_ALERTABLE;
     return NTDLL_wait_for_multiple_objects( count, handles, flags, timeout, 0 );
@@ -1469,3 +1803,844 @@ VOID NTAPI RtlRunOnceInitialize(PRTL_RUN_ONCE initonce)
 {
     initonce->Ptr = NULL;
 }
+
+
+/* SRW locks and condition variables
+ *
+ * The lock word is the first 32 bits of the SRWLOCK pointer. It holds the
+ * number of shared owners, the number of threads waiting to acquire the lock
+ * exclusively, and flags for exclusive ownership and for waiting shared
+ * threads. Exclusive waiters are preferred: shared acquirers don't get the
+ * lock while an exclusive waiter is queued, so writers can't be starved.
+ *
+ * Everything is done with atomic operations on the lock word, and threads
+ * only sleep on futexes when there is contention, so the wineserver is never
+ * involved. When futexes are missing they sleep in the process wait table
+ * below instead, which is also used by the keyed events.
+ */
+
+#define SRWLOCK_EXCLUSIVE_BIT       0x80000000
+#define SRWLOCK_SHARED_WAITERS_BIT  0x40000000
+#define SRWLOCK_EXCLUSIVE_WAITERS   0x3fff0000
+#define SRWLOCK_EXCLUSIVE_WAITER    0x00010000
+#define SRWLOCK_SHARED_OWNERS       0x0000ffff
+#define SRWLOCK_SHARED_OWNER        0x00000001
+
+/* futex bitsets, so that exclusive and shared waiters can be woken separately */
+#define SRWLOCK_WAIT_EXCLUSIVE      1
+#define SRWLOCK_WAIT_SHARED         2
+
+#define TICKSPERSEC 10000000
+
+int futex_private = 128;  /* FUTEX_PRIVATE_FLAG */
+
+/***********************************************************************
+ *           use_futexes
+ *
+ * Check whether the kernel supports the futex operations, and whether they can be private.
+ */
+int use_futexes(void)
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        int val = 10;
+
+        futex_wait_bitset( &val, 0, NULL, ~0 );
+        if (errno == ENOSYS)
+        {
+            futex_private = 0;
+            futex_wait_bitset( &val, 0, NULL, ~0 );
+        }
+        supported = (errno != ENOSYS);
+    }
+    return supported;
+}
+
+/* convert an NT timeout to a relative timespec; returns NULL for infinite timeouts */
+static struct timespec *get_relative_timespec( struct timespec *ts, const LARGE_INTEGER *timeout )
+{
+    LONGLONG diff;
+
+    if (!timeout) return NULL;
+    if (timeout->QuadPart <= 0) diff = -timeout->QuadPart;
+    else
+    {
+        LARGE_INTEGER now;
+        NtQuerySystemTime( &now );
+        diff = max( 0, timeout->QuadPart - now.QuadPart );
+    }
+    ts->tv_sec  = diff / TICKSPERSEC;
+    ts->tv_nsec = (diff % TICKSPERSEC) * 100;
+    return ts;
+}
+
+/* convert an NT timeout to an absolute timespec; returns NULL for infinite timeouts */
+static struct timespec *get_abs_timespec( struct timespec *ts, const LARGE_INTEGER *timeout, BOOL monotonic )
+{
+    struct timespec rel;
+
+    if (!get_relative_timespec( &rel, timeout )) return NULL;
+
+#ifdef __linux__
+    clock_gettime( monotonic ? CLOCK_MONOTONIC : CLOCK_REALTIME, ts );
+#else
+    {
+        struct timeval now;
+        gettimeofday( &now, NULL );
+        ts->tv_sec  = now.tv_sec;
+        ts->tv_nsec = now.tv_usec * 1000;
+    }
+#endif
+    ts->tv_sec  += rel.tv_sec;
+    ts->tv_nsec += rel.tv_nsec;
+    if (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+#define WAIT_TABLE_SIZE 64  /* must be a power of 2 */
+
+enum wait_type
+{
+    WAIT_KEYED_EVENT,     /* waiting in NtWaitForKeyedEvent */
+    RELEASE_KEYED_EVENT,  /* waiting in NtReleaseKeyedEvent */
+    WAIT_ADDRESS          /* waiting for a value change, when futexes are missing */
+};
+
+struct wait_entry
+{
+    struct list     entry;   /* entry in the bucket list */
+    enum wait_type  type;    /* what the thread is waiting for */
+    unsigned int    id;      /* keyed event id, 0 for the process keyed event and addresses */
+    const void     *key;     /* keyed event key or address */
+    int             mask;    /* wake bitset for address waits */
+    int             woken;   /* set once woken, used as futex */
+};
+
+struct wait_bucket
+{
+    pthread_mutex_t mutex;   /* protects the list and the entries */
+    pthread_cond_t  cond;    /* signaled on wake when futexes are missing */
+    struct list     waits;   /* waiting threads */
+};
+
+static struct wait_bucket wait_table[WAIT_TABLE_SIZE];
+static pthread_once_t wait_table_once = PTHREAD_ONCE_INIT;
+
+static void init_wait_table(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < WAIT_TABLE_SIZE; i++)
+    {
+        pthread_mutex_init( &wait_table[i].mutex, NULL );
+        pthread_cond_init( &wait_table[i].cond, NULL );
+        list_init( &wait_table[i].waits );
+    }
+}
+
+/* get the locked bucket for a keyed event key or an address */
+static struct wait_bucket *lock_wait_bucket( unsigned int id, const void *key )
+{
+    ULONG_PTR hash = ((ULONG_PTR)key >> 2) ^ ((ULONG_PTR)key >> 9) ^ id;
+    struct wait_bucket *bucket = &wait_table[hash & (WAIT_TABLE_SIZE - 1)];
+
+    pthread_once( &wait_table_once, init_wait_table );
+    pthread_mutex_lock( &bucket->mutex );
+    return bucket;
+}
+
+/* queue a wait entry and sleep until it gets woken; called with the bucket locked */
+static NTSTATUS block_on_wait_entry( struct wait_bucket *bucket, struct wait_entry *wait,
+                                     const LARGE_INTEGER *timeout )
+{
+    struct timespec ts, *end;
+    int ret = 0;
+
+    wait->woken = 0;
+    list_add_tail( &bucket->waits, &wait->entry );
+
+    if (use_futexes())
+    {
+        end = get_abs_timespec( &ts, timeout, TRUE );
+        pthread_mutex_unlock( &bucket->mutex );
+        while (!*(volatile int *)&wait->woken)
+        {
+            if (futex_wait_bitset( &wait->woken, 0, end, ~0 ) == -1 && errno == ETIMEDOUT) break;
+        }
+        pthread_mutex_lock( &bucket->mutex );
+    }
+    else
+    {
+        end = get_abs_timespec( &ts, timeout, FALSE );
+        while (!wait->woken && ret != ETIMEDOUT)
+        {
+            if (end) ret = pthread_cond_timedwait( &bucket->cond, &bucket->mutex, end );
+            else pthread_cond_wait( &bucket->cond, &bucket->mutex );
+        }
+    }
+
+    /* the entry may have been woken right after the timeout */
+    if (wait->woken) return STATUS_SUCCESS;
+    list_remove( &wait->entry );
+    return STATUS_TIMEOUT;
+}
+
+/* wake a queued entry; called with the bucket locked */
+static void wake_wait_entry( struct wait_bucket *bucket, struct wait_entry *wait )
+{
+    list_remove( &wait->entry );
+    wait->woken = 1;
+    if (use_futexes()) futex_wake_bitset( &wait->woken, 1, ~0 );
+    else pthread_cond_broadcast( &bucket->cond );
+}
+
+/* wait until the value at addr is no longer val, or until the timeout expires */
+static NTSTATUS wait_for_value_change( int *addr, int val, const LARGE_INTEGER *timeout, int mask )
+{
+    struct wait_bucket *bucket;
+    struct wait_entry wait;
+    struct timespec ts;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    if (use_futexes())
+    {
+        if (futex_wait_bitset( addr, val, get_abs_timespec( &ts, timeout, TRUE ), mask ) == -1 &&
+            errno == ETIMEDOUT)
+            return STATUS_TIMEOUT;
+        return STATUS_SUCCESS;
+    }
+
+    /* the value is checked with the bucket locked, so a wake can't get lost */
+    bucket = lock_wait_bucket( 0, addr );
+    if (*(volatile int *)addr == val)
+    {
+        wait.type = WAIT_ADDRESS;
+        wait.id   = 0;
+        wait.key  = addr;
+        wait.mask = mask;
+        status = block_on_wait_entry( bucket, &wait, timeout );
+    }
+    pthread_mutex_unlock( &bucket->mutex );
+    return status;
+}
+
+/* wake up to count threads waiting for the value at addr to change; returns the number woken */
+static int wake_value_waiters( int *addr, int count, int mask )
+{
+    struct wait_bucket *bucket;
+    struct wait_entry *entry, *next;
+    int woken = 0;
+
+    if (use_futexes()) return max( 0, futex_wake_bitset( addr, count, mask ) );
+
+    bucket = lock_wait_bucket( 0, addr );
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &bucket->waits, struct wait_entry, entry )
+    {
+        if (entry->type != WAIT_ADDRESS || entry->key != addr || !(entry->mask & mask)) continue;
+        wake_wait_entry( bucket, entry );
+        if (++woken == count) break;
+    }
+    pthread_mutex_unlock( &bucket->mutex );
+    return woken;
+}
+
+static inline int *get_srwlock_word( RTL_SRWLOCK *lock )
+{
+    return (int *)&lock->Ptr;
+}
+
+/***********************************************************************
+ *              RtlInitializeSRWLock (NTDLL.@)
+ */
+void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
+{
+    lock->Ptr = NULL;
+}
+
+/***********************************************************************
+ *              RtlAcquireSRWLockExclusive (NTDLL.@)
+ */
+void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
+{
+    int *word = get_srwlock_word( lock );
+    int old, new;
+
+    if (!interlocked_cmpxchg( word, SRWLOCK_EXCLUSIVE_BIT, 0 )) return;
+
+    /* register as an exclusive waiter so that new shared owners stay out */
+    interlocked_xchg_add( word, SRWLOCK_EXCLUSIVE_WAITER );
+    for (;;)
+    {
+        old = *(volatile int *)word;
+        if (!(old & (SRWLOCK_EXCLUSIVE_BIT | SRWLOCK_SHARED_OWNERS)))
+        {
+            new = (old | SRWLOCK_EXCLUSIVE_BIT) - SRWLOCK_EXCLUSIVE_WAITER;
+            if (interlocked_cmpxchg( word, new, old ) == old) return;
+            continue;
+        }
+        wait_for_value_change( word, old, NULL, SRWLOCK_WAIT_EXCLUSIVE );
+    }
+}
+
+/***********************************************************************
+ *              RtlAcquireSRWLockShared (NTDLL.@)
+ */
+void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
+{
+    int *word = get_srwlock_word( lock );
+    int old, new;
+
+    for (;;)
+    {
+        old = *(volatile int *)word;
+        if (!(old & (SRWLOCK_EXCLUSIVE_BIT | SRWLOCK_EXCLUSIVE_WAITERS)))
+        {
+            new = old + SRWLOCK_SHARED_OWNER;
+            if (interlocked_cmpxchg( word, new, old ) == old) return;
+            continue;
+        }
+        new = old | SRWLOCK_SHARED_WAITERS_BIT;
+        if (new != old && interlocked_cmpxchg( word, new, old ) != old) continue;
+        wait_for_value_change( word, new, NULL, SRWLOCK_WAIT_SHARED );
+    }
+}
+
+/***********************************************************************
+ *              RtlReleaseSRWLockExclusive (NTDLL.@)
+ */
+void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
+{
+    int *word = get_srwlock_word( lock );
+    int old, new;
+
+    do
+    {
+        old = *(volatile int *)word;
+        if (!(old & SRWLOCK_EXCLUSIVE_BIT))
+        {
+            ERR( "lock %p is not owned exclusively (%#x)\n", lock, old );
+            return;
+        }
+        new = old & ~SRWLOCK_EXCLUSIVE_BIT;
+        /* the shared waiters keep waiting if an exclusive waiter goes first */
+        if (!(new & SRWLOCK_EXCLUSIVE_WAITERS)) new &= ~SRWLOCK_SHARED_WAITERS_BIT;
+    } while (interlocked_cmpxchg( word, new, old ) != old);
+
+    if (new & SRWLOCK_EXCLUSIVE_WAITERS)
+        wake_value_waiters( word, 1, SRWLOCK_WAIT_EXCLUSIVE );
+    else if (old & SRWLOCK_SHARED_WAITERS_BIT)
+        wake_value_waiters( word, INT_MAX, SRWLOCK_WAIT_SHARED );
+}
+
+/***********************************************************************
+ *              RtlReleaseSRWLockShared (NTDLL.@)
+ */
+void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
+{
+    int *word = get_srwlock_word( lock );
+    int old, new;
+
+    do
+    {
+        old = *(volatile int *)word;
+        if ((old & SRWLOCK_EXCLUSIVE_BIT) || !(old & SRWLOCK_SHARED_OWNERS))
+        {
+            ERR( "lock %p is not owned shared (%#x)\n", lock, old );
+            return;
+        }
+        new = old - SRWLOCK_SHARED_OWNER;
+    } while (interlocked_cmpxchg( word, new, old ) != old);
+
+    /* only the last owner needs to wake up an exclusive waiter */
+    if (!(new & SRWLOCK_SHARED_OWNERS) && (new & SRWLOCK_EXCLUSIVE_WAITERS))
+        wake_value_waiters( word, 1, SRWLOCK_WAIT_EXCLUSIVE );
+}
+
+/***********************************************************************
+ *              RtlTryAcquireSRWLockExclusive (NTDLL.@)
+ */
+BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
+{
+    int *word = get_srwlock_word( lock );
+    int old;
+
+    do
+    {
+        old = *(volatile int *)word;
+        if (old & (SRWLOCK_EXCLUSIVE_BIT | SRWLOCK_SHARED_OWNERS)) return FALSE;
+    } while (interlocked_cmpxchg( word, old | SRWLOCK_EXCLUSIVE_BIT, old ) != old);
+    return TRUE;
+}
+
+/***********************************************************************
+ *              RtlTryAcquireSRWLockShared (NTDLL.@)
+ */
+BOOLEAN WINAPI RtlTryAcquireSRWLockShared( RTL_SRWLOCK *lock )
+{
+    int *word = get_srwlock_word( lock );
+    int old;
+
+    do
+    {
+        old = *(volatile int *)word;
+        if (old & (SRWLOCK_EXCLUSIVE_BIT | SRWLOCK_EXCLUSIVE_WAITERS)) return FALSE;
+    } while (interlocked_cmpxchg( word, old + SRWLOCK_SHARED_OWNER, old ) != old);
+    return TRUE;
+}
+
+/* The condition variable holds the number of sleeping threads in the low
+ * bits, and a sequence number that changes on every wake in the high bits.
+ * A wake without sleepers is a plain read and never reaches the kernel. */
+#define CONDVAR_WAITERS  0x0000ffff
+#define CONDVAR_WAITER   0x00000001
+#define CONDVAR_SEQ_INC  0x00010000
+
+static inline int *get_condition_variable_word( RTL_CONDITION_VARIABLE *variable )
+{
+    return (int *)&variable->Ptr;
+}
+
+/* wait for the sequence number to change, then unregister as waiter */
+static NTSTATUS wait_for_condition_variable( int *word, int seq, const LARGE_INTEGER *timeout )
+{
+    LARGE_INTEGER end;
+    NTSTATUS status;
+    int val = seq;
+
+    /* other threads coming and going change the word too, so keep an absolute timeout */
+    if (timeout && timeout->QuadPart < 0)
+    {
+        NtQuerySystemTime( &end );
+        end.QuadPart -= timeout->QuadPart;
+        timeout = &end;
+    }
+    do
+    {
+        if ((status = wait_for_value_change( word, val, timeout, ~0 ))) break;
+        val = *(volatile int *)word;
+    } while (!((val ^ seq) & ~CONDVAR_WAITERS));
+
+    interlocked_xchg_add( word, -CONDVAR_WAITER );
+    return status;
+}
+
+/***********************************************************************
+ *              RtlInitializeConditionVariable (NTDLL.@)
+ */
+void WINAPI RtlInitializeConditionVariable( RTL_CONDITION_VARIABLE *variable )
+{
+    variable->Ptr = NULL;
+}
+
+/***********************************************************************
+ *              RtlWakeConditionVariable (NTDLL.@)
+ */
+void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
+{
+    int *word = get_condition_variable_word( variable );
+
+    if (!(*(volatile int *)word & CONDVAR_WAITERS)) return;
+    interlocked_xchg_add( word, CONDVAR_SEQ_INC );
+    wake_value_waiters( word, 1, ~0 );
+}
+
+/***********************************************************************
+ *              RtlWakeAllConditionVariable (NTDLL.@)
+ */
+void WINAPI RtlWakeAllConditionVariable( RTL_CONDITION_VARIABLE *variable )
+{
+    int *word = get_condition_variable_word( variable );
+
+    if (!(*(volatile int *)word & CONDVAR_WAITERS)) return;
+    interlocked_xchg_add( word, CONDVAR_SEQ_INC );
+    wake_value_waiters( word, INT_MAX, ~0 );
+}
+
+/***********************************************************************
+ *              RtlSleepConditionVariableCS (NTDLL.@)
+ */
+NTSTATUS WINAPI RtlSleepConditionVariableCS( RTL_CONDITION_VARIABLE *variable, RTL_CRITICAL_SECTION *crit,
+                                             const LARGE_INTEGER *timeout )
+{
+    int *word = get_condition_variable_word( variable );
+    int seq = interlocked_xchg_add( word, CONDVAR_WAITER ) + CONDVAR_WAITER;
+    NTSTATUS status;
+
+    RtlLeaveCriticalSection( crit );
+    status = wait_for_condition_variable( word, seq, timeout );
+    RtlEnterCriticalSection( crit );
+    return status;
+}
+
+/***********************************************************************
+ *              RtlSleepConditionVariableSRW (NTDLL.@)
+ */
+NTSTATUS WINAPI RtlSleepConditionVariableSRW( RTL_CONDITION_VARIABLE *variable, RTL_SRWLOCK *lock,
+                                              const LARGE_INTEGER *timeout, ULONG flags )
+{
+    int *word = get_condition_variable_word( variable );
+    int seq = interlocked_xchg_add( word, CONDVAR_WAITER ) + CONDVAR_WAITER;
+    NTSTATUS status;
+
+    if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+        RtlReleaseSRWLockShared( lock );
+    else
+        RtlReleaseSRWLockExclusive( lock );
+
+    status = wait_for_condition_variable( word, seq, timeout );
+
+    if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+        RtlAcquireSRWLockShared( lock );
+    else
+        RtlAcquireSRWLockExclusive( lock );
+    return status;
+}
+
+
+/* Keyed events
+ *
+ * A waiter and a releaser for the same key meet in a hashed wait table inside
+ * the process: whichever comes first queues itself in its bucket and sleeps
+ * until the other one shows up. Like on Windows, only threads of the same
+ * process are paired, so the table is enough for unnamed keyed events, even
+ * when the handle was duplicated into another process. The waits match on
+ * the id the server gave to the object, not on the handle value, so that any
+ * handle to the same keyed event can be used. Named keyed events can be
+ * opened by name from anywhere, so their waits always go through the server.
+ * A NULL handle selects the process keyed event, like on Vista.
+ */
+
+struct keyed_event_cache_entry
+{
+    unsigned int id;          /* server id of the keyed event, 0 if unknown */
+    unsigned int access : 31; /* access rights of the handle */
+    unsigned int shared : 1;  /* waits have to go through the server */
+};
+
+#define KEYED_EVENT_CACHE_BLOCK_SIZE  (65536 / sizeof(struct keyed_event_cache_entry))
+#define KEYED_EVENT_CACHE_ENTRIES     128
+
+static struct keyed_event_cache_entry *keyed_event_cache[KEYED_EVENT_CACHE_ENTRIES];
+
+static inline unsigned int keyed_event_handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / KEYED_EVENT_CACHE_BLOCK_SIZE;
+    return idx % KEYED_EVENT_CACHE_BLOCK_SIZE;
+}
+
+static void add_keyed_event_to_cache( HANDLE handle, unsigned int id, unsigned int access, int shared )
+{
+    unsigned int entry, idx = keyed_event_handle_to_index( handle, &entry );
+    struct keyed_event_cache_entry *block;
+
+    if (entry >= KEYED_EVENT_CACHE_ENTRIES) return;
+
+    if (!(block = keyed_event_cache[entry]))  /* do we need to allocate a new block of entries? */
+    {
+        if (!(block = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                       KEYED_EVENT_CACHE_BLOCK_SIZE * sizeof(*block) )))
+            return;
+        if (interlocked_cmpxchg_ptr( (void **)&keyed_event_cache[entry], block, NULL ))
+        {
+            RtlFreeHeap( GetProcessHeap(), 0, block );
+            block = keyed_event_cache[entry];
+        }
+    }
+    block[idx].access = access;
+    block[idx].shared = shared;
+    interlocked_xchg( (int *)&block[idx].id, id );
+}
+
+/***********************************************************************
+ *           keyed_event_remove_from_cache
+ */
+void keyed_event_remove_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = keyed_event_handle_to_index( handle, &entry );
+
+    if (entry < KEYED_EVENT_CACHE_ENTRIES && keyed_event_cache[entry])
+        interlocked_xchg( (int *)&keyed_event_cache[entry][idx].id, 0 );
+}
+
+/* check the type and access rights of a keyed event handle, and get the object id */
+static NTSTATUS get_keyed_event_id( HANDLE handle, ACCESS_MASK access, unsigned int *id, int *shared )
+{
+    unsigned int entry, idx = keyed_event_handle_to_index( handle, &entry );
+    unsigned int handle_access;
+    NTSTATUS ret;
+
+    if (entry < KEYED_EVENT_CACHE_ENTRIES && keyed_event_cache[entry] &&
+        (*id = keyed_event_cache[entry][idx].id))
+    {
+        if ((keyed_event_cache[entry][idx].access & access) != access) return STATUS_ACCESS_DENIED;
+        *shared = keyed_event_cache[entry][idx].shared;
+        return STATUS_SUCCESS;
+    }
+
+    SERVER_START_REQ( get_keyed_event_info )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        req->access = access;
+        if (!(ret = wine_server_call( req )))
+        {
+            *id           = reply->id;
+            *shared       = reply->shared;
+            handle_access = reply->access;
+        }
+    }
+    SERVER_END_REQ;
+
+    if (!ret) add_keyed_event_to_cache( handle, *id, handle_access, *shared );
+    return ret;
+}
+
+/******************************************************************************
+ *              NtCreateKeyedEvent (NTDLL.@)
+ *              ZwCreateKeyedEvent (NTDLL.@)
+ */
+NTSTATUS WINAPI NtCreateKeyedEvent( HANDLE *handle, ACCESS_MASK access,
+                                    const OBJECT_ATTRIBUTES *attr, ULONG flags )
+{
+    DWORD len = attr && attr->ObjectName ? attr->ObjectName->Length : 0;
+    NTSTATUS ret;
+    struct security_descriptor *sd = NULL;
+    struct object_attributes objattr;
+
+    if (len >= MAX_PATH * sizeof(WCHAR)) return STATUS_NAME_TOO_LONG;
+
+    objattr.rootdir = wine_server_obj_handle( attr ? attr->RootDirectory : 0 );
+    objattr.sd_len = 0;
+    objattr.name_len = len;
+    if (attr)
+    {
+        ret = NTDLL_create_struct_sd( attr->SecurityDescriptor, &sd, &objattr.sd_len );
+        if (ret != STATUS_SUCCESS) return ret;
+    }
+
+    SERVER_START_REQ( create_keyed_event )
+    {
+        req->access = access;
+        req->attributes = attr ? attr->Attributes : 0;
+        wine_server_add_data( req, &objattr, sizeof(objattr) );
+        if (objattr.sd_len) wine_server_add_data( req, sd, objattr.sd_len );
+        if (len) wine_server_add_data( req, attr->ObjectName->Buffer, len );
+        ret = wine_server_call( req );
+        *handle = wine_server_ptr_handle( reply->handle );
+        if (!ret) add_keyed_event_to_cache( *handle, reply->id, reply->access, reply->shared );
+    }
+    SERVER_END_REQ;
+
+    NTDLL_free_struct_sd( sd );
+    return ret;
+}
+
+/******************************************************************************
+ *              NtOpenKeyedEvent (NTDLL.@)
+ *              ZwOpenKeyedEvent (NTDLL.@)
+ */
+NTSTATUS WINAPI NtOpenKeyedEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_ATTRIBUTES *attr )
+{
+    DWORD len = attr && attr->ObjectName ? attr->ObjectName->Length : 0;
+    NTSTATUS ret;
+
+    if (len >= MAX_PATH * sizeof(WCHAR)) return STATUS_NAME_TOO_LONG;
+
+    SERVER_START_REQ( open_keyed_event )
+    {
+        req->access     = access;
+        req->attributes = attr ? attr->Attributes : 0;
+        req->rootdir    = wine_server_obj_handle( attr ? attr->RootDirectory : 0 );
+        if (len) wine_server_add_data( req, attr->ObjectName->Buffer, len );
+        ret = wine_server_call( req );
+        *handle = wine_server_ptr_handle( reply->handle );
+        if (!ret) add_keyed_event_to_cache( *handle, reply->id, reply->access, reply->shared );
+    }
+    SERVER_END_REQ;
+    return ret;
+}
+
+/* meet the thread doing the opposite keyed event operation */
+static NTSTATUS keyed_event_rendezvous( HANDLE handle, const void *key, BOOLEAN alertable,
+                                        const LARGE_INTEGER *timeout, BOOL release )
+{
+    enum wait_type type = release ? RELEASE_KEYED_EVENT : WAIT_KEYED_EVENT;
+    enum wait_type other = release ? WAIT_KEYED_EVENT : RELEASE_KEYED_EVENT;
+    struct wait_bucket *bucket;
+    struct wait_entry *entry, wait;
+    unsigned int id = 0;
+    int shared = 0;
+    NTSTATUS status;
+
+    if ((ULONG_PTR)key & 1) return STATUS_INVALID_PARAMETER_1;
+
+    if (handle && (status = get_keyed_event_id( handle, release ? KEYEDEVENT_WAKE : KEYEDEVENT_WAIT,
+                                                &id, &shared )))
+        return status;
+
+    if (shared)
+    {
+        UINT flags = release ? SELECT_KEYED_EVENT_RELEASE : SELECT_KEYED_EVENT_WAIT;
+        if (alertable) flags |= SELECT_ALERTABLE;
+        return server_wait( 1, &handle, flags, key, timeout, 0 );
+    }
+    if (alertable) FIXME( "alertable keyed event waits not supported\n" );
+
+    status = STATUS_SUCCESS;
+    bucket = lock_wait_bucket( id, key );
+    LIST_FOR_EACH_ENTRY( entry, &bucket->waits, struct wait_entry, entry )
+    {
+        if (entry->type != other || entry->id != id || entry->key != key) continue;
+        wake_wait_entry( bucket, entry );
+        goto done;
+    }
+    wait.type = type;
+    wait.id   = id;
+    wait.key  = key;
+    wait.mask = ~0;
+    status = block_on_wait_entry( bucket, &wait, timeout );
+done:
+    pthread_mutex_unlock( &bucket->mutex );
+    return status;
+}
+
+/******************************************************************************
+ *              NtWaitForKeyedEvent (NTDLL.@)
+ *              ZwWaitForKeyedEvent (NTDLL.@)
+ */
+NTSTATUS WINAPI NtWaitForKeyedEvent( HANDLE handle, const void *key,
+                                     BOOLEAN alertable, const LARGE_INTEGER *timeout )
+{
+    return keyed_event_rendezvous( handle, key, alertable, timeout, FALSE );
+}
+
+/******************************************************************************
+ *              NtReleaseKeyedEvent (NTDLL.@)
+ *              ZwReleaseKeyedEvent (NTDLL.@)
+ */
+NTSTATUS WINAPI NtReleaseKeyedEvent( HANDLE handle, const void *key,
+                                     BOOLEAN alertable, const LARGE_INTEGER *timeout )
+{
+    return keyed_event_rendezvous( handle, key, alertable, timeout, TRUE );
+}
+
+/* Run once
+ *
+ * The low bits of the pointer hold the state: 0 not started, 1 in progress,
+ * 2 done, and 3 in progress asynchronously. While in progress the rest of the
+ * pointer is a list of waiting threads, linked through their stacks; they are
+ * woken through the process keyed event once the initialization completes.
+ */
+
+/******************************************************************
+ *              RtlRunOnceBeginInitialize (NTDLL.@)
+ */
+DWORD WINAPI RtlRunOnceBeginInitialize( RTL_RUN_ONCE *once, ULONG flags, void **context )
+{
+    if (flags & RTL_RUN_ONCE_CHECK_ONLY)
+    {
+        ULONG_PTR val = (ULONG_PTR)once->Ptr;
+
+        if (flags & RTL_RUN_ONCE_ASYNC) return STATUS_INVALID_PARAMETER;
+        if ((val & 3) != 2) return STATUS_UNSUCCESSFUL;
+        if (context) *context = (void *)(val & ~3);
+        return STATUS_SUCCESS;
+    }
+
+    for (;;)
+    {
+        ULONG_PTR next, val = (ULONG_PTR)once->Ptr;
+
+        switch (val & 3)
+        {
+        case 0:  /* first time */
+            if (!interlocked_cmpxchg_ptr( &once->Ptr,
+                                          (flags & RTL_RUN_ONCE_ASYNC) ? (void *)3 : (void *)1, 0 ))
+                return STATUS_PENDING;
+            break;
+
+        case 1:  /* in progress, wait */
+            if (flags & RTL_RUN_ONCE_ASYNC) return STATUS_INVALID_PARAMETER;
+            next = val & ~3;
+            if (interlocked_cmpxchg_ptr( &once->Ptr, (void *)((ULONG_PTR)&next | 1),
+                                         (void *)val ) == (void *)val)
+                NtWaitForKeyedEvent( 0, &next, FALSE, NULL );
+            break;
+
+        case 2:  /* done */
+            if (context) *context = (void *)(val & ~3);
+            return STATUS_SUCCESS;
+
+        case 3:  /* in progress, async */
+            if (!(flags & RTL_RUN_ONCE_ASYNC)) return STATUS_INVALID_PARAMETER;
+            return STATUS_PENDING;
+        }
+    }
+}
+
+/******************************************************************
+ *              RtlRunOnceComplete (NTDLL.@)
+ */
+DWORD WINAPI RtlRunOnceComplete( RTL_RUN_ONCE *once, ULONG flags, void *context )
+{
+    if ((ULONG_PTR)context & 3) return STATUS_INVALID_PARAMETER;
+
+    if (flags & RTL_RUN_ONCE_INIT_FAILED)
+    {
+        if (context) return STATUS_INVALID_PARAMETER;
+        if (flags & RTL_RUN_ONCE_ASYNC) return STATUS_INVALID_PARAMETER;
+    }
+    else context = (void *)((ULONG_PTR)context | 2);
+
+    for (;;)
+    {
+        ULONG_PTR val = (ULONG_PTR)once->Ptr;
+
+        switch (val & 3)
+        {
+        case 1:  /* in progress */
+            if (interlocked_cmpxchg_ptr( &once->Ptr, context, (void *)val ) != (void *)val) break;
+            val &= ~3;
+            while (val)
+            {
+                ULONG_PTR next = *(ULONG_PTR *)val;
+                NtReleaseKeyedEvent( 0, (void *)val, FALSE, NULL );
+                val = next;
+            }
+            return STATUS_SUCCESS;
+
+        case 3:  /* in progress, async */
+            if (!(flags & RTL_RUN_ONCE_ASYNC)) return STATUS_INVALID_PARAMETER;
+            if (interlocked_cmpxchg_ptr( &once->Ptr, context, (void *)val ) != (void *)val) break;
+            return STATUS_SUCCESS;
+
+        default:
+            return STATUS_UNSUCCESSFUL;
+        }
+    }
+}
+
+/******************************************************************
+ *              RtlRunOnceExecuteOnce (NTDLL.@)
+ */
+DWORD WINAPI RtlRunOnceExecuteOnce( RTL_RUN_ONCE *once, PRTL_RUN_ONCE_INIT_FN func,
+                                    void *param, void **context )
+{
+    DWORD ret = RtlRunOnceBeginInitialize( once, 0, context );
+
+    if (ret != STATUS_PENDING) return ret;
+
+    if (!func( once, param, context ))
+    {
+        RtlRunOnceComplete( once, RTL_RUN_ONCE_INIT_FAILED, NULL );
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return RtlRunOnceComplete( once, 0, context ? *context : NULL );
+}
@@ -324,6 +324,99 @@ static void test_redirection(void)
     pRtlWow64EnableFsRedirectionEx( old, &cur );
 }
 
+#define DIR_PERF_FILES 10000
+
+/* create a directory with many files for the benchmarks, return FALSE if it failed */
+static BOOL set_up_perf_dir(const char *dirA)
+{
+    char buf[MAX_PATH];
+    HANDLE h;
+    int i;
+
+    if (!CreateDirectoryA(dirA, NULL)) return FALSE;
+    for (i = 0; i < DIR_PERF_FILES; i++)
+    {
+        sprintf(buf, "%s\\File%05u.tmp", dirA, i);
+        h = CreateFileA(buf, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if (h == INVALID_HANDLE_VALUE) return FALSE;
+        CloseHandle(h);
+    }
+    return TRUE;
+}
+
+static void tear_down_perf_dir(const char *dirA)
+{
+    char buf[MAX_PATH];
+    int i;
+
+    for (i = 0; i < DIR_PERF_FILES; i++)
+    {
+        sprintf(buf, "%s\\File%05u.tmp", dirA, i);
+        DeleteFileA(buf);
+    }
+    RemoveDirectoryA(dirA);
+}
+
+static void test_directory_perf(void)
+{
+    static const char * const masks[] = { "*", "*.*", "File1*", "*5.tmp", "F?le*1.t?p" };
+    LARGE_INTEGER freq, start, end;
+    char dirA[MAX_PATH], buf[MAX_PATH];
+    DWORD seed = 12345;
+    int i;
+
+    if (!winetest_interactive)
+    {
+        skip("directory benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+
+    GetTempPathA(MAX_PATH, dirA);
+    strcat(dirA, "DirectoryPerf.tmp");
+    tear_down_perf_dir(dirA);
+    if (!set_up_perf_dir(dirA))
+    {
+        skip("couldn't create the benchmark directory\n");
+        tear_down_perf_dir(dirA);
+        return;
+    }
+    QueryPerformanceFrequency(&freq);
+
+    /* names that don't match the case on disk need a case-insensitive search of the directory */
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < DIR_PERF_FILES; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        sprintf(buf, "%s\\fILE%05u.TMP", dirA, seed % DIR_PERF_FILES);
+        GetFileAttributesA(buf);
+    }
+    QueryPerformanceCounter(&end);
+    trace("mixed case lookups in a %u entry directory: %.1f us per lookup\n", DIR_PERF_FILES,
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / DIR_PERF_FILES);
+
+    /* full enumerations, with masks that skip the matching, use a prefix or suffix, or need the full matcher */
+    for (i = 0; i < sizeof(masks) / sizeof(masks[0]); i++)
+    {
+        WIN32_FIND_DATAA data;
+        HANDLE handle;
+        int j, count = 0;
+
+        QueryPerformanceCounter(&start);
+        for (j = 0; j < 10; j++)
+        {
+            sprintf(buf, "%s\\%s", dirA, masks[i]);
+            if ((handle = FindFirstFileA(buf, &data)) == INVALID_HANDLE_VALUE) continue;
+            do count++; while (FindNextFileA(handle, &data));
+            FindClose(handle);
+        }
+        QueryPerformanceCounter(&end);
+        trace("enumerate with mask %s: %.1f ms, %u entries\n", masks[i],
+              (end.QuadPart - start.QuadPart) * 1e3 / freq.QuadPart / 10, count / 10);
+    }
+
+    tear_down_perf_dir(dirA);
+}
+
 START_TEST(directory)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
@@ -346,4 +439,5 @@ START_TEST(directory)
 
     test_NtQueryDirectoryFile();
     test_redirection();
+    test_directory_perf();
 }
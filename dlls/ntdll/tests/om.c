@@ -47,6 +47,10 @@ static NTSTATUS (WINAPI *pNtCreateSymbolicLinkObject)(PHANDLE, ACCESS_MASK, POBJ
 static NTSTATUS (WINAPI *pNtQuerySymbolicLinkObject)(HANDLE,PUNICODE_STRING,PULONG);
 static NTSTATUS (WINAPI *pNtQueryObject)(HANDLE,OBJECT_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 static NTSTATUS (WINAPI *pNtReleaseSemaphore)(HANDLE handle, ULONG count, PULONG previous);
+static NTSTATUS (WINAPI *pNtCreateKeyedEvent)( HANDLE *, ACCESS_MASK, const OBJECT_ATTRIBUTES *, ULONG );
+static NTSTATUS (WINAPI *pNtOpenKeyedEvent)( HANDLE *, ACCESS_MASK, const OBJECT_ATTRIBUTES * );
+static NTSTATUS (WINAPI *pNtWaitForKeyedEvent)( HANDLE, const void *, BOOLEAN, const LARGE_INTEGER * );
+static NTSTATUS (WINAPI *pNtReleaseKeyedEvent)( HANDLE, const void *, BOOLEAN, const LARGE_INTEGER * );
 
 
 static void test_case_sensitive (void)
@@ -798,6 +802,91 @@ static void test_type_mismatch(void)
     pNtClose( h );
 }
 
+static HANDLE keyed_event;
+static int keyed_key;
+
+static DWORD WINAPI keyed_event_thread( void *arg )
+{
+    NTSTATUS status;
+
+    Sleep( 50 );
+    status = pNtReleaseKeyedEvent( keyed_event, &keyed_key, FALSE, NULL );
+    ok( !status, "NtReleaseKeyedEvent failed %x\n", status );
+    return 0;
+}
+
+static void test_keyed_events(void)
+{
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING str;
+    LARGE_INTEGER timeout;
+    HANDLE handle, thread;
+    NTSTATUS status;
+
+    if (!pNtCreateKeyedEvent)
+    {
+        win_skip( "Keyed events not supported\n" );
+        return;
+    }
+
+    pRtlCreateUnicodeStringFromAsciiz( &str, "\\BaseNamedObjects\\WineTestKeyedEvent" );
+    InitializeObjectAttributes( &attr, &str, 0, 0, NULL );
+
+    status = pNtCreateKeyedEvent( &keyed_event, KEYEDEVENT_ALL_ACCESS, &attr, 0 );
+    ok( !status, "NtCreateKeyedEvent failed %x\n", status );
+
+    status = pNtOpenKeyedEvent( &handle, KEYEDEVENT_ALL_ACCESS, &attr );
+    ok( !status, "NtOpenKeyedEvent failed %x\n", status );
+    pNtClose( handle );
+
+    status = pNtCreateEvent( &handle, GENERIC_ALL, &attr, FALSE, FALSE );
+    ok( status == STATUS_OBJECT_TYPE_MISMATCH, "expected STATUS_OBJECT_TYPE_MISMATCH, got %x\n", status );
+    pRtlFreeUnicodeString( &str );
+
+    timeout.QuadPart = -100000;
+    status = pNtWaitForKeyedEvent( keyed_event, &keyed_key, FALSE, &timeout );
+    ok( status == STATUS_TIMEOUT, "NtWaitForKeyedEvent returned %x\n", status );
+    status = pNtReleaseKeyedEvent( keyed_event, &keyed_key, FALSE, &timeout );
+    ok( status == STATUS_TIMEOUT, "NtReleaseKeyedEvent returned %x\n", status );
+    status = pNtWaitForKeyedEvent( keyed_event, (char *)&keyed_key + 1, FALSE, &timeout );
+    ok( status == STATUS_INVALID_PARAMETER_1, "NtWaitForKeyedEvent returned %x\n", status );
+
+    thread = CreateThread( NULL, 0, keyed_event_thread, NULL, 0, NULL );
+    timeout.QuadPart = -50000000;
+    status = pNtWaitForKeyedEvent( keyed_event, &keyed_key, FALSE, &timeout );
+    ok( !status, "NtWaitForKeyedEvent returned %x\n", status );
+    WaitForSingleObject( thread, 5000 );
+    CloseHandle( thread );
+
+    pNtClose( keyed_event );
+
+    /* the waits match on the object, not on the handle */
+    status = pNtCreateKeyedEvent( &handle, KEYEDEVENT_ALL_ACCESS, NULL, 0 );
+    ok( !status, "NtCreateKeyedEvent failed %x\n", status );
+    DuplicateHandle( GetCurrentProcess(), handle, GetCurrentProcess(), &keyed_event,
+                     KEYEDEVENT_WAKE, FALSE, 0 );
+
+    timeout.QuadPart = -100000;
+    status = pNtWaitForKeyedEvent( keyed_event, &keyed_key, FALSE, &timeout );
+    ok( status == STATUS_ACCESS_DENIED, "NtWaitForKeyedEvent returned %x\n", status );
+
+    thread = CreateThread( NULL, 0, keyed_event_thread, NULL, 0, NULL );
+    timeout.QuadPart = -50000000;
+    status = pNtWaitForKeyedEvent( handle, &keyed_key, FALSE, &timeout );
+    ok( !status, "NtWaitForKeyedEvent returned %x\n", status );
+    WaitForSingleObject( thread, 5000 );
+    CloseHandle( thread );
+
+    pNtClose( keyed_event );
+    pNtClose( handle );
+
+    status = pNtCreateEvent( &handle, GENERIC_ALL, NULL, FALSE, FALSE );
+    ok( !status, "NtCreateEvent failed %x\n", status );
+    status = pNtWaitForKeyedEvent( handle, &keyed_key, FALSE, &timeout );
+    ok( status == STATUS_OBJECT_TYPE_MISMATCH, "NtWaitForKeyedEvent returned %x\n", status );
+    pNtClose( handle );
+}
+
 START_TEST(om)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
@@ -830,6 +919,10 @@ START_TEST(om)
     pNtCreateSection        =  (void *)GetProcAddress(hntdll, "NtCreateSection");
     pNtQueryObject          =  (void *)GetProcAddress(hntdll, "NtQueryObject");
     pNtReleaseSemaphore     =  (void *)GetProcAddress(hntdll, "NtReleaseSemaphore");
+    pNtCreateKeyedEvent     =  (void *)GetProcAddress(hntdll, "NtCreateKeyedEvent");
+    pNtOpenKeyedEvent       =  (void *)GetProcAddress(hntdll, "NtOpenKeyedEvent");
+    pNtWaitForKeyedEvent    =  (void *)GetProcAddress(hntdll, "NtWaitForKeyedEvent");
+    pNtReleaseKeyedEvent    =  (void *)GetProcAddress(hntdll, "NtReleaseKeyedEvent");
 
     test_case_sensitive();
     test_namespace_pipe();
@@ -838,4 +931,5 @@ START_TEST(om)
     test_symboliclink();
     test_query_object();
     test_type_mismatch();
+    test_keyed_events();
 }
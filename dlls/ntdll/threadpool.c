@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <limits.h>
+#include <string.h>
 
 #define NONAMELESSUNION
 #include "ntstatus.h"
@@ -37,23 +38,202 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(threadpool);
 
-#define WORKER_TIMEOUT 30000 /* 30 seconds */
+/*
+ * Vista thread pool
+ *
+ * Every pool owns a set of worker threads, each with its own deque of
+ * queued callbacks. Callbacks posted from a worker thread are pushed on the
+ * bottom of that worker's deque and popped back in LIFO order, so that work
+ * spawned by a callback runs while its data is still in the cache; callbacks
+ * posted from other threads go to the pool queue. A worker that runs out of
+ * work takes from the pool queue, then steals the oldest callback of another
+ * worker, and only then goes to sleep. Workers are started on demand, up to
+ * one per cpu plus one per callback that may run long, and exit after
+ * staying idle for THREADPOOL_WORKER_TIMEOUT.
+ */
+
+#define THREADPOOL_WORKER_TIMEOUT 5000  /* 5 seconds */
+#define THREADPOOL_MAX_WORKERS    500
+#define THREADPOOL_DEQUE_SIZE     64    /* initial deque size, must be a power of 2 */
+#define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
+
+struct threadpool_deque
+{
+    RTL_CRITICAL_SECTION        cs;
+    struct threadpool_object  **items;      /* ring buffer of queued objects */
+    unsigned int                size;       /* size of the ring buffer */
+    unsigned int                top;        /* index of the oldest entry */
+    unsigned int                bottom;     /* index past the newest entry */
+};
+
+struct threadpool
+{
+    LONG                        refcount;
+    BOOL                        shutdown;
+    RTL_CRITICAL_SECTION        cs;         /* protects the worker list and worker sleep/wakeup */
+    struct list                 workers;
+    struct threadpool_deque     queue;      /* callbacks posted from outside of the pool */
+    LONG                        num_queued; /* callbacks in the pool queue and the worker deques */
+    LONG                        num_workers;
+    LONG                        num_idle;   /* workers sleeping on update_event */
+    LONG                        wake_pending; /* an idle worker was woken up but isn't running yet */
+    LONG                        num_long;   /* workers blocked in a long running callback */
+    int                         max_workers;
+    int                         min_workers;
+    RTL_CONDITION_VARIABLE      update_event;
+};
+
+struct threadpool_worker
+{
+    struct list                 entry;      /* entry in pool workers list */
+    struct threadpool          *pool;
+    struct threadpool_deque     deque;
+};
+
+enum threadpool_objtype
+{
+    TP_OBJECT_TYPE_SIMPLE,
+    TP_OBJECT_TYPE_WORK,
+    TP_OBJECT_TYPE_TIMER,
+    TP_OBJECT_TYPE_WAIT
+};
+
+struct threadpool_object
+{
+    LONG                        refcount;
+    BOOL                        shutdown;
+    enum threadpool_objtype     type;
+    struct threadpool          *pool;
+    struct threadpool_group    *group;
+    PVOID                       userdata;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK group_cancel_callback;
+    PTP_SIMPLE_CALLBACK         finalization_callback;
+    BOOL                        may_run_long;
+    HMODULE                     race_dll;
+    /* group membership, locked via the group cs */
+    struct list                 group_entry;
+    BOOL                        is_group_member;
+    /* callback counters, the waiters are woken up under the pool cs */
+    LONG                        num_pending_callbacks;
+    LONG                        num_running_callbacks;
+    LONG                        num_waiters;
+    RTL_CONDITION_VARIABLE      finished_event;
+    union
+    {
+        struct
+        {
+            PTP_SIMPLE_CALLBACK callback;
+        } simple;
+        struct
+        {
+            PTP_WORK_CALLBACK callback;
+        } work;
+        struct
+        {
+            PTP_TIMER_CALLBACK callback;
+            /* locked via the timerqueue cs */
+            BOOL                timer_initialized;
+            BOOL                timer_pending;
+            struct list         timer_entry;
+            BOOL                timer_set;
+            ULONGLONG           timeout;
+            LONG                period;
+            LONG                window_length;
+        } timer;
+        struct
+        {
+            PTP_WAIT_CALLBACK   callback;
+            /* locked via the waitqueue cs */
+            struct waitqueue_bucket *bucket;
+            BOOL                wait_pending;
+            struct list         wait_entry;
+            HANDLE              handle;
+            ULONGLONG           timeout;
+            TP_WAIT_RESULT      result;
+        } wait;
+    } u;
+};
+
+struct threadpool_instance
+{
+    struct threadpool_object   *object;
+    DWORD                       threadid;
+    BOOL                        associated;
+    BOOL                        may_run_long;
+    struct
+    {
+        RTL_CRITICAL_SECTION   *critical_section;
+        HANDLE                  mutex;
+        HANDLE                  semaphore;
+        LONG                    semaphore_count;
+        HANDLE                  event;
+        HMODULE                 library;
+    } cleanup;
+};
+
+struct threadpool_group
+{
+    LONG                        refcount;
+    BOOL                        shutdown;
+    RTL_CRITICAL_SECTION        cs;
+    struct list                 members;    /* objects in the group */
+};
+
+/* timer thread shared by all the pools */
+static RTL_CRITICAL_SECTION_DEBUG timerqueue_debug;
+static struct
+{
+    RTL_CRITICAL_SECTION        cs;
+    LONG                        objcount;
+    BOOL                        thread_running;
+    struct list                 pending_timers;    /* armed timers, sorted by timeout */
+    RTL_CONDITION_VARIABLE      update_event;
+}
+timerqueue =
+{
+    { &timerqueue_debug, -1, 0, 0, 0, 0 },
+    0,
+    FALSE,
+    LIST_INIT( timerqueue.pending_timers ),
+    RTL_CONDITION_VARIABLE_INIT
+};
 
-static LONG num_workers;
-static LONG num_work_items;
-static LONG num_busy_workers;
+static RTL_CRITICAL_SECTION_DEBUG timerqueue_debug =
+{
+    0, 0, &timerqueue.cs,
+    { &timerqueue_debug.ProcessLocksList, &timerqueue_debug.ProcessLocksList },
+    0, 0, { (DWORD_PTR)(__FILE__ ": timerqueue.cs") }
+};
+
+/* wait threads shared by all the pools, each serving up to MAXIMUM_WAITQUEUE_OBJECTS waits */
+struct waitqueue_bucket
+{
+    struct list                 bucket_entry;
+    LONG                        objcount;
+    struct list                 waiting;    /* armed waits */
+    HANDLE                      update_event;
+};
 
-static struct list work_item_list = LIST_INIT(work_item_list);
-static HANDLE work_item_event;
+static RTL_CRITICAL_SECTION_DEBUG waitqueue_debug;
+static struct
+{
+    RTL_CRITICAL_SECTION        cs;
+    struct list                 buckets;
+}
+waitqueue =
+{
+    { &waitqueue_debug, -1, 0, 0, 0, 0 },
+    LIST_INIT( waitqueue.buckets )
+};
 
-static RTL_CRITICAL_SECTION threadpool_cs;
-static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
+static RTL_CRITICAL_SECTION_DEBUG waitqueue_debug =
 {
-    0, 0, &threadpool_cs,
-    { &critsect_debug.ProcessLocksList, &critsect_debug.ProcessLocksList },
-    0, 0, { (DWORD_PTR)(__FILE__ ": threadpool_cs") }
+    0, 0, &waitqueue.cs,
+    { &waitqueue_debug.ProcessLocksList, &waitqueue_debug.ProcessLocksList },
+    0, 0, { (DWORD_PTR)(__FILE__ ": waitqueue.cs") }
 };
-static RTL_CRITICAL_SECTION threadpool_cs = { &critsect_debug, -1, 0, 0, 0, 0 };
+
+static struct threadpool *default_threadpool = NULL;
 
 static HANDLE compl_port = NULL;
 static RTL_CRITICAL_SECTION threadpool_compl_cs;
@@ -65,9 +245,8 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_compl_debug =
 };
 static RTL_CRITICAL_SECTION threadpool_compl_cs = { &critsect_compl_debug, -1, 0, 0, 0, 0 };
 
-struct work_item
+struct rtl_work_item
 {
-    struct list entry;
     PRTL_WORK_ITEM_ROUTINE function;
     PVOID context;
 };
@@ -82,708 +261,1782 @@ static inline LONG interlocked_dec( PLONG dest )
     return interlocked_xchg_add( dest, -1 ) - 1;
 }
 
-static void WINAPI worker_thread_proc(void * param)
+static inline struct threadpool *impl_from_TP_POOL( TP_POOL *pool )
 {
-    interlocked_inc(&num_workers);
+    return (struct threadpool *)pool;
+}
 
-    /* free the work item memory sooner to reduce memory usage */
-    while (TRUE)
-    {
-        if (num_work_items > 0)
-        {
-            struct list *item;
-            RtlEnterCriticalSection(&threadpool_cs);
-            item = list_head(&work_item_list);
-            if (item)
-            {
-                struct work_item *work_item_ptr = LIST_ENTRY(item, struct work_item, entry);
-                struct work_item work_item;
-                list_remove(&work_item_ptr->entry);
-                interlocked_dec(&num_work_items);
+static inline struct threadpool_object *impl_from_TP_WORK( TP_WORK *work )
+{
+    struct threadpool_object *object = (struct threadpool_object *)work;
+    assert( object->type == TP_OBJECT_TYPE_WORK );
+    return object;
+}
 
-                RtlLeaveCriticalSection(&threadpool_cs);
+static inline struct threadpool_object *impl_from_TP_TIMER( TP_TIMER *timer )
+{
+    struct threadpool_object *object = (struct threadpool_object *)timer;
+    assert( object->type == TP_OBJECT_TYPE_TIMER );
+    return object;
+}
 
-                work_item = *work_item_ptr;
-                RtlFreeHeap(GetProcessHeap(), 0, work_item_ptr);
+static inline struct threadpool_object *impl_from_TP_WAIT( TP_WAIT *wait )
+{
+    struct threadpool_object *object = (struct threadpool_object *)wait;
+    assert( object->type == TP_OBJECT_TYPE_WAIT );
+    return object;
+}
 
-                TRACE("executing %p(%p)\n", work_item.function, work_item.context);
+static inline struct threadpool_group *impl_from_TP_CLEANUP_GROUP( TP_CLEANUP_GROUP *group )
+{
+    return (struct threadpool_group *)group;
+}
 
-                interlocked_inc(&num_busy_workers);
+static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CALLBACK_INSTANCE *instance )
+{
+    return (struct threadpool_instance *)instance;
+}
 
-                /* do the work */
-                work_item.function(work_item.context);
+static void CALLBACK threadpool_worker_proc( void *param );
+static void tp_object_execute( struct threadpool_object *object );
+static BOOL tp_object_release( struct threadpool_object *object );
 
-                interlocked_dec(&num_busy_workers);
-            }
-            else
-                RtlLeaveCriticalSection(&threadpool_cs);
-        }
-        else
+/***********************************************************************
+ *           tp_deque_init    (internal)
+ */
+static NTSTATUS tp_deque_init( struct threadpool_deque *deque, const char *name )
+{
+    if (!(deque->items = RtlAllocateHeap( GetProcessHeap(), 0, THREADPOOL_DEQUE_SIZE * sizeof(*deque->items) )))
+        return STATUS_NO_MEMORY;
+
+    deque->size   = THREADPOOL_DEQUE_SIZE;
+    deque->top    = 0;
+    deque->bottom = 0;
+    RtlInitializeCriticalSection( &deque->cs );
+    deque->cs.DebugInfo->Spare[0] = (DWORD_PTR)name;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           tp_deque_destroy    (internal)
+ */
+static void tp_deque_destroy( struct threadpool_deque *deque )
+{
+    assert( deque->top == deque->bottom );
+    deque->cs.DebugInfo->Spare[0] = 0;
+    RtlDeleteCriticalSection( &deque->cs );
+    RtlFreeHeap( GetProcessHeap(), 0, deque->items );
+}
+
+/***********************************************************************
+ *           tp_deque_push    (internal)
+ *
+ * Pushes an object on the bottom of a deque, growing it when full.
+ */
+static BOOL tp_deque_push( struct threadpool_deque *deque, struct threadpool_object *object )
+{
+    RtlEnterCriticalSection( &deque->cs );
+
+    if (deque->bottom - deque->top == deque->size)
+    {
+        struct threadpool_object **items;
+        unsigned int i;
+
+        if (!(items = RtlAllocateHeap( GetProcessHeap(), 0, 2 * deque->size * sizeof(*items) )))
         {
-            NTSTATUS status;
-            LARGE_INTEGER timeout;
-            timeout.QuadPart = -(WORKER_TIMEOUT * (ULONGLONG)10000);
-            status = NtWaitForSingleObject(work_item_event, FALSE, &timeout);
-            if (status != STATUS_WAIT_0)
-                break;
+            RtlLeaveCriticalSection( &deque->cs );
+            return FALSE;
         }
+        for (i = 0; i < deque->size; i++)
+            items[i] = deque->items[(deque->top + i) & (deque->size - 1)];
+        RtlFreeHeap( GetProcessHeap(), 0, deque->items );
+        deque->items  = items;
+        deque->top    = 0;
+        deque->bottom = deque->size;
+        deque->size  *= 2;
     }
 
-    interlocked_dec(&num_workers);
+    deque->items[deque->bottom++ & (deque->size - 1)] = object;
+    RtlLeaveCriticalSection( &deque->cs );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           tp_deque_pop    (internal)
+ *
+ * Removes the newest object of a deque, or the oldest one when stealing.
+ */
+static struct threadpool_object *tp_deque_pop( struct threadpool_deque *deque, BOOL steal )
+{
+    struct threadpool_object *object = NULL;
 
-    RtlExitUserThread(0);
+    /* don't bother locking empty deques */
+    if (*(volatile unsigned int *)&deque->top == *(volatile unsigned int *)&deque->bottom) return NULL;
 
-    /* never reached */
+    RtlEnterCriticalSection( &deque->cs );
+    if (deque->top != deque->bottom)
+    {
+        if (steal) object = deque->items[deque->top++ & (deque->size - 1)];
+        else object = deque->items[--deque->bottom & (deque->size - 1)];
+    }
+    RtlLeaveCriticalSection( &deque->cs );
+    return object;
 }
 
-static NTSTATUS add_work_item_to_queue(struct work_item *work_item)
+/***********************************************************************
+ *           tp_threadpool_alloc    (internal)
+ *
+ * Allocates a new threadpool object.
+ */
+static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 {
+    struct threadpool *pool;
     NTSTATUS status;
 
-    RtlEnterCriticalSection(&threadpool_cs);
-    list_add_tail(&work_item_list, &work_item->entry);
-    num_work_items++;
-    RtlLeaveCriticalSection(&threadpool_cs);
+    if (!(pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) )))
+        return STATUS_NO_MEMORY;
 
-    if (!work_item_event)
+    if ((status = tp_deque_init( &pool->queue, __FILE__ ": threadpool.queue.cs" )))
     {
-        HANDLE sem;
-        status = NtCreateSemaphore(&sem, SEMAPHORE_ALL_ACCESS, NULL, 1, INT_MAX);
-        if (interlocked_cmpxchg_ptr( &work_item_event, sem, 0 ))
-            NtClose(sem);  /* somebody beat us to it */
+        RtlFreeHeap( GetProcessHeap(), 0, pool );
+        return status;
     }
-    else
-        status = NtReleaseSemaphore(work_item_event, 1, NULL);
 
-    return status;
+    pool->refcount    = 1;
+    pool->shutdown    = FALSE;
+    RtlInitializeCriticalSection( &pool->cs );
+    pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
+    list_init( &pool->workers );
+    pool->num_queued  = 0;
+    pool->num_workers = 0;
+    pool->num_idle    = 0;
+    pool->wake_pending = 0;
+    pool->num_long    = 0;
+    pool->max_workers = THREADPOOL_MAX_WORKERS;
+    pool->min_workers = 0;
+    RtlInitializeConditionVariable( &pool->update_event );
+
+    TRACE( "allocated threadpool %p\n", pool );
+
+    *out = pool;
+    return STATUS_SUCCESS;
 }
 
 /***********************************************************************
- *              RtlQueueWorkItem   (NTDLL.@)
+ *           tp_threadpool_shutdown    (internal)
  *
- * Queues a work item into a thread in the thread pool.
- *
- * PARAMS
- *  Function [I] Work function to execute.
- *  Context  [I] Context to pass to the work function when it is executed.
- *  Flags    [I] Flags. See notes.
- *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ * Prepares the shutdown of a threadpool object; the workers exit as soon
+ * as the queued callbacks have been processed.
+ */
+static void tp_threadpool_shutdown( struct threadpool *pool )
+{
+    assert( pool != default_threadpool );
+
+    RtlEnterCriticalSection( &pool->cs );
+    pool->shutdown = TRUE;
+    RtlWakeAllConditionVariable( &pool->update_event );
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_threadpool_release    (internal)
  *
- * NOTES
- *  Flags can be one or more of the following:
- *|WT_EXECUTEDEFAULT - Executes the work item in a non-I/O worker thread.
- *|WT_EXECUTEINIOTHREAD - Executes the work item in an I/O worker thread.
- *|WT_EXECUTEINPERSISTENTTHREAD - Executes the work item in a thread that is persistent.
- *|WT_EXECUTELONGFUNCTION - Hints that the execution can take a long time.
- *|WT_TRANSFER_IMPERSONATION - Executes the function with the current access token.
+ * Releases a reference to a threadpool object.
  */
-NTSTATUS WINAPI RtlQueueWorkItem(PRTL_WORK_ITEM_ROUTINE Function, PVOID Context, ULONG Flags)
+static BOOL tp_threadpool_release( struct threadpool *pool )
 {
-    HANDLE thread;
-    NTSTATUS status;
-    struct work_item *work_item = RtlAllocateHeap(GetProcessHeap(), 0, sizeof(struct work_item));
+    if (interlocked_dec( &pool->refcount ))
+        return FALSE;
 
-    if (!work_item)
-        return STATUS_NO_MEMORY;
+    TRACE( "destroying threadpool %p\n", pool );
 
-    work_item->function = Function;
-    work_item->context = Context;
+    assert( pool->shutdown );
+    assert( list_empty( &pool->workers ) );
 
-    if (Flags & ~WT_EXECUTELONGFUNCTION)
-        FIXME("Flags 0x%x not supported\n", Flags);
+    pool->cs.DebugInfo->Spare[0] = 0;
+    RtlDeleteCriticalSection( &pool->cs );
+    tp_deque_destroy( &pool->queue );
+    RtlFreeHeap( GetProcessHeap(), 0, pool );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           tp_threadpool_lock    (internal)
+ *
+ * Acquires a reference to the pool of a callback environment, or to the
+ * default pool when none is specified.
+ */
+static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool *pool = NULL;
+    NTSTATUS status;
 
-    status = add_work_item_to_queue(work_item);
+    if (environment)
+        pool = impl_from_TP_POOL( environment->Pool );
 
-    /* FIXME: tune this algorithm to not be as aggressive with creating threads
-     * if WT_EXECUTELONGFUNCTION isn't specified */
-    if ((status == STATUS_SUCCESS) &&
-        ((num_workers == 0) || (num_workers == num_busy_workers)))
+    if (!pool)
     {
-        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE,
-                                    NULL, 0, 0,
-                                    worker_thread_proc, NULL, &thread, NULL );
-        if (status == STATUS_SUCCESS)
-            NtClose( thread );
+        if (!default_threadpool)
+        {
+            if ((status = tp_threadpool_alloc( &pool )))
+                return status;
 
-        /* NOTE: we don't care if we couldn't create the thread if there is at
-         * least one other available to process the request */
-        if ((num_workers > 0) && (status != STATUS_SUCCESS))
-            status = STATUS_SUCCESS;
+            if (interlocked_cmpxchg_ptr( (void **)&default_threadpool, pool, NULL ) != NULL)
+            {
+                /* somebody beat us to it */
+                pool->shutdown = TRUE;
+                tp_threadpool_release( pool );
+            }
+        }
+        pool = default_threadpool;
     }
 
-    if (status != STATUS_SUCCESS)
-    {
-        RtlEnterCriticalSection(&threadpool_cs);
+    interlocked_inc( &pool->refcount );
+    *out = pool;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           tp_threadpool_target_workers    (internal)
+ *
+ * Number of workers the pool should have to keep all the cpus busy.
+ */
+static inline LONG tp_threadpool_target_workers( struct threadpool *pool )
+{
+    LONG target = NtCurrentTeb()->Peb->NumberOfProcessors + pool->num_long;
+    return max( pool->min_workers, min( pool->max_workers, target ) );
+}
+
+/***********************************************************************
+ *           tp_new_worker_thread    (internal)
+ *
+ * Creates a new worker thread. Must be called with the pool cs held.
+ */
+static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
+{
+    struct threadpool_worker *worker;
+    HANDLE thread;
+    NTSTATUS status;
 
-        interlocked_dec(&num_work_items);
-        list_remove(&work_item->entry);
-        RtlFreeHeap(GetProcessHeap(), 0, work_item);
+    if (!(worker = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*worker) )))
+        return STATUS_NO_MEMORY;
+
+    if ((status = tp_deque_init( &worker->deque, __FILE__ ": threadpool_worker.deque.cs" )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, worker );
+        return status;
+    }
+    worker->pool = pool;
 
-        RtlLeaveCriticalSection(&threadpool_cs);
+    interlocked_inc( &pool->refcount );
+    interlocked_inc( &pool->num_workers );
+    list_add_tail( &pool->workers, &worker->entry );
 
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                  threadpool_worker_proc, worker, &thread, NULL );
+    if (status != STATUS_SUCCESS)
+    {
+        list_remove( &worker->entry );
+        interlocked_dec( &pool->num_workers );
+        interlocked_dec( &pool->refcount );
+        tp_deque_destroy( &worker->deque );
+        RtlFreeHeap( GetProcessHeap(), 0, worker );
         return status;
     }
 
+    NtClose( thread );
     return STATUS_SUCCESS;
 }
 
 /***********************************************************************
- * iocp_poller - get completion events and run callbacks
+ *           tp_threadpool_kick    (internal)
+ *
+ * Makes sure that a worker picks up newly queued callbacks, waking up an
+ * idle worker or starting a new one when all of them are busy. Only one
+ * wakeup is in flight at a time; the woken worker passes it on if more
+ * callbacks are queued, instead of every poster paying for a wakeup.
  */
-static DWORD CALLBACK iocp_poller(LPVOID Arg)
+static void tp_threadpool_kick( struct threadpool *pool )
 {
-    while( TRUE )
+    if (pool->num_idle ? pool->wake_pending : pool->num_workers >= tp_threadpool_target_workers( pool ))
+        return;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (pool->num_idle)
     {
-        PRTL_OVERLAPPED_COMPLETION_ROUTINE callback;
-        LPVOID overlapped;
-        IO_STATUS_BLOCK iosb;
-        NTSTATUS res = NtRemoveIoCompletion( compl_port, (PULONG_PTR)&callback, (PULONG_PTR)&overlapped, &iosb, NULL );
-        if (res)
-        {
-            ERR("NtRemoveIoCompletion failed: 0x%x\n", res);
-        }
-        else
+        if (!pool->wake_pending)
         {
-            DWORD transferred = 0;
-            DWORD err = 0;
-
-            if (iosb.u.Status == STATUS_SUCCESS)
-                transferred = iosb.Information;
-            else
-                err = RtlNtStatusToDosError(iosb.u.Status);
-
-            callback( err, transferred, overlapped );
+            pool->wake_pending = TRUE;
+            RtlWakeConditionVariable( &pool->update_event );
         }
     }
-    return 0;
+    else if (pool->num_workers < tp_threadpool_target_workers( pool ))
+    {
+        NTSTATUS status = tp_new_worker_thread( pool );
+        if (status && !pool->num_workers) ERR( "failed to start a worker thread, status %x\n", status );
+    }
+    RtlLeaveCriticalSection( &pool->cs );
 }
 
 /***********************************************************************
- *              RtlSetIoCompletionCallback  (NTDLL.@)
- *
- * Binds a handle to a thread pool's completion port, and possibly
- * starts a non-I/O thread to monitor this port and call functions back.
- *
- * PARAMS
- *  FileHandle [I] Handle to bind to a completion port.
- *  Function   [I] Callback function to call on I/O completions.
- *  Flags      [I] Not used.
- *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ *           tp_threadpool_get_object    (internal)
  *
+ * Finds the next callback to run: first from the own deque, then from the
+ * pool queue, and finally by stealing from the other workers.
  */
-NTSTATUS WINAPI RtlSetIoCompletionCallback(HANDLE FileHandle, PRTL_OVERLAPPED_COMPLETION_ROUTINE Function, ULONG Flags)
+static struct threadpool_object *tp_threadpool_get_object( struct threadpool *pool,
+                                                           struct threadpool_worker *worker )
 {
-    IO_STATUS_BLOCK iosb;
-    FILE_COMPLETION_INFORMATION info;
+    struct threadpool_object *object;
+    struct list *ptr;
 
-    if (Flags) FIXME("Unknown value Flags=0x%x\n", Flags);
+    if ((object = tp_deque_pop( &worker->deque, FALSE ))) return object;
+    if ((object = tp_deque_pop( &pool->queue, TRUE ))) return object;
+    if (!pool->num_queued) return NULL;
 
-    if (!compl_port)
+    /* start with the next worker in the list so that thieves spread out */
+    RtlEnterCriticalSection( &pool->cs );
+    for (ptr = &worker->entry;;)
     {
-        NTSTATUS res = STATUS_SUCCESS;
+        if (!(ptr = list_next( &pool->workers, ptr ))) ptr = list_head( &pool->workers );
+        if (ptr == &worker->entry) break;
+        if ((object = tp_deque_pop( &LIST_ENTRY( ptr, struct threadpool_worker, entry )->deque, TRUE )))
+            break;
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+    return object;
+}
 
-        RtlEnterCriticalSection(&threadpool_compl_cs);
-        if (!compl_port)
+/***********************************************************************
+ *           threadpool_worker_proc    (internal)
+ */
+static void CALLBACK threadpool_worker_proc( void *param )
+{
+    struct threadpool_worker *worker = param;
+    struct threadpool *pool = worker->pool;
+    struct threadpool_object *object;
+    LARGE_INTEGER timeout;
+    NTSTATUS status;
+
+    TRACE( "starting worker %p for pool %p\n", worker, pool );
+
+    ntdll_get_thread_data()->threadpool_worker = worker;
+
+    for (;;)
+    {
+        if ((object = tp_threadpool_get_object( pool, worker )))
         {
-            HANDLE cport;
+            if (interlocked_dec( &pool->num_queued ) && pool->num_idle)
+                tp_threadpool_kick( pool );
+            tp_object_execute( object );
+            continue;
+        }
 
-            res = NtCreateIoCompletion( &cport, IO_COMPLETION_ALL_ACCESS, NULL, 0 );
-            if (!res)
-            {
-                /* FIXME native can start additional threads in case of e.g. hung callback function. */
-                res = RtlQueueWorkItem( iocp_poller, NULL, WT_EXECUTEDEFAULT );
-                if (!res)
-                    compl_port = cport;
-                else
-                    NtClose( cport );
-            }
+        /* posters check num_idle after queuing, so it has to be raised before checking num_queued */
+        RtlEnterCriticalSection( &pool->cs );
+        interlocked_inc( &pool->num_idle );
+        status = STATUS_SUCCESS;
+        if (!pool->num_queued && !pool->shutdown)
+        {
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+            status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+            interlocked_xchg( &pool->wake_pending, FALSE );
         }
-        RtlLeaveCriticalSection(&threadpool_compl_cs);
-        if (res) return res;
+        interlocked_dec( &pool->num_idle );
+
+        if (!pool->num_queued && (pool->shutdown ||
+            (status == STATUS_TIMEOUT && pool->num_workers > pool->min_workers)))
+            break;
+        RtlLeaveCriticalSection( &pool->cs );
     }
 
-    info.CompletionPort = compl_port;
-    info.CompletionKey = (ULONG_PTR)Function;
+    list_remove( &worker->entry );
+    interlocked_dec( &pool->num_workers );
+    RtlLeaveCriticalSection( &pool->cs );
 
-    return NtSetInformationFile( FileHandle, &iosb, &info, sizeof(info), FileCompletionInformation );
+    ntdll_get_thread_data()->threadpool_worker = NULL;
+
+    /* a callback may have been posted while we were deciding to exit */
+    if (pool->num_queued) tp_threadpool_kick( pool );
+
+    TRACE( "exiting worker %p for pool %p\n", worker, pool );
+
+    tp_deque_destroy( &worker->deque );
+    RtlFreeHeap( GetProcessHeap(), 0, worker );
+    tp_threadpool_release( pool );
+    RtlExitUserThread( 0 );
 }
 
-static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout )
-{
-    if (timeout == INFINITE) return NULL;
-    pTime->QuadPart = (ULONGLONG)timeout * -10000;
-    return pTime;
-}
-
-struct wait_work_item
+/***********************************************************************
+ *           tp_group_release    (internal)
+ *
+ * Releases a reference to a group object.
+ */
+static BOOL tp_group_release( struct threadpool_group *group )
 {
-    HANDLE Object;
-    HANDLE CancelEvent;
-    WAITORTIMERCALLBACK Callback;
-    PVOID Context;
-    ULONG Milliseconds;
-    ULONG Flags;
-    HANDLE CompletionEvent;
-    LONG DeleteCount;
-    BOOLEAN CallbackInProgress;
-};
+    if (interlocked_dec( &group->refcount ))
+        return FALSE;
 
-static void delete_wait_work_item(struct wait_work_item *wait_work_item)
-{
-    NtClose( wait_work_item->CancelEvent );
-    RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
+    TRACE( "destroying group %p\n", group );
+
+    assert( group->shutdown );
+    assert( list_empty( &group->members ) );
+
+    group->cs.DebugInfo->Spare[0] = 0;
+    RtlDeleteCriticalSection( &group->cs );
+    RtlFreeHeap( GetProcessHeap(), 0, group );
+    return TRUE;
 }
 
-static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
+/***********************************************************************
+ *           tp_object_submit    (internal)
+ *
+ * Queues a callback of an object; from a worker thread of the same pool
+ * it goes to the worker's own deque.
+ */
+static NTSTATUS tp_object_submit( struct threadpool_object *object )
 {
-    struct wait_work_item *wait_work_item = Arg;
-    NTSTATUS status;
-    BOOLEAN alertable = (wait_work_item->Flags & WT_EXECUTEINIOTHREAD) != 0;
-    HANDLE handles[2] = { wait_work_item->Object, wait_work_item->CancelEvent };
-    LARGE_INTEGER timeout;
-    HANDLE completion_event;
+    struct threadpool_worker *worker = ntdll_get_thread_data()->threadpool_worker;
+    struct threadpool *pool = object->pool;
 
-    TRACE("\n");
+    interlocked_inc( &object->refcount );
+    interlocked_inc( &object->num_pending_callbacks );
 
-    while (TRUE)
+    if (!worker || worker->pool != pool || !tp_deque_push( &worker->deque, object ))
     {
-        status = NtWaitForMultipleObjects( 2, handles, FALSE, alertable,
-                                           get_nt_timeout( &timeout, wait_work_item->Milliseconds ) );
-        if (status == STATUS_WAIT_0 || status == STATUS_TIMEOUT)
+        if (!tp_deque_push( &pool->queue, object ))
         {
-            BOOLEAN TimerOrWaitFired;
-
-            if (status == STATUS_WAIT_0)
-            {
-                TRACE( "object %p signaled, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = FALSE;
-            }
-            else
-            {
-                TRACE( "wait for object %p timed out, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = TRUE;
-            }
-            wait_work_item->CallbackInProgress = TRUE;
-            wait_work_item->Callback( wait_work_item->Context, TimerOrWaitFired );
-            wait_work_item->CallbackInProgress = FALSE;
-
-            if (wait_work_item->Flags & WT_EXECUTEONLYONCE)
-                break;
+            interlocked_dec( &object->num_pending_callbacks );
+            tp_object_release( object );
+            return STATUS_NO_MEMORY;
         }
-        else
-            break;
     }
 
-    completion_event = wait_work_item->CompletionEvent;
-    if (completion_event) NtSetEvent( completion_event, NULL );
+    interlocked_inc( &pool->num_queued );
+    tp_threadpool_kick( pool );
+    return STATUS_SUCCESS;
+}
 
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
-        delete_wait_work_item( wait_work_item );
+/***********************************************************************
+ *           tp_object_cancel    (internal)
+ *
+ * Cancels all the queued callbacks of an object; the corresponding queue
+ * entries are skipped once they are popped.
+ */
+static void tp_object_cancel( struct threadpool_object *object, BOOL group_cancel, PVOID userdata )
+{
+    LONG pending_callbacks = interlocked_xchg( &object->num_pending_callbacks, 0 );
 
-    return 0;
+    TRACE( "cancelled %d callbacks of object %p\n", pending_callbacks, object );
+
+    /* the cancel callback is only invoked when something was actually cancelled */
+    if (pending_callbacks && group_cancel && object->group_cancel_callback)
+    {
+        TRACE( "executing group cancel callback %p(%p, %p)\n",
+               object->group_cancel_callback, object->userdata, userdata );
+        object->group_cancel_callback( object->userdata, userdata );
+    }
 }
 
 /***********************************************************************
- *              RtlRegisterWait   (NTDLL.@)
+ *           tp_object_may_run_long    (internal)
  *
- * Registers a wait for a handle to become signaled.
+ * Accounts for a worker that is going to block for a while, so that
+ * another one gets started if there is queued work.
+ */
+static BOOL tp_object_may_run_long( struct threadpool *pool )
+{
+    BOOL ret = pool->num_idle || pool->num_workers < pool->max_workers;
+
+    interlocked_inc( &pool->num_long );
+    if (pool->num_queued) tp_threadpool_kick( pool );
+    return ret;
+}
+
+/***********************************************************************
+ *           tp_object_wait    (internal)
  *
- * PARAMS
- *  NewWaitObject [I] Handle to the new wait object. Use RtlDeregisterWait() to free it.
- *  Object   [I] Object to wait to become signaled.
- *  Callback [I] Callback function to execute when the wait times out or the handle is signaled.
- *  Context  [I] Context to pass to the callback function when it is executed.
- *  Milliseconds [I] Number of milliseconds to wait before timing out.
- *  Flags    [I] Flags. See notes.
+ * Waits until all the pending and running callbacks of an object have
+ * finished.
+ */
+static void tp_object_wait( struct threadpool_object *object )
+{
+    struct threadpool_worker *worker = ntdll_get_thread_data()->threadpool_worker;
+    struct threadpool *pool = object->pool;
+    BOOL blocking = worker && worker->pool == pool;
+
+    /* the callbacks may be sitting in our own deque */
+    if (blocking) tp_object_may_run_long( pool );
+
+    RtlEnterCriticalSection( &pool->cs );
+    interlocked_inc( &object->num_waiters );
+    while (object->num_pending_callbacks || object->num_running_callbacks)
+        RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
+    interlocked_dec( &object->num_waiters );
+    RtlLeaveCriticalSection( &pool->cs );
+
+    if (blocking) interlocked_dec( &pool->num_long );
+}
+
+/***********************************************************************
+ *           tp_object_end_callback    (internal)
  *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ * Marks a callback as finished and wakes up the waiters when it was the
+ * last one.
+ */
+static void tp_object_end_callback( struct threadpool_object *object )
+{
+    if (interlocked_dec( &object->num_running_callbacks ) || object->num_pending_callbacks)
+        return;
+    if (!object->num_waiters)
+        return;
+
+    RtlEnterCriticalSection( &object->pool->cs );
+    RtlWakeAllConditionVariable( &object->finished_event );
+    RtlLeaveCriticalSection( &object->pool->cs );
+}
+
+/***********************************************************************
+ *           tp_object_claim_pending    (internal)
  *
- * NOTES
- *  Flags can be one or more of the following:
- *|WT_EXECUTEDEFAULT - Executes the work item in a non-I/O worker thread.
- *|WT_EXECUTEINIOTHREAD - Executes the work item in an I/O worker thread.
- *|WT_EXECUTEINPERSISTENTTHREAD - Executes the work item in a thread that is persistent.
- *|WT_EXECUTELONGFUNCTION - Hints that the execution can take a long time.
- *|WT_TRANSFER_IMPERSONATION - Executes the function with the current access token.
+ * Takes one of the pending callbacks of an object; fails when they have
+ * been cancelled.
  */
-NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
-                                RTL_WAITORTIMERCALLBACKFUNC Callback,
-                                PVOID Context, ULONG Milliseconds, ULONG Flags)
+static BOOL tp_object_claim_pending( struct threadpool_object *object )
 {
-    struct wait_work_item *wait_work_item;
-    NTSTATUS status;
+    LONG pending = object->num_pending_callbacks, prev;
 
-    TRACE( "(%p, %p, %p, %p, %d, 0x%x)\n", NewWaitObject, Object, Callback, Context, Milliseconds, Flags );
+    while (pending)
+    {
+        if ((prev = interlocked_cmpxchg( &object->num_pending_callbacks, pending - 1, pending )) == pending)
+            return TRUE;
+        pending = prev;
+    }
+    return FALSE;
+}
 
-    wait_work_item = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*wait_work_item) );
-    if (!wait_work_item)
-        return STATUS_NO_MEMORY;
+/***********************************************************************
+ *           tp_object_execute    (internal)
+ *
+ * Runs a queued callback of an object and its cleanup actions.
+ */
+static void tp_object_execute( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+    TP_CALLBACK_INSTANCE *callback_instance;
+    struct threadpool_instance instance;
 
-    wait_work_item->Object = Object;
-    wait_work_item->Callback = Callback;
-    wait_work_item->Context = Context;
-    wait_work_item->Milliseconds = Milliseconds;
-    wait_work_item->Flags = Flags;
-    wait_work_item->CallbackInProgress = FALSE;
-    wait_work_item->DeleteCount = 0;
-    wait_work_item->CompletionEvent = NULL;
+    /* raise the running count first so that waiters never see both counts at zero in between */
+    interlocked_inc( &object->num_running_callbacks );
+    if (!tp_object_claim_pending( object ))
+    {
+        tp_object_end_callback( object );
+        goto done;
+    }
 
-    status = NtCreateEvent( &wait_work_item->CancelEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
-    if (status != STATUS_SUCCESS)
+    instance.object                   = object;
+    instance.threadid                 = GetCurrentThreadId();
+    instance.associated               = TRUE;
+    instance.may_run_long             = object->may_run_long;
+    instance.cleanup.critical_section = NULL;
+    instance.cleanup.mutex            = NULL;
+    instance.cleanup.semaphore        = NULL;
+    instance.cleanup.semaphore_count  = 0;
+    instance.cleanup.event            = NULL;
+    instance.cleanup.library          = NULL;
+    callback_instance = (TP_CALLBACK_INSTANCE *)&instance;
+
+    if (instance.may_run_long) tp_object_may_run_long( pool );
+
+    switch (object->type)
     {
-        RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
-        return status;
+        case TP_OBJECT_TYPE_SIMPLE:
+        {
+            TRACE( "executing simple callback %p(%p, %p)\n",
+                   object->u.simple.callback, callback_instance, object->userdata );
+            object->u.simple.callback( callback_instance, object->userdata );
+            TRACE( "callback %p returned\n", object->u.simple.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_WORK:
+        {
+            TRACE( "executing work callback %p(%p, %p, %p)\n",
+                   object->u.work.callback, callback_instance, object->userdata, object );
+            object->u.work.callback( callback_instance, object->userdata, (TP_WORK *)object );
+            TRACE( "callback %p returned\n", object->u.work.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_TIMER:
+        {
+            TRACE( "executing timer callback %p(%p, %p, %p)\n",
+                   object->u.timer.callback, callback_instance, object->userdata, object );
+            object->u.timer.callback( callback_instance, object->userdata, (TP_TIMER *)object );
+            TRACE( "callback %p returned\n", object->u.timer.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_WAIT:
+        {
+            TRACE( "executing wait callback %p(%p, %p, %p, %u)\n",
+                   object->u.wait.callback, callback_instance, object->userdata, object, object->u.wait.result );
+            object->u.wait.callback( callback_instance, object->userdata, (TP_WAIT *)object, object->u.wait.result );
+            TRACE( "callback %p returned\n", object->u.wait.callback );
+            break;
+        }
+
+        default:
+            assert(0);
+            break;
     }
 
-    Flags = Flags & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD |
-                     WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION);
-    status = RtlQueueWorkItem( wait_thread_proc, wait_work_item, Flags );
-    if (status != STATUS_SUCCESS)
+    if (object->finalization_callback)
     {
-        delete_wait_work_item( wait_work_item );
-        return status;
+        TRACE( "executing finalization callback %p(%p, %p)\n",
+               object->finalization_callback, callback_instance, object->userdata );
+        object->finalization_callback( callback_instance, object->userdata );
+        TRACE( "callback %p returned\n", object->finalization_callback );
     }
 
-    *NewWaitObject = wait_work_item;
-    return status;
+    /* execute the cleanup actions requested by the callback */
+    if (instance.cleanup.critical_section)
+        RtlLeaveCriticalSection( instance.cleanup.critical_section );
+    if (instance.cleanup.mutex)
+        NtReleaseMutant( instance.cleanup.mutex, NULL );
+    if (instance.cleanup.semaphore)
+        NtReleaseSemaphore( instance.cleanup.semaphore, instance.cleanup.semaphore_count, NULL );
+    if (instance.cleanup.event)
+        NtSetEvent( instance.cleanup.event, NULL );
+    if (instance.cleanup.library)
+        LdrUnloadDll( instance.cleanup.library );
+
+    if (instance.may_run_long) interlocked_dec( &pool->num_long );
+    if (instance.associated) tp_object_end_callback( object );
+
+done:
+    /* simple callbacks don't have a handle, the reference of the creator goes away with the callback */
+    if (object->type == TP_OBJECT_TYPE_SIMPLE) tp_object_release( object );
+    tp_object_release( object );
 }
 
 /***********************************************************************
- *              RtlDeregisterWaitEx   (NTDLL.@)
- *
- * Cancels a wait operation and frees the resources associated with calling
- * RtlRegisterWait().
- *
- * PARAMS
- *  WaitObject [I] Handle to the wait object to free.
- *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ *           timerqueue_thread_proc    (internal)
  */
-NTSTATUS WINAPI RtlDeregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent)
+static void CALLBACK timerqueue_thread_proc( void *param )
 {
-    struct wait_work_item *wait_work_item = WaitHandle;
-    NTSTATUS status = STATUS_SUCCESS;
+    ULONGLONG timeout_lower, timeout_upper, new_timeout;
+    struct threadpool_object *other_timer;
+    LARGE_INTEGER now, timeout;
+    struct list *ptr;
 
-    TRACE( "(%p)\n", WaitHandle );
+    TRACE( "starting timer queue thread\n" );
 
-    NtSetEvent( wait_work_item->CancelEvent, NULL );
-    if (wait_work_item->CallbackInProgress)
+    RtlEnterCriticalSection( &timerqueue.cs );
+    for (;;)
     {
-        if (CompletionEvent != NULL)
+        NtQuerySystemTime( &now );
+
+        /* queue the callbacks of all the expired timers */
+        while ((ptr = list_head( &timerqueue.pending_timers )))
         {
-            if (CompletionEvent == INVALID_HANDLE_VALUE)
-            {
-                status = NtCreateEvent( &CompletionEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
-                if (status != STATUS_SUCCESS)
-                    return status;
-                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
-                if (wait_work_item->CallbackInProgress)
-                    NtWaitForSingleObject( CompletionEvent, FALSE, NULL );
-                NtClose( CompletionEvent );
-            }
-            else
+            struct threadpool_object *timer = LIST_ENTRY( ptr, struct threadpool_object, u.timer.timer_entry );
+            assert( timer->type == TP_OBJECT_TYPE_TIMER );
+            assert( timer->u.timer.timer_pending );
+
+            if (timer->u.timer.timeout > now.QuadPart)
+                break;
+
+            list_remove( &timer->u.timer.timer_entry );
+            timer->u.timer.timer_pending = FALSE;
+
+            if (!timer->shutdown)
+                tp_object_submit( timer );
+
+            /* rearm periodic timers, skipping the periods that were missed */
+            if (timer->u.timer.period)
             {
-                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
-                if (wait_work_item->CallbackInProgress)
-                    status = STATUS_PENDING;
+                timer->u.timer.timeout += (ULONGLONG)timer->u.timer.period * 10000;
+                if (timer->u.timer.timeout <= now.QuadPart)
+                    timer->u.timer.timeout = now.QuadPart + 1;
+
+                LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
+                                     struct threadpool_object, u.timer.timer_entry )
+                {
+                    if (timer->u.timer.timeout < other_timer->u.timer.timeout)
+                        break;
+                }
+                list_add_before( &other_timer->u.timer.timer_entry, &timer->u.timer.timer_entry );
+                timer->u.timer.timer_pending = TRUE;
             }
         }
+
+        /* sleep until the latest moment that still satisfies the window of all timers
+         * firing by then, so that timers with overlapping windows are coalesced */
+        timeout_lower = timeout_upper = TIMEOUT_INFINITE;
+        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
+                             struct threadpool_object, u.timer.timer_entry )
+        {
+            if (other_timer->u.timer.timeout > timeout_upper)
+                break;
+
+            timeout_lower = other_timer->u.timer.timeout;
+            new_timeout = timeout_lower + (ULONGLONG)other_timer->u.timer.window_length * 10000;
+            if (new_timeout < timeout_upper)
+                timeout_upper = new_timeout;
+        }
+
+        if (timeout_lower != TIMEOUT_INFINITE)
+        {
+            timeout.QuadPart = timeout_lower;
+            RtlSleepConditionVariableCS( &timerqueue.update_event, &timerqueue.cs, &timeout );
+        }
+        else if (timerqueue.objcount)
+            RtlSleepConditionVariableCS( &timerqueue.update_event, &timerqueue.cs, NULL );
         else
-            status = STATUS_PENDING;
+        {
+            /* stay around for a while in case a new timer gets created */
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+            if (RtlSleepConditionVariableCS( &timerqueue.update_event, &timerqueue.cs, &timeout ) == STATUS_TIMEOUT &&
+                !timerqueue.objcount)
+                break;
+        }
     }
 
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
+    timerqueue.thread_running = FALSE;
+    RtlLeaveCriticalSection( &timerqueue.cs );
+
+    TRACE( "terminating timer queue thread\n" );
+    RtlExitUserThread( 0 );
+}
+
+/***********************************************************************
+ *           tp_timerqueue_lock    (internal)
+ *
+ * Registers a timer object with the timer thread, starting it if needed.
+ */
+static NTSTATUS tp_timerqueue_lock( struct threadpool_object *timer )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    assert( timer->type == TP_OBJECT_TYPE_TIMER );
+
+    timer->u.timer.timer_initialized    = FALSE;
+    timer->u.timer.timer_pending        = FALSE;
+    timer->u.timer.timer_set            = FALSE;
+    timer->u.timer.timeout              = 0;
+    timer->u.timer.period               = 0;
+    timer->u.timer.window_length        = 0;
+
+    RtlEnterCriticalSection( &timerqueue.cs );
+
+    if (!timerqueue.thread_running)
     {
-        status = STATUS_SUCCESS;
-        delete_wait_work_item( wait_work_item );
+        HANDLE thread;
+        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                      timerqueue_thread_proc, NULL, &thread, NULL );
+        if (status == STATUS_SUCCESS)
+        {
+            timerqueue.thread_running = TRUE;
+            NtClose( thread );
+        }
+    }
+
+    if (status == STATUS_SUCCESS)
+    {
+        timer->u.timer.timer_initialized = TRUE;
+        timerqueue.objcount++;
     }
 
+    RtlLeaveCriticalSection( &timerqueue.cs );
     return status;
 }
 
 /***********************************************************************
- *              RtlDeregisterWait   (NTDLL.@)
- *
- * Cancels a wait operation and frees the resources associated with calling
- * RtlRegisterWait().
- *
- * PARAMS
- *  WaitObject [I] Handle to the wait object to free.
+ *           tp_timerqueue_unlock    (internal)
  *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ * Disarms a timer and unregisters it from the timer thread.
  */
-NTSTATUS WINAPI RtlDeregisterWait(HANDLE WaitHandle)
+static void tp_timerqueue_unlock( struct threadpool_object *timer )
 {
-    return RtlDeregisterWaitEx(WaitHandle, NULL);
-}
+    assert( timer->type == TP_OBJECT_TYPE_TIMER );
 
+    RtlEnterCriticalSection( &timerqueue.cs );
+    if (timer->u.timer.timer_initialized)
+    {
+        if (timer->u.timer.timer_pending)
+        {
+            list_remove( &timer->u.timer.timer_entry );
+            timer->u.timer.timer_pending = FALSE;
+        }
 
-/************************** Timer Queue Impl **************************/
-
-struct timer_queue;
-struct queue_timer
-{
-    struct timer_queue *q;
-    struct list entry;
-    ULONG runcount;             /* number of callbacks pending execution */
-    RTL_WAITORTIMERCALLBACKFUNC callback;
-    PVOID param;
-    DWORD period;
-    ULONG flags;
-    ULONGLONG expire;
-    BOOL destroy;      /* timer should be deleted; once set, never unset */
-    HANDLE event;      /* removal event */
-};
-
-struct timer_queue
-{
-    RTL_CRITICAL_SECTION cs;
-    struct list timers;          /* sorted by expiration time */
-    BOOL quit;         /* queue should be deleted; once set, never unset */
-    HANDLE event;
-    HANDLE thread;
-};
+        if (!--timerqueue.objcount)
+            RtlWakeAllConditionVariable( &timerqueue.update_event );
 
-#define EXPIRE_NEVER (~(ULONGLONG) 0)
+        timer->u.timer.timer_initialized = FALSE;
+    }
+    RtlLeaveCriticalSection( &timerqueue.cs );
+}
 
-static void queue_remove_timer(struct queue_timer *t)
+/***********************************************************************
+ *           tp_waitqueue_fire    (internal)
+ *
+ * Disarms a wait and queues its callback. Must be called with the
+ * waitqueue cs held.
+ */
+static void tp_waitqueue_fire( struct threadpool_object *wait, TP_WAIT_RESULT result )
 {
-    /* We MUST hold the queue cs while calling this function.  This ensures
-       that we cannot queue another callback for this timer.  The runcount
-       being zero makes sure we don't have any already queued.  */
-    struct timer_queue *q = t->q;
-
-    assert(t->runcount == 0);
-    assert(t->destroy);
+    list_remove( &wait->u.wait.wait_entry );
+    wait->u.wait.wait_pending = FALSE;
+    wait->u.wait.result = result;
+    if (!wait->shutdown) tp_object_submit( wait );
+}
 
-    list_remove(&t->entry);
-    if (t->event)
-        NtSetEvent(t->event, NULL);
-    RtlFreeHeap(GetProcessHeap(), 0, t);
+/***********************************************************************
+ *           tp_waitqueue_find    (internal)
+ *
+ * Checks whether a wait is still armed in a bucket; the object may have
+ * been disarmed or even destroyed while the bucket thread was waiting.
+ */
+static BOOL tp_waitqueue_find( struct waitqueue_bucket *bucket, struct threadpool_object *wait, HANDLE handle )
+{
+    struct threadpool_object *other;
 
-    if (q->quit && list_empty(&q->timers))
-        NtSetEvent(q->event, NULL);
+    LIST_FOR_EACH_ENTRY( other, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+        if (other == wait) return wait->u.wait.handle == handle;
+    return FALSE;
 }
 
-static void timer_cleanup_callback(struct queue_timer *t)
+/***********************************************************************
+ *           waitqueue_thread_proc    (internal)
+ */
+static void CALLBACK waitqueue_thread_proc( void *param )
 {
-    struct timer_queue *q = t->q;
-    RtlEnterCriticalSection(&q->cs);
+    struct threadpool_object *objects[MAXIMUM_WAITQUEUE_OBJECTS];
+    HANDLE handles[MAXIMUM_WAITQUEUE_OBJECTS + 1];
+    struct waitqueue_bucket *bucket = param;
+    struct threadpool_object *wait, *next;
+    LARGE_INTEGER now, timeout;
+    ULONGLONG next_timeout;
+    DWORD num_handles;
+    NTSTATUS status;
 
-    assert(0 < t->runcount);
-    --t->runcount;
+    TRACE( "starting wait queue thread for bucket %p\n", bucket );
 
-    if (t->destroy && t->runcount == 0)
-        queue_remove_timer(t);
+    RtlEnterCriticalSection( &waitqueue.cs );
+    for (;;)
+    {
+        NtQuerySystemTime( &now );
+        next_timeout = TIMEOUT_INFINITE;
+        num_handles = 0;
 
-    RtlLeaveCriticalSection(&q->cs);
-}
+        LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+        {
+            assert( wait->type == TP_OBJECT_TYPE_WAIT );
 
-static DWORD WINAPI timer_callback_wrapper(LPVOID p)
-{
-    struct queue_timer *t = p;
-    t->callback(t->param, TRUE);
-    timer_cleanup_callback(t);
-    return 0;
-}
+            if (wait->u.wait.timeout <= now.QuadPart)
+            {
+                tp_waitqueue_fire( wait, WAIT_TIMEOUT );
+                continue;
+            }
 
-static inline ULONGLONG queue_current_time(void)
-{
-    LARGE_INTEGER now, freq;
-    NtQueryPerformanceCounter(&now, &freq);
-    return now.QuadPart * 1000 / freq.QuadPart;
-}
+            objects[num_handles] = wait;
+            handles[num_handles] = wait->u.wait.handle;
+            num_handles++;
+            if (wait->u.wait.timeout < next_timeout)
+                next_timeout = wait->u.wait.timeout;
+        }
 
-static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
-                            BOOL set_event)
-{
-    /* We MUST hold the queue cs while calling this function.  */
-    struct timer_queue *q = t->q;
-    struct list *ptr = &q->timers;
+        if (!bucket->objcount)
+            break;
 
-    assert(!q->quit || (t->destroy && time == EXPIRE_NEVER));
+        handles[num_handles] = bucket->update_event;
+        timeout.QuadPart = next_timeout;
 
-    if (time != EXPIRE_NEVER)
-        LIST_FOR_EACH(ptr, &q->timers)
+        RtlLeaveCriticalSection( &waitqueue.cs );
+        status = NtWaitForMultipleObjects( num_handles + 1, handles, FALSE, FALSE,
+                                           next_timeout != TIMEOUT_INFINITE ? &timeout : NULL );
+        RtlEnterCriticalSection( &waitqueue.cs );
+
+        if (status < num_handles)
         {
-            struct queue_timer *cur = LIST_ENTRY(ptr, struct queue_timer, entry);
-            if (time < cur->expire)
-                break;
+            wait = objects[status];
+            if (tp_waitqueue_find( bucket, wait, handles[status] ))
+                tp_waitqueue_fire( wait, WAIT_OBJECT_0 );
         }
-    list_add_before(ptr, &t->entry);
+        else if (status >= STATUS_ABANDONED_WAIT_0 && status < STATUS_ABANDONED_WAIT_0 + num_handles)
+        {
+            wait = objects[status - STATUS_ABANDONED_WAIT_0];
+            if (tp_waitqueue_find( bucket, wait, handles[status - STATUS_ABANDONED_WAIT_0] ))
+                tp_waitqueue_fire( wait, WAIT_ABANDONED_0 );
+        }
+        else if (status != num_handles && status != STATUS_TIMEOUT)
+        {
+            /* most likely a handle was closed while armed, drop it to avoid spinning */
+            LARGE_INTEGER zero;
+            zero.QuadPart = 0;
+            LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+            {
+                status = NtWaitForSingleObject( wait->u.wait.handle, FALSE, &zero );
+                if (status == STATUS_WAIT_0 || status == STATUS_TIMEOUT || status == STATUS_ABANDONED_WAIT_0)
+                    continue;
+                WARN( "dropping wait %p on handle %p, status %x\n", wait, wait->u.wait.handle, status );
+                list_remove( &wait->u.wait.wait_entry );
+                wait->u.wait.wait_pending = FALSE;
+            }
+        }
+    }
 
-    t->expire = time;
+    list_remove( &bucket->bucket_entry );
+    RtlLeaveCriticalSection( &waitqueue.cs );
 
-    /* If we insert at the head of the list, we need to expire sooner
-       than expected.  */
-    if (set_event && &t->entry == list_head(&q->timers))
-        NtSetEvent(q->event, NULL);
-}
+    TRACE( "terminating wait queue thread for bucket %p\n", bucket );
 
-static inline void queue_move_timer(struct queue_timer *t, ULONGLONG time,
-                                    BOOL set_event)
-{
-    /* We MUST hold the queue cs while calling this function.  */
-    list_remove(&t->entry);
-    queue_add_timer(t, time, set_event);
+    NtClose( bucket->update_event );
+    RtlFreeHeap( GetProcessHeap(), 0, bucket );
+    RtlExitUserThread( 0 );
 }
 
-static void queue_timer_expire(struct timer_queue *q)
+/***********************************************************************
+ *           tp_waitqueue_lock    (internal)
+ *
+ * Assigns a wait object to a bucket with a free slot, creating a new
+ * bucket and its thread if needed.
+ */
+static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
 {
-    struct queue_timer *t = NULL;
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    HANDLE thread;
+    assert( wait->type == TP_OBJECT_TYPE_WAIT );
 
-    RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    wait->u.wait.bucket         = NULL;
+    wait->u.wait.wait_pending   = FALSE;
+    wait->u.wait.handle         = NULL;
+    wait->u.wait.timeout        = 0;
+    wait->u.wait.result         = 0;
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
     {
-        ULONGLONG now, next;
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
-        if (!t->destroy && t->expire <= ((now = queue_current_time())))
+        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS)
         {
-            ++t->runcount;
-            if (t->period)
-            {
-                next = t->expire + t->period;
-                /* avoid trigger cascade if overloaded / hibernated */
-                if (next < now)
-                    next = now + t->period;
-            }
-            else
-                next = EXPIRE_NEVER;
-            queue_move_timer(t, next, FALSE);
+            bucket->objcount++;
+            wait->u.wait.bucket = bucket;
+            status = STATUS_SUCCESS;
+            goto out;
         }
-        else
-            t = NULL;
     }
-    RtlLeaveCriticalSection(&q->cs);
 
-    if (t)
+    if (!(bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) )))
     {
-        if (t->flags & WT_EXECUTEINTIMERTHREAD)
-            timer_callback_wrapper(t);
-        else
-        {
-            ULONG flags
-                = (t->flags
-                   & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD
-                      | WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION));
-            NTSTATUS status = RtlQueueWorkItem(timer_callback_wrapper, t, flags);
-            if (status != STATUS_SUCCESS)
-                timer_cleanup_callback(t);
-        }
+        status = STATUS_NO_MEMORY;
+        goto out;
+    }
+
+    bucket->objcount = 0;
+    list_init( &bucket->waiting );
+
+    status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        goto out;
+    }
+
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                  waitqueue_thread_proc, bucket, &thread, NULL );
+    if (status)
+    {
+        NtClose( bucket->update_event );
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        goto out;
     }
+    NtClose( thread );
+
+    list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+    bucket->objcount++;
+    wait->u.wait.bucket = bucket;
+
+out:
+    RtlLeaveCriticalSection( &waitqueue.cs );
+    return status;
 }
 
-static ULONG queue_get_timeout(struct timer_queue *q)
+/***********************************************************************
+ *           tp_waitqueue_unlock    (internal)
+ *
+ * Disarms a wait and releases its bucket slot.
+ */
+static void tp_waitqueue_unlock( struct threadpool_object *wait )
 {
-    struct queue_timer *t;
-    ULONG timeout = INFINITE;
+    assert( wait->type == TP_OBJECT_TYPE_WAIT );
 
-    RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    RtlEnterCriticalSection( &waitqueue.cs );
+    if (wait->u.wait.bucket)
     {
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
-        assert(!t->destroy || t->expire == EXPIRE_NEVER);
+        struct waitqueue_bucket *bucket = wait->u.wait.bucket;
 
-        if (t->expire != EXPIRE_NEVER)
+        if (wait->u.wait.wait_pending)
         {
-            ULONGLONG time = queue_current_time();
-            timeout = t->expire < time ? 0 : t->expire - time;
+            list_remove( &wait->u.wait.wait_entry );
+            wait->u.wait.wait_pending = FALSE;
         }
-    }
-    RtlLeaveCriticalSection(&q->cs);
 
-    return timeout;
+        bucket->objcount--;
+        wait->u.wait.bucket = NULL;
+        NtSetEvent( bucket->update_event, NULL );
+    }
+    RtlLeaveCriticalSection( &waitqueue.cs );
 }
 
-static void WINAPI timer_queue_thread_proc(LPVOID p)
+/***********************************************************************
+ *           tp_object_initialize    (internal)
+ *
+ * Initializes the common part of a threadpool object from a callback
+ * environment, and adds it to its cleanup group.
+ */
+static NTSTATUS tp_object_initialize( struct threadpool_object *object, PVOID userdata,
+                                      TP_CALLBACK_ENVIRON *environment )
 {
-    struct timer_queue *q = p;
-    ULONG timeout_ms;
+    struct threadpool_group *group;
+    NTSTATUS status;
 
-    timeout_ms = INFINITE;
-    for (;;)
+    object->refcount                = 1;
+    object->shutdown                = FALSE;
+    object->pool                    = NULL;
+    object->group                   = NULL;
+    object->userdata                = userdata;
+    object->group_cancel_callback   = NULL;
+    object->finalization_callback   = NULL;
+    object->may_run_long            = FALSE;
+    object->race_dll                = NULL;
+    object->is_group_member         = FALSE;
+    object->num_pending_callbacks   = 0;
+    object->num_running_callbacks   = 0;
+    object->num_waiters             = 0;
+    RtlInitializeConditionVariable( &object->finished_event );
+
+    if (environment)
     {
-        LARGE_INTEGER timeout;
-        NTSTATUS status;
-        BOOL done = FALSE;
+        if (environment->Version != 1 && environment->Version != 3)
+            FIXME( "unsupported environment version %u\n", environment->Version );
+
+        object->group                 = impl_from_TP_CLEANUP_GROUP( environment->CleanupGroup );
+        object->group_cancel_callback = environment->CleanupGroupCancelCallback;
+        object->finalization_callback = environment->FinalizationCallback;
+        object->may_run_long          = environment->u.s.LongFunction != 0;
+        object->race_dll              = environment->RaceDll;
+
+        if (environment->ActivationContext)
+            FIXME( "activation context not supported yet\n" );
+        if (environment->u.s.Persistent)
+            FIXME( "persistent threads not supported yet\n" );
+    }
 
-        status = NtWaitForSingleObject(
-            q->event, FALSE, get_nt_timeout(&timeout, timeout_ms));
+    if ((status = tp_threadpool_lock( &object->pool, environment )))
+        return status;
 
-        if (status == STATUS_WAIT_0)
-        {
-            /* There are two possible ways to trigger the event.  Either
-               we are quitting and the last timer got removed, or a new
-               timer got put at the head of the list so we need to adjust
-               our timeout.  */
-            RtlEnterCriticalSection(&q->cs);
-            if (q->quit && list_empty(&q->timers))
-                done = TRUE;
-            RtlLeaveCriticalSection(&q->cs);
-        }
-        else if (status == STATUS_TIMEOUT)
-            queue_timer_expire(q);
+    if (object->race_dll)
+        LdrAddRefDll( 0, object->race_dll );
 
-        if (done)
-            break;
+    if ((group = object->group))
+    {
+        interlocked_inc( &group->refcount );
+        interlocked_inc( &object->refcount );  /* reference held by the group */
 
-        timeout_ms = queue_get_timeout(q);
+        RtlEnterCriticalSection( &group->cs );
+        list_add_tail( &group->members, &object->group_entry );
+        object->is_group_member = TRUE;
+        RtlLeaveCriticalSection( &group->cs );
     }
 
-    NtClose(q->event);
-    RtlDeleteCriticalSection(&q->cs);
-    RtlFreeHeap(GetProcessHeap(), 0, q);
+    TRACE( "initialized object %p of type %u\n", object, object->type );
+    return STATUS_SUCCESS;
 }
 
-static void queue_destroy_timer(struct queue_timer *t)
+/***********************************************************************
+ *           tp_object_leave_group    (internal)
+ *
+ * Removes an object from its cleanup group, dropping the group reference.
+ */
+static void tp_object_leave_group( struct threadpool_object *object )
 {
-    /* We MUST hold the queue cs while calling this function.  */
-    t->destroy = TRUE;
-    if (t->runcount == 0)
-        /* Ensure a timer is promptly removed.  If callbacks are pending,
-           it will be removed after the last one finishes by the callback
-           cleanup wrapper.  */
-        queue_remove_timer(t);
-    else
-        /* Make sure no destroyed timer masks an active timer at the head
-           of the sorted list.  */
-        queue_move_timer(t, EXPIRE_NEVER, FALSE);
+    struct threadpool_group *group = object->group;
+    BOOL member;
+
+    if (!group) return;
+
+    RtlEnterCriticalSection( &group->cs );
+    if ((member = object->is_group_member))
+    {
+        list_remove( &object->group_entry );
+        object->is_group_member = FALSE;
+    }
+    RtlLeaveCriticalSection( &group->cs );
+
+    if (member) tp_object_release( object );
 }
 
 /***********************************************************************
- *              RtlCreateTimerQueue   (NTDLL.@)
- *
- * Creates a timer queue object and returns a handle to it.
- *
- * PARAMS
- *  NewTimerQueue [O] The newly created queue.
+ *           tp_object_shutdown    (internal)
  *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ * Disarms an object before its handle is released; queued callbacks
+ * still run.
  */
-NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
+static void tp_object_shutdown( struct threadpool_object *object )
 {
-    NTSTATUS status;
-    struct timer_queue *q = RtlAllocateHeap(GetProcessHeap(), 0, sizeof *q);
-    if (!q)
-        return STATUS_NO_MEMORY;
+    if (object->type == TP_OBJECT_TYPE_TIMER)
+        tp_timerqueue_unlock( object );
+    else if (object->type == TP_OBJECT_TYPE_WAIT)
+        tp_waitqueue_unlock( object );
+
+    object->shutdown = TRUE;
+}
+
+/***********************************************************************
+ *           tp_object_release    (internal)
+ *
+ * Releases a reference to a threadpool object.
+ */
+static BOOL tp_object_release( struct threadpool_object *object )
+{
+    if (interlocked_dec( &object->refcount ))
+        return FALSE;
+
+    TRACE( "destroying object %p of type %u\n", object, object->type );
+
+    assert( !object->is_group_member );
+    assert( !object->num_running_callbacks );
+
+    if (object->group)
+        tp_group_release( object->group );
+    if (object->race_dll)
+        LdrUnloadDll( object->race_dll );
+
+    tp_threadpool_release( object->pool );
+    RtlFreeHeap( GetProcessHeap(), 0, object );
+    return TRUE;
+}
+
+static void CALLBACK process_rtl_work_item( TP_CALLBACK_INSTANCE *instance, void *userdata )
+{
+    struct rtl_work_item *item = userdata;
+
+    TRACE( "executing %p(%p)\n", item->function, item->context );
+    item->function( item->context );
+
+    RtlFreeHeap( GetProcessHeap(), 0, item );
+}
+
+/***********************************************************************
+ *              RtlQueueWorkItem   (NTDLL.@)
+ *
+ * Queues a work item into a thread in the thread pool.
+ *
+ * PARAMS
+ *  Function [I] Work function to execute.
+ *  Context  [I] Context to pass to the work function when it is executed.
+ *  Flags    [I] Flags. See notes.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ *
+ * NOTES
+ *  Flags can be one or more of the following:
+ *|WT_EXECUTEDEFAULT - Executes the work item in a non-I/O worker thread.
+ *|WT_EXECUTEINIOTHREAD - Executes the work item in an I/O worker thread.
+ *|WT_EXECUTEINPERSISTENTTHREAD - Executes the work item in a thread that is persistent.
+ *|WT_EXECUTELONGFUNCTION - Hints that the execution can take a long time.
+ *|WT_TRANSFER_IMPERSONATION - Executes the function with the current access token.
+ *
+ *  The work items run on the default pool of the Tp* functions. They are
+ *  always treated as long running callbacks, so that a new worker is
+ *  started when all the workers are busy; callers of this function
+ *  commonly block in their work items.
+ */
+NTSTATUS WINAPI RtlQueueWorkItem(PRTL_WORK_ITEM_ROUTINE Function, PVOID Context, ULONG Flags)
+{
+    TP_CALLBACK_ENVIRON environment;
+    struct rtl_work_item *item;
+    NTSTATUS status;
+
+    TRACE( "%p %p %u\n", Function, Context, Flags );
+
+    if (Flags & ~WT_EXECUTELONGFUNCTION)
+        FIXME("Flags 0x%x not supported\n", Flags);
+
+    if (!(item = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*item) )))
+        return STATUS_NO_MEMORY;
+
+    memset( &environment, 0, sizeof(environment) );
+    environment.Version = 1;
+    environment.u.s.LongFunction = TRUE;
+
+    item->function = Function;
+    item->context  = Context;
+
+    status = TpSimpleTryPost( process_rtl_work_item, item, &environment );
+    if (status)
+        RtlFreeHeap( GetProcessHeap(), 0, item );
+    return status;
+}
+
+/***********************************************************************
+ * iocp_poller - get completion events and run callbacks
+ */
+static DWORD CALLBACK iocp_poller(LPVOID Arg)
+{
+    while( TRUE )
+    {
+        PRTL_OVERLAPPED_COMPLETION_ROUTINE callback;
+        LPVOID overlapped;
+        IO_STATUS_BLOCK iosb;
+        NTSTATUS res = NtRemoveIoCompletion( compl_port, (PULONG_PTR)&callback, (PULONG_PTR)&overlapped, &iosb, NULL );
+        if (res)
+        {
+            ERR("NtRemoveIoCompletion failed: 0x%x\n", res);
+        }
+        else
+        {
+            DWORD transferred = 0;
+            DWORD err = 0;
+
+            if (iosb.u.Status == STATUS_SUCCESS)
+                transferred = iosb.Information;
+            else
+                err = RtlNtStatusToDosError(iosb.u.Status);
+
+            callback( err, transferred, overlapped );
+        }
+    }
+    return 0;
+}
+
+/***********************************************************************
+ *              RtlSetIoCompletionCallback  (NTDLL.@)
+ *
+ * Binds a handle to a thread pool's completion port, and possibly
+ * starts a non-I/O thread to monitor this port and call functions back.
+ *
+ * PARAMS
+ *  FileHandle [I] Handle to bind to a completion port.
+ *  Function   [I] Callback function to call on I/O completions.
+ *  Flags      [I] Not used.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ *
+ */
+NTSTATUS WINAPI RtlSetIoCompletionCallback(HANDLE FileHandle, PRTL_OVERLAPPED_COMPLETION_ROUTINE Function, ULONG Flags)
+{
+    IO_STATUS_BLOCK iosb;
+    FILE_COMPLETION_INFORMATION info;
+
+    if (Flags) FIXME("Unknown value Flags=0x%x\n", Flags);
+
+    if (!compl_port)
+    {
+        NTSTATUS res = STATUS_SUCCESS;
+
+        RtlEnterCriticalSection(&threadpool_compl_cs);
+        if (!compl_port)
+        {
+            HANDLE cport;
+
+            res = NtCreateIoCompletion( &cport, IO_COMPLETION_ALL_ACCESS, NULL, 0 );
+            if (!res)
+            {
+                /* FIXME native can start additional threads in case of e.g. hung callback function. */
+                res = RtlQueueWorkItem( iocp_poller, NULL, WT_EXECUTELONGFUNCTION );
+                if (!res)
+                    compl_port = cport;
+                else
+                    NtClose( cport );
+            }
+        }
+        RtlLeaveCriticalSection(&threadpool_compl_cs);
+        if (res) return res;
+    }
+
+    info.CompletionPort = compl_port;
+    info.CompletionKey = (ULONG_PTR)Function;
+
+    return NtSetInformationFile( FileHandle, &iosb, &info, sizeof(info), FileCompletionInformation );
+}
+
+static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout )
+{
+    if (timeout == INFINITE) return NULL;
+    pTime->QuadPart = (ULONGLONG)timeout * -10000;
+    return pTime;
+}
+
+struct wait_work_item
+{
+    HANDLE Object;
+    HANDLE CancelEvent;
+    WAITORTIMERCALLBACK Callback;
+    PVOID Context;
+    ULONG Milliseconds;
+    ULONG Flags;
+    HANDLE CompletionEvent;
+    LONG DeleteCount;
+    BOOLEAN CallbackInProgress;
+};
+
+static void delete_wait_work_item(struct wait_work_item *wait_work_item)
+{
+    NtClose( wait_work_item->CancelEvent );
+    RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
+}
+
+static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
+{
+    struct wait_work_item *wait_work_item = Arg;
+    NTSTATUS status;
+    BOOLEAN alertable = (wait_work_item->Flags & WT_EXECUTEINIOTHREAD) != 0;
+    HANDLE handles[2] = { wait_work_item->Object, wait_work_item->CancelEvent };
+    LARGE_INTEGER timeout;
+    HANDLE completion_event;
+
+    TRACE("\n");
+
+    while (TRUE)
+    {
+        status = NtWaitForMultipleObjects( 2, handles, FALSE, alertable,
+                                           get_nt_timeout( &timeout, wait_work_item->Milliseconds ) );
+        if (status == STATUS_WAIT_0 || status == STATUS_TIMEOUT)
+        {
+            BOOLEAN TimerOrWaitFired;
+
+            if (status == STATUS_WAIT_0)
+            {
+                TRACE( "object %p signaled, calling callback %p with context %p\n",
+                    wait_work_item->Object, wait_work_item->Callback,
+                    wait_work_item->Context );
+                TimerOrWaitFired = FALSE;
+            }
+            else
+            {
+                TRACE( "wait for object %p timed out, calling callback %p with context %p\n",
+                    wait_work_item->Object, wait_work_item->Callback,
+                    wait_work_item->Context );
+                TimerOrWaitFired = TRUE;
+            }
+            wait_work_item->CallbackInProgress = TRUE;
+            wait_work_item->Callback( wait_work_item->Context, TimerOrWaitFired );
+            wait_work_item->CallbackInProgress = FALSE;
+
+            if (wait_work_item->Flags & WT_EXECUTEONLYONCE)
+                break;
+        }
+        else
+            break;
+    }
+
+    completion_event = wait_work_item->CompletionEvent;
+    if (completion_event) NtSetEvent( completion_event, NULL );
+
+    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
+        delete_wait_work_item( wait_work_item );
+
+    return 0;
+}
+
+/***********************************************************************
+ *              RtlRegisterWait   (NTDLL.@)
+ *
+ * Registers a wait for a handle to become signaled.
+ *
+ * PARAMS
+ *  NewWaitObject [I] Handle to the new wait object. Use RtlDeregisterWait() to free it.
+ *  Object   [I] Object to wait to become signaled.
+ *  Callback [I] Callback function to execute when the wait times out or the handle is signaled.
+ *  Context  [I] Context to pass to the callback function when it is executed.
+ *  Milliseconds [I] Number of milliseconds to wait before timing out.
+ *  Flags    [I] Flags. See notes.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ *
+ * NOTES
+ *  Flags can be one or more of the following:
+ *|WT_EXECUTEDEFAULT - Executes the work item in a non-I/O worker thread.
+ *|WT_EXECUTEINIOTHREAD - Executes the work item in an I/O worker thread.
+ *|WT_EXECUTEINPERSISTENTTHREAD - Executes the work item in a thread that is persistent.
+ *|WT_EXECUTELONGFUNCTION - Hints that the execution can take a long time.
+ *|WT_TRANSFER_IMPERSONATION - Executes the function with the current access token.
+ */
+NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
+                                RTL_WAITORTIMERCALLBACKFUNC Callback,
+                                PVOID Context, ULONG Milliseconds, ULONG Flags)
+{
+    struct wait_work_item *wait_work_item;
+    NTSTATUS status;
+
+    TRACE( "(%p, %p, %p, %p, %d, 0x%x)\n", NewWaitObject, Object, Callback, Context, Milliseconds, Flags );
+
+    wait_work_item = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*wait_work_item) );
+    if (!wait_work_item)
+        return STATUS_NO_MEMORY;
+
+    wait_work_item->Object = Object;
+    wait_work_item->Callback = Callback;
+    wait_work_item->Context = Context;
+    wait_work_item->Milliseconds = Milliseconds;
+    wait_work_item->Flags = Flags;
+    wait_work_item->CallbackInProgress = FALSE;
+    wait_work_item->DeleteCount = 0;
+    wait_work_item->CompletionEvent = NULL;
+
+    status = NtCreateEvent( &wait_work_item->CancelEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
+    if (status != STATUS_SUCCESS)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
+        return status;
+    }
+
+    /* the wait thread blocks until the wait is deregistered */
+    Flags = Flags & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD | WT_TRANSFER_IMPERSONATION);
+    status = RtlQueueWorkItem( wait_thread_proc, wait_work_item, Flags | WT_EXECUTELONGFUNCTION );
+    if (status != STATUS_SUCCESS)
+    {
+        delete_wait_work_item( wait_work_item );
+        return status;
+    }
+
+    *NewWaitObject = wait_work_item;
+    return status;
+}
+
+/***********************************************************************
+ *              RtlDeregisterWaitEx   (NTDLL.@)
+ *
+ * Cancels a wait operation and frees the resources associated with calling
+ * RtlRegisterWait().
+ *
+ * PARAMS
+ *  WaitObject [I] Handle to the wait object to free.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ */
+NTSTATUS WINAPI RtlDeregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent)
+{
+    struct wait_work_item *wait_work_item = WaitHandle;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    TRACE( "(%p)\n", WaitHandle );
+
+    NtSetEvent( wait_work_item->CancelEvent, NULL );
+    if (wait_work_item->CallbackInProgress)
+    {
+        if (CompletionEvent != NULL)
+        {
+            if (CompletionEvent == INVALID_HANDLE_VALUE)
+            {
+                status = NtCreateEvent( &CompletionEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
+                if (status != STATUS_SUCCESS)
+                    return status;
+                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
+                if (wait_work_item->CallbackInProgress)
+                    NtWaitForSingleObject( CompletionEvent, FALSE, NULL );
+                NtClose( CompletionEvent );
+            }
+            else
+            {
+                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
+                if (wait_work_item->CallbackInProgress)
+                    status = STATUS_PENDING;
+            }
+        }
+        else
+            status = STATUS_PENDING;
+    }
+
+    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
+    {
+        status = STATUS_SUCCESS;
+        delete_wait_work_item( wait_work_item );
+    }
+
+    return status;
+}
+
+/***********************************************************************
+ *              RtlDeregisterWait   (NTDLL.@)
+ *
+ * Cancels a wait operation and frees the resources associated with calling
+ * RtlRegisterWait().
+ *
+ * PARAMS
+ *  WaitObject [I] Handle to the wait object to free.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ */
+NTSTATUS WINAPI RtlDeregisterWait(HANDLE WaitHandle)
+{
+    return RtlDeregisterWaitEx(WaitHandle, NULL);
+}
+
+
+/************************** Timer Queue Impl **************************/
+
+struct timer_queue;
+struct queue_timer
+{
+    struct timer_queue *q;
+    struct list entry;
+    ULONG runcount;             /* number of callbacks pending execution */
+    RTL_WAITORTIMERCALLBACKFUNC callback;
+    PVOID param;
+    DWORD period;
+    ULONG flags;
+    ULONGLONG expire;
+    BOOL destroy;      /* timer should be deleted; once set, never unset */
+    HANDLE event;      /* removal event */
+};
+
+struct timer_queue
+{
+    RTL_CRITICAL_SECTION cs;
+    struct list timers;          /* sorted by expiration time */
+    BOOL quit;         /* queue should be deleted; once set, never unset */
+    HANDLE event;
+    HANDLE thread;
+};
+
+#define EXPIRE_NEVER (~(ULONGLONG) 0)
+
+static void queue_remove_timer(struct queue_timer *t)
+{
+    /* We MUST hold the queue cs while calling this function.  This ensures
+       that we cannot queue another callback for this timer.  The runcount
+       being zero makes sure we don't have any already queued.  */
+    struct timer_queue *q = t->q;
+
+    assert(t->runcount == 0);
+    assert(t->destroy);
+
+    list_remove(&t->entry);
+    if (t->event)
+        NtSetEvent(t->event, NULL);
+    RtlFreeHeap(GetProcessHeap(), 0, t);
+
+    if (q->quit && list_empty(&q->timers))
+        NtSetEvent(q->event, NULL);
+}
+
+static void timer_cleanup_callback(struct queue_timer *t)
+{
+    struct timer_queue *q = t->q;
+    RtlEnterCriticalSection(&q->cs);
+
+    assert(0 < t->runcount);
+    --t->runcount;
+
+    if (t->destroy && t->runcount == 0)
+        queue_remove_timer(t);
+
+    RtlLeaveCriticalSection(&q->cs);
+}
+
+static DWORD WINAPI timer_callback_wrapper(LPVOID p)
+{
+    struct queue_timer *t = p;
+    t->callback(t->param, TRUE);
+    timer_cleanup_callback(t);
+    return 0;
+}
+
+static inline ULONGLONG queue_current_time(void)
+{
+    LARGE_INTEGER now, freq;
+    NtQueryPerformanceCounter(&now, &freq);
+    return now.QuadPart * 1000 / freq.QuadPart;
+}
+
+static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
+                            BOOL set_event)
+{
+    /* We MUST hold the queue cs while calling this function.  */
+    struct timer_queue *q = t->q;
+    struct list *ptr = &q->timers;
+
+    assert(!q->quit || (t->destroy && time == EXPIRE_NEVER));
+
+    if (time != EXPIRE_NEVER)
+        LIST_FOR_EACH(ptr, &q->timers)
+        {
+            struct queue_timer *cur = LIST_ENTRY(ptr, struct queue_timer, entry);
+            if (time < cur->expire)
+                break;
+        }
+    list_add_before(ptr, &t->entry);
+
+    t->expire = time;
+
+    /* If we insert at the head of the list, we need to expire sooner
+       than expected.  */
+    if (set_event && &t->entry == list_head(&q->timers))
+        NtSetEvent(q->event, NULL);
+}
+
+static inline void queue_move_timer(struct queue_timer *t, ULONGLONG time,
+                                    BOOL set_event)
+{
+    /* We MUST hold the queue cs while calling this function.  */
+    list_remove(&t->entry);
+    queue_add_timer(t, time, set_event);
+}
+
+static void queue_timer_expire(struct timer_queue *q)
+{
+    struct queue_timer *t = NULL;
+
+    RtlEnterCriticalSection(&q->cs);
+    if (list_head(&q->timers))
+    {
+        ULONGLONG now, next;
+        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
+        if (!t->destroy && t->expire <= ((now = queue_current_time())))
+        {
+            ++t->runcount;
+            if (t->period)
+            {
+                next = t->expire + t->period;
+                /* avoid trigger cascade if overloaded / hibernated */
+                if (next < now)
+                    next = now + t->period;
+            }
+            else
+                next = EXPIRE_NEVER;
+            queue_move_timer(t, next, FALSE);
+        }
+        else
+            t = NULL;
+    }
+    RtlLeaveCriticalSection(&q->cs);
+
+    if (t)
+    {
+        if (t->flags & WT_EXECUTEINTIMERTHREAD)
+            timer_callback_wrapper(t);
+        else
+        {
+            ULONG flags
+                = (t->flags
+                   & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD
+                      | WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION));
+            NTSTATUS status = RtlQueueWorkItem(timer_callback_wrapper, t, flags);
+            if (status != STATUS_SUCCESS)
+                timer_cleanup_callback(t);
+        }
+    }
+}
+
+static ULONG queue_get_timeout(struct timer_queue *q)
+{
+    struct queue_timer *t;
+    ULONG timeout = INFINITE;
+
+    RtlEnterCriticalSection(&q->cs);
+    if (list_head(&q->timers))
+    {
+        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
+        assert(!t->destroy || t->expire == EXPIRE_NEVER);
+
+        if (t->expire != EXPIRE_NEVER)
+        {
+            ULONGLONG time = queue_current_time();
+            timeout = t->expire < time ? 0 : t->expire - time;
+        }
+    }
+    RtlLeaveCriticalSection(&q->cs);
+
+    return timeout;
+}
+
+static void WINAPI timer_queue_thread_proc(LPVOID p)
+{
+    struct timer_queue *q = p;
+    ULONG timeout_ms;
+
+    timeout_ms = INFINITE;
+    for (;;)
+    {
+        LARGE_INTEGER timeout;
+        NTSTATUS status;
+        BOOL done = FALSE;
+
+        status = NtWaitForSingleObject(
+            q->event, FALSE, get_nt_timeout(&timeout, timeout_ms));
+
+        if (status == STATUS_WAIT_0)
+        {
+            /* There are two possible ways to trigger the event.  Either
+               we are quitting and the last timer got removed, or a new
+               timer got put at the head of the list so we need to adjust
+               our timeout.  */
+            RtlEnterCriticalSection(&q->cs);
+            if (q->quit && list_empty(&q->timers))
+                done = TRUE;
+            RtlLeaveCriticalSection(&q->cs);
+        }
+        else if (status == STATUS_TIMEOUT)
+            queue_timer_expire(q);
+
+        if (done)
+            break;
+
+        timeout_ms = queue_get_timeout(q);
+    }
+
+    NtClose(q->event);
+    RtlDeleteCriticalSection(&q->cs);
+    RtlFreeHeap(GetProcessHeap(), 0, q);
+}
+
+static void queue_destroy_timer(struct queue_timer *t)
+{
+    /* We MUST hold the queue cs while calling this function.  */
+    t->destroy = TRUE;
+    if (t->runcount == 0)
+        /* Ensure a timer is promptly removed.  If callbacks are pending,
+           it will be removed after the last one finishes by the callback
+           cleanup wrapper.  */
+        queue_remove_timer(t);
+    else
+        /* Make sure no destroyed timer masks an active timer at the head
+           of the sorted list.  */
+        queue_move_timer(t, EXPIRE_NEVER, FALSE);
+}
+
+/***********************************************************************
+ *              RtlCreateTimerQueue   (NTDLL.@)
+ *
+ * Creates a timer queue object and returns a handle to it.
+ *
+ * PARAMS
+ *  NewTimerQueue [O] The newly created queue.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ */
+NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
+{
+    NTSTATUS status;
+    struct timer_queue *q = RtlAllocateHeap(GetProcessHeap(), 0, sizeof *q);
+    if (!q)
+        return STATUS_NO_MEMORY;
 
     RtlInitializeCriticalSection(&q->cs);
     list_init(&q->timers);
@@ -791,262 +2044,869 @@ NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
     status = NtCreateEvent(&q->event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
     if (status != STATUS_SUCCESS)
     {
-        RtlFreeHeap(GetProcessHeap(), 0, q);
-        return status;
+        RtlFreeHeap(GetProcessHeap(), 0, q);
+        return status;
+    }
+    status = RtlCreateUserThread(GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                 timer_queue_thread_proc, q, &q->thread, NULL);
+    if (status != STATUS_SUCCESS)
+    {
+        NtClose(q->event);
+        RtlFreeHeap(GetProcessHeap(), 0, q);
+        return status;
+    }
+
+    *NewTimerQueue = q;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *              RtlDeleteTimerQueueEx   (NTDLL.@)
+ *
+ * Deletes a timer queue object.
+ *
+ * PARAMS
+ *  TimerQueue      [I] The timer queue to destroy.
+ *  CompletionEvent [I] If NULL, return immediately.  If INVALID_HANDLE_VALUE,
+ *                      wait until all timers are finished firing before
+ *                      returning.  Otherwise, return immediately and set the
+ *                      event when all timers are done.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS if synchronous, STATUS_PENDING if not.
+ *  Failure: Any NTSTATUS code.
+ */
+NTSTATUS WINAPI RtlDeleteTimerQueueEx(HANDLE TimerQueue, HANDLE CompletionEvent)
+{
+    struct timer_queue *q = TimerQueue;
+    struct queue_timer *t, *temp;
+    HANDLE thread;
+    NTSTATUS status;
+
+    if (!q)
+        return STATUS_INVALID_HANDLE;
+
+    thread = q->thread;
+
+    RtlEnterCriticalSection(&q->cs);
+    q->quit = TRUE;
+    if (list_head(&q->timers))
+        /* When the last timer is removed, it will signal the timer thread to
+           exit...  */
+        LIST_FOR_EACH_ENTRY_SAFE(t, temp, &q->timers, struct queue_timer, entry)
+            queue_destroy_timer(t);
+    else
+        /* However if we have none, we must do it ourselves.  */
+        NtSetEvent(q->event, NULL);
+    RtlLeaveCriticalSection(&q->cs);
+
+    if (CompletionEvent == INVALID_HANDLE_VALUE)
+    {
+        NtWaitForSingleObject(thread, FALSE, NULL);
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        if (CompletionEvent)
+        {
+            FIXME("asynchronous return on completion event unimplemented\n");
+            NtWaitForSingleObject(thread, FALSE, NULL);
+            NtSetEvent(CompletionEvent, NULL);
+        }
+        status = STATUS_PENDING;
+    }
+
+    NtClose(thread);
+    return status;
+}
+
+static struct timer_queue *default_timer_queue;
+
+static struct timer_queue *get_timer_queue(HANDLE TimerQueue)
+{
+    if (TimerQueue)
+        return TimerQueue;
+    else
+    {
+        if (!default_timer_queue)
+        {
+            HANDLE q;
+            NTSTATUS status = RtlCreateTimerQueue(&q);
+            if (status == STATUS_SUCCESS)
+            {
+                PVOID p = interlocked_cmpxchg_ptr(
+                    (void **) &default_timer_queue, q, NULL);
+                if (p)
+                    /* Got beat to the punch.  */
+                    RtlDeleteTimerQueueEx(p, NULL);
+            }
+        }
+        return default_timer_queue;
+    }
+}
+
+/***********************************************************************
+ *              RtlCreateTimer   (NTDLL.@)
+ *
+ * Creates a new timer associated with the given queue.
+ *
+ * PARAMS
+ *  NewTimer   [O] The newly created timer.
+ *  TimerQueue [I] The queue to hold the timer.
+ *  Callback   [I] The callback to fire.
+ *  Parameter  [I] The argument for the callback.
+ *  DueTime    [I] The delay, in milliseconds, before first firing the
+ *                 timer.
+ *  Period     [I] The period, in milliseconds, at which to fire the timer
+ *                 after the first callback.  If zero, the timer will only
+ *                 fire once.  It still needs to be deleted with
+ *                 RtlDeleteTimer.
+ * Flags       [I] Flags controlling the execution of the callback.  In
+ *                 addition to the WT_* thread pool flags (see
+ *                 RtlQueueWorkItem), WT_EXECUTEINTIMERTHREAD and
+ *                 WT_EXECUTEONLYONCE are supported.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ */
+NTSTATUS WINAPI RtlCreateTimer(PHANDLE NewTimer, HANDLE TimerQueue,
+                               RTL_WAITORTIMERCALLBACKFUNC Callback,
+                               PVOID Parameter, DWORD DueTime, DWORD Period,
+                               ULONG Flags)
+{
+    NTSTATUS status;
+    struct queue_timer *t;
+    struct timer_queue *q = get_timer_queue(TimerQueue);
+    if (!q)
+        return STATUS_NO_MEMORY;
+
+    t = RtlAllocateHeap(GetProcessHeap(), 0, sizeof *t);
+    if (!t)
+        return STATUS_NO_MEMORY;
+
+    t->q = q;
+    t->runcount = 0;
+    t->callback = Callback;
+    t->param = Parameter;
+    t->period = Period;
+    t->flags = Flags;
+    t->destroy = FALSE;
+    t->event = NULL;
+
+    status = STATUS_SUCCESS;
+    RtlEnterCriticalSection(&q->cs);
+    if (q->quit)
+        status = STATUS_INVALID_HANDLE;
+    else
+        queue_add_timer(t, queue_current_time() + DueTime, TRUE);
+    RtlLeaveCriticalSection(&q->cs);
+
+    if (status == STATUS_SUCCESS)
+        *NewTimer = t;
+    else
+        RtlFreeHeap(GetProcessHeap(), 0, t);
+
+    return status;
+}
+
+/***********************************************************************
+ *              RtlUpdateTimer   (NTDLL.@)
+ *
+ * Changes the time at which a timer expires.
+ *
+ * PARAMS
+ *  TimerQueue [I] The queue that holds the timer.
+ *  Timer      [I] The timer to update.
+ *  DueTime    [I] The delay, in milliseconds, before next firing the timer.
+ *  Period     [I] The period, in milliseconds, at which to fire the timer
+ *                 after the first callback.  If zero, the timer will not
+ *                 refire once.  It still needs to be deleted with
+ *                 RtlDeleteTimer.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: Any NTSTATUS code.
+ */
+NTSTATUS WINAPI RtlUpdateTimer(HANDLE TimerQueue, HANDLE Timer,
+                               DWORD DueTime, DWORD Period)
+{
+    struct queue_timer *t = Timer;
+    struct timer_queue *q = t->q;
+
+    RtlEnterCriticalSection(&q->cs);
+    /* Can't change a timer if it was once-only or destroyed.  */
+    if (t->expire != EXPIRE_NEVER)
+    {
+        t->period = Period;
+        queue_move_timer(t, queue_current_time() + DueTime, TRUE);
+    }
+    RtlLeaveCriticalSection(&q->cs);
+
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *              RtlDeleteTimer   (NTDLL.@)
+ *
+ * Cancels a timer-queue timer.
+ *
+ * PARAMS
+ *  TimerQueue      [I] The queue that holds the timer.
+ *  Timer           [I] The timer to update.
+ *  CompletionEvent [I] If NULL, return immediately.  If INVALID_HANDLE_VALUE,
+ *                      wait until the timer is finished firing all pending
+ *                      callbacks before returning.  Otherwise, return
+ *                      immediately and set the timer is done.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS if the timer is done, STATUS_PENDING if not,
+             or if the completion event is NULL.
+ *  Failure: Any NTSTATUS code.
+ */
+NTSTATUS WINAPI RtlDeleteTimer(HANDLE TimerQueue, HANDLE Timer,
+                               HANDLE CompletionEvent)
+{
+    struct queue_timer *t = Timer;
+    struct timer_queue *q;
+    NTSTATUS status = STATUS_PENDING;
+    HANDLE event = NULL;
+
+    if (!Timer)
+        return STATUS_INVALID_PARAMETER_1;
+    q = t->q;
+    if (CompletionEvent == INVALID_HANDLE_VALUE)
+    {
+        status = NtCreateEvent(&event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+        if (status == STATUS_SUCCESS)
+            status = STATUS_PENDING;
+    }
+    else if (CompletionEvent)
+        event = CompletionEvent;
+
+    RtlEnterCriticalSection(&q->cs);
+    t->event = event;
+    if (t->runcount == 0 && event)
+        status = STATUS_SUCCESS;
+    queue_destroy_timer(t);
+    RtlLeaveCriticalSection(&q->cs);
+
+    if (CompletionEvent == INVALID_HANDLE_VALUE && event)
+    {
+        if (status == STATUS_PENDING)
+        {
+            NtWaitForSingleObject(event, FALSE, NULL);
+            status = STATUS_SUCCESS;
+        }
+        NtClose(event);
+    }
+
+    return status;
+}
+
+/***********************************************************************
+ *           TpAllocCleanupGroup    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocCleanupGroup( TP_CLEANUP_GROUP **out )
+{
+    struct threadpool_group *group;
+
+    TRACE( "%p\n", out );
+
+    if (!out) return STATUS_ACCESS_VIOLATION;
+
+    if (!(group = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*group) )))
+        return STATUS_NO_MEMORY;
+
+    group->refcount = 1;
+    group->shutdown = FALSE;
+    RtlInitializeCriticalSection( &group->cs );
+    group->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool_group.cs");
+    list_init( &group->members );
+
+    TRACE( "allocated group %p\n", group );
+
+    *out = (TP_CLEANUP_GROUP *)group;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpAllocPool    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocPool( TP_POOL **out, PVOID reserved )
+{
+    TRACE( "%p %p\n", out, reserved );
+
+    if (reserved) FIXME( "reserved argument is nonzero (%p)\n", reserved );
+    if (!out) return STATUS_ACCESS_VIOLATION;
+
+    return tp_threadpool_alloc( (struct threadpool **)out );
+}
+
+/***********************************************************************
+ *           TpAllocTimer    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocTimer( TP_TIMER **out, PTP_TIMER_CALLBACK callback, PVOID userdata,
+                              TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    if (!(object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) )))
+        return STATUS_NO_MEMORY;
+
+    object->type = TP_OBJECT_TYPE_TIMER;
+    object->u.timer.callback = callback;
+
+    if ((status = tp_timerqueue_lock( object )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    if ((status = tp_object_initialize( object, userdata, environment )))
+    {
+        tp_timerqueue_unlock( object );
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    *out = (TP_TIMER *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpAllocWait    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocWait( TP_WAIT **out, PTP_WAIT_CALLBACK callback, PVOID userdata,
+                             TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    if (!(object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) )))
+        return STATUS_NO_MEMORY;
+
+    object->type = TP_OBJECT_TYPE_WAIT;
+    object->u.wait.callback = callback;
+
+    if ((status = tp_waitqueue_lock( object )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    if ((status = tp_object_initialize( object, userdata, environment )))
+    {
+        tp_waitqueue_unlock( object );
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    *out = (TP_WAIT *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpAllocWork    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocWork( TP_WORK **out, PTP_WORK_CALLBACK callback, PVOID userdata,
+                             TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    if (!(object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) )))
+        return STATUS_NO_MEMORY;
+
+    object->type = TP_OBJECT_TYPE_WORK;
+    object->u.work.callback = callback;
+
+    if ((status = tp_object_initialize( object, userdata, environment )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
+
+    *out = (TP_WORK *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpCallbackLeaveCriticalSectionOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackLeaveCriticalSectionOnCompletion( TP_CALLBACK_INSTANCE *instance, RTL_CRITICAL_SECTION *crit )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, crit );
+
+    if (!this->cleanup.critical_section)
+        this->cleanup.critical_section = crit;
+}
+
+/***********************************************************************
+ *           TpCallbackMayRunLong    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpCallbackMayRunLong( TP_CALLBACK_INSTANCE *instance )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p\n", instance );
+
+    if (this->threadid != GetCurrentThreadId())
+    {
+        ERR( "called from wrong thread, ignoring\n" );
+        return STATUS_UNSUCCESSFUL; /* FIXME */
+    }
+
+    if (this->may_run_long)
+        return STATUS_SUCCESS;
+
+    this->may_run_long = TRUE;
+    return tp_object_may_run_long( this->object->pool ) ? STATUS_SUCCESS : STATUS_TOO_MANY_THREADS;
+}
+
+/***********************************************************************
+ *           TpCallbackReleaseMutexOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackReleaseMutexOnCompletion( TP_CALLBACK_INSTANCE *instance, HANDLE mutex )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, mutex );
+
+    if (!this->cleanup.mutex)
+        this->cleanup.mutex = mutex;
+}
+
+/***********************************************************************
+ *           TpCallbackReleaseSemaphoreOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackReleaseSemaphoreOnCompletion( TP_CALLBACK_INSTANCE *instance, HANDLE semaphore, DWORD count )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p %u\n", instance, semaphore, count );
+
+    if (!this->cleanup.semaphore)
+    {
+        this->cleanup.semaphore = semaphore;
+        this->cleanup.semaphore_count = count;
+    }
+}
+
+/***********************************************************************
+ *           TpCallbackSetEventOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackSetEventOnCompletion( TP_CALLBACK_INSTANCE *instance, HANDLE event )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, event );
+
+    if (!this->cleanup.event)
+        this->cleanup.event = event;
+}
+
+/***********************************************************************
+ *           TpCallbackUnloadDllOnCompletion    (NTDLL.@)
+ */
+VOID WINAPI TpCallbackUnloadDllOnCompletion( TP_CALLBACK_INSTANCE *instance, HMODULE module )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p %p\n", instance, module );
+
+    if (!this->cleanup.library)
+        this->cleanup.library = module;
+}
+
+/***********************************************************************
+ *           TpDisassociateCallback    (NTDLL.@)
+ */
+VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
+{
+    struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
+
+    TRACE( "%p\n", instance );
+
+    if (this->threadid != GetCurrentThreadId())
+    {
+        ERR( "called from wrong thread, ignoring\n" );
+        return;
+    }
+
+    if (this->associated)
+    {
+        this->associated = FALSE;
+        tp_object_end_callback( this->object );
+    }
+}
+
+/***********************************************************************
+ *           TpIsTimerSet    (NTDLL.@)
+ */
+BOOL WINAPI TpIsTimerSet( TP_TIMER *timer )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p\n", timer );
+
+    return this->u.timer.timer_set;
+}
+
+/***********************************************************************
+ *           TpPostWork    (NTDLL.@)
+ */
+VOID WINAPI TpPostWork( TP_WORK *work )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+
+    TRACE( "%p\n", work );
+
+    tp_object_submit( this );
+}
+
+/***********************************************************************
+ *           TpReleaseCleanupGroup    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseCleanupGroup( TP_CLEANUP_GROUP *group )
+{
+    struct threadpool_group *this = impl_from_TP_CLEANUP_GROUP( group );
+
+    TRACE( "%p\n", group );
+
+    this->shutdown = TRUE;
+    tp_group_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseCleanupGroupMembers    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseCleanupGroupMembers( TP_CLEANUP_GROUP *group, BOOL cancel_pending, PVOID userdata )
+{
+    struct threadpool_group *this = impl_from_TP_CLEANUP_GROUP( group );
+    struct threadpool_object *object, *next;
+    struct list members;
+
+    TRACE( "%p %u %p\n", group, cancel_pending, userdata );
+
+    /* take over the members, the group references go with them */
+    RtlEnterCriticalSection( &this->cs );
+    LIST_FOR_EACH_ENTRY( object, &this->members, struct threadpool_object, group_entry )
+    {
+        assert( object->group == this );
+        assert( object->is_group_member );
+        object->is_group_member = FALSE;
+    }
+    list_init( &members );
+    list_move_tail( &members, &this->members );
+    RtlLeaveCriticalSection( &this->cs );
+
+    LIST_FOR_EACH_ENTRY( object, &members, struct threadpool_object, group_entry )
+    {
+        if (object->type != TP_OBJECT_TYPE_SIMPLE)
+            tp_object_shutdown( object );
+        if (cancel_pending)
+            tp_object_cancel( object, TRUE, userdata );
+        tp_object_wait( object );
+    }
+
+    LIST_FOR_EACH_ENTRY_SAFE( object, next, &members, struct threadpool_object, group_entry )
+    {
+        list_remove( &object->group_entry );
+        /* the members are implicitly closed, except simple callbacks that have no handle */
+        if (object->type != TP_OBJECT_TYPE_SIMPLE)
+            tp_object_release( object );
+        tp_object_release( object );
+    }
+}
+
+/***********************************************************************
+ *           TpReleasePool    (NTDLL.@)
+ */
+VOID WINAPI TpReleasePool( TP_POOL *pool )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+
+    TRACE( "%p\n", pool );
+
+    tp_threadpool_shutdown( this );
+    tp_threadpool_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseTimer     (NTDLL.@)
+ */
+VOID WINAPI TpReleaseTimer( TP_TIMER *timer )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p\n", timer );
+
+    tp_object_leave_group( this );
+    tp_object_shutdown( this );
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseWait    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseWait( TP_WAIT *wait )
+{
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+
+    TRACE( "%p\n", wait );
+
+    tp_object_leave_group( this );
+    tp_object_shutdown( this );
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpReleaseWork    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseWork( TP_WORK *work )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+
+    TRACE( "%p\n", work );
+
+    tp_object_leave_group( this );
+    tp_object_shutdown( this );
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpSetPoolMaxThreads    (NTDLL.@)
+ */
+VOID WINAPI TpSetPoolMaxThreads( TP_POOL *pool, DWORD maximum )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+
+    TRACE( "%p %u\n", pool, maximum );
+
+    RtlEnterCriticalSection( &this->cs );
+    this->max_workers = max( maximum, 1 );
+    this->min_workers = min( this->min_workers, this->max_workers );
+    RtlLeaveCriticalSection( &this->cs );
+}
+
+/***********************************************************************
+ *           TpSetPoolMinThreads    (NTDLL.@)
+ */
+BOOL WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+    NTSTATUS status = STATUS_SUCCESS;
+
+    TRACE( "%p %u\n", pool, minimum );
+
+    RtlEnterCriticalSection( &this->cs );
+
+    while (this->num_workers < minimum)
+    {
+        if ((status = tp_new_worker_thread( this )))
+            break;
     }
-    status = RtlCreateUserThread(GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                 timer_queue_thread_proc, q, &q->thread, NULL);
-    if (status != STATUS_SUCCESS)
+
+    if (status == STATUS_SUCCESS)
     {
-        NtClose(q->event);
-        RtlFreeHeap(GetProcessHeap(), 0, q);
-        return status;
+        this->min_workers = minimum;
+        this->max_workers = max( this->min_workers, this->max_workers );
     }
 
-    *NewTimerQueue = q;
-    return STATUS_SUCCESS;
+    RtlLeaveCriticalSection( &this->cs );
+    return !status;
 }
 
 /***********************************************************************
- *              RtlDeleteTimerQueueEx   (NTDLL.@)
- *
- * Deletes a timer queue object.
- *
- * PARAMS
- *  TimerQueue      [I] The timer queue to destroy.
- *  CompletionEvent [I] If NULL, return immediately.  If INVALID_HANDLE_VALUE,
- *                      wait until all timers are finished firing before
- *                      returning.  Otherwise, return immediately and set the
- *                      event when all timers are done.
- *
- * RETURNS
- *  Success: STATUS_SUCCESS if synchronous, STATUS_PENDING if not.
- *  Failure: Any NTSTATUS code.
+ *           TpSetTimer    (NTDLL.@)
  */
-NTSTATUS WINAPI RtlDeleteTimerQueueEx(HANDLE TimerQueue, HANDLE CompletionEvent)
+VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LONG window_length )
 {
-    struct timer_queue *q = TimerQueue;
-    struct queue_timer *t, *temp;
-    HANDLE thread;
-    NTSTATUS status;
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+    struct threadpool_object *other_timer;
+    LARGE_INTEGER now;
 
-    if (!q)
-        return STATUS_INVALID_HANDLE;
+    TRACE( "%p %p %u %u\n", timer, timeout, period, window_length );
 
-    thread = q->thread;
+    RtlEnterCriticalSection( &timerqueue.cs );
 
-    RtlEnterCriticalSection(&q->cs);
-    q->quit = TRUE;
-    if (list_head(&q->timers))
-        /* When the last timer is removed, it will signal the timer thread to
-           exit...  */
-        LIST_FOR_EACH_ENTRY_SAFE(t, temp, &q->timers, struct queue_timer, entry)
-            queue_destroy_timer(t);
-    else
-        /* However if we have none, we must do it ourselves.  */
-        NtSetEvent(q->event, NULL);
-    RtlLeaveCriticalSection(&q->cs);
+    assert( this->u.timer.timer_initialized );
+    this->u.timer.timer_set = timeout != NULL;
 
-    if (CompletionEvent == INVALID_HANDLE_VALUE)
+    if (this->u.timer.timer_pending)
     {
-        NtWaitForSingleObject(thread, FALSE, NULL);
-        status = STATUS_SUCCESS;
+        list_remove( &this->u.timer.timer_entry );
+        this->u.timer.timer_pending = FALSE;
     }
-    else
+
+    if (timeout)
     {
-        if (CompletionEvent)
+        ULONGLONG when = timeout->QuadPart;
+
+        /* negative timeouts are relative, an absolute time in the past fires immediately */
+        if ((LONGLONG)when < 0)
         {
-            FIXME("asynchronous return on completion event unimplemented\n");
-            NtWaitForSingleObject(thread, FALSE, NULL);
-            NtSetEvent(CompletionEvent, NULL);
+            NtQuerySystemTime( &now );
+            when = now.QuadPart - (LONGLONG)when;
         }
-        status = STATUS_PENDING;
+
+        this->u.timer.timeout       = when;
+        this->u.timer.period        = period;
+        this->u.timer.window_length = window_length;
+
+        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
+                             struct threadpool_object, u.timer.timer_entry )
+        {
+            if (this->u.timer.timeout < other_timer->u.timer.timeout)
+                break;
+        }
+        list_add_before( &other_timer->u.timer.timer_entry, &this->u.timer.timer_entry );
+        this->u.timer.timer_pending = TRUE;
+
+        /* the timer thread only needs to wake up if the next timeout changed */
+        if (list_head( &timerqueue.pending_timers ) == &this->u.timer.timer_entry)
+            RtlWakeAllConditionVariable( &timerqueue.update_event );
     }
 
-    NtClose(thread);
-    return status;
+    RtlLeaveCriticalSection( &timerqueue.cs );
 }
 
-static struct timer_queue *default_timer_queue;
-
-static struct timer_queue *get_timer_queue(HANDLE TimerQueue)
+/***********************************************************************
+ *           TpSetWait    (NTDLL.@)
+ */
+VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
 {
-    if (TimerQueue)
-        return TimerQueue;
-    else
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+    struct waitqueue_bucket *bucket;
+    LARGE_INTEGER now;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p\n", wait, handle, timeout );
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    assert( this->u.wait.bucket );
+    bucket = this->u.wait.bucket;
+
+    if (this->u.wait.wait_pending)
     {
-        if (!default_timer_queue)
+        list_remove( &this->u.wait.wait_entry );
+        this->u.wait.wait_pending = FALSE;
+        NtSetEvent( bucket->update_event, NULL );
+    }
+
+    if (handle)
+    {
+        this->u.wait.handle = handle;
+
+        if (!timeout)
+            this->u.wait.timeout = TIMEOUT_INFINITE;
+        else if (timeout->QuadPart < 0)
         {
-            HANDLE q;
-            NTSTATUS status = RtlCreateTimerQueue(&q);
-            if (status == STATUS_SUCCESS)
-            {
-                PVOID p = interlocked_cmpxchg_ptr(
-                    (void **) &default_timer_queue, q, NULL);
-                if (p)
-                    /* Got beat to the punch.  */
-                    RtlDeleteTimerQueueEx(p, NULL);
-            }
+            NtQuerySystemTime( &now );
+            this->u.wait.timeout = now.QuadPart - timeout->QuadPart;
+        }
+        else
+            this->u.wait.timeout = timeout->QuadPart;
+
+        /* a zero timeout only polls the object, there is no need to involve the wait thread */
+        if (timeout && !timeout->QuadPart)
+        {
+            status = NtWaitForSingleObject( handle, FALSE, timeout );
+            this->u.wait.result = (status == STATUS_WAIT_0) ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+            tp_object_submit( this );
+        }
+        else
+        {
+            list_add_tail( &bucket->waiting, &this->u.wait.wait_entry );
+            this->u.wait.wait_pending = TRUE;
+            NtSetEvent( bucket->update_event, NULL );
         }
-        return default_timer_queue;
     }
+
+    RtlLeaveCriticalSection( &waitqueue.cs );
 }
 
 /***********************************************************************
- *              RtlCreateTimer   (NTDLL.@)
- *
- * Creates a new timer associated with the given queue.
- *
- * PARAMS
- *  NewTimer   [O] The newly created timer.
- *  TimerQueue [I] The queue to hold the timer.
- *  Callback   [I] The callback to fire.
- *  Parameter  [I] The argument for the callback.
- *  DueTime    [I] The delay, in milliseconds, before first firing the
- *                 timer.
- *  Period     [I] The period, in milliseconds, at which to fire the timer
- *                 after the first callback.  If zero, the timer will only
- *                 fire once.  It still needs to be deleted with
- *                 RtlDeleteTimer.
- * Flags       [I] Flags controlling the execution of the callback.  In
- *                 addition to the WT_* thread pool flags (see
- *                 RtlQueueWorkItem), WT_EXECUTEINTIMERTHREAD and
- *                 WT_EXECUTEONLYONCE are supported.
- *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ *           TpSimpleTryPost    (NTDLL.@)
  */
-NTSTATUS WINAPI RtlCreateTimer(PHANDLE NewTimer, HANDLE TimerQueue,
-                               RTL_WAITORTIMERCALLBACKFUNC Callback,
-                               PVOID Parameter, DWORD DueTime, DWORD Period,
-                               ULONG Flags)
+NTSTATUS WINAPI TpSimpleTryPost( PTP_SIMPLE_CALLBACK callback, PVOID userdata,
+                                 TP_CALLBACK_ENVIRON *environment )
 {
+    struct threadpool_object *object;
     NTSTATUS status;
-    struct queue_timer *t;
-    struct timer_queue *q = get_timer_queue(TimerQueue);
-    if (!q)
-        return STATUS_NO_MEMORY;
 
-    t = RtlAllocateHeap(GetProcessHeap(), 0, sizeof *t);
-    if (!t)
-        return STATUS_NO_MEMORY;
+    TRACE( "%p %p %p\n", callback, userdata, environment );
 
-    t->q = q;
-    t->runcount = 0;
-    t->callback = Callback;
-    t->param = Parameter;
-    t->period = Period;
-    t->flags = Flags;
-    t->destroy = FALSE;
-    t->event = NULL;
+    if (!(object = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*object) )))
+        return STATUS_NO_MEMORY;
 
-    status = STATUS_SUCCESS;
-    RtlEnterCriticalSection(&q->cs);
-    if (q->quit)
-        status = STATUS_INVALID_HANDLE;
-    else
-        queue_add_timer(t, queue_current_time() + DueTime, TRUE);
-    RtlLeaveCriticalSection(&q->cs);
+    object->type = TP_OBJECT_TYPE_SIMPLE;
+    object->u.simple.callback = callback;
 
-    if (status == STATUS_SUCCESS)
-        *NewTimer = t;
-    else
-        RtlFreeHeap(GetProcessHeap(), 0, t);
+    if ((status = tp_object_initialize( object, userdata, environment )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, object );
+        return status;
+    }
 
+    /* the callback owns the creation reference */
+    if ((status = tp_object_submit( object )))
+    {
+        tp_object_leave_group( object );
+        tp_object_release( object );
+    }
     return status;
 }
 
 /***********************************************************************
- *              RtlUpdateTimer   (NTDLL.@)
- *
- * Changes the time at which a timer expires.
- *
- * PARAMS
- *  TimerQueue [I] The queue that holds the timer.
- *  Timer      [I] The timer to update.
- *  DueTime    [I] The delay, in milliseconds, before next firing the timer.
- *  Period     [I] The period, in milliseconds, at which to fire the timer
- *                 after the first callback.  If zero, the timer will not
- *                 refire once.  It still needs to be deleted with
- *                 RtlDeleteTimer.
- *
- * RETURNS
- *  Success: STATUS_SUCCESS.
- *  Failure: Any NTSTATUS code.
+ *           TpWaitForTimer    (NTDLL.@)
  */
-NTSTATUS WINAPI RtlUpdateTimer(HANDLE TimerQueue, HANDLE Timer,
-                               DWORD DueTime, DWORD Period)
+VOID WINAPI TpWaitForTimer( TP_TIMER *timer, BOOL cancel_pending )
 {
-    struct queue_timer *t = Timer;
-    struct timer_queue *q = t->q;
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
 
-    RtlEnterCriticalSection(&q->cs);
-    /* Can't change a timer if it was once-only or destroyed.  */
-    if (t->expire != EXPIRE_NEVER)
-    {
-        t->period = Period;
-        queue_move_timer(t, queue_current_time() + DueTime, TRUE);
-    }
-    RtlLeaveCriticalSection(&q->cs);
+    TRACE( "%p %d\n", timer, cancel_pending );
 
-    return STATUS_SUCCESS;
+    if (cancel_pending)
+        tp_object_cancel( this, FALSE, NULL );
+    tp_object_wait( this );
 }
 
 /***********************************************************************
- *              RtlDeleteTimer   (NTDLL.@)
- *
- * Cancels a timer-queue timer.
- *
- * PARAMS
- *  TimerQueue      [I] The queue that holds the timer.
- *  Timer           [I] The timer to update.
- *  CompletionEvent [I] If NULL, return immediately.  If INVALID_HANDLE_VALUE,
- *                      wait until the timer is finished firing all pending
- *                      callbacks before returning.  Otherwise, return
- *                      immediately and set the timer is done.
- *
- * RETURNS
- *  Success: STATUS_SUCCESS if the timer is done, STATUS_PENDING if not,
-             or if the completion event is NULL.
- *  Failure: Any NTSTATUS code.
+ *           TpWaitForWait    (NTDLL.@)
  */
-NTSTATUS WINAPI RtlDeleteTimer(HANDLE TimerQueue, HANDLE Timer,
-                               HANDLE CompletionEvent)
+VOID WINAPI TpWaitForWait( TP_WAIT *wait, BOOL cancel_pending )
 {
-    struct queue_timer *t = Timer;
-    struct timer_queue *q;
-    NTSTATUS status = STATUS_PENDING;
-    HANDLE event = NULL;
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
 
-    if (!Timer)
-        return STATUS_INVALID_PARAMETER_1;
-    q = t->q;
-    if (CompletionEvent == INVALID_HANDLE_VALUE)
-    {
-        status = NtCreateEvent(&event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
-        if (status == STATUS_SUCCESS)
-            status = STATUS_PENDING;
-    }
-    else if (CompletionEvent)
-        event = CompletionEvent;
+    TRACE( "%p %d\n", wait, cancel_pending );
 
-    RtlEnterCriticalSection(&q->cs);
-    t->event = event;
-    if (t->runcount == 0 && event)
-        status = STATUS_SUCCESS;
-    queue_destroy_timer(t);
-    RtlLeaveCriticalSection(&q->cs);
+    if (cancel_pending)
+        tp_object_cancel( this, FALSE, NULL );
+    tp_object_wait( this );
+}
 
-    if (CompletionEvent == INVALID_HANDLE_VALUE && event)
-    {
-        if (status == STATUS_PENDING)
-        {
-            NtWaitForSingleObject(event, FALSE, NULL);
-            status = STATUS_SUCCESS;
-        }
-        NtClose(event);
-    }
+/***********************************************************************
+ *           TpWaitForWork    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForWork( TP_WORK *work, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
 
-    return status;
+    TRACE( "%p %u\n", work, cancel_pending );
+
+    if (cancel_pending)
+        tp_object_cancel( this, FALSE, NULL );
+    tp_object_wait( this );
 }
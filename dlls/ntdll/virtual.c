@@ -52,6 +52,7 @@
 #include "wine/server.h"
 #include "wine/exception.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 
@@ -70,6 +71,9 @@ WINE_DECLARE_DEBUG_CHANNEL(module);
 struct file_view
 {
     struct list   entry;       /* Entry in global view list */
+    struct wine_rb_entry tree_entry; /* Entry in views tree */
+    struct wine_rb_entry free_entry; /* Entry in free ranges tree */
+    int           free_range;  /* Whether the view is followed by a free range */
     void         *base;        /* Base address */
     size_t        size;        /* Size in bytes */
     HANDLE        mapping;     /* Handle to the file mapping */
@@ -101,6 +105,8 @@ static const BYTE VIRTUAL_Win32Flags[16] =
 };
 
 static struct list views_list = LIST_INIT(views_list);
+static struct wine_rb_tree views_tree;        /* views sorted by base address */
+static struct wine_rb_tree free_ranges_tree;  /* views followed by at least one free allocation unit */
 
 static RTL_CRITICAL_SECTION csVirtual;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -154,6 +160,56 @@ static void *preload_reserve_end;
 static int use_locks;
 static int force_exec_prot;  /* whether to force PROT_EXEC on all PROT_READ mmaps */
 
+static const UINT_PTR granularity_mask = 0xffff;  /* allocation granularity */
+
+static void *view_rb_alloc( size_t size )
+{
+    return RtlAllocateHeap( virtual_heap, 0, size );
+}
+
+static void *view_rb_realloc( void *ptr, size_t size )
+{
+    return RtlReAllocateHeap( virtual_heap, 0, ptr, size );
+}
+
+static void view_rb_free( void *ptr )
+{
+    RtlFreeHeap( virtual_heap, 0, ptr );
+}
+
+static inline int compare_addr( const void *addr, const void *base )
+{
+    if (addr < base) return -1;
+    if (addr > base) return 1;
+    return 0;
+}
+
+static int view_rb_compare( const void *key, const struct wine_rb_entry *entry )
+{
+    return compare_addr( key, WINE_RB_ENTRY_VALUE( entry, const struct file_view, tree_entry )->base );
+}
+
+static int free_range_rb_compare( const void *key, const struct wine_rb_entry *entry )
+{
+    return compare_addr( key, WINE_RB_ENTRY_VALUE( entry, const struct file_view, free_entry )->base );
+}
+
+static const struct wine_rb_functions views_tree_functions =
+{
+    view_rb_alloc,
+    view_rb_realloc,
+    view_rb_free,
+    view_rb_compare,
+};
+
+static const struct wine_rb_functions free_ranges_tree_functions =
+{
+    view_rb_alloc,
+    view_rb_realloc,
+    view_rb_free,
+    free_range_rb_compare,
+};
+
 
 /***********************************************************************
  *           VIRTUAL_GetProtStr
@@ -246,6 +302,46 @@ static void VIRTUAL_Dump(void)
 #endif
 
 
+/***********************************************************************
+ *           find_view_below
+ *
+ * Find the view with the highest base address not above a given address.
+ * The csVirtual section must be held by caller.
+ */
+static struct file_view *find_view_below( const void *addr )
+{
+    struct wine_rb_entry *ptr = views_tree.root;
+    struct file_view *ret = NULL;
+
+    while (ptr)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, tree_entry );
+
+        if (view->base > addr) ptr = ptr->left;
+        else
+        {
+            ret = view;
+            ptr = ptr->right;
+        }
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           next_view
+ *
+ * Get the view following a given one, or the first view if NULL.
+ * The csVirtual section must be held by caller.
+ */
+static inline struct file_view *next_view( struct file_view *view )
+{
+    struct list *ptr = view ? list_next( &views_list, &view->entry ) : list_head( &views_list );
+
+    return ptr ? LIST_ENTRY( ptr, struct file_view, entry ) : NULL;
+}
+
+
 /***********************************************************************
  *           VIRTUAL_FindView
  *
@@ -260,17 +356,13 @@ static void VIRTUAL_Dump(void)
  */
 static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 {
-    struct file_view *view;
+    struct file_view *view = find_view_below( addr );
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
-    {
-        if (view->base > addr) break;  /* no matching view */
-        if ((const char *)view->base + view->size <= (const char *)addr) continue;
-        if ((const char *)view->base + view->size < (const char *)addr + size) break;  /* size too large */
-        if ((const char *)addr + size < (const char *)addr) break; /* overflow */
-        return view;
-    }
-    return NULL;
+    if (!view) return NULL;  /* no matching view */
+    if ((const char *)view->base + view->size <= (const char *)addr) return NULL;
+    if ((const char *)view->base + view->size < (const char *)addr + size) return NULL;  /* size too large */
+    if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
+    return view;
 }
 
 
@@ -292,15 +384,154 @@ static inline UINT_PTR get_mask( ULONG zero_bits )
  * The csVirtual section must be held by caller.
  */
 static struct file_view *find_view_range( const void *addr, size_t size )
+{
+    struct file_view *view = find_view_below( addr );
+
+    if (view && (const char *)view->base + view->size > (const char *)addr) return view;
+    if (!(view = next_view( view ))) return NULL;
+    if ((const char *)view->base >= (const char *)addr + size) return NULL;
+    return view;
+}
+
+
+/***********************************************************************
+ *           find_free_range_below
+ *
+ * Find the highest view followed by a free range whose base is not above a given address.
+ * The csVirtual section must be held by caller.
+ */
+static struct file_view *find_free_range_below( const void *addr )
+{
+    struct wine_rb_entry *ptr = free_ranges_tree.root;
+    struct file_view *ret = NULL;
+
+    while (ptr)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, free_entry );
+
+        if (view->base > addr) ptr = ptr->left;
+        else
+        {
+            ret = view;
+            ptr = ptr->right;
+        }
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           find_free_range_above
+ *
+ * Find the lowest view followed by a free range whose base is not below a given address.
+ * The csVirtual section must be held by caller.
+ */
+static struct file_view *find_free_range_above( const void *addr )
+{
+    struct wine_rb_entry *ptr = free_ranges_tree.root;
+    struct file_view *ret = NULL;
+
+    while (ptr)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, free_entry );
+
+        if (view->base < addr) ptr = ptr->right;
+        else
+        {
+            ret = view;
+            ptr = ptr->left;
+        }
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           update_free_range
+ *
+ * Add or remove a view from the free ranges tree, depending on whether
+ * at least one full allocation unit is free between it and the next view.
+ * The csVirtual section must be held by caller.
+ */
+static void update_free_range( struct file_view *view )
+{
+    struct file_view *next = next_view( view );
+    char *end = (char *)view->base + view->size;
+    char *start = ROUND_ADDR( end + granularity_mask, granularity_mask );
+    int free_range = (start >= end && (!next || start < (char *)next->base));
+
+    if (free_range == view->free_range) return;
+    if (!free_range) wine_rb_remove( &free_ranges_tree, view->base );
+    else if (wine_rb_put( &free_ranges_tree, view->base, &view->free_entry ) == -1)
+    {
+        /* the area is simply not reused until the next update */
+        FIXME( "out of memory in virtual heap for free range after %p-%p\n", view->base, end );
+        return;
+    }
+    view->free_range = free_range;
+}
+
+
+/***********************************************************************
+ *           get_free_range
+ *
+ * Clip a range to the free space following a view, or preceding the first view if NULL.
+ * The csVirtual section must be held by caller.
+ */
+static void get_free_range( struct file_view *view, char **start, char **end )
+{
+    struct file_view *next = next_view( view );
+
+    if (view && (char *)view->base + view->size > *start) *start = (char *)view->base + view->size;
+    if (next && (char *)next->base < *end) *end = next->base;
+}
+
+
+/***********************************************************************
+ *           find_free_range_area
+ *
+ * Find a free area between views inside the specified range, using the free ranges
+ * tree. Only valid for a mask at least as large as the allocation granularity.
+ * The csVirtual section must be held by caller.
+ */
+static void *find_free_range_area( void *base, void *end, size_t size, size_t mask, int top_down )
 {
     struct file_view *view;
+    char *start, *range_start, *range_end;
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    if (top_down)
     {
-        if ((const char *)view->base >= (const char *)addr + size) break;
-        if ((const char *)view->base + view->size > (const char *)addr) return view;
+        view = find_view_below( (char *)end - 1 );
+        for (;;)
+        {
+            range_start = base;
+            range_end = end;
+            get_free_range( view, &range_start, &range_end );
+            if (range_end > range_start && range_end - range_start >= size)
+            {
+                start = ROUND_ADDR( range_end - size, mask );
+                if (start >= range_start) return start;
+            }
+            /* stop if remaining space is not large enough */
+            if (!view || (char *)view->base < (char *)base + size) return NULL;
+            view = find_free_range_below( (char *)view->base - 1 );
+        }
+    }
+    else
+    {
+        view = find_view_below( base );
+        for (;;)
+        {
+            range_start = base;
+            range_end = end;
+            get_free_range( view, &range_start, &range_end );
+            start = ROUND_ADDR( range_start + mask, mask );
+            if (start >= range_start && start < range_end && range_end - start >= size) return start;
+            view = find_free_range_above( view ? (char *)view->base + view->size : (char *)base );
+            /* stop if remaining space is not large enough */
+            if (!view || (char *)view->base >= (char *)end) return NULL;
+        }
     }
-    return NULL;
 }
 
 
@@ -312,15 +543,21 @@ static struct file_view *find_view_range( const void *addr, size_t size )
  */
 static void *find_free_area( void *base, void *end, size_t size, size_t mask, int top_down )
 {
+    struct file_view *first;
     struct list *ptr;
     void *start;
 
+    if (mask >= granularity_mask) return find_free_range_area( base, end, size, mask, top_down );
+
     if (top_down)
     {
         start = ROUND_ADDR( (char *)end - size, mask );
         if (start >= end || start < base) return NULL;
 
-        for (ptr = views_list.prev; ptr != &views_list; ptr = ptr->prev)
+        if ((first = find_view_below( (char *)start + size - 1 ))) ptr = &first->entry;
+        else ptr = &views_list;
+
+        for ( ; ptr != &views_list; ptr = ptr->prev)
         {
             struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
@@ -336,7 +573,10 @@ static void *find_free_area( void *base, void *end, size_t size, size_t mask, in
         start = ROUND_ADDR( (char *)base + mask, mask );
         if (start >= end || (char *)end - (char *)start < size) return NULL;
 
-        for (ptr = views_list.next; ptr != &views_list; ptr = ptr->next)
+        if ((first = find_view_below( start ))) ptr = &first->entry;
+        else ptr = views_list.next;
+
+        for ( ; ptr != &views_list; ptr = ptr->next)
         {
             struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
@@ -389,7 +629,8 @@ static void remove_reserved_area( void *addr, size_t size )
     wine_mmap_remove_reserved_area( addr, size, 0 );
 
     /* unmap areas not covered by an existing view */
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    if (!(view = find_view_below( addr ))) view = next_view( NULL );
+    for ( ; view; view = next_view( view ))
     {
         if ((char *)view->base >= (char *)addr + size)
         {
@@ -440,8 +681,13 @@ static inline void unmap_area( void *addr, size_t size )
  */
 static void delete_view( struct file_view *view ) /* [in] View */
 {
+    struct list *prev = list_prev( &views_list, &view->entry );
+
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
+    if (view->free_range) wine_rb_remove( &free_ranges_tree, view->base );
+    wine_rb_remove( &views_tree, view->base );
     list_remove( &view->entry );
+    if (prev) update_free_range( LIST_ENTRY( prev, struct file_view, entry ));
     if (view->mapping) close_handle( view->mapping );
     RtlFreeHeap( virtual_heap, 0, view );
 }
@@ -454,8 +700,7 @@ static void delete_view( struct file_view *view ) /* [in] View */
  */
 static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t size, unsigned int vprot )
 {
-    struct file_view *view;
-    struct list *ptr;
+    struct file_view *view, *prev, *next;
     int unix_prot = VIRTUAL_GetUnixProt( vprot );
 
     assert( !((UINT_PTR)base & page_mask) );
@@ -474,45 +719,46 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->mapping = 0;
     view->map_protect = 0;
     view->protect = vprot;
+    view->free_range = 0;
     memset( view->prot, vprot, size >> page_shift );
 
-    /* Insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &views_list )
-    {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if (next->base > base) break;
-    }
-    list_add_before( ptr, &view->entry );
-
     /* Check for overlapping views. This can happen if the previous view
      * was a system view that got unmapped behind our back. In that case
      * we recover by simply deleting it. */
 
-    if ((ptr = list_prev( &views_list, &view->entry )) != NULL)
+    if ((prev = find_view_below( base )) && (char *)prev->base + prev->size > (char *)base)
     {
-        struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)prev->base + prev->size > (char *)base)
-        {
-            TRACE( "overlapping prev view %p-%p for %p-%p\n",
-                   prev->base, (char *)prev->base + prev->size,
-                   base, (char *)base + view->size );
-            assert( prev->protect & VPROT_SYSTEM );
-            delete_view( prev );
-        }
+        struct list *ptr = list_prev( &views_list, &prev->entry );
+
+        TRACE( "overlapping prev view %p-%p for %p-%p\n",
+               prev->base, (char *)prev->base + prev->size,
+               base, (char *)base + view->size );
+        assert( prev->protect & VPROT_SYSTEM );
+        delete_view( prev );
+        prev = ptr ? LIST_ENTRY( ptr, struct file_view, entry ) : NULL;
     }
-    if ((ptr = list_next( &views_list, &view->entry )) != NULL)
+    if ((next = next_view( prev )) && (char *)base + view->size > (char *)next->base)
     {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)base + view->size > (char *)next->base)
-        {
-            TRACE( "overlapping next view %p-%p for %p-%p\n",
-                   next->base, (char *)next->base + next->size,
-                   base, (char *)base + view->size );
-            assert( next->protect & VPROT_SYSTEM );
-            delete_view( next );
-        }
+        TRACE( "overlapping next view %p-%p for %p-%p\n",
+               next->base, (char *)next->base + next->size,
+               base, (char *)base + view->size );
+        assert( next->protect & VPROT_SYSTEM );
+        delete_view( next );
+    }
+
+    /* Insert it in the tree and the linked list */
+
+    if (wine_rb_put( &views_tree, base, &view->tree_entry ) == -1)
+    {
+        FIXME( "out of memory in virtual heap for %p-%p\n", base, (char *)base + size );
+        RtlFreeHeap( virtual_heap, 0, view );
+        return STATUS_NO_MEMORY;
     }
+    if (prev) list_add_after( &prev->entry, &view->entry );
+    else list_add_head( &views_list, &view->entry );
+
+    update_free_range( view );
+    if (prev) update_free_range( prev );
 
     *view_ret = view;
     VIRTUAL_DEBUG_DUMP_VIEW( view );
@@ -1438,6 +1684,12 @@ void virtual_init(void)
     assert( heap_base != (void *)-1 );
     virtual_heap = RtlCreateHeap( HEAP_NO_SERIALIZE, heap_base, VIRTUAL_HEAP_SIZE,
                                   VIRTUAL_HEAP_SIZE, NULL, NULL );
+    if (wine_rb_init( &views_tree, &views_tree_functions ) == -1 ||
+        wine_rb_init( &free_ranges_tree, &free_ranges_tree_functions ) == -1)
+    {
+        ERR( "failed to initialize the views tree\n" );
+        exit(1);
+    }
     create_view( &heap_view, heap_base, VIRTUAL_HEAP_SIZE, VPROT_COMMITTED | VPROT_READ | VPROT_WRITE );
 
     /* make the DOS area accessible (except the low 64K) to hide bugs in broken apps like Excel 2003 */
@@ -2245,7 +2497,6 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
 {
     struct file_view *view;
     char *base, *alloc_base = 0;
-    struct list *ptr;
     SIZE_T size = 0;
     MEMORY_BASIC_INFORMATION *info = buffer;
     sigset_t sigset;
@@ -2301,30 +2552,19 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
     /* Find the view containing the address */
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    ptr = list_head( &views_list );
-    for (;;)
+    if ((view = find_view_below( base )) && (char *)view->base + view->size > base)
     {
-        if (!ptr)
-        {
-            size = (char *)working_set_limit - alloc_base;
-            view = NULL;
-            break;
-        }
-        view = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)view->base > base)
-        {
-            size = (char *)view->base - alloc_base;
-            view = NULL;
-            break;
-        }
-        if ((char *)view->base + view->size > base)
-        {
-            alloc_base = view->base;
-            size = view->size;
-            break;
-        }
-        alloc_base = (char *)view->base + view->size;
-        ptr = list_next( &views_list, ptr );
+        alloc_base = view->base;
+        size = view->size;
+    }
+    else
+    {
+        struct file_view *next = next_view( view );
+
+        if (view) alloc_base = (char *)view->base + view->size;
+        if (next) size = (char *)next->base - alloc_base;
+        else size = (char *)working_set_limit - alloc_base;
+        view = NULL;
     }
 
     /* Fill the info structure */
@@ -53,6 +53,37 @@ WINE_DEFAULT_DEBUG_CHANNEL(win);
 WINE_DECLARE_DEBUG_CHANNEL(keyboard);
 
 
+/***********************************************************************
+ *           read_input_shm
+ *
+ * Read the state of the desktop or of the thread input of the current thread
+ * from the shared memory, if available. The server increments the seq count
+ * before and after each update, so we retry until we get a consistent copy.
+ */
+static BOOL read_input_shm( BOOL desktop, struct input_shm *state )
+{
+    const volatile struct queue_shm *queue;
+    const volatile struct input_shm *shm;
+    int i, index, seq;
+    LONG barrier;
+
+    if (!get_user_thread_info()->queue_shm || !(queue = get_queue_shm())) return FALSE;
+
+    for (i = 0; i < 100; i++)
+    {
+        if ((index = desktop ? queue->desktop_index : queue->input_index) == -1) return FALSE;
+        shm = get_input_shm( index );
+        if ((seq = shm->seq) & 1) continue;  /* being updated */
+        InterlockedExchange( &barrier, 0 );
+        memcpy( state, (const struct input_shm *)shm, sizeof(*state) );
+        InterlockedExchange( &barrier, 0 );
+        if (shm->seq == seq && (desktop ? queue->desktop_index : queue->input_index) == index)
+            return TRUE;
+    }
+    return FALSE;  /* let the server handle it */
+}
+
+
 /***********************************************************************
  *           get_key_state
  */
@@ -237,21 +268,32 @@ void WINAPI mouse_event( DWORD dwFlags, DWORD dx, DWORD dy,
  */
 BOOL WINAPI DECLSPEC_HOTPATCH GetCursorPos( POINT *pt )
 {
+    struct input_shm state;
     BOOL ret;
     DWORD last_change;
 
     if (!pt) return FALSE;
 
-    SERVER_START_REQ( set_cursor )
+    if (read_input_shm( TRUE, &state ))
     {
-        if ((ret = !wine_server_call( req )))
+        pt->x = state.cursor_x;
+        pt->y = state.cursor_y;
+        last_change = state.cursor_last_change;
+        ret = TRUE;
+    }
+    else
+    {
+        SERVER_START_REQ( set_cursor )
         {
-            pt->x = reply->new_x;
-            pt->y = reply->new_y;
-            last_change = reply->last_change;
+            if ((ret = !wine_server_call( req )))
+            {
+                pt->x = reply->new_x;
+                pt->y = reply->new_y;
+                last_change = reply->last_change;
+            }
         }
+        SERVER_END_REQ;
     }
-    SERVER_END_REQ;
 
     /* query new position from graphics driver if we haven't updated recently */
     if (ret && GetTickCount() - last_change > 100) ret = USER_Driver->pGetCursorPos( pt );
@@ -369,6 +411,7 @@ static void check_for_events( UINT flags )
 SHORT WINAPI DECLSPEC_HOTPATCH GetAsyncKeyState( INT key )
 {
     struct user_thread_info *thread_info = get_user_thread_info();
+    struct input_shm state;
     SHORT ret;
 
     if (key < 0 || key >= 256) return 0;
@@ -377,6 +420,10 @@ SHORT WINAPI DECLSPEC_HOTPATCH GetAsyncKeyState( INT key )
 
     if ((ret = USER_Driver->pGetAsyncKeyState( key )) == -1)
     {
+        /* the pressed since last call bit has to be cleared by the server */
+        if (read_input_shm( TRUE, &state ) && !(state.keystate[key] & 0x40))
+            return (state.keystate[key] & 0x80) ? 0x8000 : 0;
+
         if (thread_info->key_state &&
             !(thread_info->key_state[key] & 0xc0) &&
             GetTickCount() - thread_info->key_state_time < 50)
@@ -408,6 +455,7 @@ SHORT WINAPI DECLSPEC_HOTPATCH GetAsyncKeyState( INT key )
  */
 DWORD WINAPI GetQueueStatus( UINT flags )
 {
+    const struct queue_shm *shm;
     DWORD ret;
 
     if (flags & ~(QS_ALLINPUT | QS_ALLPOSTMESSAGE | QS_SMRESULT))
@@ -418,6 +466,10 @@ DWORD WINAPI GetQueueStatus( UINT flags )
 
     check_for_events( flags );
 
+    /* the changed bits only need to be cleared in the server if some are set */
+    if (get_user_thread_info()->queue_shm && (shm = get_queue_shm()) && !shm->changed_bits)
+        return MAKELONG( 0, shm->wake_bits & flags );
+
     SERVER_START_REQ( get_queue_status )
     {
         req->clear = 1;
@@ -434,10 +486,14 @@ DWORD WINAPI GetQueueStatus( UINT flags )
  */
 BOOL WINAPI GetInputState(void)
 {
+    const struct queue_shm *shm;
     DWORD ret;
 
     check_for_events( QS_INPUT );
 
+    if (get_user_thread_info()->queue_shm && (shm = get_queue_shm()))
+        return shm->wake_bits & (QS_KEY | QS_MOUSEBUTTON);
+
     SERVER_START_REQ( get_queue_status )
     {
         req->clear = 0;
@@ -746,8 +802,16 @@ BOOL WINAPI AttachThreadInput( DWORD from, DWORD to, BOOL attach )
  */
 SHORT WINAPI DECLSPEC_HOTPATCH GetKeyState(INT vkey)
 {
+    struct input_shm state;
     SHORT retval = 0;
 
+    if (read_input_shm( FALSE, &state ))
+    {
+        retval = (signed char)state.keystate[vkey & 0xff];
+        TRACE("key (0x%x) -> %x\n", vkey, retval);
+        return retval;
+    }
+
     SERVER_START_REQ( get_key_state )
     {
         req->tid = GetCurrentThreadId();
@@ -765,10 +829,17 @@ SHORT WINAPI DECLSPEC_HOTPATCH GetKeyState(INT vkey)
  */
 BOOL WINAPI DECLSPEC_HOTPATCH GetKeyboardState( LPBYTE state )
 {
+    struct input_shm input;
     BOOL ret;
 
     TRACE("(%p)\n", state);
 
+    if (read_input_shm( FALSE, &input ))
+    {
+        memcpy( state, input.keystate, 256 );
+        return TRUE;
+    }
+
     memset( state, 0, 256 );
     SERVER_START_REQ( get_key_state )
     {
@@ -2720,6 +2720,97 @@ static inline void call_sendmsg_callback( SENDASYNCPROC callback, HWND hwnd, UIN
 }
 
 
+/***********************************************************************
+ *           get_queue_shm
+ *
+ * Get the shared memory status of the current thread queue, or NULL if not available.
+ */
+static const struct queue_shm *queue_shm_base;  /* shared memory of the queues and input states */
+
+const struct queue_shm *get_queue_shm(void)
+{
+    static const struct queue_shm no_queue_shm;
+    struct user_thread_info *thread_info = get_user_thread_info();
+    HANDLE handle = 0;
+    unsigned int index = 0;
+    void *ptr;
+
+    if (!thread_info->queue_shm)
+    {
+        thread_info->queue_shm = &no_queue_shm;
+
+        SERVER_START_REQ( get_queue_shm )
+        {
+            if (!wine_server_call( req ))
+            {
+                handle = wine_server_ptr_handle( reply->handle );
+                index  = reply->index;
+            }
+        }
+        SERVER_END_REQ;
+
+        if (handle)
+        {
+            if (!queue_shm_base && (ptr = MapViewOfFile( handle, FILE_MAP_READ, 0, 0, 0 )) &&
+                InterlockedCompareExchangePointer( (void **)&queue_shm_base, ptr, NULL ))
+                UnmapViewOfFile( ptr );
+            if (queue_shm_base) thread_info->queue_shm = queue_shm_base + index;
+            CloseHandle( handle );
+        }
+    }
+    return thread_info->queue_shm != &no_queue_shm ? thread_info->queue_shm : NULL;
+}
+
+
+/***********************************************************************
+ *           get_input_shm
+ *
+ * Get a desktop or thread input state from its index in the shared memory.
+ * The queue shared memory must have been mapped already.
+ */
+const struct input_shm *get_input_shm( int index )
+{
+    return (const struct input_shm *)((const char *)queue_shm_base + QUEUE_SHM_SIZE) + index;
+}
+
+
+/***********************************************************************
+ *           get_window_shm
+ *
+ * Get the shared memory state of a window, which is indexed like the user handles.
+ * Returns NULL if the shared memory hasn't been mapped by any thread yet.
+ */
+const struct window_shm *get_window_shm( HWND hwnd )
+{
+    UINT index = (LOWORD(hwnd) - FIRST_USER_HANDLE) >> 1;
+
+    if (!queue_shm_base || index >= WINDOW_SHM_SIZE / sizeof(struct window_shm)) return NULL;
+    return (const struct window_shm *)((const char *)queue_shm_base + QUEUE_SHM_SIZE + INPUT_SHM_SIZE) + index;
+}
+
+
+/***********************************************************************
+ *           is_queue_empty
+ *
+ * Check in the shared memory status whether a get_message request for the given
+ * filter would find nothing. The server is still called at least once per second
+ * so that it doesn't consider the thread hung.
+ */
+static BOOL is_queue_empty( UINT flags )
+{
+    const struct queue_shm *shm;
+    UINT filter = flags >> 16;
+
+    if (GetTickCount() - get_user_thread_info()->last_get_msg >= 1000) return FALSE;
+    if (!(shm = get_queue_shm())) return FALSE;
+
+    if (!filter) filter = QS_ALLINPUT;
+    /* sent messages are always processed, and quit messages are not filtered */
+    filter |= QS_SENDMESSAGE | QS_POSTMESSAGE | QS_ALLPOSTMESSAGE;
+    return !(shm->wake_bits & filter);
+}
+
+
 /***********************************************************************
  *           peek_message
  *
@@ -2735,6 +2826,9 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
     void *buffer;
     size_t buffer_size = 256;
 
+    /* the wake masks are only set by the server call, so it can't be skipped before waiting */
+    if (!changed_mask && is_queue_empty( flags )) return FALSE;
+
     if (!(buffer = HeapAlloc( GetProcessHeap(), 0, buffer_size ))) return FALSE;
 
     if (!first && !last) last = ~0;
@@ -2773,6 +2867,7 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
             else buffer_size = reply->total;
         }
         SERVER_END_REQ;
+        thread_info->last_get_msg = GetTickCount();
 
         if (res)
         {
@@ -26,9 +26,11 @@
 
 #include "windef.h"
 #include "winbase.h"
+#include "wingdi.h"
 #include "winuser.h"
 #include "wine/unicode.h"
 #include "wine/server.h"
+#include "user_private.h"
 
 /* size of buffer needed to store an atom string */
 #define ATOM_BUFFER_SIZE 256
@@ -129,7 +131,21 @@ HANDLE WINAPI GetPropA( HWND hwnd, LPCSTR str )
  */
 HANDLE WINAPI GetPropW( HWND hwnd, LPCWSTR str )
 {
+    struct window_shm state;
     ULONG_PTR ret = 0;
+    int i;
+
+    /* string names need the server to be resolved, unless there are no properties at all */
+    if (read_window_shm( hwnd, &state ) && state.prop_count != -1)
+    {
+        if (!state.prop_count) return 0;
+        if (IS_INTRESOURCE(str))
+        {
+            for (i = 0; i < state.prop_count; i++)
+                if (state.props[i].atom == LOWORD(str)) return (HANDLE)(ULONG_PTR)state.props[i].data;
+            return 0;
+        }
+    }
 
     SERVER_START_REQ( get_window_property )
     {
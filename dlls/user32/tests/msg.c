@@ -14105,6 +14105,66 @@ static void test_layered_window(void)
     DeleteObject( bmp );
 }
 
+#define PEEK_PERF_CALLS 100000
+
+static void test_peek_message_perf(void)
+{
+    LARGE_INTEGER freq, start, end;
+    MSG msg;
+    HWND hwnd;
+    DWORD i;
+
+    if (!winetest_interactive)
+    {
+        skip( "message queue benchmark (set WINETEST_INTERACTIVE=1)\n" );
+        return;
+    }
+
+    hwnd = CreateWindowExA( 0, "TestWindowClass", "Test", WS_OVERLAPPEDWINDOW,
+                            100, 100, 200, 200, 0, 0, 0, NULL );
+    flush_events();
+    QueryPerformanceFrequency( &freq );
+
+    /* polling an empty queue is what game and UI loops do between frames */
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < PEEK_PERF_CALLS; i++) PeekMessageA( &msg, 0, 0, 0, PM_REMOVE );
+    QueryPerformanceCounter( &end );
+    trace( "PeekMessage on an empty queue: %.2f us\n",
+           (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / PEEK_PERF_CALLS );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < PEEK_PERF_CALLS; i++) PeekMessageA( &msg, hwnd, WM_KEYFIRST, WM_KEYLAST, PM_REMOVE );
+    QueryPerformanceCounter( &end );
+    trace( "PeekMessage with a filter: %.2f us\n",
+           (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / PEEK_PERF_CALLS );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < PEEK_PERF_CALLS; i++) GetQueueStatus( QS_ALLINPUT );
+    QueryPerformanceCounter( &end );
+    trace( "GetQueueStatus: %.2f us\n",
+           (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / PEEK_PERF_CALLS );
+
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < PEEK_PERF_CALLS; i++) GetInputState();
+    QueryPerformanceCounter( &end );
+    trace( "GetInputState: %.2f us\n",
+           (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / PEEK_PERF_CALLS );
+
+    /* one posted message per call, that one has to go to the server */
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < PEEK_PERF_CALLS; i++)
+    {
+        PostMessageA( hwnd, WM_USER, 0, 0 );
+        PeekMessageA( &msg, 0, 0, 0, PM_REMOVE );
+    }
+    QueryPerformanceCounter( &end );
+    trace( "PostMessage and PeekMessage: %.2f us\n",
+           (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / PEEK_PERF_CALLS );
+
+    DestroyWindow( hwnd );
+    flush_sequence();
+}
+
 START_TEST(msg)
 {
     char **test_argv;
@@ -14219,6 +14279,7 @@ START_TEST(msg)
     test_keyflags();
     test_hotkey();
     test_layered_window();
+    test_peek_message_perf();
     /* keep it the last test, under Windows it tends to break the tests
      * which rely on active/foreground windows being correct.
      */
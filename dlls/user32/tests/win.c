@@ -7469,10 +7469,142 @@ todo_wine
     DestroyWindow(parent);
 }
 
+#define HITTEST_PERF_COLUMNS 50
+#define HITTEST_PERF_ROWS    40
+#define HITTEST_PERF_CALLS   20000
+
+static void test_hittest_perf(void)
+{
+    LARGE_INTEGER freq, start, end;
+    DWORD i, seed = 12345;
+    HWND parent;
+    POINT pt;
+    int x, y;
+
+    if (!winetest_interactive)
+    {
+        skip("window hit-testing benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+
+    parent = CreateWindowExA(0, "MainWindowClass", "hit-testing", WS_POPUP | WS_VISIBLE,
+                             0, 0, HITTEST_PERF_COLUMNS * 10, HITTEST_PERF_ROWS * 10, 0, 0, 0, NULL);
+    for (y = 0; y < HITTEST_PERF_ROWS; y++)
+        for (x = 0; x < HITTEST_PERF_COLUMNS; x++)
+            CreateWindowExA(0, "static", NULL, WS_CHILD | WS_VISIBLE, x * 10, y * 10, 10, 10,
+                            parent, 0, 0, NULL);
+    flush_events( TRUE );
+    QueryPerformanceFrequency(&freq);
+
+    /* mouse moves over a window with many children */
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < HITTEST_PERF_CALLS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        pt.x = (seed >> 8) % (HITTEST_PERF_COLUMNS * 10);
+        pt.y = (seed >> 20) % (HITTEST_PERF_ROWS * 10);
+        WindowFromPoint(pt);
+    }
+    QueryPerformanceCounter(&end);
+    trace("WindowFromPoint over %u children: %.2f us\n", HITTEST_PERF_COLUMNS * HITTEST_PERF_ROWS,
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / HITTEST_PERF_CALLS);
+
+    DestroyWindow(parent);
+}
+
+/* child process owning the window for test_GetWindowInfo_perf */
+static void window_info_perf_child(void)
+{
+    HANDLE ready = OpenEventA(EVENT_ALL_ACCESS, FALSE, "win_perf_ready");
+    HANDLE done = OpenEventA(EVENT_ALL_ACCESS, FALSE, "win_perf_done");
+    HWND hwnd;
+
+    hwnd = CreateWindowExA(0, "static", "win perf child", WS_POPUP | WS_VISIBLE,
+                           100, 100, 200, 200, 0, 0, 0, NULL);
+    SetEvent(ready);
+    WaitForSingleObject(done, 30000);
+    DestroyWindow(hwnd);
+    CloseHandle(ready);
+    CloseHandle(done);
+}
+
+#define WINDOW_INFO_PERF_CALLS 100000
+
+static void test_GetWindowInfo_perf(const char *argv0)
+{
+    LARGE_INTEGER freq, start, end;
+    STARTUPINFOA startup;
+    PROCESS_INFORMATION pi;
+    HANDLE ready, done;
+    char cmdline[MAX_PATH];
+    WINDOWINFO info;
+    HWND hwnd;
+    DWORD i;
+
+    if (!winetest_interactive)
+    {
+        skip("GetWindowInfo benchmark (set WINETEST_INTERACTIVE=1)\n");
+        return;
+    }
+    if (!pGetWindowInfo)
+    {
+        win_skip("GetWindowInfo is not available\n");
+        return;
+    }
+
+    ready = CreateEventA(NULL, FALSE, FALSE, "win_perf_ready");
+    done = CreateEventA(NULL, FALSE, FALSE, "win_perf_done");
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    sprintf(cmdline, "%s win perf_child", argv0);
+    if (!CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &pi))
+    {
+        skip("CreateProcess failed err %u\n", GetLastError());
+        CloseHandle(ready);
+        CloseHandle(done);
+        return;
+    }
+    WaitForSingleObject(ready, 10000);
+    hwnd = FindWindowA("static", "win perf child");
+    ok(hwnd != 0, "child window not found\n");
+
+    QueryPerformanceFrequency(&freq);
+    info.cbSize = sizeof(info);
+
+    /* everything about a window of another process has to come from the server */
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < WINDOW_INFO_PERF_CALLS; i++) pGetWindowInfo(hwnd, &info);
+    QueryPerformanceCounter(&end);
+    trace("GetWindowInfo on a window of another process: %.2f us\n",
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / WINDOW_INFO_PERF_CALLS);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < WINDOW_INFO_PERF_CALLS; i++) pGetWindowInfo(hwndMain, &info);
+    QueryPerformanceCounter(&end);
+    trace("GetWindowInfo on a window of this process: %.2f us\n",
+          (end.QuadPart - start.QuadPart) * 1e6 / freq.QuadPart / WINDOW_INFO_PERF_CALLS);
+
+    SetEvent(done);
+    WaitForSingleObject(pi.hProcess, 10000);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    CloseHandle(ready);
+    CloseHandle(done);
+}
+
 START_TEST(win)
 {
     HMODULE user32 = GetModuleHandleA( "user32.dll" );
     HMODULE gdi32 = GetModuleHandleA("gdi32.dll");
+    char **argv;
+    int argc = winetest_get_mainargs( &argv );
+
+    if (argc >= 3 && !strcmp(argv[2], "perf_child"))
+    {
+        window_info_perf_child();
+        return;
+    }
+
     pGetAncestor = (void *)GetProcAddress( user32, "GetAncestor" );
     pGetWindowInfo = (void *)GetProcAddress( user32, "GetWindowInfo" );
     pGetWindowModuleFileNameA = (void *)GetProcAddress( user32, "GetWindowModuleFileNameA" );
@@ -7579,6 +7711,8 @@ START_TEST(win)
     test_winregion();
     test_map_points();
     test_update_region();
+    test_hittest_perf();
+    test_GetWindowInfo_perf(argv[0]);
 
     /* add the tests above this line */
     if (hhook) UnhookWindowsHookEx(hhook);
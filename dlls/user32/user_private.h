@@ -187,8 +187,10 @@ struct user_thread_info
     HWND                          top_window;             /* Desktop window */
     HWND                          msg_window;             /* HWND_MESSAGE parent window */
     RAWINPUT                     *rawinput;
+    const struct queue_shm       *queue_shm;              /* Shared memory status of the queue */
+    DWORD                         last_get_msg;           /* Time of last get_message request */
 
-    ULONG                         pad[8];                 /* Available for more data */
+    ULONG                         pad[5];                 /* Available for more data */
 };
 
 struct hook_extra_info
@@ -225,6 +227,10 @@ extern void move_window_bits( HWND hwnd, struct window_surface *old_surface,
                               const RECT *visible_rect, const RECT *old_visible_rect,
                               const RECT *client_rect, const RECT *valid_rects ) DECLSPEC_HIDDEN;
 extern void *get_hook_proc( void *proc, const WCHAR *module ) DECLSPEC_HIDDEN;
+extern const struct queue_shm *get_queue_shm(void) DECLSPEC_HIDDEN;
+extern const struct input_shm *get_input_shm( int index ) DECLSPEC_HIDDEN;
+extern const struct window_shm *get_window_shm( HWND hwnd ) DECLSPEC_HIDDEN;
+extern BOOL read_window_shm( HWND hwnd, struct window_shm *state ) DECLSPEC_HIDDEN;
 extern RECT get_virtual_screen_rect(void) DECLSPEC_HIDDEN;
 extern LRESULT call_current_hook( HHOOK hhook, INT code, WPARAM wparam, LPARAM lparam ) DECLSPEC_HIDDEN;
 extern DWORD get_input_codepage( void ) DECLSPEC_HIDDEN;
@@ -791,6 +791,97 @@ ULONG WIN_SetStyle( HWND hwnd, ULONG set_bits, ULONG clear_bits )
 }
 
 
+/***********************************************************************
+ *           read_window_shm
+ *
+ * Read the state of a window from the shared memory, if available. The server
+ * increments the seq count before and after each update, so we retry until we
+ * get a consistent copy.
+ */
+BOOL read_window_shm( HWND hwnd, struct window_shm *state )
+{
+    const volatile struct window_shm *shm;
+    int i, seq;
+    LONG barrier;
+
+    if (!(shm = get_window_shm( hwnd ))) return FALSE;
+
+    for (i = 0; i < 100; i++)
+    {
+        if ((seq = shm->seq) & 1) continue;  /* being updated */
+        InterlockedExchange( &barrier, 0 );
+        memcpy( state, (const struct window_shm *)shm, sizeof(*state) );
+        InterlockedExchange( &barrier, 0 );
+        if (shm->seq != seq) continue;
+        /* the entry may be free, or used by another window with the same handle index */
+        return state->handle && (state->handle == wine_server_user_handle( hwnd ) ||
+                                 !HIWORD(hwnd) || HIWORD(hwnd) == 0xffff);
+    }
+    return FALSE;  /* let the server handle it */
+}
+
+
+/***********************************************************************
+ *           get_shm_rectangles
+ *
+ * Get the window and client rectangles of a window of another process
+ * from the shared memory, like the get_window_rectangles request does.
+ */
+static BOOL get_shm_rectangles( HWND hwnd, enum coords_relative relative, RECT *rectWindow, RECT *rectClient )
+{
+    struct window_shm state, parent;
+    RECT window_rect, client_rect, rect;
+
+    if (!read_window_shm( hwnd, &state )) return FALSE;
+
+    SetRect( &window_rect, state.window_rect.left, state.window_rect.top,
+             state.window_rect.right, state.window_rect.bottom );
+    SetRect( &client_rect, state.client_rect.left, state.client_rect.top,
+             state.client_rect.right, state.client_rect.bottom );
+
+    switch (relative)
+    {
+    case COORDS_CLIENT:
+        rect = client_rect;
+        OffsetRect( &window_rect, -rect.left, -rect.top );
+        OffsetRect( &client_rect, -rect.left, -rect.top );
+        if (state.ex_style & WS_EX_LAYOUTRTL) mirror_rect( &rect, &window_rect );
+        break;
+    case COORDS_WINDOW:
+        rect = window_rect;
+        OffsetRect( &window_rect, -rect.left, -rect.top );
+        OffsetRect( &client_rect, -rect.left, -rect.top );
+        if (state.ex_style & WS_EX_LAYOUTRTL) mirror_rect( &rect, &client_rect );
+        break;
+    case COORDS_PARENT:
+        if (!state.parent) break;
+        if (!read_window_shm( wine_server_ptr_handle( state.parent ), &parent )) return FALSE;
+        if (parent.ex_style & WS_EX_LAYOUTRTL)
+        {
+            SetRect( &rect, parent.client_rect.left, parent.client_rect.top,
+                     parent.client_rect.right, parent.client_rect.bottom );
+            mirror_rect( &rect, &window_rect );
+            mirror_rect( &rect, &client_rect );
+        }
+        break;
+    case COORDS_SCREEN:
+        while (state.parent)
+        {
+            if (!read_window_shm( wine_server_ptr_handle( state.parent ), &state )) return FALSE;
+            if (!state.parent) break;  /* desktop window */
+            OffsetRect( &window_rect, state.client_rect.left, state.client_rect.top );
+            OffsetRect( &client_rect, state.client_rect.left, state.client_rect.top );
+        }
+        break;
+    default:
+        return FALSE;
+    }
+    if (rectWindow) *rectWindow = window_rect;
+    if (rectClient) *rectClient = client_rect;
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           WIN_GetRectangles
  *
@@ -898,6 +989,8 @@ BOOL WIN_GetRectangles( HWND hwnd, enum coords_relative relative, RECT *rectWind
     }
 
 other_process:
+    if (get_shm_rectangles( hwnd, relative, rectWindow, rectClient )) return TRUE;
+
     SERVER_START_REQ( get_window_rectangles )
     {
         req->handle = wine_server_user_handle( hwnd );
@@ -2180,6 +2273,7 @@ BOOL WINAPI IsWindowUnicode( HWND hwnd )
  */
 static LONG_PTR WIN_GetWindowLong( HWND hwnd, INT offset, UINT size, BOOL unicode )
 {
+    struct window_shm state;
     LONG_PTR retvalue = 0;
     WND *wndPtr;
 
@@ -2203,6 +2297,17 @@ static LONG_PTR WIN_GetWindowLong( HWND hwnd, INT offset, UINT size, BOOL unicod
             SetLastError( ERROR_ACCESS_DENIED );
             return 0;
         }
+        if (offset < 0 && read_window_shm( hwnd, &state ))
+        {
+            switch(offset)
+            {
+            case GWL_STYLE:      return state.style;
+            case GWL_EXSTYLE:    return state.ex_style;
+            case GWLP_ID:        return state.id;
+            case GWLP_HINSTANCE: return (ULONG_PTR)wine_server_get_ptr( state.instance );
+            case GWLP_USERDATA:  return state.user_data;
+            }
+        }
         SERVER_START_REQ( set_window_info )
         {
             req->handle = wine_server_user_handle( hwnd );
@@ -3052,11 +3157,26 @@ BOOL WINAPI IsChild( HWND parent, HWND child )
  */
 BOOL WINAPI IsWindowVisible( HWND hwnd )
 {
-    HWND *list;
+    struct window_shm state;
+    HWND *list, parent;
     BOOL retval = TRUE;
     int i;
 
     if (!(GetWindowLongW( hwnd, GWL_STYLE ) & WS_VISIBLE)) return FALSE;
+
+    /* walk the parents in the shared memory if possible */
+    if (read_window_shm( hwnd, &state ))
+    {
+        if (!state.parent) return TRUE;
+        for (;;)
+        {
+            parent = wine_server_ptr_handle( state.parent );
+            if (!read_window_shm( parent, &state )) break;
+            if (!state.parent) return (parent == GetDesktopWindow());  /* top message window isn't visible */
+            if (!(state.style & WS_VISIBLE)) return FALSE;
+        }
+    }
+
     if (!(list = list_window_parents( hwnd ))) return TRUE;
     if (list[0])
     {
@@ -3566,6 +3686,65 @@ UINT WINAPI GetWindowModuleFileNameW( HWND hwnd, LPWSTR module, UINT size )
     return GetModuleFileNameW( hinst, module, size );
 }
 
+/***********************************************************************
+ *           get_other_process_window_info
+ *
+ * Helper for GetWindowInfo. Everything has to be fetched from the server
+ * for windows of other processes, so do it in a single round-trip.
+ */
+static BOOL get_other_process_window_info( HWND hwnd, WINDOWINFO *info )
+{
+    SERVER_BATCH_REQ( rects, get_window_rectangles );
+    SERVER_BATCH_REQ( win, set_window_info );
+    SERVER_BATCH_REQ( input, get_thread_input );
+    SERVER_BATCH_REQ( class, set_class_info );
+    void *batch[4];
+    unsigned int status;
+
+    rects_req->handle = wine_server_user_handle( hwnd );
+    rects_req->relative = COORDS_SCREEN;
+    win_req->handle = wine_server_user_handle( hwnd );
+    win_req->flags = 0;  /* don't set anything, just retrieve */
+    win_req->extra_offset = -1;
+    input_req->tid = GetCurrentThreadId();
+    class_req->window = wine_server_user_handle( hwnd );
+    class_req->flags = 0;  /* don't set anything, just retrieve */
+    class_req->extra_offset = -1;
+
+    batch[0] = &rects_info;
+    batch[1] = &win_info;
+    batch[2] = &input_info;
+    batch[3] = &class_info;
+    if (!(status = wine_server_call_batch( batch, 4 )))
+        status = wine_server_reply_error( rects_reply );
+    if (status)
+    {
+        SetLastError( RtlNtStatusToDosError( status ));
+        return FALSE;
+    }
+
+    info->rcWindow.left   = rects_reply->window.left;
+    info->rcWindow.top    = rects_reply->window.top;
+    info->rcWindow.right  = rects_reply->window.right;
+    info->rcWindow.bottom = rects_reply->window.bottom;
+    info->rcClient.left   = rects_reply->client.left;
+    info->rcClient.top    = rects_reply->client.top;
+    info->rcClient.right  = rects_reply->client.right;
+    info->rcClient.bottom = rects_reply->client.bottom;
+
+    info->dwStyle = wine_server_reply_error( win_reply ) ? 0 : win_reply->old_style;
+    info->dwExStyle = wine_server_reply_error( win_reply ) ? 0 : win_reply->old_ex_style;
+    info->dwWindowStatus = (!wine_server_reply_error( input_reply ) &&
+                            wine_server_ptr_handle( input_reply->active ) == hwnd) ? WS_ACTIVECAPTION : 0;
+
+    info->cxWindowBorders = info->rcClient.left - info->rcWindow.left;
+    info->cyWindowBorders = info->rcWindow.bottom - info->rcClient.bottom;
+
+    info->atomWindowType = wine_server_reply_error( class_reply ) ? 0 : class_reply->old_atom;
+    info->wCreatorVersion = 0x0400;
+    return TRUE;
+}
+
 /******************************************************************************
  *              GetWindowInfo (USER32.@)
  *
@@ -3573,7 +3752,13 @@ UINT WINAPI GetWindowModuleFileNameW( HWND hwnd, LPWSTR module, UINT size )
  */
 BOOL WINAPI DECLSPEC_HOTPATCH GetWindowInfo( HWND hwnd, PWINDOWINFO pwi)
 {
+    WND *win;
+
     if (!pwi) return FALSE;
+
+    if ((win = WIN_GetPtr( hwnd )) == WND_OTHER_PROCESS) return get_other_process_window_info( hwnd, pwi );
+    if (win && win != WND_DESKTOP) WIN_ReleasePtr( win );
+
     if (!WIN_GetRectangles( hwnd, COORDS_SCREEN, &pwi->rcWindow, &pwi->rcClient )) return FALSE;
 
     pwi->dwStyle = GetWindowLongW(hwnd, GWL_STYLE);
@@ -50,6 +50,7 @@ struct __server_request_info
 };
 
 extern unsigned int wine_server_call( void *req_ptr );
+extern unsigned int CDECL wine_server_call_batch( void **reqs, unsigned int count );
 extern void CDECL wine_server_send_fd( int fd );
 extern int CDECL wine_server_fd_to_handle( int fd, unsigned int access, unsigned int attributes, HANDLE *handle );
 extern int CDECL wine_server_handle_to_fd( HANDLE handle, unsigned int access, int *unix_fd, unsigned int *options );
@@ -69,6 +70,12 @@ static inline data_size_t wine_server_reply_size( const void *reply )
     return ((const struct reply_header *)reply)->reply_size;
 }
 
+/* get the status of a request executed as part of a batch */
+static inline unsigned int wine_server_reply_error( const void *reply )
+{
+    return ((const struct reply_header *)reply)->error;
+}
+
 /* add some data to be sent along with the request */
 static inline void wine_server_add_data( void *req_ptr, const void *ptr, data_size_t size )
 {
@@ -138,5 +145,20 @@ static inline void *wine_server_get_ptr( client_ptr_t ptr )
         while(0); \
     } while(0)
 
+/* initialize a request that will be sent with wine_server_call_batch */
+static inline void *wine_server_init_req( struct __server_request_info *info, enum request req )
+{
+    memset( &info->u.req, 0, sizeof(info->u.req) );
+    info->u.req.request_header.req = req;
+    info->data_count = 0;
+    return &info->u.req;
+}
+
+/* declare a request of a batch; the request info is name##_info */
+#define SERVER_BATCH_REQ(name,type) \
+    struct __server_request_info name##_info; \
+    struct type##_request * const name##_req = wine_server_init_req( &name##_info, REQ_##type ); \
+    const struct type##_reply * const name##_reply = &name##_info.u.reply.type##_reply
+
 
 #endif  /* __WINE_WINE_SERVER_H */
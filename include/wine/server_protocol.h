@@ -203,6 +203,72 @@ struct wake_up_reply
 };
 
 
+
+
+
+struct request_shm
+{
+    int                     seq;
+    int                     waiting;
+    int                     req_seq;
+    int                     slot;
+    int                     __pad[12];
+    struct request_max_size msg;
+    char                    data[1];
+};
+#define REQUEST_SHM_SIZE      0x10000
+#define REQUEST_SHM_DATA_SIZE (REQUEST_SHM_SIZE - 128)
+#define REQUEST_SHM_SLOTS     4096
+
+
+struct request_shm_header
+{
+    int                     sleeping;
+    int                     __pad[15];
+    unsigned int            pending[REQUEST_SHM_SLOTS / 32];
+};
+#define REQUEST_SHM_HEADER_SIZE 0x1000
+
+
+
+struct fast_sync_object
+{
+    int                     type;
+    int                     value;
+    unsigned int            max;
+    unsigned int            count;
+    int                     abandoned;
+    int                     waiters;
+    int                     sleepers;
+    int                     __pad;
+};
+enum fast_sync_type { FAST_SYNC_NONE, FAST_SYNC_EVENT, FAST_SYNC_SEMAPHORE, FAST_SYNC_MUTEX };
+#define FAST_SYNC_EVENT_SIGNALED 1
+#define FAST_SYNC_SHM_SIZE       0x200000
+
+
+struct queue_shm
+{
+    unsigned int            wake_bits;
+    unsigned int            changed_bits;
+    int                     input_index;
+    int                     desktop_index;
+};
+#define QUEUE_SHM_SIZE        0x10000
+
+
+
+struct input_shm
+{
+    int                     seq;
+    int                     cursor_x;
+    int                     cursor_y;
+    unsigned int            cursor_last_change;
+    unsigned char           keystate[256];
+};
+#define INPUT_SHM_SIZE        0x100000
+
+
 typedef __int64 timeout_t;
 #define TIMEOUT_INFINITE (((timeout_t)0x7fffffff) << 32 | 0xffffffff)
 
@@ -260,6 +326,27 @@ typedef struct
 } rectangle_t;
 
 
+
+#define WINDOW_SHM_PROPS      8
+struct window_shm
+{
+    int                     seq;
+    user_handle_t           handle;
+    user_handle_t           parent;
+    unsigned int            style;
+    unsigned int            ex_style;
+    unsigned int            id;
+    rectangle_t             window_rect;
+    rectangle_t             client_rect;
+    mod_handle_t            instance;
+    lparam_t                user_data;
+    int                     prop_count;
+    int                     __pad;
+    property_data_t         props[WINDOW_SHM_PROPS];
+};
+#define WINDOW_SHM_SIZE       0x700000
+
+
 typedef struct
 {
     obj_handle_t    handle;
@@ -742,6 +829,21 @@ struct init_thread_reply
 
 
 
+
+struct create_request_shm_request
+{
+    struct request_header __header;
+    int          get_fds;
+};
+struct create_request_shm_reply
+{
+    struct reply_header __header;
+    data_size_t  size;
+    char __pad_12[4];
+};
+
+
+
 struct terminate_process_request
 {
     struct request_header __header;
@@ -1055,6 +1157,7 @@ struct select_request
     obj_handle_t signal;
     obj_handle_t prev_apc;
     timeout_t    timeout;
+    client_ptr_t key;
     /* VARARG(result,apc_result); */
     /* VARARG(handles,handles); */
 };
@@ -1069,6 +1172,8 @@ struct select_reply
 #define SELECT_ALL           1
 #define SELECT_ALERTABLE     2
 #define SELECT_INTERRUPTIBLE 4
+#define SELECT_KEYED_EVENT_WAIT    8
+#define SELECT_KEYED_EVENT_RELEASE 16
 
 
 
@@ -1122,6 +1227,60 @@ struct open_event_reply
 
 
 
+struct create_keyed_event_request
+{
+    struct request_header __header;
+    unsigned int access;
+    unsigned int attributes;
+    /* VARARG(objattr,object_attributes); */
+    char __pad_20[4];
+};
+struct create_keyed_event_reply
+{
+    struct reply_header __header;
+    obj_handle_t handle;
+    unsigned int id;
+    unsigned int access;
+    int          shared;
+};
+
+
+struct open_keyed_event_request
+{
+    struct request_header __header;
+    unsigned int access;
+    unsigned int attributes;
+    obj_handle_t rootdir;
+    /* VARARG(name,unicode_str); */
+};
+struct open_keyed_event_reply
+{
+    struct reply_header __header;
+    obj_handle_t handle;
+    unsigned int id;
+    unsigned int access;
+    int          shared;
+};
+
+
+struct get_keyed_event_info_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    unsigned int access;
+    char __pad_20[4];
+};
+struct get_keyed_event_info_reply
+{
+    struct reply_header __header;
+    unsigned int id;
+    unsigned int access;
+    int          shared;
+    char __pad_20[4];
+};
+
+
+
 struct create_mutex_request
 {
     struct request_header __header;
@@ -1222,6 +1381,49 @@ struct open_semaphore_reply
 
 
 
+
+struct get_fast_sync_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_fast_sync_shm_reply
+{
+    struct reply_header __header;
+    data_size_t  size;
+    char __pad_12[4];
+};
+
+
+
+struct get_fast_sync_obj_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_fast_sync_obj_reply
+{
+    struct reply_header __header;
+    unsigned int index;
+    int          type;
+    unsigned int access;
+    char __pad_20[4];
+};
+
+
+
+struct wake_fast_sync_obj_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct wake_fast_sync_obj_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct create_file_request
 {
     struct request_header __header;
@@ -2739,6 +2941,20 @@ struct set_queue_mask_reply
 
 
 
+struct get_queue_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_queue_shm_reply
+{
+    struct reply_header __header;
+    obj_handle_t handle;
+    unsigned int index;
+};
+
+
+
 struct get_queue_status_request
 {
     struct request_header __header;
@@ -4952,6 +5168,24 @@ struct set_suspend_context_reply
 };
 
 
+
+struct batch_request
+{
+    struct request_header __header;
+    /* VARARG(requests,bytes); */
+    char __pad_12[4];
+};
+struct batch_reply
+{
+    struct reply_header __header;
+    unsigned int count;
+    /* VARARG(replies,bytes); */
+    char __pad_12[4];
+};
+
+#define BATCH_ALIGN(size) (((size) + 7) & ~7)
+
+
 enum request
 {
     REQ_new_process,
@@ -4960,6 +5194,7 @@ enum request
     REQ_get_startup_info,
     REQ_init_process_done,
     REQ_init_thread,
+    REQ_create_request_shm,
     REQ_terminate_process,
     REQ_terminate_thread,
     REQ_get_process_info,
@@ -4982,12 +5217,18 @@ enum request
     REQ_create_event,
     REQ_event_op,
     REQ_open_event,
+    REQ_create_keyed_event,
+    REQ_open_keyed_event,
+    REQ_get_keyed_event_info,
     REQ_create_mutex,
     REQ_release_mutex,
     REQ_open_mutex,
     REQ_create_semaphore,
     REQ_release_semaphore,
     REQ_open_semaphore,
+    REQ_get_fast_sync_shm,
+    REQ_get_fast_sync_obj,
+    REQ_wake_fast_sync_obj,
     REQ_create_file,
     REQ_open_file_object,
     REQ_alloc_file_handle,
@@ -5075,6 +5316,7 @@ enum request
     REQ_get_msg_queue,
     REQ_set_queue_fd,
     REQ_set_queue_mask,
+    REQ_get_queue_shm,
     REQ_get_queue_status,
     REQ_get_process_idle_event,
     REQ_send_message,
@@ -5203,6 +5445,7 @@ enum request
     REQ_update_rawinput_devices,
     REQ_get_suspend_context,
     REQ_set_suspend_context,
+    REQ_batch,
     REQ_NB_REQUESTS
 };
 
@@ -5216,6 +5459,7 @@ union generic_request
     struct get_startup_info_request get_startup_info_request;
     struct init_process_done_request init_process_done_request;
     struct init_thread_request init_thread_request;
+    struct create_request_shm_request create_request_shm_request;
     struct terminate_process_request terminate_process_request;
     struct terminate_thread_request terminate_thread_request;
     struct get_process_info_request get_process_info_request;
@@ -5238,12 +5482,18 @@ union generic_request
     struct create_event_request create_event_request;
     struct event_op_request event_op_request;
     struct open_event_request open_event_request;
+    struct create_keyed_event_request create_keyed_event_request;
+    struct open_keyed_event_request open_keyed_event_request;
+    struct get_keyed_event_info_request get_keyed_event_info_request;
     struct create_mutex_request create_mutex_request;
     struct release_mutex_request release_mutex_request;
     struct open_mutex_request open_mutex_request;
     struct create_semaphore_request create_semaphore_request;
     struct release_semaphore_request release_semaphore_request;
     struct open_semaphore_request open_semaphore_request;
+    struct get_fast_sync_shm_request get_fast_sync_shm_request;
+    struct get_fast_sync_obj_request get_fast_sync_obj_request;
+    struct wake_fast_sync_obj_request wake_fast_sync_obj_request;
     struct create_file_request create_file_request;
     struct open_file_object_request open_file_object_request;
     struct alloc_file_handle_request alloc_file_handle_request;
@@ -5331,6 +5581,7 @@ union generic_request
     struct get_msg_queue_request get_msg_queue_request;
     struct set_queue_fd_request set_queue_fd_request;
     struct set_queue_mask_request set_queue_mask_request;
+    struct get_queue_shm_request get_queue_shm_request;
     struct get_queue_status_request get_queue_status_request;
     struct get_process_idle_event_request get_process_idle_event_request;
     struct send_message_request send_message_request;
@@ -5459,6 +5710,7 @@ union generic_request
     struct update_rawinput_devices_request update_rawinput_devices_request;
     struct get_suspend_context_request get_suspend_context_request;
     struct set_suspend_context_request set_suspend_context_request;
+    struct batch_request batch_request;
 };
 union generic_reply
 {
@@ -5470,6 +5722,7 @@ union generic_reply
     struct get_startup_info_reply get_startup_info_reply;
     struct init_process_done_reply init_process_done_reply;
     struct init_thread_reply init_thread_reply;
+    struct create_request_shm_reply create_request_shm_reply;
     struct terminate_process_reply terminate_process_reply;
     struct terminate_thread_reply terminate_thread_reply;
     struct get_process_info_reply get_process_info_reply;
@@ -5492,12 +5745,18 @@ union generic_reply
     struct create_event_reply create_event_reply;
     struct event_op_reply event_op_reply;
     struct open_event_reply open_event_reply;
+    struct create_keyed_event_reply create_keyed_event_reply;
+    struct open_keyed_event_reply open_keyed_event_reply;
+    struct get_keyed_event_info_reply get_keyed_event_info_reply;
     struct create_mutex_reply create_mutex_reply;
     struct release_mutex_reply release_mutex_reply;
     struct open_mutex_reply open_mutex_reply;
     struct create_semaphore_reply create_semaphore_reply;
     struct release_semaphore_reply release_semaphore_reply;
     struct open_semaphore_reply open_semaphore_reply;
+    struct get_fast_sync_shm_reply get_fast_sync_shm_reply;
+    struct get_fast_sync_obj_reply get_fast_sync_obj_reply;
+    struct wake_fast_sync_obj_reply wake_fast_sync_obj_reply;
     struct create_file_reply create_file_reply;
     struct open_file_object_reply open_file_object_reply;
     struct alloc_file_handle_reply alloc_file_handle_reply;
@@ -5585,6 +5844,7 @@ union generic_reply
     struct get_msg_queue_reply get_msg_queue_reply;
     struct set_queue_fd_reply set_queue_fd_reply;
     struct set_queue_mask_reply set_queue_mask_reply;
+    struct get_queue_shm_reply get_queue_shm_reply;
     struct get_queue_status_reply get_queue_status_reply;
     struct get_process_idle_event_reply get_process_idle_event_reply;
     struct send_message_reply send_message_reply;
@@ -5713,8 +5973,9 @@ union generic_reply
     struct update_rawinput_devices_reply update_rawinput_devices_reply;
     struct get_suspend_context_reply get_suspend_context_reply;
     struct set_suspend_context_reply set_suspend_context_reply;
+    struct batch_reply batch_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 440
+#define SERVER_PROTOCOL_VERSION 453
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
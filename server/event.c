@@ -22,6 +22,7 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -38,25 +39,28 @@
 
 struct event
 {
-    struct object  obj;             /* object header */
-    int            manual_reset;    /* is it a manual reset event? */
-    int            signaled;        /* event has been signaled */
+    struct object            obj;           /* object header */
+    struct fast_sync_object *sync;          /* manual-reset flag and state, possibly shared with the clients */
+    struct fast_sync_object  private_sync;  /* storage for the state when it isn't shared */
 };
 
 static void event_dump( struct object *obj, int verbose );
 static struct object_type *event_get_type( struct object *obj );
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int event_signaled( struct object *obj, struct thread *thread );
 static int event_satisfied( struct object *obj, struct thread *thread );
 static unsigned int event_map_access( struct object *obj, unsigned int access );
 static int event_signal( struct object *obj, unsigned int access);
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
     sizeof(struct event),      /* size */
     event_dump,                /* dump */
     event_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    event_add_queue,           /* add_queue */
+    event_remove_queue,        /* remove_queue */
     event_signaled,            /* signaled */
     event_satisfied,           /* satisfied */
     event_signal,              /* signal */
@@ -67,7 +71,43 @@ static const struct object_ops event_ops =
     no_lookup_name,            /* lookup_name */
     no_open_file,              /* open_file */
     no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_destroy              /* destroy */
+};
+
+
+struct keyed_event
+{
+    struct object  obj;             /* object header */
+    unsigned int   id;              /* unique id, used by the clients to match their waits */
+    int            shared;          /* named, so the waits have to be done in the server */
+};
+
+static void keyed_event_dump( struct object *obj, int verbose );
+static struct object_type *keyed_event_get_type( struct object *obj );
+static int keyed_event_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static int keyed_event_signaled( struct object *obj, struct thread *thread );
+static unsigned int keyed_event_map_access( struct object *obj, unsigned int access );
+
+/* unnamed keyed events are waited on in the client; named ones can be shared, so
+ * their waits go through the server */
+static const struct object_ops keyed_event_ops =
+{
+    sizeof(struct keyed_event),  /* size */
+    keyed_event_dump,            /* dump */
+    keyed_event_get_type,        /* get_type */
+    keyed_event_add_queue,       /* add_queue */
+    remove_queue,                /* remove_queue */
+    keyed_event_signaled,        /* signaled */
+    no_satisfied,                /* satisfied */
+    no_signal,                   /* signal */
+    no_get_fd,                   /* get_fd */
+    keyed_event_map_access,      /* map_access */
+    default_get_sd,              /* get_sd */
+    default_set_sd,              /* set_sd */
+    no_lookup_name,              /* lookup_name */
+    no_open_file,                /* open_file */
+    no_close_handle,             /* close_handle */
+    no_destroy                   /* destroy */
 };
 
 
@@ -82,8 +122,9 @@ struct event *create_event( struct directory *root, const struct unicode_str *na
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            event->manual_reset = manual_reset;
-            event->signaled     = initial_state;
+            event->sync = alloc_fast_sync_object( &event->private_sync, FAST_SYNC_EVENT );
+            event->sync->max   = manual_reset;
+            event->sync->value = initial_state ? FAST_SYNC_EVENT_SIGNALED : 0;
             if (sd) default_set_sd( &event->obj, sd, OWNER_SECURITY_INFORMATION|
                                                      GROUP_SECURITY_INFORMATION|
                                                      DACL_SECURITY_INFORMATION|
@@ -98,32 +139,72 @@ struct event *get_event_obj( struct process *process, obj_handle_t handle, unsig
     return (struct event *)get_handle_obj( process, handle, access, &event_ops );
 }
 
-void pulse_event( struct event *event )
+struct fast_sync_object *get_event_fast_sync( struct object *obj )
 {
-    event->signaled = 1;
+    if (obj->ops != &event_ops) return NULL;
+    return ((struct event *)obj)->sync;
+}
+
+/* set the signaled state and bump the set count, so that the client waiters notice even a pulse */
+static void signal_event_state( struct event *event )
+{
+    int value;
+
+    do value = event->sync->value;
+    while (interlocked_cmpxchg( &event->sync->value,
+                                (int)((unsigned int)value + 2) | FAST_SYNC_EVENT_SIGNALED,
+                                value ) != value);
+
     /* wake up all waiters if manual reset, a single one otherwise */
-    wake_up( &event->obj, !event->manual_reset );
-    event->signaled = 0;
+    wake_up( &event->obj, !event->sync->max );
+    fast_sync_wake( event->sync, event->sync->max ? INT_MAX : 1 );
+}
+
+void pulse_event( struct event *event )
+{
+    int value;
+
+    signal_event_state( event );
+
+    /* the client waiters of a manual-reset event notice the set count change */
+    if (event->sync->max)
+    {
+        reset_event( event );
+        return;
+    }
+
+    /* leave an auto-reset pulse that no waiter took for a client waiter to claim */
+    do
+    {
+        value = event->sync->value;
+        if (!(value & FAST_SYNC_EVENT_SIGNALED)) return;
+    }
+    while (interlocked_cmpxchg( &event->sync->value, value & ~FAST_SYNC_EVENT_SIGNALED,
+                                value ) != value);
+    interlocked_xchg( (int *)&event->sync->count, value & ~FAST_SYNC_EVENT_SIGNALED );
+    fast_sync_wake( event->sync, INT_MAX );
 }
 
 void set_event( struct event *event )
 {
-    event->signaled = 1;
-    /* wake up all waiters if manual reset, a single one otherwise */
-    wake_up( &event->obj, !event->manual_reset );
+    signal_event_state( event );
 }
 
 void reset_event( struct event *event )
 {
-    event->signaled = 0;
+    int value;
+
+    do value = event->sync->value;
+    while (interlocked_cmpxchg( &event->sync->value, value & ~FAST_SYNC_EVENT_SIGNALED,
+                                value ) != value);
 }
 
 static void event_dump( struct object *obj, int verbose )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    fprintf( stderr, "Event manual=%d signaled=%d ",
-             event->manual_reset, event->signaled );
+    fprintf( stderr, "Event manual=%d signaled=%d ", event->sync->max,
+             event->sync->value & FAST_SYNC_EVENT_SIGNALED );
     dump_object_name( &event->obj );
     fputc( '\n', stderr );
 }
@@ -135,19 +216,43 @@ static struct object_type *event_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    return fast_sync_add_queue( obj, entry, event->sync );
+}
+
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    fast_sync_remove_queue( obj, entry, event->sync );
+}
+
 static int event_signaled( struct object *obj, struct thread *thread )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    return event->signaled;
+    return event->sync->value & FAST_SYNC_EVENT_SIGNALED;
 }
 
 static int event_satisfied( struct object *obj, struct thread *thread )
 {
     struct event *event = (struct event *)obj;
+    int value;
+
     assert( obj->ops == &event_ops );
+    if (event->sync->max) return 0;  /* Not abandoned */
+
     /* Reset if it's an auto-reset event */
-    if (!event->manual_reset) event->signaled = 0;
+    do
+    {
+        value = event->sync->value;
+        if (!(value & FAST_SYNC_EVENT_SIGNALED)) return -1;  /* already taken by a client */
+    }
+    while (interlocked_cmpxchg( &event->sync->value, value & ~FAST_SYNC_EVENT_SIGNALED,
+                                value ) != value);
     return 0;  /* Not abandoned */
 }
 
@@ -174,6 +279,103 @@ static int event_signal( struct object *obj, unsigned int access )
     return 1;
 }
 
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    free_fast_sync_object( event->sync );
+}
+
+static struct keyed_event *create_keyed_event( struct directory *root, const struct unicode_str *name,
+                                               unsigned int attr, const struct security_descriptor *sd )
+{
+    static unsigned int last_id;
+    struct keyed_event *event;
+
+    if ((event = create_named_object_dir( root, name, attr, &keyed_event_ops )))
+    {
+        if (get_error() != STATUS_OBJECT_NAME_EXISTS)
+        {
+            /* initialize it if it didn't already exist */
+            event->id     = ++last_id;
+            event->shared = (event->obj.name != NULL);
+            if (sd) default_set_sd( &event->obj, sd, OWNER_SECURITY_INFORMATION|
+                                                     GROUP_SECURITY_INFORMATION|
+                                                     DACL_SECURITY_INFORMATION|
+                                                     SACL_SECURITY_INFORMATION );
+        }
+    }
+    return event;
+}
+
+struct object *get_keyed_event_obj( struct process *process, obj_handle_t handle, unsigned int access )
+{
+    return get_handle_obj( process, handle, access, &keyed_event_ops );
+}
+
+static void keyed_event_dump( struct object *obj, int verbose )
+{
+    assert( obj->ops == &keyed_event_ops );
+    fputs( "Keyed event ", stderr );
+    dump_object_name( obj );
+    fputc( '\n', stderr );
+}
+
+static struct object_type *keyed_event_get_type( struct object *obj )
+{
+    static const WCHAR name[] = {'K','e','y','e','d','E','v','e','n','t'};
+    static const struct unicode_str str = { name, sizeof(name) };
+    return get_object_type( &str );
+}
+
+static int keyed_event_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    client_ptr_t key;
+
+    assert( obj->ops == &keyed_event_ops );
+    /* keyed events can only be waited on with a key */
+    if (!get_wait_queue_keyed_op( entry, &key ))
+    {
+        set_error( STATUS_OBJECT_TYPE_MISMATCH );
+        return 0;
+    }
+    return add_queue( obj, entry );
+}
+
+/* a keyed event operation is satisfied once a thread of the same process does the opposite one */
+static int keyed_event_signaled( struct object *obj, struct thread *thread )
+{
+    struct wait_queue_entry *entry;
+    client_ptr_t key, other_key;
+    int op = 0, other_op;
+
+    assert( obj->ops == &keyed_event_ops );
+
+    LIST_FOR_EACH_ENTRY( entry, &obj->wait_queue, struct wait_queue_entry, entry )
+    {
+        if (entry->thread == thread && (op = get_wait_queue_keyed_op( entry, &key ))) break;
+    }
+    if (!op) return 0;
+
+    LIST_FOR_EACH_ENTRY( entry, &obj->wait_queue, struct wait_queue_entry, entry )
+    {
+        if (entry->thread->process != thread->process) continue;
+        if (!(other_op = get_wait_queue_keyed_op( entry, &other_key ))) continue;
+        if (other_op == op || other_key != key) continue;
+        if (wake_thread_queue_entry( entry )) return 1;
+    }
+    return 0;
+}
+
+static unsigned int keyed_event_map_access( struct object *obj, unsigned int access )
+{
+    if (access & GENERIC_READ)    access |= STANDARD_RIGHTS_READ | KEYEDEVENT_WAIT;
+    if (access & GENERIC_WRITE)   access |= STANDARD_RIGHTS_WRITE | KEYEDEVENT_WAKE;
+    if (access & GENERIC_EXECUTE) access |= STANDARD_RIGHTS_EXECUTE;
+    if (access & GENERIC_ALL)     access |= KEYEDEVENT_ALL_ACCESS;
+    return access & ~(GENERIC_READ | GENERIC_WRITE | GENERIC_EXECUTE | GENERIC_ALL);
+}
+
 /* create an event */
 DECL_HANDLER(create_event)
 {
@@ -249,3 +451,80 @@ DECL_HANDLER(event_op)
     }
     release_object( event );
 }
+
+/* create a keyed event */
+DECL_HANDLER(create_keyed_event)
+{
+    struct keyed_event *event;
+    struct unicode_str name;
+    struct directory *root = NULL;
+    const struct object_attributes *objattr = get_req_data();
+    const struct security_descriptor *sd;
+
+    reply->handle = 0;
+
+    if (!objattr_is_valid( objattr, get_req_data_size() ))
+        return;
+
+    sd = objattr->sd_len ? (const struct security_descriptor *)(objattr + 1) : NULL;
+    objattr_get_name( objattr, &name );
+
+    if (objattr->rootdir && !(root = get_directory_obj( current->process, objattr->rootdir, 0 )))
+        return;
+
+    if ((event = create_keyed_event( root, &name, req->attributes, sd )))
+    {
+        if (get_error() == STATUS_OBJECT_NAME_EXISTS)
+            reply->handle = alloc_handle( current->process, event, req->access, req->attributes );
+        else
+            reply->handle = alloc_handle_no_access_check( current->process, event, req->access, req->attributes );
+        if (reply->handle)
+        {
+            reply->id     = event->id;
+            reply->access = get_handle_access( current->process, reply->handle );
+            reply->shared = event->shared;
+        }
+        release_object( event );
+    }
+
+    if (root) release_object( root );
+}
+
+/* open a handle to a keyed event */
+DECL_HANDLER(open_keyed_event)
+{
+    struct unicode_str name;
+    struct directory *root = NULL;
+    struct keyed_event *event;
+
+    get_req_unicode_str( &name );
+    if (req->rootdir && !(root = get_directory_obj( current->process, req->rootdir, 0 )))
+        return;
+
+    if ((event = open_object_dir( root, &name, req->attributes, &keyed_event_ops )))
+    {
+        if ((reply->handle = alloc_handle( current->process, &event->obj, req->access, req->attributes )))
+        {
+            reply->id     = event->id;
+            reply->access = get_handle_access( current->process, reply->handle );
+            reply->shared = event->shared;
+        }
+        release_object( event );
+    }
+
+    if (root) release_object( root );
+}
+
+/* get the identity of a keyed event */
+DECL_HANDLER(get_keyed_event_info)
+{
+    struct keyed_event *event;
+
+    if ((event = (struct keyed_event *)get_keyed_event_obj( current->process, req->handle, req->access )))
+    {
+        reply->id     = event->id;
+        reply->access = get_handle_access( current->process, req->handle );
+        reply->shared = event->shared;
+        release_object( event );
+    }
+}
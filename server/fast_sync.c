@@ -0,0 +1,231 @@
+/*
+ * Server-side fast synchronization objects
+ *
+ * Copyright (C) 2026 the Wine project authors (see the file AUTHORS for a complete list)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * When the server is started with WINEFASTSYNC set, the state of events,
+ * semaphores and mutexes is stored in a shared memory area that every
+ * client process maps. The clients then signal and acquire uncontended
+ * objects with atomic operations, and sleep on the object state with
+ * futexes, without any server round-trip. The server keeps accessing the
+ * state for the waits that still go through it (alertable waits, waits on
+ * other object types, wait-all), so all the updates done here are atomic
+ * too. The waiters field tells a client that it has to ask the server to
+ * check its wait queues after signaling an object.
+ */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "file.h"
+#include "handle.h"
+#include "thread.h"
+#include "request.h"
+
+static struct fast_sync_object *fast_sync_shm;  /* shared memory, NULL if disabled */
+static int fast_sync_fd = -1;                   /* fd of the shared memory file */
+static unsigned int fast_sync_used;             /* number of entries used at least once */
+static int fast_sync_free = -1;                 /* first free entry, linked through the max field */
+
+#define FAST_SYNC_COUNT (FAST_SYNC_SHM_SIZE / sizeof(struct fast_sync_object))
+
+/* create the shared memory if fast synchronization is enabled */
+void init_fast_sync(void)
+{
+#if defined(__linux__) && defined(__NR_futex)
+    const char *env = getenv( "WINEFASTSYNC" );
+    void *ptr;
+
+    if (!env || !atoi( env )) return;
+    if ((fast_sync_fd = create_temp_file( FAST_SYNC_SHM_SIZE )) == -1)
+    {
+        fprintf( stderr, "wineserver: failed to create the fast synchronization memory, disabling it\n" );
+        return;
+    }
+    if ((ptr = mmap( NULL, FAST_SYNC_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fast_sync_fd, 0 )) == MAP_FAILED)
+    {
+        fprintf( stderr, "wineserver: failed to map the fast synchronization memory, disabling it\n" );
+        close( fast_sync_fd );
+        fast_sync_fd = -1;
+        return;
+    }
+    fast_sync_shm = ptr;
+#endif
+}
+
+static inline int is_fast_sync_shared( const struct fast_sync_object *obj )
+{
+    return fast_sync_shm && obj >= fast_sync_shm && obj < fast_sync_shm + FAST_SYNC_COUNT;
+}
+
+/* allocate the state of a synchronization object, in the shared memory if possible */
+struct fast_sync_object *alloc_fast_sync_object( struct fast_sync_object *private_obj, int type )
+{
+    struct fast_sync_object *obj = private_obj;
+
+    if (fast_sync_shm)
+    {
+        if (fast_sync_free != -1)
+        {
+            obj = &fast_sync_shm[fast_sync_free];
+            fast_sync_free = (int)obj->max;
+        }
+        else if (fast_sync_used < FAST_SYNC_COUNT) obj = &fast_sync_shm[fast_sync_used++];
+    }
+    memset( obj, 0, sizeof(*obj) );
+    obj->type = type;
+    return obj;
+}
+
+/* release the state of a synchronization object */
+void free_fast_sync_object( struct fast_sync_object *obj )
+{
+    if (!is_fast_sync_shared( obj )) return;
+    obj->type = FAST_SYNC_NONE;
+    obj->max = fast_sync_free;
+    fast_sync_free = obj - fast_sync_shm;
+}
+
+/* wake up to count client threads sleeping on the object value; the state has already been
+ * updated with an interlocked operation, so sleepers is up to date */
+void fast_sync_wake( struct fast_sync_object *obj, int count )
+{
+#if defined(__linux__) && defined(__NR_futex)
+    if (is_fast_sync_shared( obj ) && obj->sleepers)
+        syscall( __NR_futex, &obj->value, 1 /* FUTEX_WAKE */, count, NULL, 0, 0 );
+#endif
+}
+
+/* get the state of an event, semaphore or mutex if it is in the shared memory */
+struct fast_sync_object *get_shared_fast_sync( struct object *obj )
+{
+    struct fast_sync_object *sync;
+
+    if (!(sync = get_event_fast_sync( obj )) &&
+        !(sync = get_semaphore_fast_sync( obj )) &&
+        !(sync = get_mutex_fast_sync( obj )))
+        return NULL;
+    return is_fast_sync_shared( sync ) ? sync : NULL;
+}
+
+/* give back an object acquired by a wait that can't be satisfied after all */
+void fast_sync_undo_satisfied( struct fast_sync_object *obj, int abandoned )
+{
+    int value;
+
+    switch (obj->type)
+    {
+    case FAST_SYNC_EVENT:
+        if (obj->max) return;  /* manual-reset events aren't acquired */
+        do value = obj->value;
+        while (interlocked_cmpxchg( &obj->value, value | FAST_SYNC_EVENT_SIGNALED, value ) != value);
+        break;
+    case FAST_SYNC_SEMAPHORE:
+        interlocked_xchg_add( &obj->value, 1 );
+        break;
+    case FAST_SYNC_MUTEX:
+        if (--obj->count) return;  /* it was already owned */
+        if (abandoned) obj->abandoned = 1;
+        interlocked_xchg( &obj->value, 0 );
+        break;
+    default:
+        return;
+    }
+    fast_sync_wake( obj, 1 );
+}
+
+/* add a server wait queue entry; clients check the count after signaling the object */
+int fast_sync_add_queue( struct object *obj, struct wait_queue_entry *entry, struct fast_sync_object *sync )
+{
+    /* the interlocked op orders the count update with the state checks of the wait */
+    interlocked_xchg_add( &sync->waiters, 1 );
+    return add_queue( obj, entry );
+}
+
+/* remove a server wait queue entry */
+void fast_sync_remove_queue( struct object *obj, struct wait_queue_entry *entry, struct fast_sync_object *sync )
+{
+    interlocked_xchg_add( &sync->waiters, -1 );
+    remove_queue( obj, entry );
+}
+
+/* get the shared memory of the fast synchronization objects */
+DECL_HANDLER(get_fast_sync_shm)
+{
+    if (fast_sync_fd == -1)
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        return;
+    }
+    if (send_client_fd( current->process, fast_sync_fd, 0 ) == -1) return;
+    reply->size = FAST_SYNC_SHM_SIZE;
+}
+
+/* get the shared memory entry of an event, semaphore or mutex */
+DECL_HANDLER(get_fast_sync_obj)
+{
+    struct fast_sync_object *sync;
+    struct object *obj;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+
+    if (!(sync = get_event_fast_sync( obj )) &&
+        !(sync = get_semaphore_fast_sync( obj )) &&
+        !(sync = get_mutex_fast_sync( obj )))
+        set_error( STATUS_OBJECT_TYPE_MISMATCH );
+    else if (!is_fast_sync_shared( sync ))
+        set_error( STATUS_NOT_SUPPORTED );
+    else
+    {
+        reply->index  = sync - fast_sync_shm;
+        reply->type   = sync->type;
+        reply->access = get_handle_access( current->process, req->handle );
+    }
+    release_object( obj );
+}
+
+/* wake the server waiters of an object signaled by a client */
+DECL_HANDLER(wake_fast_sync_obj)
+{
+    struct object *obj;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+    wake_up( obj, 0 );
+    release_object( obj );
+}
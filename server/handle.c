@@ -45,14 +45,17 @@ struct handle_entry
     unsigned int   access;    /* access rights */
 };
 
+struct handle_chunk;
+
 struct handle_table
 {
-    struct object        obj;         /* object header */
-    struct process      *process;     /* process owning this table */
-    int                  count;       /* number of allocated entries */
-    int                  last;        /* last used entry */
-    int                  free;        /* first entry that may be free */
-    struct handle_entry *entries;     /* handle entries */
+    struct object         obj;         /* object header */
+    struct process       *process;     /* process owning this table */
+    int                   count;       /* number of allocated entries */
+    int                   last;        /* last used entry */
+    int                   free;        /* first entry that may be free */
+    int                   nb_chunks;   /* size of the chunks array */
+    struct handle_chunk **chunks;      /* handle entries, allocated by chunks that never move */
 };
 
 static struct handle_table *global_table;
@@ -63,9 +66,45 @@ static struct handle_table *global_table;
 #define RESERVED_CLOSE_PROTECT (HANDLE_FLAG_PROTECT_FROM_CLOSE << RESERVED_SHIFT)
 #define RESERVED_ALL           (RESERVED_INHERIT | RESERVED_CLOSE_PROTECT)
 
-#define MIN_HANDLE_ENTRIES  32
+#define MIN_HANDLE_CHUNKS   4
 #define MAX_HANDLE_ENTRIES  0x00ffffff
 
+/* handle entries are allocated in chunks, so that growing the table never moves them */
+#define HANDLE_CHUNK_SHIFT  8
+#define HANDLE_CHUNK_SIZE   (1 << HANDLE_CHUNK_SHIFT)
+#define HANDLE_CHUNK_MASK   (HANDLE_CHUNK_SIZE - 1)
+
+struct handle_chunk
+{
+    int                 used;          /* number of entries in use, to skip full chunks */
+    unsigned int        free_map[HANDLE_CHUNK_SIZE / 32];  /* bitmap of the free entries */
+    struct handle_entry entries[HANDLE_CHUNK_SIZE];
+};
+
+/* return the entry for an index */
+static inline struct handle_entry *get_entry( struct handle_table *table, int index )
+{
+    return &table->chunks[index >> HANDLE_CHUNK_SHIFT]->entries[index & HANDLE_CHUNK_MASK];
+}
+
+/* mark an entry as used in its chunk */
+static inline void set_entry_used( struct handle_table *table, int index )
+{
+    struct handle_chunk *chunk = table->chunks[index >> HANDLE_CHUNK_SHIFT];
+
+    chunk->free_map[(index & HANDLE_CHUNK_MASK) / 32] &= ~(1u << (index % 32));
+    chunk->used++;
+}
+
+/* mark an entry as free in its chunk */
+static inline void set_entry_free( struct handle_table *table, int index )
+{
+    struct handle_chunk *chunk = table->chunks[index >> HANDLE_CHUNK_SHIFT];
+
+    chunk->free_map[(index & HANDLE_CHUNK_MASK) / 32] |= 1u << (index % 32);
+    chunk->used--;
+}
+
 
 /* handle to table index conversion */
 
@@ -133,9 +172,9 @@ static void handle_table_dump( struct object *obj, int verbose )
     fprintf( stderr, "Handle table last=%d count=%d process=%p\n",
              table->last, table->count, table->process );
     if (!verbose) return;
-    entry = table->entries;
-    for (i = 0; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         fprintf( stderr, "    %04x: %p %08x ",
                  index_to_handle(i), entry->ptr, entry->access );
@@ -155,20 +194,23 @@ static void handle_table_destroy( struct object *obj )
     /* first notify all objects that handles are being closed */
     if (table->process)
     {
-        for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+        for (i = 0; i <= table->last; i++)
         {
-            struct object *obj = entry->ptr;
+            struct object *obj = get_entry( table, i )->ptr;
             if (obj) obj->ops->close_handle( obj, table->process, index_to_handle(i) );
         }
     }
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
-        struct object *obj = entry->ptr;
+        struct object *obj;
+        entry = get_entry( table, i );
+        obj = entry->ptr;
         entry->ptr = NULL;
         if (obj) release_object( obj );
     }
-    free( table->entries );
+    for (i = 0; i < table->count >> HANDLE_CHUNK_SHIFT; i++) free( table->chunks[i] );
+    free( table->chunks );
 }
 
 /* close all the process handles and free the handle table */
@@ -184,51 +226,69 @@ void close_process_handles( struct process *process )
 struct handle_table *alloc_handle_table( struct process *process, int count )
 {
     struct handle_table *table;
+    int nb_chunks = (count + HANDLE_CHUNK_MASK) >> HANDLE_CHUNK_SHIFT;
 
-    if (count < MIN_HANDLE_ENTRIES) count = MIN_HANDLE_ENTRIES;
+    if (nb_chunks < MIN_HANDLE_CHUNKS) nb_chunks = MIN_HANDLE_CHUNKS;
     if (!(table = alloc_object( &handle_table_ops )))
         return NULL;
-    table->process = process;
-    table->count   = count;
-    table->last    = -1;
-    table->free    = 0;
-    if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
+    table->process   = process;
+    table->count     = 0;
+    table->last      = -1;
+    table->free      = 0;
+    table->nb_chunks = nb_chunks;
+    if ((table->chunks = mem_alloc( nb_chunks * sizeof(*table->chunks) ))) return table;
     release_object( table );
     return NULL;
 }
 
-/* grow a handle table */
+/* grow a handle table by one chunk of entries */
 static int grow_handle_table( struct handle_table *table )
 {
-    struct handle_entry *new_entries;
-    int count = min( table->count * 2, MAX_HANDLE_ENTRIES );
+    struct handle_chunk *chunk;
+    int nb = table->count >> HANDLE_CHUNK_SHIFT;
 
-    if (count == table->count ||
-        !(new_entries = realloc( table->entries, count * sizeof(struct handle_entry) )))
+    if (table->count + HANDLE_CHUNK_SIZE > MAX_HANDLE_ENTRIES) goto error;
+    if (nb == table->nb_chunks)
     {
-        set_error( STATUS_INSUFFICIENT_RESOURCES );
-        return 0;
+        struct handle_chunk **new_chunks;
+        if (!(new_chunks = realloc( table->chunks, 2 * nb * sizeof(*new_chunks) ))) goto error;
+        table->chunks    = new_chunks;
+        table->nb_chunks = 2 * nb;
     }
-    table->entries = new_entries;
-    table->count   = count;
+    if (!(chunk = malloc( sizeof(*chunk) ))) goto error;
+    chunk->used = 0;
+    memset( chunk->free_map, 0xff, sizeof(chunk->free_map) );
+    table->chunks[nb] = chunk;
+    table->count += HANDLE_CHUNK_SIZE;
     return 1;
+
+error:
+    set_error( STATUS_INSUFFICIENT_RESOURCES );
+    return 0;
 }
 
 /* allocate the first free entry in the handle table */
 static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned int access )
 {
-    struct handle_entry *entry = table->entries + table->free;
-    int i;
+    struct handle_entry *entry;
+    struct handle_chunk *chunk;
+    int i, word;
 
-    for (i = table->free; i <= table->last; i++, entry++) if (!entry->ptr) goto found;
-    if (i >= table->count)
+    for (i = table->free; i < table->count; i = (i | HANDLE_CHUNK_MASK) + 1)
     {
-        if (!grow_handle_table( table )) return 0;
-        entry = table->entries + i;  /* the entries may have moved */
+        chunk = table->chunks[i >> HANDLE_CHUNK_SHIFT];
+        if (chunk->used == HANDLE_CHUNK_SIZE) continue;
+        /* the entries before table->free are all in use, so this finds the lowest free one */
+        for (word = (i & HANDLE_CHUNK_MASK) / 32; !chunk->free_map[word]; word++) /* nothing */;
+        i = (i & ~HANDLE_CHUNK_MASK) + word * 32 + ffs( chunk->free_map[word] ) - 1;
+        goto found;
     }
-    table->last = i;
+    if (!grow_handle_table( table )) return 0;
  found:
+    if (i > table->last) table->last = i;
     table->free = i + 1;
+    set_entry_used( table, i );
+    entry = get_entry( table, i );
     entry->ptr    = grab_object( obj );
     entry->access = access;
     return index_to_handle(i);
@@ -299,7 +359,7 @@ static struct handle_entry *get_handle( struct process *process, obj_handle_t ha
     index = handle_to_index( handle );
     if (index < 0) return NULL;
     if (index > table->last) return NULL;
-    entry = table->entries + index;
+    entry = get_entry( table, index );
     if (!entry->ptr) return NULL;
     return entry;
 }
@@ -307,22 +367,14 @@ static struct handle_entry *get_handle( struct process *process, obj_handle_t ha
 /* attempt to shrink a table */
 static void shrink_handle_table( struct handle_table *table )
 {
-    struct handle_entry *entry = table->entries + table->last;
-    struct handle_entry *new_entries;
-    int count = table->count;
+    int i, nb = table->count >> HANDLE_CHUNK_SHIFT;
 
-    while (table->last >= 0)
-    {
-        if (entry->ptr) break;
-        table->last--;
-        entry--;
-    }
-    if (table->last >= count / 4) return;  /* no need to shrink */
-    if (count < MIN_HANDLE_ENTRIES * 2) return;  /* too small to shrink */
-    count /= 2;
-    if (!(new_entries = realloc( table->entries, count * sizeof(*new_entries) ))) return;
-    table->count   = count;
-    table->entries = new_entries;
+    while (table->last >= 0 && !get_entry( table, table->last )->ptr) table->last--;
+    if (table->free > table->last + 1) table->free = table->last + 1;
+    if (table->last >= table->count / 4) return;  /* no need to shrink */
+    if (nb < 2) return;  /* too small to shrink */
+    for (i = nb / 2; i < nb; i++) free( table->chunks[i] );
+    table->count = (nb / 2) << HANDLE_CHUNK_SHIFT;
 }
 
 /* copy the handle table of the parent process */
@@ -336,22 +388,29 @@ struct handle_table *copy_handle_table( struct process *process, struct process
     assert( parent_table );
     assert( parent_table->obj.ops == &handle_table_ops );
 
-    if (!(table = alloc_handle_table( process, parent_table->count )))
+    if (!(table = alloc_handle_table( process, parent_table->last + 1 )))
         return NULL;
 
-    if ((table->last = parent_table->last) >= 0)
+    while (table->count <= parent_table->last)
+    {
+        if (grow_handle_table( table )) continue;
+        release_object( table );
+        return NULL;
+    }
+    for (i = 0; i <= parent_table->last; i++)
     {
-        struct handle_entry *ptr = table->entries;
-        memcpy( ptr, parent_table->entries, (table->last + 1) * sizeof(struct handle_entry) );
-        for (i = 0; i <= table->last; i++, ptr++)
+        struct handle_entry *src = get_entry( parent_table, i );
+        struct handle_entry *dst = get_entry( table, i );
+
+        if (src->ptr && (src->access & RESERVED_INHERIT))
         {
-            if (!ptr->ptr) continue;
-            if (ptr->access & RESERVED_INHERIT) grab_object( ptr->ptr );
-            else ptr->ptr = NULL; /* don't inherit this entry */
+            dst->ptr    = grab_object( src->ptr );
+            dst->access = src->access;
+            set_entry_used( table, i );
+            table->last = i;
         }
+        else dst->ptr = NULL; /* don't inherit this entry */
     }
-    /* attempt to shrink the table */
-    shrink_handle_table( table );
     return table;
 }
 
@@ -361,15 +420,26 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     struct handle_table *table;
     struct handle_entry *entry;
     struct object *obj;
+    int index;
 
     if (!(entry = get_handle( process, handle ))) return STATUS_INVALID_HANDLE;
     if (entry->access & RESERVED_CLOSE_PROTECT) return STATUS_HANDLE_NOT_CLOSABLE;
     obj = entry->ptr;
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
+    if (handle_is_global(handle))
+    {
+        table = global_table;
+        index = handle_to_index( handle_global_to_local(handle) );
+    }
+    else
+    {
+        table = process->handles;
+        index = handle_to_index( handle );
+    }
     entry->ptr = NULL;
-    table = handle_is_global(handle) ? global_table : process->handles;
-    if (entry < table->entries + table->free) table->free = entry - table->entries;
-    if (entry == table->entries + table->last) shrink_handle_table( table );
+    set_entry_free( table, index );
+    if (index < table->free) table->free = index;
+    if (index == table->last) shrink_handle_table( table );
     release_object( obj );
     return STATUS_SUCCESS;
 }
@@ -443,8 +513,9 @@ obj_handle_t find_inherited_handle( struct process *process, const struct object
 
     if (!table) return 0;
 
-    for (i = 0, ptr = table->entries; i <= table->last; i++, ptr++)
+    for (i = 0; i <= table->last; i++)
     {
+        ptr = get_entry( table, i );
         if (!ptr->ptr) continue;
         if (ptr->ptr->ops != ops) continue;
         if (ptr->access & RESERVED_INHERIT) return index_to_handle(i);
@@ -463,8 +534,9 @@ obj_handle_t enumerate_handles( struct process *process, const struct object_ops
 
     if (!table) return 0;
 
-    for (i = *index, entry = &table->entries[i]; i <= table->last; i++, entry++)
+    for (i = *index; (int)i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         if (entry->ptr->ops != ops) continue;
         *index = i + 1;
@@ -145,6 +145,7 @@ int main( int argc, char *argv[] )
     init_signals();
     init_directories();
     init_registry();
+    init_fast_sync();
     main_loop();
     return 0;
 }
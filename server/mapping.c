@@ -155,7 +155,7 @@ static int check_current_dir_for_exec(void)
 }
 
 /* create a temp file for anonymous mappings */
-static int create_temp_file( file_pos_t size )
+int create_temp_file( file_pos_t size )
 {
     static int temp_dir_fd = -1;
     char tmpfn[] = "anonmap.XXXXXX";
@@ -563,6 +563,27 @@ struct mapping *grab_mapping_unless_removable( struct mapping *mapping )
     return (struct mapping *)grab_object( mapping );
 }
 
+/* create an anonymous mapping that is also mapped in the server address space */
+struct mapping *create_server_mapping( mem_size_t size, void **ptr )
+{
+    static const struct unicode_str empty_name;
+    struct mapping *mapping;
+    void *base;
+    int unix_fd;
+
+    if (!(mapping = (struct mapping *)create_mapping( NULL, &empty_name, 0, size,
+                                                      VPROT_READ | VPROT_WRITE | VPROT_COMMITTED, 0, NULL )))
+        return NULL;
+    if ((unix_fd = get_unix_fd( mapping->fd )) == -1 ||
+        (base = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, unix_fd, 0 )) == MAP_FAILED)
+    {
+        release_object( mapping );
+        return NULL;
+    }
+    *ptr = base;
+    return mapping;
+}
+
 static void mapping_dump( struct object *obj, int verbose )
 {
     struct mapping *mapping = (struct mapping *)obj;
@@ -38,15 +38,19 @@
 
 struct mutex
 {
-    struct object  obj;             /* object header */
-    struct thread *owner;           /* mutex owner */
-    unsigned int   count;           /* recursion count */
-    int            abandoned;       /* has it been abandoned? */
-    struct list    entry;           /* entry in owner thread mutex list */
+    struct object            obj;           /* object header */
+    struct fast_sync_object *sync;          /* owner id, recursion count and abandoned flag */
+    struct fast_sync_object  private_sync;  /* storage for the state when it isn't shared */
+    struct list              entry;         /* entry in owner thread mutex list, or in shared list */
 };
 
+/* mutexes shared with the clients, which can change the owner without telling us */
+static struct list shared_mutexes = LIST_INIT( shared_mutexes );
+
 static void mutex_dump( struct object *obj, int verbose );
 static struct object_type *mutex_get_type( struct object *obj );
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int mutex_signaled( struct object *obj, struct thread *thread );
 static int mutex_satisfied( struct object *obj, struct thread *thread );
 static unsigned int mutex_map_access( struct object *obj, unsigned int access );
@@ -58,8 +62,8 @@ static const struct object_ops mutex_ops =
     sizeof(struct mutex),      /* size */
     mutex_dump,                /* dump */
     mutex_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    mutex_add_queue,           /* add_queue */
+    mutex_remove_queue,        /* remove_queue */
     mutex_signaled,            /* signaled */
     mutex_satisfied,           /* satisfied */
     mutex_signal,              /* signal */
@@ -74,6 +78,11 @@ static const struct object_ops mutex_ops =
 };
 
 
+static inline int is_mutex_shared( struct mutex *mutex )
+{
+    return mutex->sync != &mutex->private_sync;
+}
+
 static struct mutex *create_mutex( struct directory *root, const struct unicode_str *name,
                                    unsigned int attr, int owned, const struct security_descriptor *sd )
 {
@@ -84,9 +93,8 @@ static struct mutex *create_mutex( struct directory *root, const struct unicode_
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            mutex->count = 0;
-            mutex->owner = NULL;
-            mutex->abandoned = 0;
+            mutex->sync = alloc_fast_sync_object( &mutex->private_sync, FAST_SYNC_MUTEX );
+            if (is_mutex_shared( mutex )) list_add_tail( &shared_mutexes, &mutex->entry );
             if (owned) mutex_satisfied( &mutex->obj, current );
             if (sd) default_set_sd( &mutex->obj, sd, OWNER_SECURITY_INFORMATION|
                                                      GROUP_SECURITY_INFORMATION|
@@ -100,32 +108,48 @@ static struct mutex *create_mutex( struct directory *root, const struct unicode_
 /* release a mutex once the recursion count is 0 */
 static void do_release( struct mutex *mutex )
 {
-    assert( !mutex->count );
+    assert( !mutex->sync->count );
     /* remove the mutex from the thread list of owned mutexes */
-    list_remove( &mutex->entry );
-    mutex->owner = NULL;
+    if (!is_mutex_shared( mutex )) list_remove( &mutex->entry );
+    interlocked_xchg( &mutex->sync->value, 0 );
     wake_up( &mutex->obj, 0 );
+    fast_sync_wake( mutex->sync, 1 );
 }
 
 void abandon_mutexes( struct thread *thread )
 {
+    struct mutex *mutex, *next;
     struct list *ptr;
 
     while ((ptr = list_head( &thread->mutex_list )) != NULL)
     {
-        struct mutex *mutex = LIST_ENTRY( ptr, struct mutex, entry );
-        assert( mutex->owner == thread );
-        mutex->count = 0;
-        mutex->abandoned = 1;
+        mutex = LIST_ENTRY( ptr, struct mutex, entry );
+        assert( mutex->sync->value == thread->id );
+        mutex->sync->count = 0;
+        mutex->sync->abandoned = 1;
         do_release( mutex );
     }
+
+    LIST_FOR_EACH_ENTRY_SAFE( mutex, next, &shared_mutexes, struct mutex, entry )
+    {
+        if (mutex->sync->value != thread->id) continue;
+        mutex->sync->count = 0;
+        mutex->sync->abandoned = 1;
+        do_release( mutex );
+    }
+}
+
+struct fast_sync_object *get_mutex_fast_sync( struct object *obj )
+{
+    if (obj->ops != &mutex_ops) return NULL;
+    return ((struct mutex *)obj)->sync;
 }
 
 static void mutex_dump( struct object *obj, int verbose )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
-    fprintf( stderr, "Mutex count=%u owner=%p ", mutex->count, mutex->owner );
+    fprintf( stderr, "Mutex count=%u owner=%04x ", mutex->sync->count, mutex->sync->value );
     dump_object_name( &mutex->obj );
     fputc( '\n', stderr );
 }
@@ -137,27 +161,44 @@ static struct object_type *mutex_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    return fast_sync_add_queue( obj, entry, mutex->sync );
+}
+
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    fast_sync_remove_queue( obj, entry, mutex->sync );
+}
+
 static int mutex_signaled( struct object *obj, struct thread *thread )
 {
     struct mutex *mutex = (struct mutex *)obj;
+    int owner;
+
     assert( obj->ops == &mutex_ops );
-    return (!mutex->count || (mutex->owner == thread));
+    owner = mutex->sync->value;
+    return (!owner || owner == thread->id);
 }
 
 static int mutex_satisfied( struct object *obj, struct thread *thread )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
-    assert( !mutex->count || (mutex->owner == thread) );
 
-    if (!mutex->count++)  /* FIXME: avoid wrap-around */
+    if (mutex->sync->value != thread->id)
     {
-        assert( !mutex->owner );
-        mutex->owner = thread;
-        list_add_head( &thread->mutex_list, &mutex->entry );
+        if (interlocked_cmpxchg( &mutex->sync->value, thread->id, 0 ))
+            return -1;  /* already taken by a client */
+        assert( !mutex->sync->count );
+        if (!is_mutex_shared( mutex )) list_add_head( &thread->mutex_list, &mutex->entry );
     }
-    if (!mutex->abandoned) return 0;
-    mutex->abandoned = 0;
+    mutex->sync->count++;  /* FIXME: avoid wrap-around */
+    if (!interlocked_xchg( &mutex->sync->abandoned, 0 )) return 0;
     return 1;
 }
 
@@ -180,12 +221,12 @@ static int mutex_signal( struct object *obj, unsigned int access )
         set_error( STATUS_ACCESS_DENIED );
         return 0;
     }
-    if (!mutex->count || (mutex->owner != current))
+    if (!mutex->sync->count || mutex->sync->value != current->id)
     {
         set_error( STATUS_MUTANT_NOT_OWNED );
         return 0;
     }
-    if (!--mutex->count) do_release( mutex );
+    if (!--mutex->sync->count) do_release( mutex );
     return 1;
 }
 
@@ -194,9 +235,13 @@ static void mutex_destroy( struct object *obj )
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
-    if (!mutex->count) return;
-    mutex->count = 0;
-    do_release( mutex );
+    if (mutex->sync->count)
+    {
+        mutex->sync->count = 0;
+        do_release( mutex );
+    }
+    if (is_mutex_shared( mutex )) list_remove( &mutex->entry );
+    free_fast_sync_object( mutex->sync );
 }
 
 /* create a mutex */
@@ -259,11 +304,12 @@ DECL_HANDLER(release_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  0, &mutex_ops )))
     {
-        if (!mutex->count || (mutex->owner != current)) set_error( STATUS_MUTANT_NOT_OWNED );
+        if (!mutex->sync->count || mutex->sync->value != current->id)
+            set_error( STATUS_MUTANT_NOT_OWNED );
         else
         {
-            reply->prev_count = mutex->count;
-            if (!--mutex->count) do_release( mutex );
+            reply->prev_count = mutex->sync->count;
+            if (!--mutex->sync->count) do_release( mutex );
         }
         release_object( mutex );
     }
@@ -69,7 +69,7 @@ struct object_ops
     void (*remove_queue)(struct object *,struct wait_queue_entry *);
     /* is object signaled? */
     int  (*signaled)(struct object *,struct thread *);
-    /* wait satisfied; return 1 if abandoned */
+    /* wait satisfied; return 1 if abandoned, -1 if a client acquired the object in the meantime */
     int  (*satisfied)(struct object *,struct thread *);
     /* signal an object */
     int  (*signal)(struct object *, unsigned int);
@@ -160,10 +160,30 @@ extern struct event *get_event_obj( struct process *process, obj_handle_t handle
 extern void pulse_event( struct event *event );
 extern void set_event( struct event *event );
 extern void reset_event( struct event *event );
+extern struct object *get_keyed_event_obj( struct process *process, obj_handle_t handle, unsigned int access );
+extern struct fast_sync_object *get_event_fast_sync( struct object *obj );
 
 /* mutex functions */
 
 extern void abandon_mutexes( struct thread *thread );
+extern struct fast_sync_object *get_mutex_fast_sync( struct object *obj );
+
+/* semaphore functions */
+
+extern struct fast_sync_object *get_semaphore_fast_sync( struct object *obj );
+
+/* fast synchronization functions */
+
+extern void init_fast_sync(void);
+extern struct fast_sync_object *alloc_fast_sync_object( struct fast_sync_object *private_obj, int type );
+extern void free_fast_sync_object( struct fast_sync_object *obj );
+extern void fast_sync_wake( struct fast_sync_object *obj, int count );
+extern struct fast_sync_object *get_shared_fast_sync( struct object *obj );
+extern void fast_sync_undo_satisfied( struct fast_sync_object *obj, int abandoned );
+extern int fast_sync_add_queue( struct object *obj, struct wait_queue_entry *entry,
+                                struct fast_sync_object *sync );
+extern void fast_sync_remove_queue( struct object *obj, struct wait_queue_entry *entry,
+                                    struct fast_sync_object *sync );
 
 /* serial functions */
 
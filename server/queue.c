@@ -109,6 +109,7 @@ struct thread_input
     int                    cursor_count;  /* cursor show count */
     struct list            msg_list;      /* list of hardware messages */
     unsigned char          keystate[256]; /* state of each key */
+    struct input_shm      *shm;           /* key state published to the clients */
 };
 
 struct msg_queue
@@ -135,6 +136,7 @@ struct msg_queue
     struct thread_input   *input;           /* thread input descriptor */
     struct hook_table     *hooks;           /* hook table */
     timeout_t              last_get_msg;    /* time of last get message call */
+    struct queue_shm      *shm;             /* status published to the client, NULL if none */
 };
 
 struct hotkey
@@ -214,6 +216,19 @@ static const struct object_ops thread_input_ops =
 /* pointer to input structure of foreground thread */
 static unsigned int last_input_time;
 
+static struct mapping *queue_shm_mapping;  /* mapping of the queues shared memory */
+static struct queue_shm *queue_shm;        /* server view of the queues status */
+static struct input_shm *input_shm;        /* server view of the input states, after the queues */
+static struct window_shm *window_shm;      /* server view of the windows state, after the input states */
+static unsigned int queue_shm_used;        /* number of queue entries used at least once */
+static int queue_shm_free = -1;            /* first free queue entry, linked through changed_bits */
+static unsigned int input_shm_used;        /* number of input entries used at least once */
+static int input_shm_free = -1;            /* first free input entry, linked through cursor_x */
+
+#define QUEUE_SHM_COUNT (QUEUE_SHM_SIZE / sizeof(struct queue_shm))
+#define INPUT_SHM_COUNT (INPUT_SHM_SIZE / sizeof(struct input_shm))
+#define WINDOW_SHM_COUNT (WINDOW_SHM_SIZE / sizeof(struct window_shm))
+
 static void queue_hardware_message( struct desktop *desktop, struct message *msg, int always_queue );
 static void free_message( struct message *msg );
 
@@ -249,6 +264,7 @@ static struct thread_input *create_thread_input( struct thread *thread )
         list_init( &input->msg_list );
         set_caret_window( input, 0 );
         memset( input->keystate, 0, sizeof(input->keystate) );
+        input->shm          = alloc_input_shm();
 
         if (!(input->desktop = get_thread_desktop( thread, 0 /* FIXME: access rights */ )))
         {
@@ -259,6 +275,147 @@ static struct thread_input *create_thread_input( struct thread *thread )
     return input;
 }
 
+/* create the shared memory mapping of the queues, input and windows states */
+static int init_queue_shm(void)
+{
+    void *ptr;
+
+    if (queue_shm_mapping) return 1;
+    if (!(queue_shm_mapping = create_server_mapping( QUEUE_SHM_SIZE + INPUT_SHM_SIZE + WINDOW_SHM_SIZE,
+                                                     &ptr )))
+    {
+        clear_error();
+        return 0;
+    }
+    make_object_static( (struct object *)queue_shm_mapping );
+    queue_shm = ptr;
+    input_shm = (struct input_shm *)((char *)ptr + QUEUE_SHM_SIZE);
+    window_shm = (struct window_shm *)((char *)ptr + QUEUE_SHM_SIZE + INPUT_SHM_SIZE);
+    return 1;
+}
+
+/* allocate the shared memory status of a queue */
+static struct queue_shm *alloc_queue_shm(void)
+{
+    struct queue_shm *shm;
+
+    if (!init_queue_shm()) return NULL;
+    if (queue_shm_free != -1)
+    {
+        shm = &queue_shm[queue_shm_free];
+        queue_shm_free = shm->changed_bits;
+    }
+    else if (queue_shm_used < QUEUE_SHM_COUNT) shm = &queue_shm[queue_shm_used++];
+    else return NULL;
+
+    shm->wake_bits = 0;
+    shm->changed_bits = 0;
+    shm->input_index = -1;
+    shm->desktop_index = -1;
+    return shm;
+}
+
+/* free the shared memory status of a queue */
+static void free_queue_shm( struct queue_shm *shm )
+{
+    shm->wake_bits = 0;
+    shm->changed_bits = queue_shm_free;
+    queue_shm_free = shm - queue_shm;
+}
+
+/* publish the status bits of a queue to its client */
+static inline void update_queue_shm( struct msg_queue *queue )
+{
+    if (!queue->shm) return;
+    queue->shm->wake_bits = queue->wake_bits;
+    queue->shm->changed_bits = queue->changed_bits;
+}
+
+/* publish the indices of the input states of a queue */
+static void update_queue_input_shm( struct msg_queue *queue )
+{
+    struct thread_input *input = queue->input;
+
+    if (!queue->shm) return;
+    queue->shm->input_index = input->shm ? input->shm - input_shm : -1;
+    queue->shm->desktop_index = input->desktop->shm ? input->desktop->shm - input_shm : -1;
+}
+
+/* the clients retry reading an input state if seq changed or was odd, so it has */
+/* to be incremented before and after each update, with full memory barriers */
+static inline void begin_input_shm_update( struct input_shm *shm )
+{
+    interlocked_xchg_add( &shm->seq, 1 );
+}
+
+static inline void end_input_shm_update( struct input_shm *shm )
+{
+    interlocked_xchg_add( &shm->seq, 1 );
+}
+
+/* allocate a cleared input state in the shared memory */
+struct input_shm *alloc_input_shm(void)
+{
+    struct input_shm *shm;
+
+    if (!init_queue_shm()) return NULL;
+    if (input_shm_free != -1)
+    {
+        shm = &input_shm[input_shm_free];
+        input_shm_free = shm->cursor_x;
+    }
+    else if (input_shm_used < INPUT_SHM_COUNT) shm = &input_shm[input_shm_used++];
+    else return NULL;
+
+    begin_input_shm_update( shm );
+    shm->cursor_x = shm->cursor_y = 0;
+    shm->cursor_last_change = 0;
+    memset( shm->keystate, 0, sizeof(shm->keystate) );
+    end_input_shm_update( shm );
+    return shm;
+}
+
+/* free an input state of the shared memory */
+void free_input_shm( struct input_shm *shm )
+{
+    shm->cursor_x = input_shm_free;
+    input_shm_free = shm - input_shm;
+}
+
+/* publish the key state and cursor position of a desktop */
+static void update_desktop_shm( struct desktop *desktop )
+{
+    struct input_shm *shm = desktop->shm;
+
+    if (!shm) return;
+    begin_input_shm_update( shm );
+    shm->cursor_x = desktop->cursor.x;
+    shm->cursor_y = desktop->cursor.y;
+    shm->cursor_last_change = desktop->cursor.last_change;
+    memcpy( shm->keystate, desktop->keystate, sizeof(shm->keystate) );
+    end_input_shm_update( shm );
+}
+
+/* publish the key state of a thread input */
+static void update_thread_input_shm( struct thread_input *input )
+{
+    struct input_shm *shm = input->shm;
+
+    if (!shm) return;
+    begin_input_shm_update( shm );
+    memcpy( shm->keystate, input->keystate, sizeof(shm->keystate) );
+    end_input_shm_update( shm );
+}
+
+/* get the shared memory state of a window, the entries are indexed like the user handles */
+struct window_shm *get_window_shm( user_handle_t handle )
+{
+    unsigned int index = ((handle & 0xffff) - FIRST_USER_HANDLE) >> 1;
+
+    if (index >= WINDOW_SHM_COUNT || !init_queue_shm()) return NULL;
+    return &window_shm[index];
+}
+
 /* create a message queue object */
 static struct msg_queue *create_msg_queue( struct thread *thread, struct thread_input *input )
 {
@@ -289,6 +446,8 @@ static struct msg_queue *create_msg_queue( struct thread *thread, struct thread_
         queue->input           = (struct thread_input *)grab_object( input );
         queue->hooks           = NULL;
         queue->last_get_msg    = current_time;
+        queue->shm             = alloc_queue_shm();
+        update_queue_input_shm( queue );
         list_init( &queue->send_result );
         list_init( &queue->callback_result );
         list_init( &queue->pending_timers );
@@ -327,6 +486,7 @@ static int assign_thread_input( struct thread *thread, struct thread_input *new_
     }
     queue->input = (struct thread_input *)grab_object( new_input );
     new_input->cursor_count += queue->cursor_count;
+    update_queue_input_shm( queue );
     return 1;
 }
 
@@ -421,6 +581,7 @@ static inline void set_queue_bits( struct msg_queue *queue, unsigned int bits )
 {
     queue->wake_bits |= bits;
     queue->changed_bits |= bits;
+    update_queue_shm( queue );
     if (is_signaled( queue )) wake_up( &queue->obj, 0 );
 }
 
@@ -429,6 +590,7 @@ static inline void clear_queue_bits( struct msg_queue *queue, unsigned int bits
 {
     queue->wake_bits &= ~bits;
     queue->changed_bits &= ~bits;
+    update_queue_shm( queue );
 }
 
 /* check whether msg is a keyboard message */
@@ -968,6 +1130,7 @@ static void msg_queue_destroy( struct object *obj )
     release_object( queue->input );
     if (queue->hooks) release_object( queue->hooks );
     if (queue->fd) release_object( queue->fd );
+    if (queue->shm) free_queue_shm( queue->shm );
 }
 
 static void msg_queue_poll_event( struct fd *fd, int event )
@@ -992,6 +1155,7 @@ static void thread_input_destroy( struct object *obj )
     struct thread_input *input = (struct thread_input *)obj;
 
     empty_msg_list( &input->msg_list );
+    if (input->shm) free_input_shm( input->shm );
     if (input->desktop)
     {
         if (input->desktop->foreground_input == input) set_foreground_input( input->desktop, NULL );
@@ -1058,7 +1222,11 @@ int attach_thread_input( struct thread *thread_from, struct thread *thread_to )
     release_object( desktop );
 
     ret = assign_thread_input( thread_from, input );
-    if (ret) memset( input->keystate, 0, sizeof(input->keystate) );
+    if (ret)
+    {
+        memset( input->keystate, 0, sizeof(input->keystate) );
+        update_thread_input_shm( input );
+    }
     release_object( input );
     return ret;
 }
@@ -1329,6 +1497,7 @@ static void release_hardware_message( struct msg_queue *queue, unsigned int hw_i
     if (remove)
     {
         update_input_key_state( input->desktop, input->keystate, msg );
+        update_thread_input_shm( input );
         list_remove( &msg->entry );
         free_message( msg );
     }
@@ -1446,6 +1615,7 @@ static void queue_hardware_message( struct desktop *desktop, struct message *msg
     struct hardware_msg_data *data = msg->data;
 
     update_input_key_state( desktop, desktop->keystate, msg );
+    update_desktop_shm( desktop );
     last_input_time = get_tick_count();
     if (msg->msg != WM_MOUSEMOVE) always_queue = 1;
 
@@ -1466,6 +1636,7 @@ static void queue_hardware_message( struct desktop *desktop, struct message *msg
             desktop->cursor.x = x;
             desktop->cursor.y = y;
             desktop->cursor.last_change = get_tick_count();
+            update_desktop_shm( desktop );
         }
         if (desktop->keystate[VK_LBUTTON] & 0x80)  msg->wparam |= MK_LBUTTON;
         if (desktop->keystate[VK_MBUTTON] & 0x80)  msg->wparam |= MK_MBUTTON;
@@ -1488,7 +1659,11 @@ static void queue_hardware_message( struct desktop *desktop, struct message *msg
     win = find_hardware_message_window( desktop, input, msg, &msg_code );
     if (!win || !(thread = get_window_thread(win)))
     {
-        if (input) update_input_key_state( input->desktop, input->keystate, msg );
+        if (input)
+        {
+            update_input_key_state( input->desktop, input->keystate, msg );
+            update_thread_input_shm( input );
+        }
         free_message( msg );
         return;
     }
@@ -1927,6 +2102,7 @@ static int get_hardware_message( struct thread *thread, unsigned int hw_id, user
         {
             /* no window at all, remove it */
             update_input_key_state( input->desktop, input->keystate, msg );
+            update_thread_input_shm( input );
             list_remove( &msg->entry );
             free_message( msg );
             continue;
@@ -1943,6 +2119,7 @@ static int get_hardware_message( struct thread *thread, unsigned int hw_id, user
             {
                 /* for another thread input, drop it */
                 update_input_key_state( input->desktop, input->keystate, msg );
+                update_thread_input_shm( input );
                 list_remove( &msg->entry );
                 free_message( msg );
             }
@@ -2159,6 +2336,22 @@ DECL_HANDLER(get_msg_queue)
 }
 
 
+/* get the shared memory status of the current thread queue */
+DECL_HANDLER(get_queue_shm)
+{
+    struct msg_queue *queue = get_current_queue();
+
+    if (!queue) return;
+    if (!queue->shm)
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        return;
+    }
+    reply->index  = queue->shm - queue_shm;
+    reply->handle = alloc_handle( current->process, queue_shm_mapping, SECTION_MAP_READ | SECTION_QUERY, 0 );
+}
+
+
 /* set the file descriptor associated to the current thread queue */
 DECL_HANDLER(set_queue_fd)
 {
@@ -2213,7 +2406,11 @@ DECL_HANDLER(get_queue_status)
     {
         reply->wake_bits    = queue->wake_bits;
         reply->changed_bits = queue->changed_bits;
-        if (req->clear) queue->changed_bits = 0;
+        if (req->clear)
+        {
+            queue->changed_bits = 0;
+            update_queue_shm( queue );
+        }
     }
     else reply->wake_bits = reply->changed_bits = 0;
 }
@@ -2388,6 +2585,7 @@ DECL_HANDLER(get_message)
     }
     if (filter & QS_INPUT) queue->changed_bits &= ~QS_INPUT;
     if (filter & QS_PAINT) queue->changed_bits &= ~QS_PAINT;
+    update_queue_shm( queue );
 
     /* then check for posted messages */
     if ((filter & QS_POSTMESSAGE) &&
@@ -2804,7 +3002,11 @@ DECL_HANDLER(get_key_state)
         if (req->key >= 0)
         {
             reply->state = desktop->keystate[req->key & 0xff];
-            desktop->keystate[req->key & 0xff] &= ~0x40;
+            if (reply->state & 0x40)
+            {
+                desktop->keystate[req->key & 0xff] &= ~0x40;
+                update_desktop_shm( desktop );
+            }
         }
         set_reply_data( desktop->keystate, size );
         release_object( desktop );
@@ -2833,15 +3035,21 @@ DECL_HANDLER(set_key_state)
     {
         if (!(desktop = get_thread_desktop( current, 0 ))) return;
         memcpy( desktop->keystate, get_req_data(), size );
+        update_desktop_shm( desktop );
         release_object( desktop );
     }
     else
     {
         if (!(thread = get_thread_from_id( req->tid ))) return;
-        if (thread->queue) memcpy( thread->queue->input->keystate, get_req_data(), size );
+        if (thread->queue)
+        {
+            memcpy( thread->queue->input->keystate, get_req_data(), size );
+            update_thread_input_shm( thread->queue->input );
+        }
         if (req->async && (desktop = get_thread_desktop( thread, 0 )))
         {
             memcpy( desktop->keystate, get_req_data(), size );
+            update_desktop_shm( desktop );
             release_object( desktop );
         }
         release_object( thread );
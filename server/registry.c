@@ -35,6 +35,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -68,13 +72,18 @@ struct key
     WCHAR            *class;       /* key class */
     unsigned short    namelen;     /* length of key name */
     unsigned short    classlen;    /* length of class name */
+    unsigned int      hash;        /* hash of the key name */
     struct key       *parent;      /* parent key */
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
+    int               sorted_subkeys; /* count of subkeys at the start of the array that are sorted */
     struct key      **subkeys;     /* subkeys array */
+    struct name_hash *subkey_hash; /* hash table of the unsorted subkeys */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
+    int               sorted_values; /* count of values at the start of the array that are sorted */
     struct key_value *values;      /* values array */
+    struct name_hash *value_hash;  /* hash table of the unsorted values */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
@@ -94,12 +103,26 @@ struct key_value
     WCHAR            *name;    /* value name */
     unsigned short    namelen; /* length of value name */
     unsigned short    type;    /* value type */
+    unsigned int      hash;    /* hash of the value name */
     data_size_t       len;     /* value data length in bytes */
     void             *data;    /* pointer to value data */
 };
 
+/* hash table of the subkey or value names of a key
+ * Small keys keep their arrays sorted, and new entries are inserted in place. In
+ * large keys new entries are appended at the end of the array instead, and found
+ * through a hash table; they are merged with the sorted part of the array only
+ * when the order matters, i.e. for enumerating, saving and deleting. */
+struct name_hash
+{
+    unsigned int      size;     /* number of slots, always a power of 2 */
+    unsigned int      count;    /* number of used slots */
+    int               slots[1]; /* index of the entry in the array, or -1 if free */
+};
+
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
+#define MIN_HASH_ENTRIES 64  /* number of subkeys or values from which new ones are appended */
 
 #define MAX_NAME_LEN  255    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
@@ -109,6 +132,8 @@ static struct key *root_key;
 
 static const timeout_t ticks_1601_to_1970 = (timeout_t)86400 * (369 * 365 + 89) * TICKS_PER_SEC;
 static const timeout_t save_period = 30 * -TICKS_PER_SEC;  /* delay between periodic saves */
+static const long min_journal_size = 1024 * 1024;  /* journal size from which a branch is saved */
+static const char journal_header[] = "WINE REGISTRY Version 2\n;; Changes not yet saved to the registry file\n\n";
 static struct timeout_user *save_timeout_user;  /* saving timer */
 static enum prefix_type { PREFIX_UNKNOWN, PREFIX_32BIT, PREFIX_64BIT } prefix_type;
 
@@ -119,12 +144,19 @@ static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_va
 
 static void set_periodic_save_timer(void);
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void sort_subkeys( struct key *key );
+static void sort_values( struct key *key );
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    char        *journal_path;  /* path of the journal of changes not yet saved */
+    FILE        *journal;       /* journal file, or NULL if journaling is not possible */
+    long         journal_size;  /* current size of the journal */
+    long         file_size;     /* size of the branch file when last saved */
+    int          force_save;    /* are there changes that are not in the journals? */
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
@@ -253,11 +285,13 @@ static void dump_value( const struct key_value *value, FILE *f )
 }
 
 /* save a registry and all its subkeys to a text file */
-static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
+static void save_subkeys( struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
     if (key->flags & KEY_VOLATILE) return;
+    sort_subkeys( key );
+    sort_values( key );
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
@@ -277,6 +311,114 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
 }
 
+/*
+ * Changes to the saved branches are appended to a journal file as they happen, using
+ * the same text format with two additions: "[-key]" deletes a key and "value=-"
+ * deletes a value. The branch files are only rewritten when the journal grows too
+ * large, or when the server exits; the journal is replayed on top of the branch file
+ * on startup. Replaying changes that are already in the branch file is harmless, so
+ * the journal is only emptied once the branch file has been successfully renamed.
+ * Each record is terminated by an empty line, to allow discarding a partially
+ * written one.
+ */
+
+/* get the saved branch containing a key, if any */
+static struct save_branch_info *get_key_branch( const struct key *key )
+{
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return NULL;
+    for ( ; key; key = key->parent)
+        for (i = 0; i < save_branch_count; i++)
+            if (save_branch_info[i].key == key) return &save_branch_info[i];
+    return NULL;
+}
+
+/* start a journal record for a key, return the journal file */
+static FILE *start_journal_record( const struct key *key, struct save_branch_info *branch, char op )
+{
+    FILE *f = branch->journal;
+
+    fputc( '[', f );
+    if (op) fputc( op, f );
+    if (key != branch->key) dump_path( key, branch->key, f );
+    /* a deleted key is recorded with the modification time of its parent */
+    fprintf( f, "] %u\n", (unsigned int)(((op ? current_time : key->modif) - ticks_1601_to_1970) / TICKS_PER_SEC) );
+    return f;
+}
+
+/* terminate a journal record and write it out */
+static void end_journal_record( struct save_branch_info *branch )
+{
+    fputc( '\n', branch->journal );
+    if (fflush( branch->journal ) == EOF)
+    {
+        /* stop journaling, the branch file will be saved instead */
+        fprintf( stderr, "wineserver: could not write registry journal %s", branch->journal_path );
+        perror( " " );
+        fclose( branch->journal );
+        branch->journal = NULL;
+        return;
+    }
+    branch->journal_size = ftell( branch->journal );
+}
+
+/* record the creation of a key in the journal */
+static void journal_create_key( const struct key *key )
+{
+    struct save_branch_info *branch = get_key_branch( key );
+    FILE *f;
+
+    if (!branch || !branch->journal) return;
+    f = start_journal_record( key, branch, 0 );
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen / sizeof(WCHAR), f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+    end_journal_record( branch );
+}
+
+/* record the deletion of a key in the journal */
+static void journal_delete_key( const struct key *key )
+{
+    struct save_branch_info *branch = get_key_branch( key );
+
+    if (!branch || !branch->journal || key == branch->key) return;
+    start_journal_record( key, branch, '-' );
+    end_journal_record( branch );
+}
+
+/* record the new contents of a value in the journal */
+static void journal_set_value( const struct key *key, const struct key_value *value )
+{
+    struct save_branch_info *branch = get_key_branch( key );
+
+    if (!branch || !branch->journal) return;
+    dump_value( value, start_journal_record( key, branch, 0 ));
+    end_journal_record( branch );
+}
+
+/* record the deletion of a value in the journal */
+static void journal_delete_value( const struct key *key, const struct unicode_str *name )
+{
+    struct save_branch_info *branch = get_key_branch( key );
+    FILE *f;
+
+    if (!branch || !branch->journal) return;
+    f = start_journal_record( key, branch, 0 );
+    if (name->len)
+    {
+        fputc( '\"', f );
+        dump_strW( name->str, name->len / sizeof(WCHAR), f, "\"\"" );
+        fputs( "\"=-\n", f );
+    }
+    else fputs( "@=-\n", f );
+    end_journal_record( branch );
+}
+
 static void dump_operation( const struct key *key, const struct key_value *value, const char *op )
 {
     fprintf( stderr, "%s key ", op );
@@ -407,12 +549,14 @@ static void key_destroy( struct object *obj )
         free( key->values[i].data );
     }
     free( key->values );
+    free( key->value_hash );
     for (i = 0; i <= key->last_subkey; i++)
     {
         key->subkeys[i]->parent = NULL;
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->subkey_hash );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -462,6 +606,94 @@ static struct unicode_str *get_path_token( const struct unicode_str *path, struc
     return token;
 }
 
+/* compute the case-insensitive hash of a key or value name */
+static unsigned int hash_name( const WCHAR *name, data_size_t len )
+{
+    unsigned int hash = 2166136261u;
+
+    for (len /= sizeof(WCHAR); len; len--) hash = (hash ^ tolowerW( *name++ )) * 16777619;
+    return hash;
+}
+
+/* compare two key or value names, in the order used for the arrays */
+static inline int compare_names( const WCHAR *name1, data_size_t len1, const WCHAR *name2, data_size_t len2 )
+{
+    int res = memicmpW( name1, name2, min( len1, len2 ) / sizeof(WCHAR) );
+    if (!res) res = len1 - len2;
+    return res;
+}
+
+static int compare_subkeys( const void *p1, const void *p2 )
+{
+    const struct key *key1 = *(const struct key * const *)p1;
+    const struct key *key2 = *(const struct key * const *)p2;
+    return compare_names( key1->name, key1->namelen, key2->name, key2->namelen );
+}
+
+static int compare_values( const void *p1, const void *p2 )
+{
+    const struct key_value *value1 = p1;
+    const struct key_value *value2 = p2;
+    return compare_names( value1->name, value1->namelen, value2->name, value2->namelen );
+}
+
+/* sort an array of which the first 'sorted' entries are already in order */
+static void sort_array( void *array, int count, int sorted, size_t size,
+                        int (*compare)( const void *, const void * ) )
+{
+    char *base = array, *tmp;
+    int i, j, k;
+
+    if (sorted >= count) return;
+    qsort( base + sorted * size, count - sorted, size, compare );
+    if (!sorted || compare( base + (sorted - 1) * size, base + sorted * size ) < 0) return;
+
+    if (!(tmp = malloc( (count - sorted) * size )))
+    {
+        qsort( base, count, size, compare );
+        return;
+    }
+    /* merge the two sorted parts, starting from the end */
+    memcpy( tmp, base + sorted * size, (count - sorted) * size );
+    i = sorted - 1;
+    j = count - sorted - 1;
+    k = count - 1;
+    while (j >= 0)
+    {
+        if (i >= 0 && compare( base + i * size, tmp + j * size ) > 0)
+            memcpy( base + k-- * size, base + i-- * size, size );
+        else
+            memcpy( base + k-- * size, tmp + j-- * size, size );
+    }
+    free( tmp );
+}
+
+/* allocate an empty hash table large enough for count entries */
+static struct name_hash *alloc_name_hash( int count )
+{
+    struct name_hash *hash;
+    unsigned int i, size = 2 * MIN_HASH_ENTRIES;
+
+    while (size < 4 * count) size *= 2;
+    if (!(hash = malloc( offsetof( struct name_hash, slots[size] )))) return NULL;
+    hash->size  = size;
+    hash->count = 0;
+    for (i = 0; i < size; i++) hash->slots[i] = -1;
+    return hash;
+}
+
+/* add an entry to a hash table; return 0 if the table is too full and must be rebuilt */
+static int add_name_hash( struct name_hash *hash, unsigned int value, int index )
+{
+    unsigned int i, mask = hash->size - 1;
+
+    if (2 * (hash->count + 1) > hash->size) return 0;
+    for (i = value & mask; hash->slots[i] != -1; i = (i + 1) & mask) /* nothing */;
+    hash->slots[i] = index;
+    hash->count++;
+    return 1;
+}
+
 /* allocate a key object */
 static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
 {
@@ -472,13 +704,18 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->class       = NULL;
         key->namelen     = name->len;
         key->classlen    = 0;
+        key->hash        = hash_name( name->str, name->len );
         key->flags       = 0;
         key->last_subkey = -1;
         key->nb_subkeys  = 0;
+        key->sorted_subkeys = 0;
         key->subkeys     = NULL;
+        key->subkey_hash = NULL;
         key->nb_values   = 0;
         key->last_value  = -1;
+        key->sorted_values = 0;
         key->values      = NULL;
+        key->value_hash  = NULL;
         key->modif       = modif;
         key->parent      = NULL;
         list_init( &key->notify_list );
@@ -565,6 +802,37 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* merge the unsorted subkeys into the sorted part of the array */
+static void sort_subkeys( struct key *key )
+{
+    int count = key->last_subkey + 1;
+
+    sort_array( key->subkeys, count, key->sorted_subkeys, sizeof(*key->subkeys), compare_subkeys );
+    key->sorted_subkeys = count;
+    free( key->subkey_hash );
+    key->subkey_hash = NULL;
+}
+
+/* add a subkey appended to the array to the hash table */
+static void hash_subkey( struct key *key, int index )
+{
+    struct name_hash *hash = key->subkey_hash;
+    int i;
+
+    if (hash && add_name_hash( hash, key->subkeys[index]->hash, index )) return;
+
+    /* allocate a larger table */
+    if (!(hash = alloc_name_hash( key->last_subkey + 1 - key->sorted_subkeys )))
+    {
+        sort_subkeys( key );
+        return;
+    }
+    for (i = key->sorted_subkeys; i <= key->last_subkey; i++)
+        add_name_hash( hash, key->subkeys[i]->hash, i );
+    free( key->subkey_hash );
+    key->subkey_hash = hash;
+}
+
 /* allocate a subkey for a given key, and return its index */
 static struct key *alloc_subkey( struct key *parent, const struct unicode_str *name,
                                  int index, timeout_t modif )
@@ -588,6 +856,14 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         for (i = ++parent->last_subkey; i > index; i--)
             parent->subkeys[i] = parent->subkeys[i-1];
         parent->subkeys[index] = key;
+        if (parent->subkey_hash || (index == parent->last_subkey && index &&
+                                    compare_subkeys( &parent->subkeys[index - 1], &key ) > 0))
+        {
+            /* appended out of order, it will be sorted later on */
+            assert( index == parent->last_subkey );
+            hash_subkey( parent, index );
+        }
+        else parent->sorted_subkeys++;
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -604,8 +880,15 @@ static void free_subkey( struct key *parent, int index )
     assert( index <= parent->last_subkey );
 
     key = parent->subkeys[index];
+    if (parent->subkey_hash)
+    {
+        /* the array has to be sorted first, this moves the key */
+        sort_subkeys( parent );
+        for (index = parent->last_subkey; parent->subkeys[index] != key; index--) /* nothing */;
+    }
     for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
     parent->last_subkey--;
+    parent->sorted_subkeys--;
     key->flags |= KEY_DELETED;
     key->parent = NULL;
     if (is_wow6432node( key->name, key->namelen )) parent->flags &= ~KEY_WOW64;
@@ -628,16 +911,13 @@ static void free_subkey( struct key *parent, int index )
 static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
-    data_size_t len;
 
     min = 0;
-    max = key->last_subkey;
+    max = key->sorted_subkeys - 1;
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->subkeys[i]->namelen, name->len );
-        res = memicmpW( key->subkeys[i]->name, name->str, len / sizeof(WCHAR) );
-        if (!res) res = key->subkeys[i]->namelen - name->len;
+        res = compare_names( key->subkeys[i]->name, key->subkeys[i]->namelen, name->str, name->len );
         if (!res)
         {
             *index = i;
@@ -646,7 +926,25 @@ static struct key *find_subkey( const struct key *key, const struct unicode_str
         if (res > 0) max = i - 1;
         else min = i + 1;
     }
-    *index = min;  /* this is where we should insert it */
+
+    if (key->subkey_hash)
+    {
+        const struct name_hash *hash = key->subkey_hash;
+        unsigned int value = hash_name( name->str, name->len ), pos, mask = hash->size - 1;
+
+        for (pos = value & mask; (i = hash->slots[pos]) != -1; pos = (pos + 1) & mask)
+        {
+            if (key->subkeys[i]->hash != value ||
+                compare_names( key->subkeys[i]->name, key->subkeys[i]->namelen, name->str, name->len ))
+                continue;
+            *index = i;
+            return key->subkeys[i];
+        }
+    }
+
+    /* this is where we should insert it; in large keys it's appended at the end */
+    if (key->subkey_hash || key->last_subkey + 1 >= MIN_HASH_ENTRIES) *index = key->last_subkey + 1;
+    else *index = min;
     return NULL;
 }
 
@@ -813,6 +1111,7 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
         free(key->class);
         if (!(key->class = memdup( class->str, key->classlen ))) key->classlen = 0;
     }
+    journal_create_key( key );
     grab_object( key );
     return key;
 }
@@ -861,7 +1160,7 @@ static struct key *create_key_recursive( struct key *key, const struct unicode_s
 }
 
 /* query information about a key or a subkey */
-static void enum_key( const struct key *key, int index, int info_class,
+static void enum_key( struct key *key, int index, int info_class,
                       struct enum_key_reply *reply )
 {
     int i;
@@ -877,6 +1176,7 @@ static void enum_key( const struct key *key, int index, int info_class,
             set_error( STATUS_NO_MORE_ENTRIES );
             return;
         }
+        sort_subkeys( key );
         key = key->subkeys[index];
     }
 
@@ -961,9 +1261,10 @@ static int delete_key( struct key *key, int recurse )
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
 
-    for (index = 0; index <= parent->last_subkey; index++)
+    /* search from the end, that's where recursive deletes remove keys from */
+    for (index = parent->last_subkey; index >= 0; index--)
         if (parent->subkeys[index] == key) break;
-    assert( index <= parent->last_subkey );
+    assert( index >= 0 );
 
     /* we can only delete a key that has no subkeys */
     if (key->last_subkey >= 0)
@@ -973,6 +1274,7 @@ static int delete_key( struct key *key, int recurse )
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    journal_delete_key( key );
     free_subkey( parent, index );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 0;
@@ -1003,20 +1305,48 @@ static int grow_values( struct key *key )
     return 1;
 }
 
+/* merge the unsorted values into the sorted part of the array */
+static void sort_values( struct key *key )
+{
+    int count = key->last_value + 1;
+
+    sort_array( key->values, count, key->sorted_values, sizeof(*key->values), compare_values );
+    key->sorted_values = count;
+    free( key->value_hash );
+    key->value_hash = NULL;
+}
+
+/* add a value appended to the array to the hash table */
+static void hash_value( struct key *key, int index )
+{
+    struct name_hash *hash = key->value_hash;
+    int i;
+
+    if (hash && add_name_hash( hash, key->values[index].hash, index )) return;
+
+    /* allocate a larger table */
+    if (!(hash = alloc_name_hash( key->last_value + 1 - key->sorted_values )))
+    {
+        sort_values( key );
+        return;
+    }
+    for (i = key->sorted_values; i <= key->last_value; i++)
+        add_name_hash( hash, key->values[i].hash, i );
+    free( key->value_hash );
+    key->value_hash = hash;
+}
+
 /* find the named value of a given key and return its index in the array */
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
-    data_size_t len;
 
     min = 0;
-    max = key->last_value;
+    max = key->sorted_values - 1;
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->values[i].namelen, name->len );
-        res = memicmpW( key->values[i].name, name->str, len / sizeof(WCHAR) );
-        if (!res) res = key->values[i].namelen - name->len;
+        res = compare_names( key->values[i].name, key->values[i].namelen, name->str, name->len );
         if (!res)
         {
             *index = i;
@@ -1025,7 +1355,25 @@ static struct key_value *find_value( const struct key *key, const struct unicode
         if (res > 0) max = i - 1;
         else min = i + 1;
     }
-    *index = min;  /* this is where we should insert it */
+
+    if (key->value_hash)
+    {
+        const struct name_hash *hash = key->value_hash;
+        unsigned int value = hash_name( name->str, name->len ), pos, mask = hash->size - 1;
+
+        for (pos = value & mask; (i = hash->slots[pos]) != -1; pos = (pos + 1) & mask)
+        {
+            if (key->values[i].hash != value ||
+                compare_names( key->values[i].name, key->values[i].namelen, name->str, name->len ))
+                continue;
+            *index = i;
+            return &key->values[i];
+        }
+    }
+
+    /* this is where we should insert it; in large keys it's appended at the end */
+    if (key->value_hash || key->last_value + 1 >= MIN_HASH_ENTRIES) *index = key->last_value + 1;
+    else *index = min;
     return NULL;
 }
 
@@ -1050,8 +1398,19 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     value = &key->values[index];
     value->name    = new_name;
     value->namelen = name->len;
+    value->hash    = hash_name( name->str, name->len );
     value->len     = 0;
     value->data    = NULL;
+    if (key->value_hash || (index == key->last_value && index &&
+                            compare_values( &key->values[index - 1], value ) > 0))
+    {
+        /* appended out of order, it will be sorted later on */
+        assert( index == key->last_value );
+        hash_value( key, index );
+        /* the array is sorted if the table couldn't be allocated */
+        if (!key->value_hash) value = find_value( key, name, &index );
+    }
+    else key->sorted_values++;
     return value;
 }
 
@@ -1100,6 +1459,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->len   = len;
     value->data  = ptr;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_set_value( key, value );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
 
@@ -1134,6 +1494,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         void *data;
         data_size_t namelen, maxlen;
 
+        sort_values( key );
         value = &key->values[i];
         reply->type = value->type;
         namelen = value->namelen;
@@ -1185,12 +1546,20 @@ static void delete_value( struct key *key, const struct unicode_str *name )
         set_error( STATUS_OBJECT_NAME_NOT_FOUND );
         return;
     }
+    if (key->value_hash)
+    {
+        /* the array has to be sorted first, this moves the value */
+        sort_values( key );
+        value = find_value( key, name, &index );
+    }
     if (debug_level > 1) dump_operation( key, value, "Delete" );
     free( value->name );
     free( value->data );
     for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
     key->last_value--;
+    key->sorted_values--;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_delete_value( key, name );
 
     /* try to shrink the array */
     nb_values = key->nb_values;
@@ -1316,44 +1685,77 @@ static int get_data_type( const char *buffer, int *type, int *parse_type )
     return 0;
 }
 
-/* load and create a key from the input file */
-static struct key *load_key( struct key *base, const char *buffer,
-                             int prefix_len, struct file_load_info *info )
+/* parse a key name and its optional modification time from the input file */
+static int parse_key_name( const char *buffer, int prefix_len, struct unicode_str *name,
+                           timeout_t *modif, struct file_load_info *info )
 {
     WCHAR *p;
-    struct unicode_str name;
     int res;
     unsigned int mod;
-    timeout_t modif = current_time;
     data_size_t len;
 
-    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return NULL;
+    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return 0;
 
     len = info->tmplen;
     if ((res = parse_strW( info->tmp, &len, buffer, ']' )) == -1)
     {
         file_read_error( "Malformed key", info );
-        return NULL;
+        return 0;
     }
     if (sscanf( buffer + res, " %u", &mod ) == 1)
-        modif = (timeout_t)mod * TICKS_PER_SEC + ticks_1601_to_1970;
+        *modif = (timeout_t)mod * TICKS_PER_SEC + ticks_1601_to_1970;
 
     p = info->tmp;
     while (prefix_len && *p) { if (*p++ == '\\') prefix_len--; }
 
-    if (!*p)
+    if (!*p && prefix_len > 1)
     {
-        if (prefix_len > 1)
-        {
-            file_read_error( "Malformed key", info );
-            return NULL;
-        }
-        /* empty key name, return base key */
-        return (struct key *)grab_object( base );
+        file_read_error( "Malformed key", info );
+        return 0;
     }
-    name.str = p;
-    name.len = len - (p - info->tmp + 1) * sizeof(WCHAR);
-    return create_key_recursive( base, &name, modif );
+    name->str = p;
+    name->len = len - (p - info->tmp + 1) * sizeof(WCHAR);
+    return 1;
+}
+
+/* load and create a key from the input file */
+static struct key *load_key( struct key *base, const char *buffer,
+                             int prefix_len, struct file_load_info *info )
+{
+    struct unicode_str name;
+    struct key *key;
+    timeout_t modif = 0;
+
+    if (!parse_key_name( buffer, prefix_len, &name, &modif, info )) return NULL;
+
+    if (!name.len) key = (struct key *)grab_object( base );  /* empty key name, return base key */
+    else if (!(key = create_key_recursive( base, &name, modif ? modif : current_time ))) return NULL;
+    /* the key may already exist when replaying a journal */
+    if (modif) key->modif = modif;
+    return key;
+}
+
+/* delete a key listed as "[-name]" in the input file */
+static void load_deleted_key( struct key *base, const char *buffer,
+                              int prefix_len, struct file_load_info *info )
+{
+    struct unicode_str name, token;
+    struct key *key = base, *parent;
+    timeout_t modif = 0;
+    int index;
+
+    if (!parse_key_name( buffer, prefix_len, &name, &modif, info )) return;
+
+    token.str = NULL;
+    if (!get_path_token( &name, &token )) return;
+    while (token.len)
+    {
+        if (!(key = find_subkey( key, &token, &index ))) return;  /* nothing to delete */
+        get_path_token( &name, &token );
+    }
+    if (key == base) return;
+    parent = key->parent;
+    if (!delete_key( key, 1 ) && modif) parent->modif = modif;
 }
 
 /* load a global option from the input file */
@@ -1474,6 +1876,18 @@ static int load_value( struct key *key, const char *buffer, struct file_load_inf
     struct key_value *value;
 
     if (!(value = parse_value_name( key, buffer, &len, info ))) return 0;
+    if (buffer[len] == '-')  /* deleted value */
+    {
+        struct unicode_str name;
+        timeout_t modif = key->modif;
+
+        /* the temp buffer still contains the name */
+        name.str = info->tmp;
+        name.len = value->namelen;
+        delete_value( key, &name );
+        key->modif = modif;
+        return 1;
+    }
     if (!(res = get_data_type( buffer + len, &type, &parse_type ))) goto error;
     buffer += len + res;
 
@@ -1594,6 +2008,13 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
         {
         case '[':   /* new key */
             if (subkey) release_object( subkey );
+            subkey = NULL;
+            if (p[1] == '-')  /* deleted key */
+            {
+                if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 2, &info );
+                load_deleted_key( key, p + 2, prefix_len, &info );
+                break;
+            }
             if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 1, &info );
             if (!(subkey = load_key( key, p + 1, prefix_len, &info )))
                 file_read_error( "Error creating key", &info );
@@ -1643,27 +2064,428 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* return the size of the complete records at the start of a journal file */
+static long get_journal_size( int fd )
+{
+    char buffer[8192], prev = 0;
+    long pos = 0, size = 0;
+    ssize_t i, count;
+
+    while ((count = read( fd, buffer, sizeof(buffer) )) > 0)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (!buffer[i]) return size;  /* garbage after a crash */
+            if (buffer[i] == '\n' && prev == '\n') size = pos + i + 1;
+            prev = buffer[i];
+        }
+        pos += count;
+    }
+    return size;
+}
+
+/* empty the journal of a registry branch */
+static int reset_journal( struct save_branch_info *info )
+{
+    if (ftruncate( fileno( info->journal ), 0 ) == -1 ||
+        fputs( journal_header, info->journal ) == EOF ||
+        fflush( info->journal ) == EOF)
+    {
+        fclose( info->journal );
+        info->journal = NULL;
+        return 0;
+    }
+    info->journal_size = sizeof(journal_header) - 1;
+    return 1;
+}
+
+/* open the journal of a registry branch, optionally replaying the changes it contains */
+static int open_journal( struct save_branch_info *info, int replay )
+{
+    long size = 0;
+    FILE *f;
+    int fd;
+
+    if ((fd = open( info->journal_path, O_RDWR | O_CREAT | O_APPEND, 0666 )) == -1) return 0;
+
+    if (replay && (size = get_journal_size( fd )) > (long)sizeof(journal_header) - 1)
+    {
+        /* discard a partially written record at the end */
+        if (ftruncate( fd, size ) == -1 || lseek( fd, 0, SEEK_SET ) == -1 ||
+            !(f = fdopen( dup( fd ), "r" )))
+        {
+            close( fd );
+            return 0;
+        }
+        clear_error();
+        load_keys( info->key, info->journal_path, f, 0 );
+        fclose( f );
+        if (get_error() == STATUS_NOT_REGISTRY_FILE)
+        {
+            fprintf( stderr, "%s is not a valid registry file\n", info->journal_path );
+            size = 0;
+        }
+        else make_dirty( info->key );  /* the branch file is missing these changes */
+    }
+    else size = 0;
+
+    if (!(info->journal = fdopen( fd, "a" )))
+    {
+        close( fd );
+        return 0;
+    }
+    if (!size) return reset_journal( info );
+    info->journal_size = size;
+    return 1;
+}
+
+/*
+ * Parsing large text files takes a while, so a binary snapshot of each branch is
+ * written along with the text file, and used at startup instead of parsing it if
+ * it matches the text file, which remains the reference. It contains the keys in
+ * depth-first order, each key followed by its values and then by its subkeys, with
+ * all the records aligned on 8 bytes.
+ */
+
+#define CACHE_MAGIC 0x31474552  /* "REG1" */
+
+struct cache_header
+{
+    unsigned int     magic;      /* CACHE_MAGIC */
+    unsigned int     arch;       /* prefix type */
+    unsigned __int64 size;       /* size of the cache file */
+    unsigned __int64 file_size;  /* size of the text file */
+    unsigned __int64 file_time;  /* modification time of the text file */
+    unsigned __int64 file_hash;  /* hash of the text file contents */
+};
+
+struct cache_key
+{
+    timeout_t        modif;      /* last modification time */
+    unsigned int     flags;      /* key flags */
+    unsigned int     values;     /* number of values */
+    unsigned int     subkeys;    /* number of subkeys */
+    unsigned short   namelen;    /* length of the name that follows */
+    unsigned short   classlen;   /* length of the class that follows the name */
+};
+
+struct cache_value
+{
+    unsigned int     type;       /* value type */
+    data_size_t      len;        /* length of the data that follows the name */
+    unsigned short   namelen;    /* length of the name */
+    unsigned short   pad;
+};
+
+#define CACHE_ALIGN(len) (((len) + 7) & ~7)
+
+/* get the size, time and hash of a text file to check a cache against it */
+static int get_cache_file_info( const char *filename, struct cache_header *header )
+{
+    unsigned __int64 hash = 0xcbf29ce484222325ull, buffer[8192];
+    struct stat st;
+    ssize_t i, count;
+    int fd;
+
+    if ((fd = open( filename, O_RDONLY )) == -1) return 0;
+    if (fstat( fd, &st ) == -1)
+    {
+        close( fd );
+        return 0;
+    }
+    header->file_size = st.st_size;
+    header->file_time = st.st_mtime;
+
+    while ((count = read( fd, buffer, sizeof(buffer) )) > 0)
+    {
+        if (count % sizeof(buffer[0]))
+            memset( (char *)buffer + count, 0, sizeof(buffer[0]) - count % sizeof(buffer[0]) );
+        for (i = 0; i < (count + sizeof(buffer[0]) - 1) / sizeof(buffer[0]); i++)
+            hash = (hash ^ buffer[i]) * 0x100000001b3ull;
+    }
+    close( fd );
+    header->file_hash = hash;
+    return !count;
+}
+
+/* write a chunk of data to the cache, padded to the cache alignment */
+static void write_cache_data( const void *data, size_t len, FILE *f )
+{
+    static const char padding[8];
+
+    if (len) fwrite( data, len, 1, f );
+    if (len % 8) fwrite( padding, 8 - len % 8, 1, f );
+}
+
+/* write a key and all its subkeys to the cache */
+static void write_cache_key( struct key *key, FILE *f )
+{
+    struct cache_key ck;
+    struct cache_value cv;
+    int i;
+
+    sort_subkeys( key );
+    sort_values( key );
+    ck.modif    = key->modif;
+    ck.flags    = key->flags & KEY_SYMLINK;
+    ck.values   = key->last_value + 1;
+    ck.subkeys  = 0;
+    ck.namelen  = key->namelen;
+    ck.classlen = key->classlen;
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!(key->subkeys[i]->flags & KEY_VOLATILE)) ck.subkeys++;
+
+    write_cache_data( &ck, sizeof(ck), f );
+    write_cache_data( key->name, key->namelen, f );
+    write_cache_data( key->class, key->classlen, f );
+    for (i = 0; i <= key->last_value; i++)
+    {
+        cv.type    = key->values[i].type;
+        cv.len     = key->values[i].len;
+        cv.namelen = key->values[i].namelen;
+        cv.pad     = 0;
+        write_cache_data( &cv, sizeof(cv), f );
+        write_cache_data( key->values[i].name, cv.namelen, f );
+        write_cache_data( key->values[i].data, cv.len, f );
+    }
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!(key->subkeys[i]->flags & KEY_VOLATILE)) write_cache_key( key->subkeys[i], f );
+}
+
+/* write the cache of a registry branch, matching the current contents of its text file */
+static void save_cache( const char *filename, struct key *key )
+{
+    struct cache_header header;
+    char *path;
+    FILE *f;
+    int ret;
+
+    if (!get_cache_file_info( filename, &header )) return;
+    if (!(path = malloc( strlen( filename ) + sizeof(".cache") ))) return;
+    strcpy( path, filename );
+    strcat( path, ".cache" );
+
+    if ((f = fopen( path, "w" )))
+    {
+        /* the header is written last, so that an incomplete file is never valid */
+        header.magic = 0;
+        header.arch  = prefix_type;
+        header.size  = 0;
+        fwrite( &header, sizeof(header), 1, f );
+        write_cache_key( key, f );
+        header.magic = CACHE_MAGIC;
+        header.size  = ftell( f );
+        ret = !fflush( f ) && !fseek( f, 0, SEEK_SET ) && fwrite( &header, sizeof(header), 1, f ) == 1;
+        if (fclose( f ) || !ret) unlink( path );
+    }
+    free( path );
+}
+
+/* get a chunk of data from the cache, NULL if the cache is truncated */
+static const void *get_cache_data( const char **ptr, const char *end, size_t len )
+{
+    const char *ret = *ptr;
+
+    if (CACHE_ALIGN( len ) > (size_t)(end - ret)) return NULL;
+    *ptr += CACHE_ALIGN( len );
+    return ret;
+}
+
+/* load a key from the cache, as a subkey of parent, or into parent itself for the top key */
+/* if append is set, the key doesn't exist yet and can be added at the end of the sorted subkeys */
+static int load_cache_key( struct key *parent, int top, int append, const char **ptr, const char *end )
+{
+    const struct cache_key *ck;
+    const struct cache_value *cv;
+    const void *data;
+    struct unicode_str name;
+    struct key *key = parent;
+    struct key_value *value;
+    unsigned int i;
+    int index = parent->last_subkey + 1;
+
+    if (!(ck = get_cache_data( ptr, end, sizeof(*ck) ))) return 0;
+    if (!(name.str = get_cache_data( ptr, end, ck->namelen ))) return 0;
+    name.len = ck->namelen;
+    if (!top && (append || !(key = find_subkey( parent, &name, &index ))) &&
+        !(key = alloc_subkey( parent, &name, index, ck->modif ))) return 0;
+    append = (key->last_value == -1);
+
+    key->modif = ck->modif;
+    key->flags |= ck->flags & KEY_SYMLINK;
+    if (!(data = get_cache_data( ptr, end, ck->classlen ))) return 0;
+    if (ck->classlen)
+    {
+        free( key->class );
+        if (!(key->class = memdup( data, ck->classlen ))) return 0;
+        key->classlen = ck->classlen;
+    }
+
+    for (i = 0; i < ck->values; i++)
+    {
+        if (!(cv = get_cache_data( ptr, end, sizeof(*cv) ))) return 0;
+        if (!(name.str = get_cache_data( ptr, end, cv->namelen ))) return 0;
+        name.len = cv->namelen;
+        if (!(data = get_cache_data( ptr, end, cv->len ))) return 0;
+        index = key->last_value + 1;
+        if ((append || !(value = find_value( key, &name, &index ))) &&
+            !(value = insert_value( key, &name, index )))
+            return 0;
+        free( value->data );
+        value->type = cv->type;
+        value->len  = 0;
+        if (!(value->data = cv->len ? memdup( data, cv->len ) : NULL) && cv->len) return 0;
+        value->len  = cv->len;
+    }
+
+    append = (key->last_subkey == -1);
+    for (i = 0; i < ck->subkeys; i++)
+        if (!load_cache_key( key, 0, append, ptr, end )) return 0;
+    return 1;
+}
+
+/* move the contents of a key loaded from the cache into the (empty) branch key */
+static void graft_cache_key( struct key *key, struct key *loaded )
+{
+#define SWAP(field) do { tmp = (void *)key->field; key->field = loaded->field; loaded->field = tmp; } while(0)
+    void *tmp;
+    int i, count;
+
+    SWAP( subkeys );
+    SWAP( subkey_hash );
+    SWAP( values );
+    SWAP( value_hash );
+    SWAP( class );
+#undef SWAP
+    count = key->nb_subkeys; key->nb_subkeys = loaded->nb_subkeys; loaded->nb_subkeys = count;
+    count = key->nb_values; key->nb_values = loaded->nb_values; loaded->nb_values = count;
+    key->last_subkey    = loaded->last_subkey;
+    key->sorted_subkeys = loaded->sorted_subkeys;
+    key->last_value     = loaded->last_value;
+    key->sorted_values  = loaded->sorted_values;
+    key->classlen       = loaded->classlen;
+    key->modif          = loaded->modif;
+    key->flags         |= loaded->flags & KEY_SYMLINK;
+    loaded->last_subkey = loaded->last_value = -1;
+    loaded->sorted_subkeys = loaded->sorted_values = 0;
+    loaded->classlen = 0;
+    for (i = 0; i <= key->last_subkey; i++) key->subkeys[i]->parent = key;
+}
+
+/* load a registry branch from its cache, if it is up to date */
+static int load_cache( const char *filename, struct key *key )
+{
+    static const struct unicode_str empty_name = { NULL, 0 };
+    struct cache_header info;
+    const struct cache_header *header;
+    struct key *loaded;
+    const char *ptr;
+    struct stat st;
+    size_t size;
+    char *path;
+    void *base;
+    int fd, ret = 0;
+
+    /* the cache is loaded into a separate key, and can only replace an empty branch */
+    if (key->last_subkey != -1 || key->last_value != -1) return 0;
+
+    if (!(path = malloc( strlen( filename ) + sizeof(".cache") ))) return 0;
+    strcpy( path, filename );
+    strcat( path, ".cache" );
+    fd = open( path, O_RDONLY );
+    free( path );
+    if (fd == -1) return 0;
+
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header) ||
+        (base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return 0;
+    }
+    close( fd );
+    size = st.st_size;
+
+    header = base;
+    if (header->magic != CACHE_MAGIC || header->size != st.st_size) goto done;
+    if (header->arch != PREFIX_UNKNOWN && prefix_type != PREFIX_UNKNOWN && header->arch != prefix_type)
+        goto done;
+    /* check the size and time first, to avoid reading the text file needlessly */
+    if (stat( filename, &st ) == -1 || st.st_size != header->file_size ||
+        st.st_mtime != header->file_time) goto done;
+    if (!get_cache_file_info( filename, &info ) || info.file_hash != header->file_hash ||
+        info.file_size != header->file_size) goto done;
+
+    if (!(loaded = alloc_key( &empty_name, key->modif ))) goto done;
+    ptr = (const char *)(header + 1);
+    if ((ret = load_cache_key( loaded, 1, 0, &ptr, (const char *)base + header->size )))
+    {
+        graft_cache_key( key, loaded );
+        if (prefix_type == PREFIX_UNKNOWN) prefix_type = header->arch;
+    }
+    /* the partially loaded keys are freed, and the text file is loaded instead */
+    else fprintf( stderr, "%s.cache is not a valid registry cache\n", filename );
+    release_object( loaded );
+
+ done:
+    munmap( base, size );
+    return ret;
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct save_branch_info *info;
+    struct timeval start, end;
+    long size = 0;
+    int cached;
     FILE *f;
 
     if ((f = fopen( filename, "r" )))
     {
-        load_keys( key, filename, f, 0 );
-        fclose( f );
-        if (get_error() == STATUS_NOT_REGISTRY_FILE)
+        gettimeofday( &start, NULL );
+        if (!(cached = load_cache( filename, key )))
         {
-            fprintf( stderr, "%s is not a valid registry file\n", filename );
-            return 1;
+            load_keys( key, filename, f, 0 );
+            if (get_error() == STATUS_NOT_REGISTRY_FILE)
+            {
+                fprintf( stderr, "%s is not a valid registry file\n", filename );
+                fclose( f );
+                return 1;
+            }
+            save_cache( filename, key );
+        }
+        if (debug_level)
+        {
+            /* timing of the startup load, to compare the cache with the text file */
+            gettimeofday( &end, NULL );
+            fprintf( stderr, "wineserver: loaded %s from the %s in %ld us\n", filename,
+                     cached ? "cache" : "text file",
+                     (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_usec - start.tv_usec) );
         }
+        fseek( f, 0, SEEK_END );
+        size = ftell( f );
+        fclose( f );
     }
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info = &save_branch_info[save_branch_count++];
+    info->path = filename;
+    info->key = (struct key *)grab_object( key );
+    info->file_size = size;
     make_object_static( &key->obj );
+
+    /* apply the changes that were not saved to the file yet */
+    if ((info->journal_path = malloc( strlen( filename ) + sizeof(".journal") )))
+    {
+        strcpy( info->journal_path, filename );
+        strcat( info->journal_path, ".journal" );
+        if (!open_journal( info, 1 ))
+        {
+            fprintf( stderr, "wineserver: could not open registry journal %s", info->journal_path );
+            perror( " " );
+        }
+    }
     return (f != NULL);
 }
 
@@ -1840,11 +2662,14 @@ static void save_registry( struct key *key, obj_handle_t handle )
 }
 
 /* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+static int save_branch( struct save_branch_info *info )
 {
+    struct key *key = info->key;
+    const char *path = info->path;
     struct stat st;
     char *p, *tmp = NULL;
     int fd, count = 0, ret = 0;
+    long size;
     FILE *f;
 
     if (!(key->flags & KEY_DIRTY))
@@ -1898,6 +2723,7 @@ static int save_branch( struct key *key, const char *path )
     }
 
     save_all_subkeys( key, f );
+    size = ftell( f );
     ret = !fclose(f);
 
     if (tmp)
@@ -1909,7 +2735,16 @@ static int save_branch( struct key *key, const char *path )
 
 done:
     free( tmp );
-    if (ret) make_clean( key );
+    if (ret)
+    {
+        make_clean( key );
+        save_cache( path, key );
+        info->file_size = size;
+        info->force_save = 0;
+        /* all the changes are in the file now, start a new journal */
+        if (info->journal) reset_journal( info );
+        else if (info->journal_path) open_journal( info, 0 );
+    }
     return ret;
 }
 
@@ -1921,7 +2756,14 @@ static void periodic_save( void *arg )
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
     for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    {
+        struct save_branch_info *info = &save_branch_info[i];
+
+        /* the changes are safe in the journal, rewrite the file only once it gets large */
+        if (info->journal && !info->force_save &&
+            (info->journal_size < min_journal_size || info->journal_size < info->file_size / 2)) continue;
+        save_branch( info );
+    }
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -1941,7 +2783,7 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        if (!save_branch( &save_branch_info[i] ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
                      save_branch_info[i].path );
@@ -2036,9 +2878,13 @@ DECL_HANDLER(delete_key)
 DECL_HANDLER(flush_key)
 {
     struct key *key = get_hkey_obj( req->hkey, 0 );
+    struct save_branch_info *branch;
+
     if (key)
     {
-        /* we don't need to do anything here with the current implementation */
+        /* the changes are already in the journal, make sure they reach the disk */
+        if ((branch = get_key_branch( key )) && branch->journal)
+            fsync( fileno( branch->journal ));
         release_object( key );
     }
 }
@@ -2147,7 +2993,11 @@ DECL_HANDLER(load_registry)
         get_req_path( &name, !req->hkey );
         if ((key = create_key( parent, &name, NULL, 0, KEY_WOW64_64KEY, 0, &dummy )))
         {
+            struct save_branch_info *branch;
+
             load_registry( key, req->file );
+            /* the loaded keys are not journaled, they have to be saved to the file */
+            if ((branch = get_key_branch( key ))) branch->force_save = 1;
             release_object( key );
         }
         release_object( parent );
@@ -47,6 +47,12 @@
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
 #include <unistd.h>
 #ifdef HAVE_POLL_H
 #include <poll.h>
@@ -119,6 +125,59 @@ static const struct fd_ops master_socket_fd_ops =
     NULL                           /* cancel_async */
 };
 
+#ifdef __linux__
+
+/* pipe written by the clients to wake the server when they store a request in their shared buffer */
+struct request_shm_doorbell
+{
+    struct object        obj;        /* object header */
+    struct fd           *fd;         /* file descriptor of the read side */
+    int                  write_fd;   /* unix fd of the write side, sent to the clients */
+};
+
+static void request_shm_doorbell_dump( struct object *obj, int verbose );
+static void request_shm_doorbell_destroy( struct object *obj );
+static void request_shm_doorbell_poll_event( struct fd *fd, int event );
+
+static const struct object_ops request_shm_doorbell_ops =
+{
+    sizeof(struct request_shm_doorbell),  /* size */
+    request_shm_doorbell_dump,     /* dump */
+    no_get_type,                   /* get_type */
+    no_add_queue,                  /* add_queue */
+    NULL,                          /* remove_queue */
+    NULL,                          /* signaled */
+    NULL,                          /* satisfied */
+    no_signal,                     /* signal */
+    no_get_fd,                     /* get_fd */
+    no_map_access,                 /* map_access */
+    default_get_sd,                /* get_sd */
+    default_set_sd,                /* set_sd */
+    no_lookup_name,                /* lookup_name */
+    no_open_file,                  /* open_file */
+    no_close_handle,               /* close_handle */
+    request_shm_doorbell_destroy   /* destroy */
+};
+
+static const struct fd_ops request_shm_doorbell_fd_ops =
+{
+    NULL,                          /* get_poll_events */
+    request_shm_doorbell_poll_event, /* poll_event */
+    NULL,                          /* flush */
+    NULL,                          /* get_fd_type */
+    NULL,                          /* ioctl */
+    NULL,                          /* queue_async */
+    NULL,                          /* reselect_async */
+    NULL                           /* cancel_async */
+};
+
+static struct request_shm_doorbell *request_shm_doorbell;
+static struct request_shm_header *request_shm_header;  /* pending bitmap shared with all the clients */
+static int request_shm_header_fd = -1;
+static struct thread *request_shm_threads[REQUEST_SHM_SLOTS];  /* owners of the buffer slots */
+
+#endif  /* __linux__ */
+
 
 struct thread *current = NULL;  /* thread handling the current request */
 unsigned int global_error = 0;  /* global error code for when no thread is current */
@@ -188,6 +247,26 @@ void write_reply( struct thread *thread )
         fatal_protocol_error( thread, "reply write: %s\n", strerror( errno ));
 }
 
+C_ASSERT( FIELD_OFFSET( struct request_shm, data ) == REQUEST_SHM_SIZE - REQUEST_SHM_DATA_SIZE );
+
+/* send a reply to the current thread through its shared buffer */
+static void send_reply_shm( union generic_reply *reply )
+{
+    struct request_shm *shm = current->request_shm;
+
+    memcpy( &shm->msg, reply, sizeof(*reply) );
+    if (current->reply_size) memcpy( shm->data, current->reply_data, current->reply_size );
+    free( current->reply_data );
+    current->reply_data = NULL;
+
+    /* the interlocked op orders the stores above with the check of the waiting flag */
+    interlocked_xchg_add( &shm->seq, 1 );
+#ifdef __linux__
+    if (*(volatile int *)&shm->waiting)
+        syscall( __NR_futex, &shm->seq, 1 /* FUTEX_WAKE */, 1, NULL, 0, 0 );
+#endif
+}
+
 /* send a reply to the current thread */
 static void send_reply( union generic_reply *reply )
 {
@@ -230,8 +309,8 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
-/* call a request handler */
-static void call_req_handler( struct thread *thread )
+/* call a request handler, the reply goes where the request came from */
+static void call_req_handler( struct thread *thread, int shm )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
@@ -255,7 +334,8 @@ static void call_req_handler( struct thread *thread )
             reply.reply_header.error = current->error;
             reply.reply_header.reply_size = current->reply_size;
             if (debug_level) trace_reply( req, &reply );
-            send_reply( &reply );
+            if (shm) send_reply_shm( &reply );
+            else send_reply( &reply );
         }
         else
         {
@@ -266,6 +346,109 @@ static void call_req_handler( struct thread *thread )
     current = NULL;
 }
 
+/* check if a request can be part of a batch */
+static int is_batch_request( enum request req )
+{
+    switch (req)
+    {
+    /* requests that change the way the thread talks to us */
+    case REQ_batch:
+    case REQ_create_request_shm:
+    case REQ_init_thread:
+    case REQ_init_process_done:
+    /* requests that can block, or return STATUS_PENDING and expect the caller to wait */
+    case REQ_select:
+    case REQ_get_message:
+    case REQ_get_message_reply:
+    case REQ_get_apc_result:
+    case REQ_get_thread_context:
+    case REQ_set_thread_context:
+    case REQ_get_exception_status:
+    case REQ_remove_completion:
+    case REQ_get_next_device_request:
+    case REQ_lock_file:
+    case REQ_register_async:
+    case REQ_ioctl:
+    case REQ_flush_file:
+    case REQ_read_directory_changes:
+        return 0;
+    default:
+        return req < REQ_NB_REQUESTS;
+    }
+}
+
+/* execute a batch of requests, storing each reply followed by its data */
+/* each request and each reply is padded to a multiple of 8 bytes */
+DECL_HANDLER(batch)
+{
+    struct thread *thread = current;
+    union generic_request batch_req = current->req;
+    void *batch_data = current->req_data;
+    const char *ptr = get_req_data(), *end = ptr + get_req_data_size();
+    data_size_t max_size = get_reply_max_size(), pos = 0;
+    char *replies = NULL;
+    unsigned int error = STATUS_SUCCESS;
+
+    if (max_size && !(replies = mem_alloc( max_size ))) return;
+
+    while (ptr < end)
+    {
+        union generic_request sub_req;
+        union generic_reply sub_reply;
+        enum request req;
+
+        if (end - ptr < sizeof(sub_req))
+        {
+            error = STATUS_INVALID_PARAMETER;
+            break;
+        }
+        memcpy( &sub_req, ptr, sizeof(sub_req) );
+        ptr += sizeof(sub_req);
+        req = sub_req.request_header.req;
+        if (!is_batch_request( req ) ||
+            sub_req.request_header.request_size > end - ptr ||
+            max_size - pos < sizeof(sub_reply) ||
+            BATCH_ALIGN( sub_req.request_header.reply_size ) > max_size - pos - sizeof(sub_reply))
+        {
+            error = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        current->req = sub_req;
+        current->req_data = (void *)ptr;
+        current->reply_size = 0;
+        ptr += min( BATCH_ALIGN( sub_req.request_header.request_size ), end - ptr );
+        clear_error();
+        memset( &sub_reply, 0, sizeof(sub_reply) );
+
+        if (debug_level) trace_request();
+        req_handlers[req]( &current->req, &sub_reply );
+
+        if (current != thread)  /* the thread has been killed */
+        {
+            free( replies );
+            return;
+        }
+        sub_reply.reply_header.error = current->error;
+        sub_reply.reply_header.reply_size = current->reply_size;
+        if (debug_level) trace_reply( req, &sub_reply );
+        memcpy( replies + pos, &sub_reply, sizeof(sub_reply) );
+        pos += sizeof(sub_reply);
+        if (current->reply_size) memcpy( replies + pos, current->reply_data, current->reply_size );
+        pos += BATCH_ALIGN( current->reply_size );
+        free( current->reply_data );
+        current->reply_data = NULL;
+        current->reply_size = 0;
+        reply->count++;
+    }
+
+    current->req = batch_req;
+    current->req_data = batch_data;
+    set_error( error );
+    if (pos) set_reply_data_ptr( replies, pos );
+    else free( replies );
+}
+
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
@@ -278,7 +461,7 @@ void read_request( struct thread *thread )
         if (!(thread->req_toread = thread->req.request_header.request_size))
         {
             /* no data, handle request at once */
-            call_req_handler( thread );
+            call_req_handler( thread, 0 );
             return;
         }
         if (!(thread->req_data = malloc( thread->req_toread )))
@@ -299,7 +482,7 @@ void read_request( struct thread *thread )
         if (ret <= 0) break;
         if (!(thread->req_toread -= ret))
         {
-            call_req_handler( thread );
+            call_req_handler( thread, 0 );
             free( thread->req_data );
             thread->req_data = NULL;
             return;
@@ -315,6 +498,196 @@ error:
         fatal_protocol_error( thread, "read: %s\n", strerror( errno ));
 }
 
+/* release the shared request buffer of a thread */
+void free_request_shm( struct thread *thread )
+{
+    if (!thread->request_shm) return;
+#ifdef __linux__
+    request_shm_threads[thread->request_shm_slot] = NULL;
+#endif
+    munmap( thread->request_shm, REQUEST_SHM_SIZE );
+    thread->request_shm = NULL;
+    thread->request_shm_slot = -1;
+}
+
+#ifdef __linux__
+
+/* read a request from the shared buffer of a thread */
+static void read_request_shm( struct thread *thread )
+{
+    struct request_shm *shm = thread->request_shm;
+    int seq = *(volatile int *)&shm->req_seq;
+
+    if (seq == thread->request_shm_seq) return;  /* stale bit, already handled */
+    thread->request_shm_seq = seq;
+
+    /* the client sends one request at a time, it can't be in the middle of a pipe transfer */
+    if (thread->req_toread || thread->reply_towrite)
+    {
+        fatal_protocol_error( thread, "shared request during a pipe transfer\n" );
+        return;
+    }
+    memcpy( &thread->req, &shm->msg, sizeof(thread->req) );
+    if (thread->req.request_header.request_size > REQUEST_SHM_DATA_SIZE ||
+        thread->req.request_header.reply_size > REQUEST_SHM_DATA_SIZE)
+    {
+        fatal_protocol_error( thread, "shared request too large %u/%u\n",
+                              thread->req.request_header.request_size,
+                              thread->req.request_header.reply_size );
+        return;
+    }
+    if (thread->req.request_header.request_size)
+    {
+        if (!(thread->req_data = malloc( thread->req.request_header.request_size )))
+        {
+            fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
+                                  thread->req.request_header.request_size,
+                                  thread->req.request_header.req );
+            return;
+        }
+        /* copy the data so that the client can't modify it behind our back */
+        memcpy( thread->req_data, shm->data, thread->req.request_header.request_size );
+    }
+    grab_object( thread );
+    call_req_handler( thread, 1 );
+    free( thread->req_data );
+    thread->req_data = NULL;
+    release_object( thread );
+}
+
+/* handle the requests stored in the shared buffers since the last call */
+void process_request_shm(void)
+{
+    unsigned int i, j, bits;
+
+    if (!request_shm_header) return;
+
+    for (i = 0; i < REQUEST_SHM_SLOTS / 32; i++)
+    {
+        if (!request_shm_header->pending[i]) continue;
+        bits = interlocked_xchg( (int *)&request_shm_header->pending[i], 0 );
+        for (j = 0; bits; j++, bits >>= 1)
+        {
+            struct thread *thread;
+
+            if (!(bits & 1)) continue;
+            if ((thread = request_shm_threads[i * 32 + j])) read_request_shm( thread );
+        }
+    }
+}
+
+/* tell the clients to ring the doorbell before waiting for events, return the timeout to use */
+int set_request_shm_sleeping( int timeout )
+{
+    unsigned int i;
+
+    if (!request_shm_header || !timeout) return timeout;
+
+    /* the interlocked op orders the flag with the check of the bitmap, */
+    /* the clients set their bit before checking the flag */
+    interlocked_xchg( &request_shm_header->sleeping, 1 );
+    for (i = 0; i < REQUEST_SHM_SLOTS / 32; i++)
+        if (*(volatile unsigned int *)&request_shm_header->pending[i]) return 0;
+    return timeout;
+}
+
+/* the server is awake again, the clients don't need to ring the doorbell */
+void clear_request_shm_sleeping(void)
+{
+    if (request_shm_header) request_shm_header->sleeping = 0;
+}
+
+static void request_shm_doorbell_dump( struct object *obj, int verbose )
+{
+    struct request_shm_doorbell *doorbell = (struct request_shm_doorbell *)obj;
+    assert( obj->ops == &request_shm_doorbell_ops );
+    fprintf( stderr, "Request doorbell fd=%p\n", doorbell->fd );
+}
+
+static void request_shm_doorbell_destroy( struct object *obj )
+{
+    struct request_shm_doorbell *doorbell = (struct request_shm_doorbell *)obj;
+    assert( obj->ops == &request_shm_doorbell_ops );
+    if (doorbell->fd) release_object( doorbell->fd );
+    close( doorbell->write_fd );
+}
+
+/* drain the doorbell, the requests are handled before the next wait */
+static void request_shm_doorbell_poll_event( struct fd *fd, int event )
+{
+    char buffer[64];
+
+    while (read( get_unix_fd( fd ), buffer, sizeof(buffer) ) > 0);
+}
+
+/* create the header and the doorbell shared by all the request buffers */
+static int init_request_shm_header(void)
+{
+    struct request_shm_doorbell *doorbell;
+    void *ptr;
+    int fd[2];
+
+    if (request_shm_header) return 1;
+
+    if ((request_shm_header_fd = create_temp_file( REQUEST_SHM_HEADER_SIZE )) == -1) return 0;
+    if ((ptr = mmap( NULL, REQUEST_SHM_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     request_shm_header_fd, 0 )) == MAP_FAILED)
+    {
+        file_set_error();
+        goto failed;
+    }
+    if (pipe( fd ) == -1)
+    {
+        file_set_error();
+        munmap( ptr, REQUEST_SHM_HEADER_SIZE );
+        goto failed;
+    }
+    /* the clients don't wait for the server to drain it */
+    fcntl( fd[0], F_SETFL, O_NONBLOCK );
+    fcntl( fd[1], F_SETFL, O_NONBLOCK );
+    if (!(doorbell = alloc_object( &request_shm_doorbell_ops )))
+    {
+        close( fd[0] );
+        close( fd[1] );
+        munmap( ptr, REQUEST_SHM_HEADER_SIZE );
+        goto failed;
+    }
+    doorbell->write_fd = fd[1];
+    if (!(doorbell->fd = create_anonymous_fd( &request_shm_doorbell_fd_ops, fd[0], &doorbell->obj, 0 )))
+    {
+        release_object( doorbell );
+        munmap( ptr, REQUEST_SHM_HEADER_SIZE );
+        goto failed;
+    }
+    set_fd_events( doorbell->fd, POLLIN );
+    make_object_static( &doorbell->obj );
+    request_shm_doorbell = doorbell;
+    request_shm_header = ptr;
+    return 1;
+
+failed:
+    close( request_shm_header_fd );
+    request_shm_header_fd = -1;
+    return 0;
+}
+
+#else  /* __linux__ */
+
+void process_request_shm(void)
+{
+}
+
+int set_request_shm_sleeping( int timeout )
+{
+    return timeout;
+}
+
+void clear_request_shm_sleeping(void)
+{
+}
+
+#endif  /* __linux__ */
+
 /* receive a file descriptor on the process socket */
 int receive_fd( struct process *process )
 {
@@ -841,3 +1214,50 @@ void close_master_socket( timeout_t timeout )
 
     master_timeout = add_timeout_user( timeout, close_socket_timeout, NULL );
 }
+
+/* create the shared memory buffer for the requests of the current thread */
+DECL_HANDLER(create_request_shm)
+{
+#ifdef __linux__
+    struct request_shm *shm;
+    int fd, slot;
+
+    if (current->request_shm)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if (!init_request_shm_header()) return;
+    for (slot = 0; slot < REQUEST_SHM_SLOTS; slot++) if (!request_shm_threads[slot]) break;
+    if (slot == REQUEST_SHM_SLOTS)
+    {
+        set_error( STATUS_NO_MEMORY );
+        return;
+    }
+    if ((fd = create_temp_file( REQUEST_SHM_SIZE )) == -1) return;
+    if ((shm = mmap( NULL, REQUEST_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        file_set_error();
+        close( fd );
+        return;
+    }
+    shm->slot = slot;
+    if (send_client_fd( current->process, fd, 0 ) == -1 ||
+        (req->get_fds &&
+         (send_client_fd( current->process, request_shm_header_fd, 0 ) == -1 ||
+          send_client_fd( current->process, request_shm_doorbell->write_fd, 0 ) == -1)))
+    {
+        munmap( shm, REQUEST_SHM_SIZE );
+        close( fd );
+        return;
+    }
+    close( fd );
+    current->request_shm = shm;
+    current->request_shm_slot = slot;
+    current->request_shm_seq = 0;
+    request_shm_threads[slot] = current;
+    reply->size = REQUEST_SHM_SIZE;
+#else
+    set_error( STATUS_NOT_SUPPORTED );  /* we need futexes to wake up the client */
+#endif
+}
@@ -50,6 +50,10 @@ extern int receive_fd( struct process *process );
 extern int send_client_fd( struct process *process, int fd, obj_handle_t handle );
 extern void read_request( struct thread *thread );
 extern void write_reply( struct thread *thread );
+extern void free_request_shm( struct thread *thread );
+extern void process_request_shm(void);
+extern int set_request_shm_sleeping( int timeout );
+extern void clear_request_shm_sleeping(void);
 extern unsigned int get_tick_count(void);
 extern void open_master_socket(void);
 extern void close_master_socket( timeout_t timeout );
@@ -112,6 +116,7 @@ DECL_HANDLER(new_thread);
 DECL_HANDLER(get_startup_info);
 DECL_HANDLER(init_process_done);
 DECL_HANDLER(init_thread);
+DECL_HANDLER(create_request_shm);
 DECL_HANDLER(terminate_process);
 DECL_HANDLER(terminate_thread);
 DECL_HANDLER(get_process_info);
@@ -134,12 +139,18 @@ DECL_HANDLER(select);
 DECL_HANDLER(create_event);
 DECL_HANDLER(event_op);
 DECL_HANDLER(open_event);
+DECL_HANDLER(create_keyed_event);
+DECL_HANDLER(open_keyed_event);
+DECL_HANDLER(get_keyed_event_info);
 DECL_HANDLER(create_mutex);
 DECL_HANDLER(release_mutex);
 DECL_HANDLER(open_mutex);
 DECL_HANDLER(create_semaphore);
 DECL_HANDLER(release_semaphore);
 DECL_HANDLER(open_semaphore);
+DECL_HANDLER(get_fast_sync_shm);
+DECL_HANDLER(get_fast_sync_obj);
+DECL_HANDLER(wake_fast_sync_obj);
 DECL_HANDLER(create_file);
 DECL_HANDLER(open_file_object);
 DECL_HANDLER(alloc_file_handle);
@@ -227,6 +238,7 @@ DECL_HANDLER(init_atom_table);
 DECL_HANDLER(get_msg_queue);
 DECL_HANDLER(set_queue_fd);
 DECL_HANDLER(set_queue_mask);
+DECL_HANDLER(get_queue_shm);
 DECL_HANDLER(get_queue_status);
 DECL_HANDLER(get_process_idle_event);
 DECL_HANDLER(send_message);
@@ -355,6 +367,7 @@ DECL_HANDLER(set_cursor);
 DECL_HANDLER(update_rawinput_devices);
 DECL_HANDLER(get_suspend_context);
 DECL_HANDLER(set_suspend_context);
+DECL_HANDLER(batch);
 
 #ifdef WANT_REQUEST_HANDLERS
 
@@ -367,6 +380,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_startup_info,
     (req_handler)req_init_process_done,
     (req_handler)req_init_thread,
+    (req_handler)req_create_request_shm,
     (req_handler)req_terminate_process,
     (req_handler)req_terminate_thread,
     (req_handler)req_get_process_info,
@@ -389,12 +403,18 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_create_event,
     (req_handler)req_event_op,
     (req_handler)req_open_event,
+    (req_handler)req_create_keyed_event,
+    (req_handler)req_open_keyed_event,
+    (req_handler)req_get_keyed_event_info,
     (req_handler)req_create_mutex,
     (req_handler)req_release_mutex,
     (req_handler)req_open_mutex,
     (req_handler)req_create_semaphore,
     (req_handler)req_release_semaphore,
     (req_handler)req_open_semaphore,
+    (req_handler)req_get_fast_sync_shm,
+    (req_handler)req_get_fast_sync_obj,
+    (req_handler)req_wake_fast_sync_obj,
     (req_handler)req_create_file,
     (req_handler)req_open_file_object,
     (req_handler)req_alloc_file_handle,
@@ -482,6 +502,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_msg_queue,
     (req_handler)req_set_queue_fd,
     (req_handler)req_set_queue_mask,
+    (req_handler)req_get_queue_shm,
     (req_handler)req_get_queue_status,
     (req_handler)req_get_process_idle_event,
     (req_handler)req_send_message,
@@ -610,6 +631,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_update_rawinput_devices,
     (req_handler)req_get_suspend_context,
     (req_handler)req_set_suspend_context,
+    (req_handler)req_batch,
 };
 
 C_ASSERT( sizeof(affinity_t) == 8 );
@@ -695,6 +717,10 @@ C_ASSERT( FIELD_OFFSET(struct init_thread_reply, info_size) == 24 );
 C_ASSERT( FIELD_OFFSET(struct init_thread_reply, version) == 28 );
 C_ASSERT( FIELD_OFFSET(struct init_thread_reply, all_cpus) == 32 );
 C_ASSERT( sizeof(struct init_thread_reply) == 40 );
+C_ASSERT( FIELD_OFFSET(struct create_request_shm_request, get_fds) == 12 );
+C_ASSERT( sizeof(struct create_request_shm_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_request_shm_reply, size) == 8 );
+C_ASSERT( sizeof(struct create_request_shm_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct terminate_process_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct terminate_process_request, exit_code) == 16 );
 C_ASSERT( sizeof(struct terminate_process_request) == 24 );
@@ -813,7 +839,8 @@ C_ASSERT( FIELD_OFFSET(struct select_request, cookie) == 16 );
 C_ASSERT( FIELD_OFFSET(struct select_request, signal) == 24 );
 C_ASSERT( FIELD_OFFSET(struct select_request, prev_apc) == 28 );
 C_ASSERT( FIELD_OFFSET(struct select_request, timeout) == 32 );
-C_ASSERT( sizeof(struct select_request) == 40 );
+C_ASSERT( FIELD_OFFSET(struct select_request, key) == 40 );
+C_ASSERT( sizeof(struct select_request) == 48 );
 C_ASSERT( FIELD_OFFSET(struct select_reply, timeout) == 8 );
 C_ASSERT( FIELD_OFFSET(struct select_reply, call) == 16 );
 C_ASSERT( FIELD_OFFSET(struct select_reply, apc_handle) == 56 );
@@ -834,6 +861,30 @@ C_ASSERT( FIELD_OFFSET(struct open_event_request, rootdir) == 20 );
 C_ASSERT( sizeof(struct open_event_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_event_reply, handle) == 8 );
 C_ASSERT( sizeof(struct open_event_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_keyed_event_request, access) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_keyed_event_request, attributes) == 16 );
+C_ASSERT( sizeof(struct create_keyed_event_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct create_keyed_event_reply, handle) == 8 );
+C_ASSERT( FIELD_OFFSET(struct create_keyed_event_reply, id) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_keyed_event_reply, access) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_keyed_event_reply, shared) == 20 );
+C_ASSERT( sizeof(struct create_keyed_event_reply) == 24 );
+C_ASSERT( FIELD_OFFSET(struct open_keyed_event_request, access) == 12 );
+C_ASSERT( FIELD_OFFSET(struct open_keyed_event_request, attributes) == 16 );
+C_ASSERT( FIELD_OFFSET(struct open_keyed_event_request, rootdir) == 20 );
+C_ASSERT( sizeof(struct open_keyed_event_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct open_keyed_event_reply, handle) == 8 );
+C_ASSERT( FIELD_OFFSET(struct open_keyed_event_reply, id) == 12 );
+C_ASSERT( FIELD_OFFSET(struct open_keyed_event_reply, access) == 16 );
+C_ASSERT( FIELD_OFFSET(struct open_keyed_event_reply, shared) == 20 );
+C_ASSERT( sizeof(struct open_keyed_event_reply) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_keyed_event_info_request, handle) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_keyed_event_info_request, access) == 16 );
+C_ASSERT( sizeof(struct get_keyed_event_info_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_keyed_event_info_reply, id) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_keyed_event_info_reply, access) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_keyed_event_info_reply, shared) == 16 );
+C_ASSERT( sizeof(struct get_keyed_event_info_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_mutex_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct create_mutex_request, attributes) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_mutex_request, owned) == 20 );
@@ -868,6 +919,17 @@ C_ASSERT( FIELD_OFFSET(struct open_semaphore_request, rootdir) == 20 );
 C_ASSERT( sizeof(struct open_semaphore_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_semaphore_reply, handle) == 8 );
 C_ASSERT( sizeof(struct open_semaphore_reply) == 16 );
+C_ASSERT( sizeof(struct get_fast_sync_shm_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_shm_reply, size) == 8 );
+C_ASSERT( sizeof(struct get_fast_sync_shm_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_request, handle) == 12 );
+C_ASSERT( sizeof(struct get_fast_sync_obj_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_reply, index) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_reply, type) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_reply, access) == 16 );
+C_ASSERT( sizeof(struct get_fast_sync_obj_reply) == 24 );
+C_ASSERT( FIELD_OFFSET(struct wake_fast_sync_obj_request, handle) == 12 );
+C_ASSERT( sizeof(struct wake_fast_sync_obj_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, attributes) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, sharing) == 20 );
@@ -1366,6 +1428,10 @@ C_ASSERT( sizeof(struct set_queue_mask_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct set_queue_mask_reply, wake_bits) == 8 );
 C_ASSERT( FIELD_OFFSET(struct set_queue_mask_reply, changed_bits) == 12 );
 C_ASSERT( sizeof(struct set_queue_mask_reply) == 16 );
+C_ASSERT( sizeof(struct get_queue_shm_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_queue_shm_reply, handle) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_queue_shm_reply, index) == 12 );
+C_ASSERT( sizeof(struct get_queue_shm_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_queue_status_request, clear) == 12 );
 C_ASSERT( sizeof(struct get_queue_status_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_queue_status_reply, wake_bits) == 8 );
@@ -2152,6 +2218,9 @@ C_ASSERT( sizeof(struct update_rawinput_devices_request) == 16 );
 C_ASSERT( sizeof(struct get_suspend_context_request) == 16 );
 C_ASSERT( sizeof(struct get_suspend_context_reply) == 8 );
 C_ASSERT( sizeof(struct set_suspend_context_request) == 16 );
+C_ASSERT( sizeof(struct batch_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct batch_reply, count) == 8 );
+C_ASSERT( sizeof(struct batch_reply) == 16 );
 
 #endif  /* WANT_REQUEST_HANDLERS */
 
@@ -38,25 +38,28 @@
 
 struct semaphore
 {
-    struct object  obj;    /* object header */
-    unsigned int   count;  /* current count */
-    unsigned int   max;    /* maximum possible count */
+    struct object            obj;           /* object header */
+    struct fast_sync_object *sync;          /* current and maximum count, possibly shared with the clients */
+    struct fast_sync_object  private_sync;  /* storage for the counts when they aren't shared */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
 static struct object_type *semaphore_get_type( struct object *obj );
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int semaphore_signaled( struct object *obj, struct thread *thread );
 static int semaphore_satisfied( struct object *obj, struct thread *thread );
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
     sizeof(struct semaphore),      /* size */
     semaphore_dump,                /* dump */
     semaphore_get_type,            /* get_type */
-    add_queue,                     /* add_queue */
-    remove_queue,                  /* remove_queue */
+    semaphore_add_queue,           /* add_queue */
+    semaphore_remove_queue,        /* remove_queue */
     semaphore_signaled,            /* signaled */
     semaphore_satisfied,           /* satisfied */
     semaphore_signal,              /* signal */
@@ -67,7 +70,7 @@ static const struct object_ops semaphore_ops =
     no_lookup_name,                /* lookup_name */
     no_open_file,                  /* open_file */
     no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -87,8 +90,9 @@ static struct semaphore *create_semaphore( struct directory *root, const struct
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            sem->count = initial;
-            sem->max   = max;
+            sem->sync = alloc_fast_sync_object( &sem->private_sync, FAST_SYNC_SEMAPHORE );
+            sem->sync->value = initial;
+            sem->sync->max   = max;
             if (sd) default_set_sd( &sem->obj, sd, OWNER_SECURITY_INFORMATION|
                                                    GROUP_SECURITY_INFORMATION|
                                                    DACL_SECURITY_INFORMATION|
@@ -98,24 +102,34 @@ static struct semaphore *create_semaphore( struct directory *root, const struct
     return sem;
 }
 
+struct fast_sync_object *get_semaphore_fast_sync( struct object *obj )
+{
+    if (obj->ops != &semaphore_ops) return NULL;
+    return ((struct semaphore *)obj)->sync;
+}
+
 static int release_semaphore( struct semaphore *sem, unsigned int count,
                               unsigned int *prev )
 {
-    if (prev) *prev = sem->count;
-    if (sem->count + count < sem->count || sem->count + count > sem->max)
-    {
-        set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
-        return 0;
-    }
-    else if (sem->count)
+    unsigned int current;
+
+    do
     {
-        /* there cannot be any thread to wake up if the count is != 0 */
-        sem->count += count;
+        current = sem->sync->value;
+        if (prev) *prev = current;
+        if (current + count < current || current + count > sem->sync->max)
+        {
+            set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
+            return 0;
+        }
     }
-    else
+    while (interlocked_cmpxchg( &sem->sync->value, current + count, current ) != current);
+
+    /* there cannot be any thread to wake up if the count was != 0 */
+    if (!current)
     {
-        sem->count = count;
         wake_up( &sem->obj, count );
+        fast_sync_wake( sem->sync, count );
     }
     return 1;
 }
@@ -124,7 +138,7 @@ static void semaphore_dump( struct object *obj, int verbose )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    fprintf( stderr, "Semaphore count=%d max=%d ", sem->count, sem->max );
+    fprintf( stderr, "Semaphore count=%d max=%d ", sem->sync->value, sem->sync->max );
     dump_object_name( &sem->obj );
     fputc( '\n', stderr );
 }
@@ -136,19 +150,39 @@ static struct object_type *semaphore_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    return fast_sync_add_queue( obj, entry, sem->sync );
+}
+
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    fast_sync_remove_queue( obj, entry, sem->sync );
+}
+
 static int semaphore_signaled( struct object *obj, struct thread *thread )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    return (sem->count > 0);
+    return (sem->sync->value > 0);
 }
 
 static int semaphore_satisfied( struct object *obj, struct thread *thread )
 {
     struct semaphore *sem = (struct semaphore *)obj;
+    int count;
+
     assert( obj->ops == &semaphore_ops );
-    assert( sem->count );
-    sem->count--;
+    do
+    {
+        count = sem->sync->value;
+        if (!count) return -1;  /* already taken by a client */
+    }
+    while (interlocked_cmpxchg( &sem->sync->value, count - 1, count ) != count);
     return 0;  /* not abandoned */
 }
 
@@ -174,6 +208,13 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    free_fast_sync_object( sem->sync );
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -76,6 +76,7 @@ struct thread_wait
     int                     count;      /* count of objects */
     int                     flags;
     client_ptr_t            cookie;     /* magic cookie to return to client */
+    client_ptr_t            key;        /* key for keyed event operations */
     timeout_t               timeout;
     struct timeout_user    *user;
     struct wait_queue_entry queues[1];
@@ -182,6 +183,9 @@ static inline void init_thread_structure( struct thread *thread )
     thread->req_toread      = 0;
     thread->reply_data      = NULL;
     thread->reply_towrite   = 0;
+    thread->request_shm     = NULL;
+    thread->request_shm_slot = -1;
+    thread->request_shm_seq = 0;
     thread->request_fd      = NULL;
     thread->reply_fd        = NULL;
     thread->wait_fd         = NULL;
@@ -270,6 +274,7 @@ static void cleanup_thread( struct thread *thread )
     clear_apc_queue( &thread->user_apc );
     free( thread->req_data );
     free( thread->reply_data );
+    free_request_shm( thread );
     if (thread->request_fd) release_object( thread->request_fd );
     if (thread->reply_fd) release_object( thread->reply_fd );
     if (thread->wait_fd) release_object( thread->wait_fd );
@@ -558,7 +563,8 @@ static void end_wait( struct thread *thread )
 }
 
 /* build the thread wait structure */
-static int wait_on( unsigned int count, struct object *objects[], int flags, timeout_t timeout )
+static int wait_on( unsigned int count, struct object *objects[], int flags,
+                    client_ptr_t key, timeout_t timeout )
 {
     struct thread_wait *wait;
     struct wait_queue_entry *entry;
@@ -569,6 +575,7 @@ static int wait_on( unsigned int count, struct object *objects[], int flags, tim
     wait->thread  = current;
     wait->count   = count;
     wait->flags   = flags;
+    wait->key     = key;
     wait->user    = NULL;
     wait->timeout = timeout;
     current->wait = wait;
@@ -587,6 +594,16 @@ static int wait_on( unsigned int count, struct object *objects[], int flags, tim
     return 1;
 }
 
+/* get the keyed event operation of a wait queue entry; 0 if it isn't part of the current wait */
+int get_wait_queue_keyed_op( struct wait_queue_entry *entry, client_ptr_t *key )
+{
+    struct thread_wait *wait = entry->thread->wait;
+
+    if (!wait || entry < wait->queues || entry >= wait->queues + wait->count) return 0;
+    *key = wait->key;
+    return wait->flags & (SELECT_KEYED_EVENT_WAIT | SELECT_KEYED_EVENT_RELEASE);
+}
+
 /* check if the thread waiting condition is satisfied */
 static int check_wait( struct thread *thread )
 {
@@ -604,17 +621,40 @@ static int check_wait( struct thread *thread )
 
     if (wait->flags & SELECT_ALL)
     {
-        int not_ok = 0;
+        struct fast_sync_object *sync;
+        int not_ok = 0, ret, abandoned[MAXIMUM_WAIT_OBJECTS];
+
         /* Note: we must check them all anyway, as some objects may
          * want to do something when signaled, even if others are not */
         for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
             not_ok |= !entry->obj->ops->signaled( entry->obj, thread );
         if (not_ok) goto other_checks;
-        /* Wait satisfied: tell it to all objects */
+        /* Wait satisfied: tell it to all objects. Clients can still acquire the objects
+         * in shared memory, so these are claimed first, and given back if one of them
+         * is gone; the wait then goes on. The other objects can't be taken from us. */
         signaled = 0;
         for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
-            if (entry->obj->ops->satisfied( entry->obj, thread ))
+        {
+            if (!get_shared_fast_sync( entry->obj )) continue;
+            if ((ret = entry->obj->ops->satisfied( entry->obj, thread )) < 0)
+            {
+                while (i--)
+                {
+                    entry--;
+                    if ((sync = get_shared_fast_sync( entry->obj )))
+                        fast_sync_undo_satisfied( sync, abandoned[i] );
+                }
+                goto other_checks;
+            }
+            abandoned[i] = ret;
+            if (ret > 0) signaled = STATUS_ABANDONED_WAIT_0;
+        }
+        for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
+        {
+            if (get_shared_fast_sync( entry->obj )) continue;
+            if (entry->obj->ops->satisfied( entry->obj, thread ) > 0)
                 signaled = STATUS_ABANDONED_WAIT_0;
+        }
         return signaled;
     }
     else
@@ -623,10 +663,9 @@ static int check_wait( struct thread *thread )
         {
             if (!entry->obj->ops->signaled( entry->obj, thread )) continue;
             /* Wait satisfied: tell it to the object */
-            signaled = i;
-            if (entry->obj->ops->satisfied( entry->obj, thread ))
-                signaled = i + STATUS_ABANDONED_WAIT_0;
-            return signaled;
+            if ((signaled = entry->obj->ops->satisfied( entry->obj, thread )) < 0)
+                continue;  /* a client acquired it first */
+            return signaled ? i + STATUS_ABANDONED_WAIT_0 : i;
         }
     }
 
@@ -676,6 +715,27 @@ int wake_thread( struct thread *thread )
     return count;
 }
 
+/* wake up a thread through a given wait queue entry, without checking the other objects */
+/* return 1 if OK, 0 if the entry isn't part of the current wait or the thread can't be woken */
+int wake_thread_queue_entry( struct wait_queue_entry *entry )
+{
+    struct thread *thread = entry->thread;
+    struct thread_wait *wait = thread->wait;
+    client_ptr_t cookie;
+    int signaled;
+
+    if (!wait || entry < wait->queues || entry >= wait->queues + wait->count) return 0;
+    if (thread->process->suspend + thread->suspend > 0) return 0;
+
+    signaled = entry - wait->queues;
+    cookie = wait->cookie;
+    if (debug_level) fprintf( stderr, "%04x: *wakeup* signaled=%d\n", thread->id, signaled );
+    end_wait( thread );
+    if (send_thread_wakeup( thread, cookie, signaled ) != -1)
+        wake_thread( thread );  /* check the other waits */
+    return 1;
+}
+
 /* thread wait timeout */
 static void thread_timeout( void *ptr )
 {
@@ -711,7 +771,7 @@ static int signal_object( obj_handle_t handle )
 
 /* select on a list of handles */
 static timeout_t select_on( unsigned int count, client_ptr_t cookie, const obj_handle_t *handles,
-                            int flags, timeout_t timeout, obj_handle_t signal_obj )
+                            int flags, client_ptr_t key, timeout_t timeout, obj_handle_t signal_obj )
 {
     int ret;
     unsigned int i;
@@ -724,14 +784,30 @@ static timeout_t select_on( unsigned int count, client_ptr_t cookie, const obj_h
         set_error( STATUS_INVALID_PARAMETER );
         return 0;
     }
-    for (i = 0; i < count; i++)
+    if (flags & (SELECT_KEYED_EVENT_WAIT | SELECT_KEYED_EVENT_RELEASE))
     {
-        if (!(objects[i] = get_handle_obj( current->process, handles[i], SYNCHRONIZE, NULL )))
-            break;
+        unsigned int access = (flags & SELECT_KEYED_EVENT_WAIT) ? KEYEDEVENT_WAIT : KEYEDEVENT_WAKE;
+
+        if (count != 1 || (flags & SELECT_ALL) || (key & 1) ||
+            (flags & SELECT_KEYED_EVENT_RELEASE && access == KEYEDEVENT_WAIT))
+        {
+            set_error( STATUS_INVALID_PARAMETER );
+            return 0;
+        }
+        i = 0;
+        if ((objects[0] = get_keyed_event_obj( current->process, handles[0], access ))) i = 1;
+    }
+    else
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (!(objects[i] = get_handle_obj( current->process, handles[i], SYNCHRONIZE, NULL )))
+                break;
+        }
     }
 
     if (i < count) goto done;
-    if (!wait_on( count, objects, flags, timeout )) goto done;
+    if (!wait_on( count, objects, flags, key, timeout )) goto done;
 
     /* signal the object */
     if (signal_obj)
@@ -1348,7 +1424,8 @@ DECL_HANDLER(select)
         release_object( apc );
     }
 
-    reply->timeout = select_on( count, req->cookie, handles, req->flags, req->timeout, req->signal );
+    reply->timeout = select_on( count, req->cookie, handles, req->flags, req->key,
+                                req->timeout, req->signal );
 
     if (get_error() == STATUS_USER_APC)
     {
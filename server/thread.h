@@ -69,6 +69,9 @@ struct thread
     void                  *reply_data;    /* variable-size data for reply */
     unsigned int           reply_size;    /* size of reply data */
     unsigned int           reply_towrite; /* amount of data still to write in reply */
+    struct request_shm    *request_shm;   /* shared memory buffer for request and reply data */
+    int                    request_shm_slot; /* slot of the buffer in the pending bitmap */
+    int                    request_shm_seq;  /* sequence number of the last request read from the buffer */
     struct fd             *request_fd;    /* fd for receiving client requests */
     struct fd             *reply_fd;      /* fd to send a reply to a client */
     struct fd             *wait_fd;       /* fd to use to wake a sleeping client */
@@ -108,6 +111,8 @@ extern struct thread *get_thread_from_pid( int pid );
 extern void stop_thread( struct thread *thread );
 extern void stop_thread_if_suspended( struct thread *thread );
 extern int wake_thread( struct thread *thread );
+extern int wake_thread_queue_entry( struct wait_queue_entry *entry );
+extern int get_wait_queue_keyed_op( struct wait_queue_entry *entry, client_ptr_t *key );
 extern int add_queue( struct object *obj, struct wait_queue_entry *entry );
 extern void remove_queue( struct object *obj, struct wait_queue_entry *entry );
 extern void kill_thread( struct thread *thread, int violent_death );
@@ -1145,6 +1145,16 @@ static void dump_init_thread_reply( const struct init_thread_reply *req )
     fprintf( stderr, ", all_cpus=%08x", req->all_cpus );
 }
 
+static void dump_create_request_shm_request( const struct create_request_shm_request *req )
+{
+    fprintf( stderr, " get_fds=%d", req->get_fds );
+}
+
+static void dump_create_request_shm_reply( const struct create_request_shm_reply *req )
+{
+    fprintf( stderr, " size=%u", req->size );
+}
+
 static void dump_terminate_process_request( const struct terminate_process_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -1360,6 +1370,7 @@ static void dump_select_request( const struct select_request *req )
     fprintf( stderr, ", signal=%04x", req->signal );
     fprintf( stderr, ", prev_apc=%04x", req->prev_apc );
     dump_timeout( ", timeout=", &req->timeout );
+    dump_uint64( ", key=", &req->key );
     dump_varargs_apc_result( ", result=", cur_size );
     dump_varargs_handles( ", handles=", cur_size );
 }
@@ -1404,6 +1415,50 @@ static void dump_open_event_reply( const struct open_event_reply *req )
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_create_keyed_event_request( const struct create_keyed_event_request *req )
+{
+    fprintf( stderr, " access=%08x", req->access );
+    fprintf( stderr, ", attributes=%08x", req->attributes );
+    dump_varargs_object_attributes( ", objattr=", cur_size );
+}
+
+static void dump_create_keyed_event_reply( const struct create_keyed_event_reply *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", id=%08x", req->id );
+    fprintf( stderr, ", access=%08x", req->access );
+    fprintf( stderr, ", shared=%d", req->shared );
+}
+
+static void dump_open_keyed_event_request( const struct open_keyed_event_request *req )
+{
+    fprintf( stderr, " access=%08x", req->access );
+    fprintf( stderr, ", attributes=%08x", req->attributes );
+    fprintf( stderr, ", rootdir=%04x", req->rootdir );
+    dump_varargs_unicode_str( ", name=", cur_size );
+}
+
+static void dump_open_keyed_event_reply( const struct open_keyed_event_reply *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", id=%08x", req->id );
+    fprintf( stderr, ", access=%08x", req->access );
+    fprintf( stderr, ", shared=%d", req->shared );
+}
+
+static void dump_get_keyed_event_info_request( const struct get_keyed_event_info_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", access=%08x", req->access );
+}
+
+static void dump_get_keyed_event_info_reply( const struct get_keyed_event_info_reply *req )
+{
+    fprintf( stderr, " id=%08x", req->id );
+    fprintf( stderr, ", access=%08x", req->access );
+    fprintf( stderr, ", shared=%d", req->shared );
+}
+
 static void dump_create_mutex_request( const struct create_mutex_request *req )
 {
     fprintf( stderr, " access=%08x", req->access );
@@ -1478,6 +1533,32 @@ static void dump_open_semaphore_reply( const struct open_semaphore_reply *req )
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_get_fast_sync_shm_request( const struct get_fast_sync_shm_request *req )
+{
+}
+
+static void dump_get_fast_sync_shm_reply( const struct get_fast_sync_shm_reply *req )
+{
+    fprintf( stderr, " size=%u", req->size );
+}
+
+static void dump_get_fast_sync_obj_request( const struct get_fast_sync_obj_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_get_fast_sync_obj_reply( const struct get_fast_sync_obj_reply *req )
+{
+    fprintf( stderr, " index=%08x", req->index );
+    fprintf( stderr, ", type=%d", req->type );
+    fprintf( stderr, ", access=%08x", req->access );
+}
+
+static void dump_wake_fast_sync_obj_request( const struct wake_fast_sync_obj_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
 static void dump_create_file_request( const struct create_file_request *req )
 {
     fprintf( stderr, " access=%08x", req->access );
@@ -2449,6 +2530,16 @@ static void dump_set_queue_mask_reply( const struct set_queue_mask_reply *req )
     fprintf( stderr, ", changed_bits=%08x", req->changed_bits );
 }
 
+static void dump_get_queue_shm_request( const struct get_queue_shm_request *req )
+{
+}
+
+static void dump_get_queue_shm_reply( const struct get_queue_shm_reply *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", index=%08x", req->index );
+}
+
 static void dump_get_queue_status_request( const struct get_queue_status_request *req )
 {
     fprintf( stderr, " clear=%d", req->clear );
@@ -3979,6 +4070,17 @@ static void dump_set_suspend_context_request( const struct set_suspend_context_r
     dump_varargs_context( " context=", cur_size );
 }
 
+static void dump_batch_request( const struct batch_request *req )
+{
+    dump_varargs_bytes( " requests=", cur_size );
+}
+
+static void dump_batch_reply( const struct batch_reply *req )
+{
+    fprintf( stderr, " count=%08x", req->count );
+    dump_varargs_bytes( ", replies=", cur_size );
+}
+
 static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_new_process_request,
     (dump_func)dump_get_new_process_info_request,
@@ -3986,6 +4088,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_startup_info_request,
     (dump_func)dump_init_process_done_request,
     (dump_func)dump_init_thread_request,
+    (dump_func)dump_create_request_shm_request,
     (dump_func)dump_terminate_process_request,
     (dump_func)dump_terminate_thread_request,
     (dump_func)dump_get_process_info_request,
@@ -4008,12 +4111,18 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_create_event_request,
     (dump_func)dump_event_op_request,
     (dump_func)dump_open_event_request,
+    (dump_func)dump_create_keyed_event_request,
+    (dump_func)dump_open_keyed_event_request,
+    (dump_func)dump_get_keyed_event_info_request,
     (dump_func)dump_create_mutex_request,
     (dump_func)dump_release_mutex_request,
     (dump_func)dump_open_mutex_request,
     (dump_func)dump_create_semaphore_request,
     (dump_func)dump_release_semaphore_request,
     (dump_func)dump_open_semaphore_request,
+    (dump_func)dump_get_fast_sync_shm_request,
+    (dump_func)dump_get_fast_sync_obj_request,
+    (dump_func)dump_wake_fast_sync_obj_request,
     (dump_func)dump_create_file_request,
     (dump_func)dump_open_file_object_request,
     (dump_func)dump_alloc_file_handle_request,
@@ -4101,6 +4210,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_msg_queue_request,
     (dump_func)dump_set_queue_fd_request,
     (dump_func)dump_set_queue_mask_request,
+    (dump_func)dump_get_queue_shm_request,
     (dump_func)dump_get_queue_status_request,
     (dump_func)dump_get_process_idle_event_request,
     (dump_func)dump_send_message_request,
@@ -4229,6 +4339,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_update_rawinput_devices_request,
     (dump_func)dump_get_suspend_context_request,
     (dump_func)dump_set_suspend_context_request,
+    (dump_func)dump_batch_request,
 };
 
 static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
@@ -4238,6 +4349,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_startup_info_reply,
     NULL,
     (dump_func)dump_init_thread_reply,
+    (dump_func)dump_create_request_shm_reply,
     (dump_func)dump_terminate_process_reply,
     (dump_func)dump_terminate_thread_reply,
     (dump_func)dump_get_process_info_reply,
@@ -4260,12 +4372,18 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_create_event_reply,
     NULL,
     (dump_func)dump_open_event_reply,
+    (dump_func)dump_create_keyed_event_reply,
+    (dump_func)dump_open_keyed_event_reply,
+    (dump_func)dump_get_keyed_event_info_reply,
     (dump_func)dump_create_mutex_reply,
     (dump_func)dump_release_mutex_reply,
     (dump_func)dump_open_mutex_reply,
     (dump_func)dump_create_semaphore_reply,
     (dump_func)dump_release_semaphore_reply,
     (dump_func)dump_open_semaphore_reply,
+    (dump_func)dump_get_fast_sync_shm_reply,
+    (dump_func)dump_get_fast_sync_obj_reply,
+    NULL,
     (dump_func)dump_create_file_reply,
     (dump_func)dump_open_file_object_reply,
     (dump_func)dump_alloc_file_handle_reply,
@@ -4353,6 +4471,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_msg_queue_reply,
     NULL,
     (dump_func)dump_set_queue_mask_reply,
+    (dump_func)dump_get_queue_shm_reply,
     (dump_func)dump_get_queue_status_reply,
     (dump_func)dump_get_process_idle_event_reply,
     NULL,
@@ -4481,6 +4600,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     (dump_func)dump_get_suspend_context_reply,
     NULL,
+    (dump_func)dump_batch_reply,
 };
 
 static const char * const req_names[REQ_NB_REQUESTS] = {
@@ -4490,6 +4610,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_startup_info",
     "init_process_done",
     "init_thread",
+    "create_request_shm",
     "terminate_process",
     "terminate_thread",
     "get_process_info",
@@ -4512,12 +4633,18 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "create_event",
     "event_op",
     "open_event",
+    "create_keyed_event",
+    "open_keyed_event",
+    "get_keyed_event_info",
     "create_mutex",
     "release_mutex",
     "open_mutex",
     "create_semaphore",
     "release_semaphore",
     "open_semaphore",
+    "get_fast_sync_shm",
+    "get_fast_sync_obj",
+    "wake_fast_sync_obj",
     "create_file",
     "open_file_object",
     "alloc_file_handle",
@@ -4605,6 +4732,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_msg_queue",
     "set_queue_fd",
     "set_queue_mask",
+    "get_queue_shm",
     "get_queue_status",
     "get_process_idle_event",
     "send_message",
@@ -4733,6 +4861,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "update_rawinput_devices",
     "get_suspend_context",
     "set_suspend_context",
+    "batch",
 };
 
 static const struct
@@ -76,6 +76,7 @@ struct desktop
     unsigned int         users;            /* processes and threads using this desktop */
     struct global_cursor cursor;           /* global cursor information */
     unsigned char        keystate[256];    /* asynchronous key state */
+    struct input_shm    *shm;              /* key state and cursor published to the clients */
 };
 
 /* user handles functions */
@@ -116,6 +117,9 @@ extern void post_win_event( struct thread *thread, unsigned int event,
                             const WCHAR *module, data_size_t module_size,
                             user_handle_t handle );
 extern void free_hotkeys( struct desktop *desktop, user_handle_t window );
+extern struct input_shm *alloc_input_shm(void);
+extern void free_input_shm( struct input_shm *shm );
+extern struct window_shm *get_window_shm( user_handle_t handle );
 
 /* region functions */
 
@@ -89,10 +89,29 @@ struct window
     int              prop_inuse;      /* number of in-use window properties */
     int              prop_alloc;      /* number of allocated window properties */
     struct property *properties;      /* window properties array */
+    struct window_shm *shm;           /* state published to the clients, NULL if none */
+    struct children_grid *grid;       /* hit-testing index of the children, NULL if not built */
     int              nb_extra_bytes;  /* number of extra bytes */
     char             extra_bytes[1];  /* extra bytes storage */
 };
 
+/* index of the children of a window for hit-testing: the parent client area covered by the */
+/* children is split in cells, each holding the children overlapping it in Z-order; it is */
+/* built on the first hit-test and freed whenever the children are moved or reordered */
+struct children_grid
+{
+    rectangle_t      bounds;          /* union of the children visible rects */
+    int              cols;            /* number of columns */
+    int              rows;            /* number of rows */
+    int              cell_width;      /* size of a cell */
+    int              cell_height;
+    unsigned int    *start;           /* index of the first entry of each cell, plus the total */
+    struct window  **entries;         /* children of all the cells */
+};
+
+#define MIN_GRID_CHILDREN  32         /* minimum number of children to build a grid */
+#define MAX_GRID_SIZE      64         /* maximum number of columns and rows */
+
 /* flags that can be set by the client */
 #define PAINT_HAS_SURFACE        SET_WINPOS_PAINT_SURFACE
 #define PAINT_HAS_PIXEL_FORMAT   SET_WINPOS_PIXEL_FORMAT
@@ -174,6 +193,164 @@ static inline void update_pixel_format_flags( struct window *win )
         win->paint_flags |= PAINT_PIXEL_FORMAT_CHILD;
 }
 
+/* publish the state of a window to the clients; they retry reading it if the seq count */
+/* changed or was odd, so it is incremented before and after the update */
+static void update_window_shm( struct window *win )
+{
+    struct window_shm *shm = win->shm;
+    int i, count = 0;
+
+    if (!shm) return;
+    interlocked_xchg_add( &shm->seq, 1 );
+    shm->handle      = win->handle;
+    shm->parent      = win->parent ? win->parent->handle : 0;
+    shm->style       = win->style;
+    shm->ex_style    = win->ex_style;
+    shm->id          = win->id;
+    shm->window_rect = win->window_rect;
+    shm->client_rect = win->client_rect;
+    shm->instance    = win->instance;
+    shm->user_data   = win->user_data;
+    for (i = 0; i < win->prop_inuse; i++)
+    {
+        if (win->properties[i].type == PROP_TYPE_FREE) continue;
+        if (count < WINDOW_SHM_PROPS)
+        {
+            shm->props[count].atom   = win->properties[i].atom;
+            shm->props[count].string = (win->properties[i].type == PROP_TYPE_STRING);
+            shm->props[count].data   = win->properties[i].data;
+        }
+        count++;
+    }
+    shm->prop_count  = count <= WINDOW_SHM_PROPS ? count : -1;
+    interlocked_xchg_add( &shm->seq, 1 );
+}
+
+/* mark the published state of a destroyed window as free */
+static void free_window_shm( struct window *win )
+{
+    struct window_shm *shm = win->shm;
+
+    if (!shm) return;
+    interlocked_xchg_add( &shm->seq, 1 );
+    shm->handle = 0;
+    interlocked_xchg_add( &shm->seq, 1 );
+}
+
+/* a dummy grid for windows whose children don't need one */
+static struct children_grid no_children_grid;
+
+/* free the hit-testing index of the children of a window, it will be rebuilt when needed */
+static void invalidate_children_grid( struct window *win )
+{
+    if (!win || !win->grid) return;
+    if (win->grid != &no_children_grid) free( win->grid );
+    win->grid = NULL;
+}
+
+/* get the range of cells overlapped by a rectangle, return 0 if there are none */
+static inline int get_grid_cells( const struct children_grid *grid, const rectangle_t *rect,
+                                  int *col1, int *row1, int *col2, int *row2 )
+{
+    if (rect->left >= rect->right || rect->top >= rect->bottom) return 0;
+    *col1 = (rect->left - grid->bounds.left) / grid->cell_width;
+    *row1 = (rect->top - grid->bounds.top) / grid->cell_height;
+    *col2 = (rect->right - 1 - grid->bounds.left) / grid->cell_width;
+    *row2 = (rect->bottom - 1 - grid->bounds.top) / grid->cell_height;
+    return 1;
+}
+
+/* build the hit-testing index of the children of a window */
+static struct children_grid *build_children_grid( struct window *parent )
+{
+    struct children_grid params, *grid;
+    struct window *ptr;
+    unsigned int i, count = 0, total = 0, cells;
+    int size, col, row, col1, row1, col2, row2;
+
+    params.bounds.left = params.bounds.top = params.bounds.right = params.bounds.bottom = 0;
+    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
+    {
+        const rectangle_t *rect = &ptr->visible_rect;
+
+        count++;
+        if (rect->left >= rect->right || rect->top >= rect->bottom) continue;
+        if (params.bounds.left >= params.bounds.right) params.bounds = *rect;
+        else
+        {
+            params.bounds.left   = min( params.bounds.left, rect->left );
+            params.bounds.top    = min( params.bounds.top, rect->top );
+            params.bounds.right  = max( params.bounds.right, rect->right );
+            params.bounds.bottom = max( params.bounds.bottom, rect->bottom );
+        }
+    }
+    if (count < MIN_GRID_CHILDREN || params.bounds.left >= params.bounds.right) return &no_children_grid;
+
+    /* use about one cell per child */
+    for (size = 1; size < MAX_GRID_SIZE && size * size < count; size++) ;
+    params.cols        = size;
+    params.rows        = size;
+    params.cell_width  = (params.bounds.right - params.bounds.left + size - 1) / size;
+    params.cell_height = (params.bounds.bottom - params.bounds.top + size - 1) / size;
+    cells = size * size;
+
+    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
+    {
+        if (!get_grid_cells( &params, &ptr->visible_rect, &col1, &row1, &col2, &row2 )) continue;
+        total += (col2 - col1 + 1) * (row2 - row1 + 1);
+    }
+    /* too many large overlapping children, the grid wouldn't help much */
+    if (total > 8 * count) return &no_children_grid;
+
+    if (!(grid = malloc( sizeof(*grid) + total * sizeof(*grid->entries) +
+                         (cells + 1) * sizeof(*grid->start) )))
+        return &no_children_grid;
+    *grid = params;
+    grid->entries = (struct window **)(grid + 1);
+    grid->start   = (unsigned int *)(grid->entries + total);
+    memset( grid->start, 0, (cells + 1) * sizeof(*grid->start) );
+
+    /* count the entries of each cell, then store them in Z-order */
+    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
+    {
+        if (!get_grid_cells( grid, &ptr->visible_rect, &col1, &row1, &col2, &row2 )) continue;
+        for (row = row1; row <= row2; row++)
+            for (col = col1; col <= col2; col++) grid->start[row * size + col + 1]++;
+    }
+    for (i = 0; i < cells; i++) grid->start[i + 1] += grid->start[i];
+    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
+    {
+        if (!get_grid_cells( grid, &ptr->visible_rect, &col1, &row1, &col2, &row2 )) continue;
+        for (row = row1; row <= row2; row++)
+            for (col = col1; col <= col2; col++) grid->entries[grid->start[row * size + col]++] = ptr;
+    }
+    /* each start now points to the next cell, shift them back */
+    for (i = cells; i > 0; i--) grid->start[i] = grid->start[i - 1];
+    grid->start[0] = 0;
+    return grid;
+}
+
+/* get the children of a window that may contain a point (in parent client coords), in Z-order */
+/* return NULL if the children list has to be used instead */
+static struct window **get_grid_children( struct window *parent, int x, int y, unsigned int *count )
+{
+    struct children_grid *grid;
+    int col, row;
+
+    if (!parent->grid) parent->grid = build_children_grid( parent );
+    if ((grid = parent->grid) == &no_children_grid) return NULL;
+
+    *count = 0;
+    if (x < grid->bounds.left || x >= grid->bounds.right ||
+        y < grid->bounds.top || y >= grid->bounds.bottom)
+        return grid->entries;
+
+    col = (x - grid->bounds.left) / grid->cell_width;
+    row = (y - grid->bounds.top) / grid->cell_height;
+    *count = grid->start[row * grid->cols + col + 1] - grid->start[row * grid->cols + col];
+    return grid->entries + grid->start[row * grid->cols + col];
+}
+
 /* link a window at the right place in the siblings list */
 static void link_window( struct window *win, struct window *previous )
 {
@@ -184,6 +361,7 @@ static void link_window( struct window *win, struct window *previous )
         previous = WINPTR_TOP;  /* fallback to the HWND_TOP case */
     }
 
+    invalidate_children_grid( win->parent );
     list_remove( &win->entry );  /* unlink it from the previous location */
 
     if (previous == WINPTR_BOTTOM)
@@ -227,6 +405,7 @@ static void link_window( struct window *win, struct window *previous )
     }
 
     win->is_linked = 1;
+    update_window_shm( win );
 }
 
 /* change the parent of a window (or unlink the window if the new parent is NULL) */
@@ -244,6 +423,7 @@ static int set_parent_window( struct window *win, struct window *parent )
         }
     }
 
+    invalidate_children_grid( win->parent );
     if (parent)
     {
         win->parent = parent;
@@ -491,6 +671,8 @@ static struct window *create_window( struct window *parent, struct window *owner
     win->prop_inuse     = 0;
     win->prop_alloc     = 0;
     win->properties     = NULL;
+    win->shm            = get_window_shm( win->handle );
+    win->grid           = NULL;
     win->nb_extra_bytes = extra_bytes;
     win->window_rect = win->visible_rect = win->client_rect = empty_rect;
     memset( win->extra_bytes, 0, extra_bytes );
@@ -527,6 +709,7 @@ static struct window *create_window( struct window *parent, struct window *owner
     }
 
     current->desktop_users++;
+    update_window_shm( win );
     return win;
 
 failed:
@@ -679,51 +862,76 @@ static unsigned int get_children_windows( struct window *parent, atom_t atom, th
     return count;
 }
 
+/* find the topmost child of 'parent' that contains the given point (in parent-relative coords) */
+static struct window *get_child_from_point( struct window *parent, int x, int y )
+{
+    struct window *ptr, **children;
+    unsigned int i, count;
+
+    if ((children = get_grid_children( parent, x, y, &count )))
+    {
+        for (i = 0; i < count; i++) if (is_point_in_window( children[i], x, y )) return children[i];
+        return NULL;
+    }
+    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
+        if (is_point_in_window( ptr, x, y )) return ptr;
+    return NULL;
+}
+
 /* find child of 'parent' that contains the given point (in parent-relative coords) */
 static struct window *child_window_from_point( struct window *parent, int x, int y )
 {
     struct window *ptr;
 
-    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
-    {
-        if (!is_point_in_window( ptr, x, y )) continue;  /* skip it */
+    if (!(ptr = get_child_from_point( parent, x, y ))) return parent;  /* not found any child */
 
-        /* if window is minimized or disabled, return at once */
-        if (ptr->style & (WS_MINIMIZE|WS_DISABLED)) return ptr;
+    /* if window is minimized or disabled, return at once */
+    if (ptr->style & (WS_MINIMIZE|WS_DISABLED)) return ptr;
 
-        /* if point is not in client area, return at once */
-        if (x < ptr->client_rect.left || x >= ptr->client_rect.right ||
-            y < ptr->client_rect.top || y >= ptr->client_rect.bottom)
-            return ptr;
+    /* if point is not in client area, return at once */
+    if (x < ptr->client_rect.left || x >= ptr->client_rect.right ||
+        y < ptr->client_rect.top || y >= ptr->client_rect.bottom)
+        return ptr;
 
-        return child_window_from_point( ptr, x - ptr->client_rect.left, y - ptr->client_rect.top );
+    return child_window_from_point( ptr, x - ptr->client_rect.left, y - ptr->client_rect.top );
+}
+
+static int get_window_children_from_point( struct window *parent, int x, int y,
+                                           struct user_handle_array *array );
+
+/* add a child and its own children to the array if it contains the given point */
+static int add_child_from_point( struct window *ptr, int x, int y, struct user_handle_array *array )
+{
+    if (!is_point_in_window( ptr, x, y )) return 1;  /* skip it */
+
+    /* if point is in client area, and window is not minimized or disabled, check children */
+    if (!(ptr->style & (WS_MINIMIZE|WS_DISABLED)) &&
+        x >= ptr->client_rect.left && x < ptr->client_rect.right &&
+        y >= ptr->client_rect.top && y < ptr->client_rect.bottom)
+    {
+        if (!get_window_children_from_point( ptr, x - ptr->client_rect.left,
+                                             y - ptr->client_rect.top, array ))
+            return 0;
     }
-    return parent;  /* not found any child */
+
+    /* now add window to the array */
+    return add_handle_to_array( array, ptr->handle );
 }
 
 /* find all children of 'parent' that contain the given point */
 static int get_window_children_from_point( struct window *parent, int x, int y,
                                            struct user_handle_array *array )
 {
-    struct window *ptr;
+    struct window *ptr, **children;
+    unsigned int i, count;
 
-    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
+    if ((children = get_grid_children( parent, x, y, &count )))
     {
-        if (!is_point_in_window( ptr, x, y )) continue;  /* skip it */
-
-        /* if point is in client area, and window is not minimized or disabled, check children */
-        if (!(ptr->style & (WS_MINIMIZE|WS_DISABLED)) &&
-            x >= ptr->client_rect.left && x < ptr->client_rect.right &&
-            y >= ptr->client_rect.top && y < ptr->client_rect.bottom)
-        {
-            if (!get_window_children_from_point( ptr, x - ptr->client_rect.left,
-                                                 y - ptr->client_rect.top, array ))
-                return 0;
-        }
-
-        /* now add window to the array */
-        if (!add_handle_to_array( array, ptr->handle )) return 0;
+        for (i = 0; i < count; i++) if (!add_child_from_point( children[i], x, y, array )) return 0;
+        return 1;
     }
+    LIST_FOR_EACH_ENTRY( ptr, &parent->children, struct window, entry )
+        if (!add_child_from_point( ptr, x, y, array )) return 0;
     return 1;
 }
 
@@ -1630,9 +1838,12 @@ static void set_window_pos( struct window *win, struct window *previous,
     win->window_rect  = *window_rect;
     win->visible_rect = *visible_rect;
     win->client_rect  = *client_rect;
+    if (memcmp( &old_visible_rect, visible_rect, sizeof(*visible_rect) ))
+        invalidate_children_grid( win->parent );
     if (!(swp_flags & SWP_NOZORDER) && win->parent) link_window( win, previous );
     if (swp_flags & SWP_SHOWWINDOW) win->style |= WS_VISIBLE;
     else if (swp_flags & SWP_HIDEWINDOW) win->style &= ~WS_VISIBLE;
+    update_window_shm( win );
 
     /* keep children at the same position relative to top right corner when the parent is mirrored */
     if (win->ex_style & WS_EX_LAYOUTRTL)
@@ -1641,11 +1852,16 @@ static void set_window_pos( struct window *win, struct window *previous,
         int old_size = old_client_rect.right - old_client_rect.left;
         int new_size = win->client_rect.right - win->client_rect.left;
 
-        if (old_size != new_size) LIST_FOR_EACH_ENTRY( child, &win->children, struct window, entry )
+        if (old_size != new_size)
         {
-            offset_rect( &child->window_rect, new_size - old_size, 0 );
-            offset_rect( &child->visible_rect, new_size - old_size, 0 );
-            offset_rect( &child->client_rect, new_size - old_size, 0 );
+            invalidate_children_grid( win );
+            LIST_FOR_EACH_ENTRY( child, &win->children, struct window, entry )
+            {
+                offset_rect( &child->window_rect, new_size - old_size, 0 );
+                offset_rect( &child->visible_rect, new_size - old_size, 0 );
+                offset_rect( &child->client_rect, new_size - old_size, 0 );
+                update_window_shm( child );
+            }
         }
     }
 
@@ -1831,8 +2047,11 @@ void destroy_window( struct window *win )
     if (win == progman_window) progman_window = NULL;
     if (win == taskman_window) taskman_window = NULL;
     free_hotkeys( win->desktop, win->handle );
+    free_window_shm( win );
     free_user_handle( win->handle );
     destroy_properties( win );
+    invalidate_children_grid( win );
+    invalidate_children_grid( win->parent );
     list_remove( &win->entry );
     if (is_desktop_window(win))
     {
@@ -1933,6 +2152,7 @@ DECL_HANDLER(get_desktop_window)
         {
             detach_window_thread( desktop->top_window );
             desktop->top_window->style  = WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN;
+            update_window_shm( desktop->top_window );
         }
     }
 
@@ -1945,6 +2165,7 @@ DECL_HANDLER(get_desktop_window)
         {
             detach_window_thread( desktop->msg_window );
             desktop->msg_window->style = WS_POPUP | WS_CLIPSIBLINGS | WS_CLIPCHILDREN;
+            update_window_shm( desktop->msg_window );
         }
     }
 
@@ -2055,6 +2276,7 @@ DECL_HANDLER(set_window_info)
 
     /* changing window style triggers a non-client paint */
     if (req->flags & SET_WIN_STYLE) win->paint_flags |= PAINT_NONCLIENT;
+    update_window_shm( win );
 }
 
 
@@ -2604,6 +2826,7 @@ DECL_HANDLER(update_window_zorder)
         /* making sure to not violate the topmost rule */
         if (!(ptr->ex_style & WS_EX_TOPMOST) || (win->ex_style & WS_EX_TOPMOST))
         {
+            invalidate_children_grid( win->parent );
             list_remove( &win->entry );
             list_add_before( &ptr->entry, &win->entry );
         }
@@ -2656,6 +2879,7 @@ DECL_HANDLER(set_window_property)
         }
     }
     else set_property( win, req->atom, req->data, PROP_TYPE_ATOM );
+    update_window_shm( win );
 }
 
 
@@ -2670,6 +2894,7 @@ DECL_HANDLER(remove_window_property)
     {
         atom_t atom = name.len ? find_global_atom( NULL, &name ) : req->atom;
         if (atom) reply->data = remove_property( win, atom );
+        update_window_shm( win );
     }
 }
 